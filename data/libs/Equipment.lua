@@ -252,6 +252,12 @@ HyperdriveType.CheckDestination = function (self, ship, destination)
 	return self:CheckJump(ship, Game.system.path, destination)
 end
 
+-- Plot the quickest chain of jumps from source to destination for this ship.
+-- Returns an array of the systems jumped to, or nil if there is no route.
+HyperdriveType.GetRoute = function (self, ship, source, destination)
+	return source:GetRouteTo(destination, self:GetMaximumRange(ship), "duration")
+end
+
 -- Give the range for the given remaining fuel
 -- If the fuel isn't specified, it takes the current value.
 HyperdriveType.GetRange = function (self, ship, remaining_fuel)
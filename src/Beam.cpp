@@ -115,7 +115,8 @@ void Beam::FreeModel()
 Beam::Beam(Body *parent, const ProjectileData &prData, const vector3d &pos, const vector3d &baseVel, const vector3d &dir) :
 	Body(),
 	m_age(0),
-	m_active(true)
+	m_active(true),
+	m_haveContact(false)
 {
 	if (!s_sideMat) BuildModel();
 	m_flags |= FLAG_DRAW_LAST;
@@ -137,7 +138,8 @@ Beam::Beam(Body *parent, const ProjectileData &prData, const vector3d &pos, cons
 
 Beam::Beam(const Json &jsonObj, Space *space) :
 	Body(jsonObj, space),
-	m_active(true)
+	m_active(true),
+	m_haveContact(false)
 {
 	if (!s_sideMat) BuildModel();
 	m_flags |= FLAG_DRAW_LAST;
@@ -182,6 +184,7 @@ void Beam::PostLoadFixup(Space *space)
 {
 	Body::PostLoadFixup(space);
 	m_parent = space->GetBodyByIndex(m_parentIndex);
+	space->WatchForRemoval(this, m_parent);
 }
 
 void Beam::UpdateInterpTransform(double alpha)
@@ -249,6 +252,23 @@ static void MiningLaserSpawnTastyStuff(Frame *f, const SystemBody *asteroid, con
 	Pi::game->GetSpace()->AddBody(cargo);
 }
 
+bool Beam::GetStaticUpdateRay(const float timeStep, CollisionRay &ray) const
+{
+	if (!m_active)
+		return false;
+	ray.start = GetPosition();
+	ray.dir = m_dir.Normalized();
+	ray.len = m_length;
+	ray.ignore = m_parent ? static_cast<ModelBody *>(m_parent)->GetGeom() : nullptr;
+	return true;
+}
+
+void Beam::SetStaticUpdateContact(const CollisionContact &c)
+{
+	m_contact = c;
+	m_haveContact = true;
+}
+
 void Beam::StaticUpdate(const float timeStep)
 {
 	PROFILE_SCOPED()
@@ -257,7 +277,14 @@ void Beam::StaticUpdate(const float timeStep)
 		return;
 
 	CollisionContact c;
-	GetFrame()->GetCollisionSpace()->TraceRay(GetPosition(), m_dir.Normalized(), m_length, &c, static_cast<ModelBody *>(m_parent)->GetGeom());
+	if (m_haveContact) {
+		c = m_contact;
+		m_haveContact = false;
+	} else {
+		CollisionRay ray;
+		GetStaticUpdateRay(timeStep, ray);
+		GetFrame()->GetCollisionSpace()->TraceRay(ray.start, ray.dir, ray.len, &c, ray.ignore);
+	}
 
 	if (c.userData1) {
 		Object *o = static_cast<Object *>(c.userData1);
@@ -362,4 +389,5 @@ void Beam::Add(Body *parent, const ProjectileData &prData, const vector3d &pos,
 {
 	Beam *p = new Beam(parent, prData, pos, baseVel, dir);
 	Pi::game->GetSpace()->AddBody(p);
+	Pi::game->GetSpace()->WatchForRemoval(p, parent);
 }
@@ -7,6 +7,7 @@
 #define _BEAM_H
 
 #include "Body.h"
+#include "collider/CollisionContact.h"
 #include "graphics/Material.h"
 
 class Frame;
@@ -31,6 +32,8 @@ public:
 	virtual ~Beam();
 	virtual void Render(Graphics::Renderer *r, const Camera *camera, const vector3d &viewCoords, const matrix4x4d &viewTransform) override final;
 	void TimeStepUpdate(const float timeStep) override final;
+	bool GetStaticUpdateRay(const float timeStep, CollisionRay &ray) const override final;
+	void SetStaticUpdateContact(const CollisionContact &c) override final;
 	void StaticUpdate(const float timeStep) override final;
 	virtual void NotifyRemoved(const Body *const removedBody) override final;
 	virtual void PostLoadFixup(Space *space) override final;
@@ -54,6 +57,9 @@ private:
 	bool m_mining;
 	bool m_active;
 
+	CollisionContact m_contact; // from SetStaticUpdateContact
+	bool m_haveContact;
+
 	int m_parentIndex; // deserialisation
 
 	static void BuildModel();
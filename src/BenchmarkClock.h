@@ -0,0 +1,17 @@
+// Copyright © 2008-2019 Pioneer Developers. See AUTHORS.txt for details
+// Licensed under the terms of the GPL v3. See licenses/GPL-3.txt
+
+#ifndef _BENCHMARKCLOCK_H
+#define _BENCHMARKCLOCK_H
+
+// for timing the UNIT_TEST benchmark mains, which run without SDL or the
+// profiler
+
+#include <chrono>
+
+inline double seconds_since(const std::chrono::steady_clock::time_point &start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+#endif /* _BENCHMARKCLOCK_H */
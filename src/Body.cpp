@@ -29,7 +29,8 @@ Body::Body() :
 	m_frame(0),
 	m_dead(false),
 	m_clipRadius(0.0),
-	m_physRadius(0.0)
+	m_physRadius(0.0),
+	m_spaceIndex(Uint32(-1))
 {
 	Properties().Set("label", m_label);
 }
@@ -39,7 +40,8 @@ Body::Body(const Json &jsonObj, Space *space) :
 	m_flags(0),
 	m_interpPos(0.0),
 	m_interpOrient(matrix3x3d::Identity()),
-	m_frame(nullptr)
+	m_frame(nullptr),
+	m_spaceIndex(Uint32(-1))
 {
 	try {
 		Json bodyObj = jsonObj["body"];
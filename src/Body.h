@@ -19,6 +19,7 @@ namespace Graphics {
 	class Renderer;
 }
 struct CollisionContact;
+struct CollisionRay;
 
 class Body : public Object, public PropertiedObject {
 public:
@@ -51,14 +52,35 @@ public:
 	virtual bool OnCollision(Object *o, Uint32 flags, double relVel) { return false; }
 	// Attacker may be null
 	virtual bool OnDamage(Object *attacker, float kgDamage, const CollisionContact &contactData) { return false; }
-	// Override to clear any pointers you hold to the body
+	// Override to clear any pointers you hold to the body. Only called for
+	// bodies registered with Space::WatchForRemoval(), or for all of them if
+	// WantsAllRemovalNotifications() says so
 	virtual void NotifyRemoved(const Body *const removedBody) {}
+	virtual bool WantsAllRemovalNotifications() const { return false; }
 
 	// before all bodies have had TimeStepUpdate (their moving step),
 	// StaticUpdate() is called. Good for special collision testing (Projectiles)
 	// as you can't test for collisions if different objects are on different 'steps'
 	virtual void StaticUpdate(const float timeStep) {}
 	virtual void TimeStepUpdate(const float timeStep) {}
+
+	// Bodies that can take part in the parallel update (see Space::TimeStep)
+	// return true here and do their TimeStepUpdate() in two halves.
+	// ParallelTimeStepUpdate() may run on any thread alongside other bodies'
+	// so it must only change this body, and only look at bodies that aren't
+	// updated in parallel (eg. our frame's planet). SerialTimeStepUpdate()
+	// follows on the main thread in body order and does everything else: Lua,
+	// sounds, spawning and killing bodies
+	virtual bool CanUpdateInParallel() const { return false; }
+	virtual void ParallelTimeStepUpdate(const float timeStep) {}
+	virtual void SerialTimeStepUpdate(const float timeStep) {}
+
+	// Bodies whose StaticUpdate() traces a ray through their frame's
+	// collision space (projectiles and beams) fill it in here. Space traces
+	// the rays of a whole frame together just before StaticUpdate() and hands
+	// each body its contact; those added since trace their own
+	virtual bool GetStaticUpdateRay(const float timeStep, CollisionRay &ray) const { return false; }
+	virtual void SetStaticUpdateContact(const CollisionContact &c) {}
 	virtual void Render(Graphics::Renderer *r, const Camera *camera, const vector3d &viewCoords, const matrix4x4d &viewTransform) = 0;
 
 	virtual void SetFrame(Frame *f) { m_frame = f; }
@@ -87,6 +109,10 @@ public:
 	// all Bodies are in space... except where they're not (Ships hidden in hyperspace clouds)
 	virtual bool IsInSpace() const { return true; }
 
+	// our slot in Space's body list and per-body tables. only Space should set it
+	void SetSpaceIndex(Uint32 idx) { m_spaceIndex = idx; }
+	Uint32 GetSpaceIndex() const { return m_spaceIndex; }
+
 	// Interpolated between physics ticks.
 	const matrix3x3d &GetInterpOrient() const { return m_interpOrient; }
 	vector3d GetInterpPosition() const { return m_interpPos; }
@@ -125,6 +151,7 @@ private:
 	bool m_dead; // Checked in destructor to make sure body has been marked dead.
 	double m_clipRadius;
 	double m_physRadius;
+	Uint32 m_spaceIndex;
 };
 
 #endif /* _BODY_H */
@@ -77,7 +77,7 @@ void CargoBody::Init()
 	Properties().Set("type", cargoname);
 }
 
-void CargoBody::TimeStepUpdate(const float timeStep)
+void CargoBody::SerialTimeStepUpdate(const float timeStep)
 {
 
 	// Suggestion: since cargo doesn't need thrust or AI, it could be
@@ -93,7 +93,7 @@ void CargoBody::TimeStepUpdate(const float timeStep)
 			SfxManager::Add(this, TYPE_EXPLOSION);
 		}
 	}
-	DynamicBody::TimeStepUpdate(timeStep);
+	DynamicBody::SerialTimeStepUpdate(timeStep);
 }
 
 bool CargoBody::OnDamage(Object *attacker, float kgDamage, const CollisionContact &contactData)
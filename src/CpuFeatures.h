@@ -0,0 +1,43 @@
+// Copyright © 2008-2019 Pioneer Developers. See AUTHORS.txt for details
+// Licensed under the terms of the GPL v3. See licenses/GPL-3.txt
+
+#ifndef _CPUFEATURES_H
+#define _CPUFEATURES_H
+
+// SSE2 is decided at compile time, it's part of x86-64 and 32-bit builds
+// can ask for it. AVX2 code is built alongside it, marked CPU_AVX2_TARGET,
+// and must only be called when CpuHasAvx2() says so.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define CPU_HAS_SSE2 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CPU_AVX2_TARGET
+#else
+#define CPU_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+// asks the CPU every time, callers keep the answer
+inline bool CpuHasAvx2()
+{
+#ifdef _MSC_VER
+	// AVX2 also needs the OS to save the upper halves of the registers
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif /* CPU_HAS_SSE2 */
+
+#endif /* _CPUFEATURES_H */
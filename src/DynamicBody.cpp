@@ -250,6 +250,12 @@ void DynamicBody::CalcExternalForce()
 }
 
 void DynamicBody::TimeStepUpdate(const float timeStep)
+{
+	ParallelTimeStepUpdate(timeStep);
+	SerialTimeStepUpdate(timeStep);
+}
+
+void DynamicBody::ParallelTimeStepUpdate(const float timeStep)
 {
 	m_oldPos = GetPosition();
 	if (m_isMoving) {
@@ -281,7 +287,10 @@ void DynamicBody::TimeStepUpdate(const float timeStep)
 	} else {
 		m_oldAngDisplacement = vector3d(0.0);
 	}
+}
 
+void DynamicBody::SerialTimeStepUpdate(const float timeStep)
+{
 	ModelBody::TimeStepUpdate(timeStep);
 }
 
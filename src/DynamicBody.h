@@ -35,7 +35,11 @@ public:
 	void SetMoving(bool isMoving) { m_isMoving = isMoving; }
 	bool IsMoving() const { return m_isMoving; }
 	virtual double GetMass() const override { return m_mass; } // XXX don't override this
-	virtual void TimeStepUpdate(const float timeStep) override;
+	// integration is the parallel half, subclasses extend the halves
+	virtual void TimeStepUpdate(const float timeStep) override final;
+	virtual bool CanUpdateInParallel() const override { return !IsStatic(); }
+	virtual void ParallelTimeStepUpdate(const float timeStep) override;
+	virtual void SerialTimeStepUpdate(const float timeStep) override;
 	virtual vector3d CalcAtmosphericForce() const;
 	double CalcAtmosphericDrag(double velSqr, double area, double coeff) const;
 	void CalcExternalForce();
@@ -40,6 +40,9 @@ GameConfig::GameConfig(const map_string &override_)
 	map["VSync"] = "1";
 	map["UseTextureCompression"] = "1";
 	map["WorkerThreads"] = "0";
+	map["JobFinishBudgetMs"] = "2.0"; // time per frame for delivering finished jobs, 0 for no limit
+	map["ParallelCollision"] = "0";
+	map["ParallelBodyUpdate"] = "0";
 	map["SpeedLines"] = "0";
 	map["EnableCockpit"] = "0";
 	map["HudTrails"] = "0";
@@ -551,6 +551,8 @@ void GasGiant::GenerateTexture()
 		std::unique_ptr<Color> bufs[NUM_PATCHES];
 		for (int i = 0; i < NUM_PATCHES; i++) {
 			Color *colors = new Color[(s_texture_size_small * s_texture_size_small)];
+			std::vector<vector3d> rowPoints(s_texture_size_small), rowColors(s_texture_size_small);
+			const std::vector<double> rowHeights(s_texture_size_small, 0.0);
 			for (Uint32 v = 0; v < s_texture_size_small; v++) {
 				for (Uint32 u = 0; u < s_texture_size_small; u++) {
 					// where in this row & colum are we now.
@@ -558,11 +560,15 @@ void GasGiant::GenerateTexture()
 					const double vstep = double(v) * fracStep;
 
 					// get point on the surface of the sphere
-					const vector3d p = GetSpherePointFromCorners(ustep, vstep, &GetPatchFaces(i, 0));
-					// get colour using `p`
-					const vector3d colour = pTerrain->GetColor(p, 0.0, p);
+					rowPoints[u] = GetSpherePointFromCorners(ustep, vstep, &GetPatchFaces(i, 0));
+				}
+
+				// get colours using the points, which are also the normals
+				pTerrain->GetColors(rowPoints.data(), rowHeights.data(), rowPoints.data(), rowColors.data(), s_texture_size_small);
 
+				for (Uint32 u = 0; u < s_texture_size_small; u++) {
 					// convert to ubyte and store
+					const vector3d &colour = rowColors[u];
 					Color *col = colors + (u + (v * s_texture_size_small));
 					col[0].r = Uint8(colour.x * 255.0);
 					col[0].g = Uint8(colour.y * 255.0);
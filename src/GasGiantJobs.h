@@ -127,6 +127,8 @@ namespace GasGiantJobs {
 		virtual void OnRun();
 		virtual void OnFinish();
 		virtual void OnCancel() {}
+		virtual Priority GetPriority() const { return PRIORITY_INTERACTIVE; }
+		virtual const char *GetName() const { return "SingleTextureFaceJob"; }
 
 	private:
 		// deliberately prevent copy constructor access
@@ -226,6 +228,8 @@ namespace GasGiantJobs {
 		virtual void OnRun();
 		virtual void OnFinish();
 		virtual void OnCancel() {}
+		virtual Priority GetPriority() const { return PRIORITY_INTERACTIVE; }
+		virtual const char *GetName() const { return "SingleGPUGenJob"; }
 
 	private:
 		SingleGPUGenJob() {}
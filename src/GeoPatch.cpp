@@ -36,6 +36,8 @@ GeoPatch::GeoPatch(const RefCountedPtr<GeoPatchContext> &ctx_, GeoSphere *gs,
 	m_v2(v2_),
 	m_v3(v3_),
 	m_heights(nullptr),
+	m_minHeight(0.0),
+	m_heightScale(0.0),
 	m_normals(nullptr),
 	m_colors(nullptr),
 	m_parent(nullptr),
@@ -68,6 +70,8 @@ GeoPatch::~GeoPatch()
 	for (int i = 0; i < NUM_KIDS; i++) {
 		m_kids[i].reset();
 	}
+	if (m_vertexBuffer)
+		m_geosphere->ReleaseVertexBuffer(std::move(m_vertexBuffer));
 	m_heights.reset();
 	m_normals.reset();
 	m_colors.reset();
@@ -80,37 +84,24 @@ void GeoPatch::UpdateVBOs(Graphics::Renderer *renderer)
 		assert(renderer);
 		m_needUpdateVBOs = false;
 
-		//create buffer and upload data
-		Graphics::VertexBufferDesc vbd;
-		vbd.attrib[0].semantic = Graphics::ATTRIB_POSITION;
-		vbd.attrib[0].format = Graphics::ATTRIB_FORMAT_FLOAT3;
-		vbd.attrib[1].semantic = Graphics::ATTRIB_NORMAL;
-		vbd.attrib[1].format = Graphics::ATTRIB_FORMAT_FLOAT3;
-		vbd.attrib[2].semantic = Graphics::ATTRIB_DIFFUSE;
-		vbd.attrib[2].format = Graphics::ATTRIB_FORMAT_UBYTE4;
-		vbd.attrib[3].semantic = Graphics::ATTRIB_UV0;
-		vbd.attrib[3].format = Graphics::ATTRIB_FORMAT_FLOAT2;
-		vbd.numVertices = m_ctx->NUMVERTICES();
-		vbd.usage = Graphics::BUFFER_USAGE_STATIC;
-		m_vertexBuffer.reset(renderer->CreateVertexBuffer(vbd));
+		//get a buffer and upload data
+		if (!m_vertexBuffer)
+			m_vertexBuffer = m_geosphere->AcquireVertexBuffer(renderer);
 
 		GeoPatchContext::VBOVertex *VBOVtxPtr = m_vertexBuffer->Map<GeoPatchContext::VBOVertex>(Graphics::BUFFER_MAP_WRITE);
 		assert(m_vertexBuffer->GetDesc().stride == sizeof(GeoPatchContext::VBOVertex));
 
 		const Sint32 edgeLen = m_ctx->GetEdgeLen();
 		const double frac = m_ctx->GetFrac();
-		const double *pHts = m_heights.get();
-		const vector3f *pNorm = m_normals.get();
+		const Uint16 *pHts = m_heights.get();
+		const OctNormal *pNorm = m_normals.get();
 		const Color3ub *pColr = m_colors.get();
 
-		double minh = DBL_MAX;
-
 		// ----------------------------------------------------
 		// inner loops
 		for (Sint32 y = 1; y < edgeLen - 1; y++) {
 			for (Sint32 x = 1; x < edgeLen - 1; x++) {
-				const double height = *pHts;
-				minh = std::min(height, minh);
+				const double height = m_minHeight + *pHts * m_heightScale;
 				const double xFrac = double(x - 1) * frac;
 				const double yFrac = double(y - 1) * frac;
 				const vector3d p((GetSpherePoint(xFrac, yFrac) * (height + 1.0)) - m_clipCentroid);
@@ -120,8 +111,7 @@ void GeoPatch::UpdateVBOs(Graphics::Renderer *renderer)
 				vtxPtr->pos = vector3f(p);
 				++pHts; // next height
 
-				const vector3f norma(pNorm->Normalized());
-				vtxPtr->norm = norma;
+				vtxPtr->norm = pNorm->Decode();
 				++pNorm; // next normal
 
 				vtxPtr->col[0] = pColr->r;
@@ -137,7 +127,7 @@ void GeoPatch::UpdateVBOs(Graphics::Renderer *renderer)
 				++vtxPtr; // next vertex
 			}
 		}
-		const double minhScale = (minh + 1.0) * 0.999995;
+		const double minhScale = (m_minHeight + 1.0) * 0.999995;
 		// ----------------------------------------------------
 		const Sint32 innerLeft = 1;
 		const Sint32 innerRight = edgeLen - 2;
@@ -418,6 +408,8 @@ void GeoPatch::ReceiveHeightmaps(SQuadSplitResult *psr)
 		for (int i = 0; i < NUM_KIDS; i++) {
 			const SQuadSplitResult::SSplitResultData &data = psr->data(i);
 			m_kids[i]->m_heights.reset(data.heights);
+			m_kids[i]->m_minHeight = data.minHeight;
+			m_kids[i]->m_heightScale = data.heightScale;
 			m_kids[i]->m_normals.reset(data.normals);
 			m_kids[i]->m_colors.reset(data.colors);
 		}
@@ -437,6 +429,8 @@ void GeoPatch::ReceiveHeightmap(const SSingleSplitResult *psr)
 	{
 		const SSingleSplitResult::SSplitResultData &data = psr->data();
 		m_heights.reset(data.heights);
+		m_minHeight = data.minHeight;
+		m_heightScale = data.heightScale;
 		m_normals.reset(data.normals);
 		m_colors.reset(data.colors);
 	}
@@ -448,3 +442,85 @@ void GeoPatch::ReceiveJobHandle(Job::Handle job)
 	assert(!m_job.HasJob());
 	m_job = static_cast<Job::Handle &&>(job);
 }
+
+bool GeoPatch::GetPatchCoords(const vector3d &p, double &x, double &y) const
+{
+	// GetSpherePoint is the normalised bilinear patch q(x,y) = v0 + x*a + y*b + x*y*c,
+	// so find the x,y where q has no component perpendicular to p with a few
+	// Gauss-Newton steps from the middle of the patch
+	const vector3d a = m_v1 - m_v0;
+	const vector3d b = m_v3 - m_v0;
+	const vector3d c = m_v2 - m_v1 - m_v3 + m_v0;
+	x = y = 0.5;
+	for (int i = 0; i < 8; i++) {
+		const vector3d q = m_v0 + x * a + y * b + (x * y) * c;
+		const vector3d dqx = a + y * c;
+		const vector3d dqy = b + x * c;
+		const vector3d r = q - q.Dot(p) * p;
+		const vector3d jx = dqx - dqx.Dot(p) * p;
+		const vector3d jy = dqy - dqy.Dot(p) * p;
+
+		const double xx = jx.Dot(jx), xy = jx.Dot(jy), yy = jy.Dot(jy);
+		const double det = xx * yy - xy * xy;
+		if (det <= 0.0)
+			return false;
+		const double rx = jx.Dot(r), ry = jy.Dot(r);
+		const double dx = (xy * ry - yy * rx) / det;
+		const double dy = (xy * rx - xx * ry) / det;
+		x += dx;
+		y += dy;
+		if (fabs(dx) + fabs(dy) < 1e-12)
+			break;
+	}
+
+	const double eps = 1e-9;
+	if (x < -eps || x > 1.0 + eps || y < -eps || y > 1.0 + eps)
+		return false;
+	// the opposite side of the sphere projects onto the patch too
+	return (m_v0 + x * a + y * b + (x * y) * c).Dot(p) > 0.0;
+}
+
+bool GeoPatch::GetResidentHeight(const vector3d &p, double x, double y, Sint32 minDepth, double &height) const
+{
+	if (m_kids[0]) {
+		for (int i = 0; i < NUM_KIDS; i++) {
+			double kx, ky;
+			if (m_kids[i]->GetPatchCoords(p, kx, ky))
+				return m_kids[i]->GetResidentHeight(p, kx, ky, minDepth, height);
+		}
+	}
+
+	if (m_depth < minDepth || !m_heights)
+		return false;
+
+	// bilinear interpolation between the heights, which are at GetSpherePoint(i * frac, j * frac)
+	const Sint32 edgeLen = m_ctx->GetEdgeLen() - 2;
+	const double fx = Clamp(x, 0.0, 1.0) * (edgeLen - 1);
+	const double fy = Clamp(y, 0.0, 1.0) * (edgeLen - 1);
+	const Sint32 ix = std::min(Sint32(fx), edgeLen - 2);
+	const Sint32 iy = std::min(Sint32(fy), edgeLen - 2);
+	const double tx = fx - ix;
+	const double ty = fy - iy;
+	const Sint32 i = ix + iy * edgeLen;
+	height = (GetHeight(i) * (1.0 - tx) + GetHeight(i + 1) * tx) * (1.0 - ty) + (GetHeight(i + edgeLen) * (1.0 - tx) + GetHeight(i + edgeLen + 1) * tx) * ty;
+	return true;
+}
+
+void GeoPatch::AddMemoryUsage(GeoPatchMemoryUsage &usage) const
+{
+	const size_t numVerts = (m_ctx->GetEdgeLen() - 2) * (m_ctx->GetEdgeLen() - 2);
+	usage.patches++;
+	if (m_heights)
+		usage.heights += numVerts * sizeof(Uint16);
+	if (m_normals)
+		usage.meshData += numVerts * sizeof(OctNormal);
+	if (m_colors)
+		usage.meshData += numVerts * sizeof(Color3ub);
+	if (m_vertexBuffer)
+		usage.vertexBuffers += m_vertexBuffer->GetDesc().numVertices * m_vertexBuffer->GetDesc().stride;
+
+	if (m_kids[0]) {
+		for (int i = 0; i < NUM_KIDS; i++)
+			m_kids[i]->AddMemoryUsage(usage);
+	}
+}
@@ -32,6 +32,21 @@ class GeoSphere;
 class BasePatchJob;
 class SQuadSplitResult;
 class SSingleSplitResult;
+struct OctNormal;
+
+// Memory held for a set of patches, in bytes
+struct GeoPatchMemoryUsage {
+	GeoPatchMemoryUsage() :
+		patches(0),
+		heights(0),
+		meshData(0),
+		vertexBuffers(0) {}
+
+	Uint32 patches;
+	size_t heights; // kept for the life of the patch
+	size_t meshData; // normals and colours waiting for the vertex buffer
+	size_t vertexBuffers; // size of the uploaded vertex buffers
+};
 
 class GeoPatch {
 public:
@@ -85,13 +100,29 @@ public:
 	void ReceiveJobHandle(Job::Handle job);
 
 	inline bool HasHeightData() const { return (m_heights.get() != nullptr); }
+
+	// Finds the patch surface coords of the direction p, inverting
+	// GetSpherePoint. Returns false if p isn't over this patch.
+	bool GetPatchCoords(const vector3d &p, double &x, double &y) const;
+
+	// Height at the direction p, interpolated from the finest patch at or below
+	// this one that covers it. x and y are the patch coords of p in this patch.
+	// Returns false if that patch is shallower than minDepth.
+	bool GetResidentHeight(const vector3d &p, double x, double y, Sint32 minDepth, double &height) const;
+
+	// Adds this patch and those below it to usage
+	void AddMemoryUsage(GeoPatchMemoryUsage &usage) const;
+
 private:
 	static const int NUM_KIDS = 4;
 
+	inline double GetHeight(const Sint32 idx) const { return m_minHeight + m_heights[idx] * m_heightScale; }
+
 	RefCountedPtr<GeoPatchContext> m_ctx;
 	const vector3d m_v0, m_v1, m_v2, m_v3;
-	std::unique_ptr<double[]> m_heights;
-	std::unique_ptr<vector3f[]> m_normals;
+	std::unique_ptr<Uint16[]> m_heights; // see SSplitResultData::heights
+	double m_minHeight, m_heightScale;
+	std::unique_ptr<OctNormal[]> m_normals;
 	std::unique_ptr<Color3ub[]> m_colors;
 	std::unique_ptr<Graphics::VertexBuffer> m_vertexBuffer;
 	std::unique_ptr<GeoPatch> m_kids[NUM_KIDS];
@@ -14,6 +14,27 @@ inline void setColour(Color3ub &r, const vector3d &v)
 	r.b = static_cast<unsigned char>(Clamp(v.z * 255.0, 0.0, 255.0));
 }
 
+// Quantises the edgeLen x edgeLen heights starting at h, with rows stride apart,
+// to 16 bit steps up from the lowest of them
+static void QuantiseHeights(const double *h, const int edgeLen, const int stride, Uint16 *out, double &minHeight, double &heightScale)
+{
+	double minh = h[0], maxh = h[0];
+	for (int y = 0; y < edgeLen; y++) {
+		for (int x = 0; x < edgeLen; x++) {
+			minh = std::min(minh, h[x + y * stride]);
+			maxh = std::max(maxh, h[x + y * stride]);
+		}
+	}
+	minHeight = minh;
+	heightScale = (maxh - minh) / 65535.0;
+	const double invScale = (heightScale > 0.0) ? 1.0 / heightScale : 0.0;
+	for (int y = 0; y < edgeLen; y++) {
+		for (int x = 0; x < edgeLen; x++) {
+			*(out++) = Uint16(std::min((h[x + y * stride] - minh) * invScale + 0.5, 65535.0));
+		}
+	}
+}
+
 // in patch surface coords, [0,1]
 inline vector3d GetSpherePoint(const vector3d &v0, const vector3d &v1, const vector3d &v2, const vector3d &v3, const double x, const double y)
 {
@@ -25,39 +46,42 @@ inline vector3d GetSpherePoint(const vector3d &v0, const vector3d &v1, const vec
 // ********************************************************************************
 
 // Generates full-detail vertices, and also non-edge normals and colors
-void SSingleSplitRequest::GenerateMesh() const
+void SSingleSplitRequest::GenerateMesh()
 {
 	const int borderedEdgeLen = edgeLen + (BORDER_SIZE * 2);
 	const int numBorderedVerts = borderedEdgeLen * borderedEdgeLen;
+	borderHeights.reset(new double[numBorderedVerts]);
+	borderVertexs.reset(new vector3d[numBorderedVerts]);
 
-	// generate heights plus a 1 unit border
+	// generate heights plus a 1 unit border, a row at a time
 	double *bhts = borderHeights.get();
 	vector3d *vrts = borderVertexs.get();
 	for (int y = -BORDER_SIZE; y < borderedEdgeLen - BORDER_SIZE; y++) {
 		const double yfrac = double(y) * fracStep;
 		for (int x = -BORDER_SIZE; x < borderedEdgeLen - BORDER_SIZE; x++) {
 			const double xfrac = double(x) * fracStep;
-			const vector3d p = GetSpherePoint(v0, v1, v2, v3, xfrac, yfrac);
-			const double height = pTerrain->GetHeight(p);
-			assert(height >= 0.0f && height <= 1.0f);
-			*(bhts++) = height;
-			*(vrts++) = p * (height + 1.0);
+			vrts[x + BORDER_SIZE] = GetSpherePoint(v0, v1, v2, v3, xfrac, yfrac);
+		}
+		pTerrain->GetHeights(vrts, bhts, borderedEdgeLen);
+		for (int x = 0; x < borderedEdgeLen; x++) {
+			assert(bhts[x] >= 0.0f && bhts[x] <= 1.0f);
+			vrts[x] = vrts[x] * (bhts[x] + 1.0);
 		}
+		bhts += borderedEdgeLen;
+		vrts += borderedEdgeLen;
 	}
 	assert(bhts == &borderHeights.get()[numBorderedVerts]);
 
+	QuantiseHeights(&borderHeights[BORDER_SIZE + BORDER_SIZE * borderedEdgeLen], edgeLen, borderedEdgeLen, heights, minHeight, heightScale);
+
 	// Generate normals & colors for non-edge vertices since they never change
 	Color3ub *col = colors;
-	vector3f *nrm = normals;
-	double *hts = heights;
+	OctNormal *nrm = normals;
 	vrts = borderVertexs.get();
+	std::vector<vector3d> rowPoints(edgeLen), rowNormals(edgeLen), rowColors(edgeLen);
 	for (int y = BORDER_SIZE; y < borderedEdgeLen - BORDER_SIZE; y++) {
+		const double *rowHeights = &borderHeights[BORDER_SIZE + y * borderedEdgeLen];
 		for (int x = BORDER_SIZE; x < borderedEdgeLen - BORDER_SIZE; x++) {
-			// height
-			const double height = borderHeights[x + y * borderedEdgeLen];
-			assert(hts != &heights[edgeLen * edgeLen]);
-			*(hts++) = height;
-
 			// normal
 			const vector3d &x1 = vrts[(x - 1) + y * borderedEdgeLen];
 			const vector3d &x2 = vrts[(x + 1) + y * borderedEdgeLen];
@@ -65,18 +89,26 @@ void SSingleSplitRequest::GenerateMesh() const
 			const vector3d &y2 = vrts[x + (y + 1) * borderedEdgeLen];
 			const vector3d n = ((x2 - x1).Cross(y2 - y1)).Normalized();
 			assert(nrm != &normals[edgeLen * edgeLen]);
-			*(nrm++) = vector3f(n);
+			*(nrm++) = OctNormal::Encode(n);
+
+			// position for the color
+			rowPoints[x - BORDER_SIZE] = GetSpherePoint(v0, v1, v2, v3, (x - BORDER_SIZE) * fracStep, (y - BORDER_SIZE) * fracStep);
+			rowNormals[x - BORDER_SIZE] = n;
+		}
 
-			// color
-			const vector3d p = GetSpherePoint(v0, v1, v2, v3, (x - BORDER_SIZE) * fracStep, (y - BORDER_SIZE) * fracStep);
-			setColour(*col, pTerrain->GetColor(p, height, n));
+		// color
+		pTerrain->GetColors(rowPoints.data(), rowHeights, rowNormals.data(), rowColors.data(), edgeLen);
+		for (int x = 0; x < edgeLen; x++) {
 			assert(col != &colors[edgeLen * edgeLen]);
+			setColour(*col, rowColors[x]);
 			++col;
 		}
 	}
-	assert(hts == &heights[edgeLen * edgeLen]);
 	assert(nrm == &normals[edgeLen * edgeLen]);
 	assert(col == &colors[edgeLen * edgeLen]);
+
+	borderHeights.reset();
+	borderVertexs.reset();
 }
 
 // ********************************************************************************
@@ -100,7 +132,7 @@ void SinglePatchJob::OnRun() // RUNS IN ANOTHER THREAD!! MUST BE THREAD SAFE!
 
 	// add this patches data
 	SSingleSplitResult *sr = new SSingleSplitResult(srd.patchID.GetPatchFaceIdx(), srd.depth);
-	sr->addResult(srd.heights, srd.normals, srd.colors,
+	sr->addResult(srd.heights, srd.minHeight, srd.heightScale, srd.normals, srd.colors,
 		srd.v0, srd.v1, srd.v2, srd.v3,
 		srd.patchID.NextPatchID(srd.depth + 1, 0));
 	// store the result
@@ -163,10 +195,12 @@ void QuadPatchJob::OnRun() // RUNS IN ANOTHER THREAD!! MUST BE THREAD SAFE!
 			borderedEdgeLen);
 
 		// add this patches data
-		sr->addResult(i, srd.heights[i], srd.normals[i], srd.colors[i],
+		sr->addResult(i, srd.heights[i], srd.minHeight[i], srd.heightScale[i], srd.normals[i], srd.colors[i],
 			vecs[i][0], vecs[i][1], vecs[i][2], vecs[i][3],
 			srd.patchID.NextPatchID(srd.depth + 1, i));
 	}
+	mData->borderHeights.reset();
+	mData->borderVertexs.reset();
 	mpResults = sr;
 }
 
@@ -180,24 +214,29 @@ QuadPatchJob::~QuadPatchJob()
 }
 
 // Generates full-detail vertices, and also non-edge normals and colors
-void SQuadSplitRequest::GenerateBorderedData() const
+void SQuadSplitRequest::GenerateBorderedData()
 {
 	const int borderedEdgeLen = (edgeLen * 2) + (BORDER_SIZE * 2) - 1;
 	const int numBorderedVerts = borderedEdgeLen * borderedEdgeLen;
+	borderHeights.reset(new double[numBorderedVerts]);
+	borderVertexs.reset(new vector3d[numBorderedVerts]);
 
-	// generate heights plus a N=BORDER_SIZE unit border
+	// generate heights plus a N=BORDER_SIZE unit border, a row at a time
 	double *bhts = borderHeights.get();
 	vector3d *vrts = borderVertexs.get();
 	for (int y = -BORDER_SIZE; y < (borderedEdgeLen - BORDER_SIZE); y++) {
 		const double yfrac = double(y) * (fracStep * 0.5);
 		for (int x = -BORDER_SIZE; x < (borderedEdgeLen - BORDER_SIZE); x++) {
 			const double xfrac = double(x) * (fracStep * 0.5);
-			const vector3d p = GetSpherePoint(v0, v1, v2, v3, xfrac, yfrac);
-			const double height = pTerrain->GetHeight(p);
-			assert(height >= 0.0f && height <= 1.0f);
-			*(bhts++) = height;
-			*(vrts++) = p * (height + 1.0);
+			vrts[x + BORDER_SIZE] = GetSpherePoint(v0, v1, v2, v3, xfrac, yfrac);
 		}
+		pTerrain->GetHeights(vrts, bhts, borderedEdgeLen);
+		for (int x = 0; x < borderedEdgeLen; x++) {
+			assert(bhts[x] >= 0.0f && bhts[x] <= 1.0f);
+			vrts[x] = vrts[x] * (bhts[x] + 1.0);
+		}
+		bhts += borderedEdgeLen;
+		vrts += borderedEdgeLen;
 	}
 	assert(bhts == &borderHeights[numBorderedVerts]);
 }
@@ -211,25 +250,24 @@ void SQuadSplitRequest::GenerateSubPatchData(
 	const int edgeLen,
 	const int xoff,
 	const int yoff,
-	const int borderedEdgeLen) const
+	const int borderedEdgeLen)
 {
+	QuantiseHeights(&borderHeights[(xoff + BORDER_SIZE) + (yoff + BORDER_SIZE) * borderedEdgeLen], edgeLen, borderedEdgeLen,
+		heights[quadrantIndex], minHeight[quadrantIndex], heightScale[quadrantIndex]);
+
 	// Generate normals & colors for vertices
 	vector3d *vrts = borderVertexs.get();
 	Color3ub *col = colors[quadrantIndex];
-	vector3f *nrm = normals[quadrantIndex];
-	double *hts = heights[quadrantIndex];
+	OctNormal *nrm = normals[quadrantIndex];
 
 	// step over the small square
+	std::vector<vector3d> rowPoints(edgeLen), rowNormals(edgeLen), rowColors(edgeLen);
 	for (int y = 0; y < edgeLen; y++) {
 		const int by = (y + BORDER_SIZE) + yoff;
+		const double *rowHeights = &borderHeights[(xoff + BORDER_SIZE) + (by * borderedEdgeLen)];
 		for (int x = 0; x < edgeLen; x++) {
 			const int bx = (x + BORDER_SIZE) + xoff;
 
-			// height
-			const double height = borderHeights[bx + (by * borderedEdgeLen)];
-			assert(hts != &heights[quadrantIndex][edgeLen * edgeLen]);
-			*(hts++) = height;
-
 			// normal
 			const vector3d &x1 = vrts[(bx - 1) + (by * borderedEdgeLen)];
 			const vector3d &x2 = vrts[(bx + 1) + (by * borderedEdgeLen)];
@@ -237,16 +275,21 @@ void SQuadSplitRequest::GenerateSubPatchData(
 			const vector3d &y2 = vrts[bx + ((by + 1) * borderedEdgeLen)];
 			const vector3d n = ((x2 - x1).Cross(y2 - y1)).Normalized();
 			assert(nrm != &normals[quadrantIndex][edgeLen * edgeLen]);
-			*(nrm++) = vector3f(n);
+			*(nrm++) = OctNormal::Encode(n);
 
-			// color
-			const vector3d p = GetSpherePoint(v0, v1, v2, v3, x * fracStep, y * fracStep);
-			setColour(*col, pTerrain->GetColor(p, height, n));
+			// position for the color
+			rowPoints[x] = GetSpherePoint(v0, v1, v2, v3, x * fracStep, y * fracStep);
+			rowNormals[x] = n;
+		}
+
+		// color
+		pTerrain->GetColors(rowPoints.data(), rowHeights, rowNormals.data(), rowColors.data(), edgeLen);
+		for (int x = 0; x < edgeLen; x++) {
 			assert(col != &colors[quadrantIndex][edgeLen * edgeLen]);
+			setColour(*col, rowColors[x]);
 			++col;
 		}
 	}
-	assert(hts == &heights[quadrantIndex][edgeLen * edgeLen]);
 	assert(nrm == &normals[quadrantIndex][edgeLen * edgeLen]);
 	assert(col == &colors[quadrantIndex][edgeLen * edgeLen]);
 }
@@ -16,6 +16,38 @@ class GeoSphere;
 
 #define BORDER_SIZE 1
 
+// Unit normal folded onto an octahedron and stored as the 16 bit x,y of the
+// point on it; the lower half is unfolded over the upper half.
+struct OctNormal {
+	Sint16 x, y;
+
+	static OctNormal Encode(const vector3d &n)
+	{
+		const double l1 = fabs(n.x) + fabs(n.y) + fabs(n.z);
+		double u = n.x / l1;
+		double v = n.y / l1;
+		if (n.z < 0.0) {
+			const double fu = (1.0 - fabs(v)) * (u >= 0.0 ? 1.0 : -1.0);
+			v = (1.0 - fabs(u)) * (v >= 0.0 ? 1.0 : -1.0);
+			u = fu;
+		}
+		OctNormal o;
+		o.x = Sint16(floor(u * 32767.0 + 0.5));
+		o.y = Sint16(floor(v * 32767.0 + 0.5));
+		return o;
+	}
+
+	vector3f Decode() const
+	{
+		vector3f n(x * (1.0f / 32767.0f), y * (1.0f / 32767.0f), 0.0f);
+		n.z = 1.0f - fabs(n.x) - fabs(n.y);
+		const float t = std::max(-n.z, 0.0f);
+		n.x += (n.x >= 0.0f) ? -t : t;
+		n.y += (n.y >= 0.0f) ? -t : t;
+		return n.Normalized();
+	}
+};
+
 class SBaseRequest {
 public:
 	SBaseRequest(const vector3d &v0_, const vector3d &v1_, const vector3d &v2_, const vector3d &v3_, const vector3d &cn,
@@ -60,28 +92,29 @@ public:
 	{
 		const int numVerts = NUMVERTICES(edgeLen_);
 		for (int i = 0; i < 4; ++i) {
-			heights[i] = new double[numVerts];
-			normals[i] = new vector3f[numVerts];
+			heights[i] = new Uint16[numVerts];
+			normals[i] = new OctNormal[numVerts];
 			colors[i] = new Color3ub[numVerts];
+			minHeight[i] = heightScale[i] = 0.0;
 		}
-		const int numBorderedVerts = NUMVERTICES((edgeLen_ * 2) + (BORDER_SIZE * 2) - 1);
-		borderHeights.reset(new double[numBorderedVerts]);
-		borderVertexs.reset(new vector3d[numBorderedVerts]);
 	}
 
 	// Generates full-detail vertices, and also non-edge normals and colors
-	void GenerateBorderedData() const;
+	void GenerateBorderedData();
 
 	void GenerateSubPatchData(const int quadrantIndex,
 		const vector3d &v0, const vector3d &v1, const vector3d &v2, const vector3d &v3,
-		const int edgeLen, const int xoff, const int yoff, const int borderedEdgeLen) const;
+		const int edgeLen, const int xoff, const int yoff, const int borderedEdgeLen);
 
 	// these are created with the request and are given to the resulting patches
-	vector3f *normals[4];
+	OctNormal *normals[4];
 	Color3ub *colors[4];
-	double *heights[4];
+	Uint16 *heights[4];
+	double minHeight[4];
+	double heightScale[4];
 
-	// these are created with the request but are destroyed when the request is finished
+	// these are only allocated while the job runs, as a queue of requests
+	// holding them would be most of the memory used by the terrain
 	std::unique_ptr<double[]> borderHeights;
 	std::unique_ptr<vector3d[]> borderVertexs;
 
@@ -98,24 +131,23 @@ public:
 		SBaseRequest(v0_, v1_, v2_, v3_, cn, depth_, sysPath_, patchID_, edgeLen_, fracStep_, pTerrain_)
 	{
 		const int numVerts = NUMVERTICES(edgeLen_);
-		heights = new double[numVerts];
-		normals = new vector3f[numVerts];
+		heights = new Uint16[numVerts];
+		normals = new OctNormal[numVerts];
 		colors = new Color3ub[numVerts];
-
-		const int numBorderedVerts = NUMVERTICES(edgeLen_ + (BORDER_SIZE * 2));
-		borderHeights.reset(new double[numBorderedVerts]);
-		borderVertexs.reset(new vector3d[numBorderedVerts]);
+		minHeight = heightScale = 0.0;
 	}
 
 	// Generates full-detail vertices, and also non-edge normals and colors
-	void GenerateMesh() const;
+	void GenerateMesh();
 
 	// these are created with the request and are given to the resulting patches
-	vector3f *normals;
+	OctNormal *normals;
 	Color3ub *colors;
-	double *heights;
+	Uint16 *heights;
+	double minHeight;
+	double heightScale;
 
-	// these are created with the request but are destroyed when the request is finished
+	// these are only allocated while the job runs
 	std::unique_ptr<double[]> borderHeights;
 	std::unique_ptr<vector3d[]> borderVertexs;
 
@@ -129,8 +161,10 @@ public:
 	struct SSplitResultData {
 		SSplitResultData() :
 			patchID(0) {}
-		SSplitResultData(double *heights_, vector3f *n_, Color3ub *c_, const vector3d &v0_, const vector3d &v1_, const vector3d &v2_, const vector3d &v3_, const GeoPatchID &patchID_) :
+		SSplitResultData(Uint16 *heights_, double minHeight_, double heightScale_, OctNormal *n_, Color3ub *c_, const vector3d &v0_, const vector3d &v1_, const vector3d &v2_, const vector3d &v3_, const GeoPatchID &patchID_) :
 			heights(heights_),
+			minHeight(minHeight_),
+			heightScale(heightScale_),
 			normals(n_),
 			colors(c_),
 			v0(v0_),
@@ -140,6 +174,9 @@ public:
 			patchID(patchID_)
 		{}
 		SSplitResultData(const SSplitResultData &r) :
+			heights(r.heights),
+			minHeight(r.minHeight),
+			heightScale(r.heightScale),
 			normals(r.normals),
 			colors(r.colors),
 			v0(r.v0),
@@ -149,8 +186,13 @@ public:
 			patchID(r.patchID)
 		{}
 
-		double *heights;
-		vector3f *normals;
+		// heights are 16 bit steps of heightScale up from the lowest height in
+		// the patch, which is well under a metre on an Earth sized planet even
+		// for the root patches
+		Uint16 *heights;
+		double minHeight;
+		double heightScale;
+		OctNormal *normals;
 		Color3ub *colors;
 		vector3d v0, v1, v2, v3;
 		GeoPatchID patchID;
@@ -185,10 +227,10 @@ public:
 	{
 	}
 
-	void addResult(const int kidIdx, double *h_, vector3f *n_, Color3ub *c_, const vector3d &v0_, const vector3d &v1_, const vector3d &v2_, const vector3d &v3_, const GeoPatchID &patchID_)
+	void addResult(const int kidIdx, Uint16 *h_, double minh_, double hscale_, OctNormal *n_, Color3ub *c_, const vector3d &v0_, const vector3d &v1_, const vector3d &v2_, const vector3d &v3_, const GeoPatchID &patchID_)
 	{
 		assert(kidIdx >= 0 && kidIdx < NUM_RESULT_DATA);
-		mData[kidIdx] = (SSplitResultData(h_, n_, c_, v0_, v1_, v2_, v3_, patchID_));
+		mData[kidIdx] = (SSplitResultData(h_, minh_, hscale_, n_, c_, v0_, v1_, v2_, v3_, patchID_));
 	}
 
 	inline const SSplitResultData &data(const int32_t idx) const { return mData[idx]; }
@@ -226,9 +268,9 @@ public:
 	{
 	}
 
-	void addResult(double *h_, vector3f *n_, Color3ub *c_, const vector3d &v0_, const vector3d &v1_, const vector3d &v2_, const vector3d &v3_, const GeoPatchID &patchID_)
+	void addResult(Uint16 *h_, double minh_, double hscale_, OctNormal *n_, Color3ub *c_, const vector3d &v0_, const vector3d &v1_, const vector3d &v2_, const vector3d &v3_, const GeoPatchID &patchID_)
 	{
-		mData = (SSplitResultData(h_, n_, c_, v0_, v1_, v2_, v3_, patchID_));
+		mData = (SSplitResultData(h_, minh_, hscale_, n_, c_, v0_, v1_, v2_, v3_, patchID_));
 	}
 
 	inline const SSplitResultData &data() const { return mData; }
@@ -270,6 +312,7 @@ public:
 	virtual void OnRun() {} // RUNS IN ANOTHER THREAD!! MUST BE THREAD SAFE!
 	virtual void OnFinish() {}
 	virtual void OnCancel() {}
+	virtual Priority GetPriority() const { return PRIORITY_INTERACTIVE; }
 };
 
 // ********************************************************************************
@@ -286,6 +329,7 @@ public:
 
 	virtual void OnRun(); // RUNS IN ANOTHER THREAD!! MUST BE THREAD SAFE!
 	virtual void OnFinish(); // runs in primary thread of the context
+	virtual const char *GetName() const { return "SinglePatchJob"; }
 
 private:
 	std::unique_ptr<SSingleSplitRequest> mData;
@@ -306,6 +350,7 @@ public:
 
 	virtual void OnRun(); // RUNS IN ANOTHER THREAD!! MUST BE THREAD SAFE!
 	virtual void OnFinish(); // runs in primary thread of the context
+	virtual const char *GetName() const { return "QuadPatchJob"; }
 
 private:
 	std::unique_ptr<SQuadSplitRequest> mData;
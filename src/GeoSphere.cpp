@@ -21,6 +21,9 @@
 #include "graphics/VertexArray.h"
 #include "perlin.h"
 #include "vcacheopt/vcacheopt.h"
+#ifdef BENCHMARK_GEOSPHERE
+#include "graphics/dummy/RendererDummy.h"
+#endif
 #include <algorithm>
 #include <deque>
 
@@ -85,6 +88,13 @@ void GeoSphere::OnChangeDetailLevel()
 	}
 }
 
+//static
+void GeoSphere::GetAllMemoryUsage(GeoPatchMemoryUsage &usage)
+{
+	for (const GeoSphere *gs : s_allGeospheres)
+		gs->GetMemoryUsage(usage);
+}
+
 //static
 bool GeoSphere::OnAddQuadSplitResult(const SystemPath &path, SQuadSplitResult *res)
 {
@@ -165,8 +175,15 @@ void GeoSphere::Reset()
 			m_patches[p].reset();
 		}
 	}
+	// the detail level and so the buffer size may be changing
+	ClearVertexBufferPool();
 
 	CalculateMaxPatchDepth();
+	ClearHeightCache();
+
+#ifdef BENCHMARK_GEOSPHERE
+	BenchmarkVertexBufferPool(100);
+#endif
 
 	m_initStage = eBuildFirstPatches;
 }
@@ -184,6 +201,7 @@ GeoSphere::GeoSphere(const SystemBody *body) :
 	s_allGeospheres.push_back(this);
 
 	CalculateMaxPatchDepth();
+	ClearHeightCache();
 
 	//SetUpMaterials is not called until first Render since light count is zero :)
 }
@@ -193,6 +211,11 @@ GeoSphere::~GeoSphere()
 	// update thread should not be able to access us now, so we can safely continue to delete
 	assert(std::count(s_allGeospheres.begin(), s_allGeospheres.end(), this) == 1);
 	s_allGeospheres.erase(std::find(s_allGeospheres.begin(), s_allGeospheres.end(), this));
+
+	// the patches give their vertex buffers back to the pool
+	for (int p = 0; p < NUM_PATCHES; p++)
+		m_patches[p].reset();
+	ClearVertexBufferPool();
 }
 
 bool GeoSphere::AddQuadSplitResult(SQuadSplitResult *res)
@@ -304,6 +327,104 @@ void GeoSphere::BuildFirstPatches()
 	m_initStage = eRequestedFirstPatches;
 }
 
+double GeoSphere::GetHeight(const vector3d &p) const
+{
+	PROFILE_SCOPED()
+	// only the deepest patches are close enough to the fractal, and they're
+	// the ones around the player where most of the queries are
+	const Sint32 finestDepth = std::min(GEOPATCH_MAX_DEPTH, m_maxDepth);
+	for (int i = 0; i < NUM_PATCHES; i++) {
+		double x, y;
+		if (m_patches[i] && m_patches[i]->GetPatchCoords(p, x, y)) {
+			double height;
+			if (m_patches[i]->GetResidentHeight(p, x, y, finestDepth, height))
+				return height;
+			break;
+		}
+	}
+	return GetFractalHeight(p);
+}
+
+double GeoSphere::GetFractalHeight(const vector3d &p) const
+{
+	Uint64 bits[3];
+	memcpy(&bits[0], &p.x, sizeof(double));
+	memcpy(&bits[1], &p.y, sizeof(double));
+	memcpy(&bits[2], &p.z, sizeof(double));
+	const Uint64 hash = (bits[0] * 0x9E3779B97F4A7C15ULL) ^ (bits[1] * 0xC2B2AE3D27D4EB4FULL) ^ (bits[2] * 0x165667B19E3779F9ULL);
+	HeightSample &sample = m_heightCache[(hash >> 32) & (HEIGHT_CACHE_SIZE - 1)];
+	if (sample.pos.ExactlyEqual(p))
+		return sample.height;
+
+	const double h = m_terrain->GetHeight(p);
+#ifdef DEBUG
+	// XXX don't remove this. Fix your fractals instead
+	// Fractals absolutely MUST return heights >= 0.0 (one planet radius)
+	// otherwise atmosphere and other things break.
+	if (h < 0.0) {
+		Output("GetHeight({ %f, %f, %f }) returned %f\n", p.x, p.y, p.z, h);
+		m_terrain->DebugDump();
+		assert(h >= 0.0);
+	}
+#endif /* DEBUG */
+	sample.pos = p;
+	sample.height = h;
+	return h;
+}
+
+void GeoSphere::ClearHeightCache()
+{
+	// a NaN position never matches
+	for (Uint32 i = 0; i < HEIGHT_CACHE_SIZE; i++)
+		m_heightCache[i].pos = vector3d(NAN);
+}
+
+void GeoSphere::GetMemoryUsage(GeoPatchMemoryUsage &usage) const
+{
+	for (int i = 0; i < NUM_PATCHES; i++) {
+		if (m_patches[i])
+			m_patches[i]->AddMemoryUsage(usage);
+	}
+}
+
+std::unique_ptr<Graphics::VertexBuffer> GeoSphere::AcquireVertexBuffer(Graphics::Renderer *renderer)
+{
+	while (!m_vertexBufferPool.empty()) {
+		std::unique_ptr<Graphics::VertexBuffer> vb(std::move(m_vertexBufferPool.back()));
+		m_vertexBufferPool.pop_back();
+		if (vb->GetDesc().numVertices == Uint32(s_patchContext->NUMVERTICES())) {
+			renderer->GetStats().AddToStatCount(Graphics::Stats::STAT_REUSE_BUFFER, 1);
+			// it may be written before the GPU is done drawing the patch that had it
+			vb->Orphan();
+			return vb;
+		}
+	}
+
+	Graphics::VertexBufferDesc vbd;
+	vbd.attrib[0].semantic = Graphics::ATTRIB_POSITION;
+	vbd.attrib[0].format = Graphics::ATTRIB_FORMAT_FLOAT3;
+	vbd.attrib[1].semantic = Graphics::ATTRIB_NORMAL;
+	vbd.attrib[1].format = Graphics::ATTRIB_FORMAT_FLOAT3;
+	vbd.attrib[2].semantic = Graphics::ATTRIB_DIFFUSE;
+	vbd.attrib[2].format = Graphics::ATTRIB_FORMAT_UBYTE4;
+	vbd.attrib[3].semantic = Graphics::ATTRIB_UV0;
+	vbd.attrib[3].format = Graphics::ATTRIB_FORMAT_FLOAT2;
+	vbd.numVertices = s_patchContext->NUMVERTICES();
+	vbd.usage = Graphics::BUFFER_USAGE_STATIC;
+	return std::unique_ptr<Graphics::VertexBuffer>(renderer->CreateVertexBuffer(vbd));
+}
+
+void GeoSphere::ReleaseVertexBuffer(std::unique_ptr<Graphics::VertexBuffer> vb)
+{
+	if (m_vertexBufferPool.size() < MAX_POOLED_VERTEX_BUFFERS)
+		m_vertexBufferPool.push_back(std::move(vb));
+}
+
+void GeoSphere::ClearVertexBufferPool()
+{
+	m_vertexBufferPool.clear();
+}
+
 void GeoSphere::CalculateMaxPatchDepth()
 {
 	const double circumference = 2.0 * M_PI * m_sbody->GetRadius();
@@ -517,3 +638,39 @@ void GeoSphere::SetUpMaterials()
 		m_atmosphereMaterial->texture1 = nullptr;
 	}
 }
+
+#ifdef BENCHMARK_GEOSPHERE
+void GeoSphere::BenchmarkVertexBufferPool(Uint32 rounds)
+{
+	Graphics::RendererDummy renderer;
+	const Graphics::Stats &stats = renderer.GetStats();
+
+	// each round, every root patch splits into four children, which then
+	// merge back, and the frame ends
+	std::vector<std::unique_ptr<Graphics::VertexBuffer>> children;
+	Uint32 firstCreated = 0, laterCreated = 0, laterDestroyed = 0, reused = 0;
+	for (Uint32 round = 0; round < rounds; round++) {
+		for (int i = 0; i < NUM_PATCHES * 4; i++)
+			children.push_back(AcquireVertexBuffer(&renderer));
+		for (auto &vb : children)
+			ReleaseVertexBuffer(std::move(vb));
+		children.clear();
+		renderer.SwapBuffers();
+
+		const Graphics::Stats::TFrameData &frame = stats.FrameStatsPrevious();
+		if (round == 0) {
+			firstCreated = frame.m_stats[Graphics::Stats::STAT_CREATE_BUFFER];
+		} else {
+			laterCreated += frame.m_stats[Graphics::Stats::STAT_CREATE_BUFFER];
+			laterDestroyed += frame.m_stats[Graphics::Stats::STAT_DESTROY_BUFFER];
+		}
+		reused += frame.m_stats[Graphics::Stats::STAT_REUSE_BUFFER];
+	}
+	ClearVertexBufferPool();
+
+	Output("BenchmarkVertexBufferPool: %u rounds of %d splits, %u buffers created in the first, then %u created, %u destroyed and %u reused\n",
+		rounds, NUM_PATCHES * 4, firstCreated, laterCreated, laterDestroyed, reused);
+	if (laterCreated || laterDestroyed)
+		Warning("BenchmarkVertexBufferPool: the vertex buffer pool didn't stop the churn\n");
+}
+#endif
@@ -12,8 +12,11 @@
 
 #include <deque>
 
+//#define BENCHMARK_GEOSPHERE
+
 namespace Graphics {
 	class Renderer;
+	class VertexBuffer;
 }
 
 class SystemBody;
@@ -22,6 +25,7 @@ class GeoPatchContext;
 class SQuadSplitRequest;
 class SQuadSplitResult;
 class SSingleSplitResult;
+struct GeoPatchMemoryUsage;
 
 #define NUM_PATCHES 6
 
@@ -33,21 +37,10 @@ public:
 	virtual void Update() override;
 	virtual void Render(Graphics::Renderer *renderer, const matrix4x4d &modelView, vector3d campos, const float radius, const std::vector<Camera::Shadow> &shadows) override;
 
-	virtual double GetHeight(const vector3d &p) const override final
-	{
-		const double h = m_terrain->GetHeight(p);
-#ifdef DEBUG
-		// XXX don't remove this. Fix your fractals instead
-		// Fractals absolutely MUST return heights >= 0.0 (one planet radius)
-		// otherwise atmosphere and other things break.
-		if (h < 0.0) {
-			Output("GetHeight({ %f, %f, %f }) returned %f\n", p.x, p.y, p.z, h);
-			m_terrain->DebugDump();
-			assert(h >= 0.0);
-		}
-#endif /* DEBUG */
-		return h;
-	}
+	// Heights come from the finest patches, where they're loaded, so they
+	// match the surface being drawn; elsewhere from the terrain fractal.
+	// Not thread safe, as the patches only change on the main thread.
+	virtual double GetHeight(const vector3d &p) const override final;
 
 	static void Init();
 	static void Uninit();
@@ -55,6 +48,8 @@ public:
 	static void OnChangeDetailLevel();
 	static bool OnAddQuadSplitResult(const SystemPath &path, SQuadSplitResult *res);
 	static bool OnAddSingleSplitResult(const SystemPath &path, SSingleSplitResult *res);
+	// memory held by the patches of every GeoSphere
+	static void GetAllMemoryUsage(GeoPatchMemoryUsage &usage);
 	// in sbody radii
 	virtual double GetMaxFeatureHeight() const override final { return m_terrain->GetMaxHeight(); }
 
@@ -66,6 +61,14 @@ public:
 
 	inline Sint32 GetMaxDepth() const { return m_maxDepth; }
 
+	// adds the memory held by this GeoSphere's patches to usage
+	void GetMemoryUsage(GeoPatchMemoryUsage &usage) const;
+
+	// Every patch has a vertex buffer of the same size, so merged patches give
+	// theirs back to be reused by the next split rather than destroying them
+	std::unique_ptr<Graphics::VertexBuffer> AcquireVertexBuffer(Graphics::Renderer *renderer);
+	void ReleaseVertexBuffer(std::unique_ptr<Graphics::VertexBuffer> vb);
+
 	void AddQuadSplitRequest(double, SQuadSplitRequest *, GeoPatch *);
 
 private:
@@ -77,7 +80,20 @@ private:
 	}
 	void ProcessQuadSplitRequests();
 
+	double GetFractalHeight(const vector3d &p) const;
+	void ClearHeightCache();
+	void ClearVertexBufferPool();
+#ifdef BENCHMARK_GEOSPHERE
+	// split the root patches and merge them again, over and over, against
+	// the dummy renderer, and report the vertex buffers it creates and
+	// destroys. once the pool is warm there should be none
+	void BenchmarkVertexBufferPool(Uint32 rounds);
+#endif
+
 	std::unique_ptr<GeoPatch> m_patches[6];
+
+	static const size_t MAX_POOLED_VERTEX_BUFFERS = 128;
+	std::vector<std::unique_ptr<Graphics::VertexBuffer>> m_vertexBufferPool;
 	struct TDistanceRequest {
 		TDistanceRequest(double dist, SQuadSplitRequest *pRequest, GeoPatch *pRequester) :
 			mDistance(dist),
@@ -113,6 +129,14 @@ private:
 	EGSInitialisationStage m_initStage;
 
 	Sint32 m_maxDepth;
+
+	// recent fractal heights, direct mapped on the bits of the position
+	struct HeightSample {
+		vector3d pos;
+		double height;
+	};
+	static const Uint32 HEIGHT_CACHE_SIZE = 256;
+	mutable HeightSample m_heightCache[HEIGHT_CACHE_SIZE];
 };
 
 #endif /* _GEOSPHERE_H */
@@ -2,7 +2,11 @@
 // Licensed under the terms of the GPL v3. See licenses/GPL-3.txt
 
 #include "JobQueue.h"
+#include "JobStats.h"
 #include "StringF.h"
+#include <algorithm>
+
+typedef std::chrono::steady_clock Clock;
 
 void Job::UnlinkHandle()
 {
@@ -89,31 +93,69 @@ Job::Handle::~Handle()
 	}
 }
 
+void Job::SpawnChild(Job *child, JobCounter &counter)
+{
+	assert(!child->m_counter);
+	child->m_counter = &counter;
+	counter.m_count++;
+
+	if (AsyncJobQueue::s_currentRunner) {
+		AsyncJobQueue::s_currentRunner->Spawn(child);
+	} else {
+		// not on a worker, so nobody else is going to run it
+		child->OnRun();
+		counter.m_count--;
+		child->OnFinish();
+		delete child;
+	}
+}
+
+void Job::WaitFor(JobCounter &counter)
+{
+	// off the workers the children have all been run already
+	if (AsyncJobQueue::s_currentRunner)
+		AsyncJobQueue::s_currentRunner->WaitFor(counter);
+	else
+		assert(counter.IsDone());
+}
+
+//static
+thread_local AsyncJobQueue::JobRunner *AsyncJobQueue::s_currentRunner = nullptr;
+
 AsyncJobQueue::AsyncJobQueue(Uint32 numRunners) :
+	m_nextQueue(0),
+	m_finished(nullptr),
+	m_numPending(0),
+	m_finishBudget(0.0),
 	m_shutdown(false)
 {
 	// Want to limit this for now to the maximum number of threads defined in the class
 	numRunners = std::min(numRunners, MAX_THREADS);
+	m_numRunners = numRunners;
 
-	m_queueLock = SDL_CreateMutex();
-	m_queueWaitCond = SDL_CreateCond();
+	for (int p = 0; p < Job::PRIORITY_COUNT; p++)
+		m_numWaiting[p] = 0;
+	m_waitLock = SDL_CreateMutex();
+	m_waitCond = SDL_CreateCond();
 
-	for (Uint32 i = 0; i < numRunners; i++) {
-		m_finishedLock[i] = SDL_CreateMutex();
+	// the runners start looking at each other's queues straight away
+	for (Uint32 i = 0; i < numRunners; i++)
+		m_queueLock[i] = SDL_CreateMutex();
+	for (Uint32 i = 0; i < numRunners; i++)
 		m_runners.push_back(new JobRunner(this, i));
-	}
 }
 
 AsyncJobQueue::~AsyncJobQueue()
 {
-	// flag shutdown. protected by the queue lock for convenience in GetJob
-	SDL_LockMutex(m_queueLock);
+	// flag shutdown. protected by the wait lock so no runner can miss it
+	// between checking for jobs and going to sleep
+	SDL_LockMutex(m_waitLock);
 	m_shutdown = true;
-	SDL_UnlockMutex(m_queueLock);
+	SDL_UnlockMutex(m_waitLock);
 
 	// broadcast to any waiting runners that they should try (and fail) to get
 	// a new job right now
-	SDL_CondBroadcast(m_queueWaitCond);
+	SDL_CondBroadcast(m_waitCond);
 
 	// Flag each job runner that we're being destroyed (with lock so no one
 	// else is running one of our functions). Both the flag and the mutex
@@ -131,146 +173,245 @@ AsyncJobQueue::~AsyncJobQueue()
 		delete (*i);
 
 	// delete any remaining jobs
-	for (std::deque<Job *>::iterator i = m_queue.begin(); i != m_queue.end(); ++i)
-		delete (*i);
 	for (uint32_t threadIdx = 0; threadIdx < numThreads; threadIdx++) {
-		for (std::deque<Job *>::iterator i = m_finished[threadIdx].begin(); i != m_finished[threadIdx].end(); ++i) {
-			delete (*i);
+		for (int p = 0; p < Job::PRIORITY_COUNT; p++) {
+			for (Job *job : m_queue[threadIdx][p])
+				delete job;
 		}
 	}
+	CollectFinished();
+	for (Job *job : m_finishing)
+		delete job;
 
 	// only us left now, we can clean up and get out of here
-	for (uint32_t threadIdx = 0; threadIdx < numThreads; threadIdx++) {
-		SDL_DestroyMutex(m_finishedLock[threadIdx]);
-	}
-	SDL_DestroyCond(m_queueWaitCond);
-	SDL_DestroyMutex(m_queueLock);
+	for (uint32_t threadIdx = 0; threadIdx < numThreads; threadIdx++)
+		SDL_DestroyMutex(m_queueLock[threadIdx]);
+	SDL_DestroyCond(m_waitCond);
+	SDL_DestroyMutex(m_waitLock);
 }
 
 Job::Handle AsyncJobQueue::Queue(Job *job, JobClient *client)
 {
 	Job::Handle handle(job, this, client);
 
-	// push the job onto the queue
-	SDL_LockMutex(m_queueLock);
-	m_queue.push_back(job);
-	SDL_UnlockMutex(m_queueLock);
+	// spread the jobs over the runners, they'll steal them from each other
+	// if they get through theirs first
+	Push(job, uint8_t(m_nextQueue++ % m_numRunners), false);
 
-	// and tell a waiting runner that there's one available
-	SDL_CondSignal(m_queueWaitCond);
 	return handle;
 }
 
-// called by the runner to get a new job
-Job *AsyncJobQueue::GetJob()
+// adds a job to a runner's queue, at the front if first is set
+void AsyncJobQueue::Push(Job *job, const uint8_t threadIdx, const bool first)
 {
-	SDL_LockMutex(m_queueLock);
+	const Job::Priority priority = job->GetPriority();
+	assert(priority >= 0 && priority < Job::PRIORITY_COUNT);
 
-	// loop until a new job is available
-	Job *job = 0;
-	while (!job) {
-		// we're shutting down, so just get out of here
-		if (m_shutdown) {
-			SDL_UnlockMutex(m_queueLock);
-			return 0;
+	job->m_queuedAt = Clock::now();
+	JobStats::JobQueued(job->GetName());
+
+	SDL_LockMutex(m_queueLock[threadIdx]);
+	if (first)
+		m_queue[threadIdx][priority].push_front(job);
+	else
+		m_queue[threadIdx][priority].push_back(job);
+	m_numWaiting[priority]++;
+	SDL_UnlockMutex(m_queueLock[threadIdx]);
+
+	// and tell a waiting runner that there's one available
+	SDL_LockMutex(m_waitLock);
+	SDL_CondSignal(m_waitCond);
+	SDL_UnlockMutex(m_waitLock);
+}
+
+// the highest priority waiting job, from the runner's own queue if it has
+// one of that priority or else stolen from another runner. null if there
+// are none or we're shutting down
+Job *AsyncJobQueue::TakeJob(const uint8_t threadIdx)
+{
+	for (int p = 0; p < Job::PRIORITY_COUNT; p++) {
+		if (m_shutdown)
+			return nullptr;
+		if (!m_numWaiting[p])
+			continue;
+
+		for (Uint32 n = 0; n < m_numRunners; n++) {
+			const Uint32 i = (threadIdx + n) % m_numRunners;
+			SDL_LockMutex(m_queueLock[i]);
+			std::deque<Job *> &queue = m_queue[i][p];
+			if (!queue.empty()) {
+				Job *job = queue.front();
+				queue.pop_front();
+				m_numWaiting[p]--;
+				SDL_UnlockMutex(m_queueLock[i]);
+				return job;
+			}
+			SDL_UnlockMutex(m_queueLock[i]);
 		}
+	}
+	return nullptr;
+}
 
-		if (!m_queue.size())
+// called by the runner to get a new job
+Job *AsyncJobQueue::GetJob(const uint8_t threadIdx)
+{
+	// loop until a new job is available
+	for (;;) {
+		Job *job = TakeJob(threadIdx);
+		if (job)
+			return job;
+
+		SDL_LockMutex(m_waitLock);
+		while (!m_shutdown) {
+			bool waiting = false;
+			for (int p = 0; p < Job::PRIORITY_COUNT; p++)
+				waiting |= (m_numWaiting[p] != 0);
+			if (waiting)
+				break;
 			// no jobs, go to sleep until one arrives
-			SDL_CondWait(m_queueWaitCond, m_queueLock);
-
-		else {
-			// got one, pop it and return it
-			job = m_queue.front();
-			m_queue.pop_front();
+			SDL_CondWait(m_waitCond, m_waitLock);
 		}
+		const bool shutdown = m_shutdown;
+		SDL_UnlockMutex(m_waitLock);
+
+		// we're shutting down, so just get out of here
+		if (shutdown)
+			return nullptr;
 	}
+}
 
-	SDL_UnlockMutex(m_queueLock);
+// called by a runner waiting for child jobs, see JobRunner::WaitFor
+void AsyncJobQueue::WaitForWork(const JobCounter &counter)
+{
+	SDL_LockMutex(m_waitLock);
+	while (!m_shutdown && !counter.IsDone() && !GetNumWaiting())
+		SDL_CondWait(m_waitCond, m_waitLock);
+	SDL_UnlockMutex(m_waitLock);
+}
+
+// wakes the runners, so the ones waiting for child jobs can check their
+// counters
+void AsyncJobQueue::WakeWaiting()
+{
+	SDL_LockMutex(m_waitLock);
+	SDL_CondBroadcast(m_waitCond);
+	SDL_UnlockMutex(m_waitLock);
+}
 
-	return job;
+Uint32 AsyncJobQueue::GetNumWaiting() const
+{
+	Uint32 waiting = 0;
+	for (int p = 0; p < Job::PRIORITY_COUNT; p++)
+		waiting += m_numWaiting[p];
+	return waiting;
 }
 
 // called by the runner when a job completes
-void AsyncJobQueue::Finish(Job *job, const uint8_t threadIdx)
+void AsyncJobQueue::Finish(Job *job)
+{
+	job->m_finishedAt = Clock::now();
+	m_numPending++;
+
+	Job *head = m_finished.load(std::memory_order_relaxed);
+	do {
+		job->m_nextFinished = head;
+	} while (!m_finished.compare_exchange_weak(head, job, std::memory_order_release, std::memory_order_relaxed));
+}
+
+// moves everything the runners have finished onto the end of m_finishing
+void AsyncJobQueue::CollectFinished()
 {
-	SDL_LockMutex(m_finishedLock[threadIdx]);
-	m_finished[threadIdx].push_back(job);
-	SDL_UnlockMutex(m_finishedLock[threadIdx]);
+	Job *job = m_finished.exchange(nullptr, std::memory_order_acquire);
+	const size_t oldSize = m_finishing.size();
+	for (; job; job = job->m_nextFinished)
+		m_finishing.push_back(job);
+	std::reverse(m_finishing.begin() + oldSize, m_finishing.end());
 }
 
 // call OnFinish methods for completed jobs, and clean up
 Uint32 AsyncJobQueue::FinishJobs()
 {
 	PROFILE_SCOPED()
+	JobStats::ScopedSpan span("FinishJobs");
 	Uint32 finished = 0;
 
-	const uint32_t numRunners = m_runners.size();
-	for (uint32_t i = 0; i < numRunners; ++i) {
-		SDL_LockMutex(m_finishedLock[i]);
-		if (m_finished[i].empty()) {
-			SDL_UnlockMutex(m_finishedLock[i]);
-			continue;
-		}
-		Job *job = m_finished[i].front();
-		m_finished[i].pop_front();
-		SDL_UnlockMutex(m_finishedLock[i]);
+	CollectFinished();
+
+	const Clock::time_point start = Clock::now();
+	while (!m_finishing.empty()) {
+		Job *job = m_finishing.front();
+		m_finishing.pop_front();
+		m_numPending--;
 
-		assert(job);
+		const double latency = std::chrono::duration<double>(Clock::now() - job->m_finishedAt).count();
+		m_finishStats.finished++;
+		m_finishStats.totalLatency += latency;
+		m_finishStats.maxLatency = std::max(m_finishStats.maxLatency, latency);
 
 		// if its already been cancelled then its taken care of, so we just forget about it
 		if (!job->cancelled) {
 			job->UnlinkHandle();
+			const Clock::time_point finishStart = Clock::now();
 			job->OnFinish();
+			JobStats::JobFinished(job->GetName(), finishStart, Clock::now());
 			finished++;
 		}
 
 		delete job;
+
+		if (m_finishBudget > 0.0 && std::chrono::duration<double, std::milli>(Clock::now() - start).count() >= m_finishBudget)
+			break;
 	}
 
+	m_finishStats.maxPending = std::max(m_finishStats.maxPending, Uint32(m_numPending));
 	return finished;
 }
 
 void AsyncJobQueue::Cancel(Job *job)
 {
-	// lock both queues, so we know that all jobs will stay put
-	SDL_LockMutex(m_queueLock);
+	// lock the waiting queues, so we know that those jobs will stay put
 	const uint32_t numRunners = m_runners.size();
-	for (uint32_t i = 0; i < numRunners; ++i) {
-		SDL_LockMutex(m_finishedLock[i]);
-	}
-
-	// check the waiting list. if its there then it hasn't run yet. just forget about it
-	for (std::deque<Job *>::iterator i = m_queue.begin(); i != m_queue.end(); ++i) {
-		if (*i == job) {
-			i = m_queue.erase(i);
-			delete job;
-			goto unlock;
-		}
-	}
+	for (uint32_t i = 0; i < numRunners; ++i)
+		SDL_LockMutex(m_queueLock[i]);
 
-	// check the finshed list. if its there then it can't be cancelled, because
-	// its alread finished! we remove it because the caller is saying "I don't care"
+	// check the waiting lists. if its there then it hasn't run yet. just forget about it
+	const Job::Priority priority = job->GetPriority();
 	for (uint32_t iRunner = 0; iRunner < numRunners; ++iRunner) {
-		for (std::deque<Job *>::iterator i = m_finished[iRunner].begin(); i != m_finished[iRunner].end(); ++i) {
+		std::deque<Job *> &queue = m_queue[iRunner][priority];
+		for (std::deque<Job *>::iterator i = queue.begin(); i != queue.end(); ++i) {
 			if (*i == job) {
-				i = m_finished[iRunner].erase(i);
+				i = queue.erase(i);
+				m_numWaiting[priority]--;
+				JobStats::JobCancelled(job->GetName());
 				delete job;
 				goto unlock;
 			}
 		}
 	}
 
-	// its running, so we have to tell it to cancel
+	// check the finshed list. if its there then it can't be cancelled, because
+	// its alread finished! we remove it because the caller is saying "I don't care"
+	CollectFinished();
+	for (std::deque<Job *>::iterator i = m_finishing.begin(); i != m_finishing.end(); ++i) {
+		if (*i == job) {
+			i = m_finishing.erase(i);
+			m_numPending--;
+			JobStats::JobCancelled(job->GetName());
+			delete job;
+			goto unlock;
+		}
+	}
+
+	// its running, or has only just finished, so we have to tell it to
+	// cancel. either way FinishJobs will see it's cancelled and delete it
 	job->cancelled = true;
 	job->UnlinkHandle();
 	job->OnCancel();
+	JobStats::JobCancelled(job->GetName());
 
 unlock:
-	for (uint32_t i = 0; i < numRunners; ++i) {
-		SDL_UnlockMutex(m_finishedLock[i]);
-	}
-	SDL_UnlockMutex(m_queueLock);
+	for (uint32_t i = 0; i < numRunners; ++i)
+		SDL_UnlockMutex(m_queueLock[i]);
 }
 
 AsyncJobQueue::JobRunner::JobRunner(AsyncJobQueue *jq, const uint8_t idx) :
@@ -279,7 +420,7 @@ AsyncJobQueue::JobRunner::JobRunner(AsyncJobQueue *jq, const uint8_t idx) :
 	m_threadIdx(idx),
 	m_queueDestroyed(false)
 {
-	m_threadName = stringf("Thread %0{d}", m_threadIdx);
+	m_threadName = stringf("Thread %0{d}", int(m_threadIdx));
 	m_jobLock = SDL_CreateMutex();
 	m_queueDestroyingLock = SDL_CreateMutex();
 	m_threadId = SDL_CreateThread(&JobRunner::Trampoline, m_threadName.c_str(), this);
@@ -306,6 +447,8 @@ AsyncJobQueue::JobRunner::~JobRunner()
 int AsyncJobQueue::JobRunner::Trampoline(void *data)
 {
 	JobRunner *jr = static_cast<JobRunner *>(data);
+	s_currentRunner = jr;
+	JobStats::SetThread(jr->m_threadIdx + 1, jr->m_threadName);
 	jr->Main();
 	return 0;
 }
@@ -320,41 +463,89 @@ void AsyncJobQueue::JobRunner::Main()
 		SDL_UnlockMutex(m_queueDestroyingLock);
 		return;
 	}
-	job = m_jobQueue->GetJob();
+	job = m_jobQueue->GetJob(m_threadIdx);
 	SDL_UnlockMutex(m_queueDestroyingLock);
 
 	while (job) {
-		// record the job so we can cancel it in case of premature shutdown
-		SDL_LockMutex(m_jobLock);
-		m_job = job;
-		SDL_UnlockMutex(m_jobLock);
-
-		// run the thing
-		job->OnRun();
+		if (!RunJob(job))
+			return;
 
-		// Lock to prevent destruction of the queue while calling Finish
+		// get a new job. this will block normally, or return null during
+		// shutdown (Lock to protect against the queue being destroyed
+		// during GetJob)
 		SDL_LockMutex(m_queueDestroyingLock);
 		if (m_queueDestroyed) {
 			SDL_UnlockMutex(m_queueDestroyingLock);
 			return;
 		}
-		m_jobQueue->Finish(job, m_threadIdx);
+		job = m_jobQueue->GetJob(m_threadIdx);
 		SDL_UnlockMutex(m_queueDestroyingLock);
+	}
+}
 
-		SDL_LockMutex(m_jobLock);
-		m_job = 0;
-		SDL_UnlockMutex(m_jobLock);
+// runs the job and hands it back to the queue. returns false if the queue
+// has been destroyed
+bool AsyncJobQueue::JobRunner::RunJob(Job *job)
+{
+	// record the job so we can cancel it in case of premature shutdown. we
+	// may be running it while waiting for the children of another one
+	SDL_LockMutex(m_jobLock);
+	Job *outerJob = m_job;
+	m_job = job;
+	SDL_UnlockMutex(m_jobLock);
 
-		// get a new job. this will block normally, or return null during
-		// shutdown (Lock to protect against the queue being destroyed
-		// during GetJob)
+	// run the thing
+	const Clock::time_point start = Clock::now();
+	job->OnRun();
+	const Clock::time_point end = Clock::now();
+	JobStats::JobRun(job->GetName(), job->m_queuedAt, start, end);
+	if (!outerJob)
+		JobStats::ThreadBusy(start, end);
+	// the counter may be gone as soon as it reaches zero
+	const bool counterDone = job->m_counter && --job->m_counter->m_count == 0;
+
+	// Lock to prevent destruction of the queue while calling Finish
+	SDL_LockMutex(m_queueDestroyingLock);
+	if (m_queueDestroyed) {
+		SDL_UnlockMutex(m_queueDestroyingLock);
+		return false;
+	}
+	if (counterDone)
+		m_jobQueue->WakeWaiting();
+	m_jobQueue->Finish(job);
+	SDL_UnlockMutex(m_queueDestroyingLock);
+
+	SDL_LockMutex(m_jobLock);
+	m_job = outerJob;
+	SDL_UnlockMutex(m_jobLock);
+	return true;
+}
+
+// children go at the front of our own queue, so they're the next thing we
+// or a thief pick up at their priority
+void AsyncJobQueue::JobRunner::Spawn(Job *child)
+{
+	m_jobQueue->Push(child, m_threadIdx, true);
+}
+
+void AsyncJobQueue::JobRunner::WaitFor(JobCounter &counter)
+{
+	while (!counter.IsDone()) {
 		SDL_LockMutex(m_queueDestroyingLock);
 		if (m_queueDestroyed) {
 			SDL_UnlockMutex(m_queueDestroyingLock);
 			return;
 		}
-		job = m_jobQueue->GetJob();
+		Job *job = m_jobQueue->TakeJob(m_threadIdx);
+		if (!job) {
+			// the last children are running elsewhere, sleep until they're
+			// done or there's something else to run
+			m_jobQueue->WaitForWork(counter);
+		}
 		SDL_UnlockMutex(m_queueDestroyingLock);
+
+		if (job && !RunJob(job))
+			return;
 	}
 }
 
@@ -371,8 +562,10 @@ void AsyncJobQueue::JobRunner::SetQueueDestroyed()
 SyncJobQueue::~SyncJobQueue()
 {
 	// delete any remaining jobs
-	for (Job *j : m_queue)
-		delete j;
+	for (int p = 0; p < Job::PRIORITY_COUNT; p++) {
+		for (Job *j : m_queue[p])
+			delete j;
+	}
 	for (Job *j : m_finished)
 		delete j;
 }
@@ -380,7 +573,7 @@ SyncJobQueue::~SyncJobQueue()
 Job::Handle SyncJobQueue::Queue(Job *job, JobClient *client)
 {
 	Job::Handle handle(job, this, client);
-	m_queue.push_back(job);
+	m_queue[job->GetPriority()].push_back(job);
 	return handle;
 }
 
@@ -409,9 +602,10 @@ Uint32 SyncJobQueue::FinishJobs()
 void SyncJobQueue::Cancel(Job *job)
 {
 	// check the waiting list. if its there then it hasn't run yet. just forget about it
-	for (std::deque<Job *>::iterator i = m_queue.begin(); i != m_queue.end(); ++i) {
+	std::deque<Job *> &queue = m_queue[job->GetPriority()];
+	for (std::deque<Job *>::iterator i = queue.begin(); i != queue.end(); ++i) {
 		if (*i == job) {
-			i = m_queue.erase(i);
+			i = queue.erase(i);
 			delete job;
 			return;
 		}
@@ -438,14 +632,228 @@ Uint32 SyncJobQueue::RunJobs(Uint32 count)
 	Uint32 executed = 0;
 	assert(count >= 1);
 	for (Uint32 i = 0; i < count; ++i) {
-		if (m_queue.empty())
+		int p = 0;
+		while (p < Job::PRIORITY_COUNT && m_queue[p].empty())
+			p++;
+		if (p == Job::PRIORITY_COUNT)
 			break;
 
-		Job *job = m_queue.front();
-		m_queue.pop_front();
+		Job *job = m_queue[p].front();
+		m_queue[p].pop_front();
 		job->OnRun();
 		executed++;
 		m_finished.push_back(job);
 	}
 	return executed;
 }
+
+#ifdef UNIT_TEST
+// Throughput and latency of the async queue with lots of tiny jobs, a few
+// large ones, interactive jobs queued behind a burst of normal ones, and
+// jobs that split themselves into children.
+#include "BenchmarkClock.h"
+#include <chrono>
+#include <stdio.h>
+
+static std::atomic<double> s_sink;
+
+static void busy_work(int n)
+{
+	double x = 0.0;
+	for (int i = 0; i < n; i++)
+		x += sqrt(double(i));
+	s_sink.store(x, std::memory_order_relaxed);
+}
+
+class WorkJob : public Job {
+public:
+	WorkJob(int work, Priority priority, double *latency = nullptr) :
+		m_work(work),
+		m_priority(priority),
+		m_latency(latency),
+		m_queued(Clock::now()) {}
+	virtual void OnRun() override
+	{
+		if (m_latency)
+			*m_latency = seconds_since(m_queued);
+		busy_work(m_work);
+	}
+	virtual void OnFinish() override { busy_work(m_finishWork); }
+	virtual Priority GetPriority() const override { return m_priority; }
+	virtual const char *GetName() const override { return "WorkJob"; }
+
+	int m_finishWork = 0;
+
+private:
+	int m_work;
+	Priority m_priority;
+	double *m_latency;
+	Clock::time_point m_queued;
+};
+
+class ChildJob : public Job {
+public:
+	ChildJob(int first, int count, Uint64 *sum) :
+		m_first(first),
+		m_count(count),
+		m_sum(sum) {}
+	virtual void OnRun() override
+	{
+		Uint64 sum = 0;
+		for (int i = m_first; i < m_first + m_count; i++)
+			sum += i;
+		*m_sum = sum;
+		busy_work(2000);
+	}
+	virtual void OnFinish() override {}
+	virtual const char *GetName() const override { return "ChildJob"; }
+
+private:
+	int m_first, m_count;
+	Uint64 *m_sum;
+};
+
+class ParentJob : public Job {
+public:
+	static const int NUM_CHILDREN = 64;
+	ParentJob(bool *ok) :
+		m_ok(ok) {}
+	virtual void OnRun() override
+	{
+		JobCounter counter;
+		Uint64 sums[NUM_CHILDREN];
+		for (int i = 0; i < NUM_CHILDREN; i++)
+			SpawnChild(new ChildJob(i * 100, 100, &sums[i]), counter);
+		WaitFor(counter);
+
+		Uint64 total = 0;
+		for (int i = 0; i < NUM_CHILDREN; i++)
+			total += sums[i];
+		const Uint64 n = NUM_CHILDREN * 100;
+		*m_ok = (total == n * (n - 1) / 2);
+	}
+	virtual void OnFinish() override {}
+	virtual const char *GetName() const override { return "ParentJob"; }
+
+private:
+	bool *m_ok;
+};
+
+static void drain(AsyncJobQueue &queue, const JobSet &jobs)
+{
+	while (!jobs.IsEmpty()) {
+		if (!queue.FinishJobs())
+			SDL_Delay(0);
+	}
+}
+
+// pass a file name to write a trace of the last few seconds to
+int main(int argc, char **argv)
+{
+	const Uint32 numThreads = std::max(SDL_GetCPUCount() - 1, 1);
+	AsyncJobQueue queue(numThreads);
+	printf("%u worker threads\n", numThreads);
+
+	{
+		const int count = 20000;
+		JobSet jobs(&queue);
+		const Clock::time_point start = Clock::now();
+		for (int i = 0; i < count; i++)
+			jobs.Order(new WorkJob(10, Job::PRIORITY_NORMAL));
+		drain(queue, jobs);
+		const double t = seconds_since(start);
+		const AsyncJobQueue::FinishStats &stats = queue.GetFinishStats();
+		printf("%d tiny jobs: %.3f s, %.0f jobs/s, finished %.3f ms after running on average, %.3f ms at worst\n",
+			count, t, count / t, stats.totalLatency * 1000.0 / stats.finished, stats.maxLatency * 1000.0);
+		queue.ClearFinishStats();
+	}
+
+	{
+		// results that take a while to deliver, handed over in 16 ms frames
+		// with 2 ms set aside for them
+		const int count = 2000;
+		JobSet jobs(&queue);
+		for (int i = 0; i < count; i++) {
+			WorkJob *job = new WorkJob(1000, Job::PRIORITY_NORMAL);
+			job->m_finishWork = 20000;
+			jobs.Order(job);
+		}
+		queue.SetFinishBudget(2.0);
+		int frames = 0;
+		double worstFrame = 0.0;
+		while (!jobs.IsEmpty()) {
+			const Clock::time_point start = Clock::now();
+			queue.FinishJobs();
+			worstFrame = std::max(worstFrame, seconds_since(start));
+			frames++;
+			SDL_Delay(16);
+		}
+		queue.SetFinishBudget(0.0);
+		printf("%d results with a 2 ms budget: %d frames, at most %.2f ms a frame, at most %u left over\n",
+			count, frames, worstFrame * 1000.0, queue.GetFinishStats().maxPending);
+		queue.ClearFinishStats();
+	}
+
+	{
+		const int count = 200;
+		JobSet jobs(&queue);
+		const Clock::time_point start = Clock::now();
+		for (int i = 0; i < count; i++)
+			jobs.Order(new WorkJob(2000000, Job::PRIORITY_NORMAL));
+		drain(queue, jobs);
+		const double t = seconds_since(start);
+		printf("%d large jobs: %.3f s, %.1f jobs/s\n", count, t, count / t);
+	}
+
+	for (int interactive = 0; interactive < 2; interactive++) {
+		// a burst of cache fills, then the jobs the player is waiting for
+		const int count = 100;
+		double latency[count];
+		JobSet jobs(&queue);
+		for (int i = 0; i < 2000; i++)
+			jobs.Order(new WorkJob(200000, Job::PRIORITY_NORMAL));
+		for (int i = 0; i < count; i++)
+			jobs.Order(new WorkJob(10, interactive ? Job::PRIORITY_INTERACTIVE : Job::PRIORITY_NORMAL, &latency[i]));
+		drain(queue, jobs);
+
+		double total = 0.0, worst = 0.0;
+		for (int i = 0; i < count; i++) {
+			total += latency[i];
+			worst = std::max(worst, latency[i]);
+		}
+		printf("%s jobs behind 2000 normal: mean latency %.2f ms, worst %.2f ms\n",
+			interactive ? "interactive" : "normal", total * 1000.0 / count, worst * 1000.0);
+	}
+
+	{
+		const int count = 50;
+		bool ok[count];
+		JobSet jobs(&queue);
+		const Clock::time_point start = Clock::now();
+		for (int i = 0; i < count; i++)
+			jobs.Order(new ParentJob(&ok[i]));
+		drain(queue, jobs);
+		const double t = seconds_since(start);
+		bool allOk = true;
+		for (int i = 0; i < count; i++)
+			allOk &= ok[i];
+		printf("%d jobs with %d children each: %.3f s, %s\n", count, ParentJob::NUM_CHILDREN, t, allOk ? "sums correct" : "SUMS WRONG");
+		if (!allOk)
+			return 1;
+	}
+
+	for (const JobStats::TypeStats &stats : JobStats::GetTypeStats()) {
+		printf("%s: %u queued, %u run, %u finished, %u cancelled\n",
+			stats.name.c_str(), stats.queued, stats.started, stats.finished, stats.cancelled);
+	}
+	if (argc > 1) {
+		FILE *f = fopen(argv[1], "w");
+		if (!f)
+			return 1;
+		JobStats::WriteTrace(f, 5.0);
+		fclose(f);
+	}
+
+	return 0;
+}
+#endif /* UNIT_TEST */
@@ -5,7 +5,9 @@
 #define JOBQUEUE_H
 
 #include "SDL_thread.h"
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <deque>
 #include <set>
 #include <string>
@@ -14,6 +16,7 @@
 static const Uint32 MAX_THREADS = 64;
 
 class JobClient;
+class JobCounter;
 class JobQueue;
 
 // represents a single unit of work that you want done
@@ -28,6 +31,12 @@ class JobQueue;
 // OnCancel: optional. called from the main thread to tell the job that its
 //           results are not wanted. it should arrange for OnRun to return
 //           as quickly as possible. OnFinish will not be called for the job
+//
+// GetPriority: optional. waiting jobs are run highest priority first. must
+//              return the same value for the life of the job
+//
+// GetName: optional. what the job is called in JobStats and the job trace.
+//          must return a string literal
 class Job {
 public:
 	// This is the RAII handle for a queued Job. A job is cancelled when the
@@ -70,9 +79,18 @@ public:
 	};
 
 public:
+	enum Priority {
+		PRIORITY_INTERACTIVE = 0, // terrain and textures the player is looking at
+		PRIORITY_NORMAL, // the default, e.g. filling the galaxy caches
+		PRIORITY_BACKGROUND, // nothing is waiting on the result
+		PRIORITY_COUNT
+	};
+
 	Job() :
 		cancelled(false),
-		m_handle(nullptr) {}
+		m_handle(nullptr),
+		m_counter(nullptr),
+		m_nextFinished(nullptr) {}
 	virtual ~Job();
 
 	Job(const Job &) = delete;
@@ -81,6 +99,20 @@ public:
 	virtual void OnRun() = 0;
 	virtual void OnFinish() = 0;
 	virtual void OnCancel() {}
+	virtual Priority GetPriority() const { return PRIORITY_NORMAL; }
+	virtual const char *GetName() const { return "Job"; }
+
+protected:
+	// call from OnRun to split the work up. the child is queued ahead of
+	// other jobs of its priority, counter goes up now and down again when
+	// the child's OnRun returns. children have no handle so can't be
+	// cancelled, but are otherwise finished and deleted like any other job.
+	// off the AsyncJobQueue workers the child is run straight away
+	void SpawnChild(Job *child, JobCounter &counter);
+
+	// call from OnRun to wait until all the children counted by counter have
+	// run. the worker runs other jobs while it waits
+	void WaitFor(JobCounter &counter);
 
 private:
 	friend class AsyncJobQueue;
@@ -94,6 +126,29 @@ private:
 
 	bool cancelled;
 	Handle *m_handle;
+	JobCounter *m_counter;
+	std::chrono::steady_clock::time_point m_queuedAt;
+
+	// for AsyncJobQueue's list of finished jobs
+	Job *m_nextFinished;
+	std::chrono::steady_clock::time_point m_finishedAt;
+};
+
+// counts the child jobs a job is waiting for, see Job::SpawnChild
+class JobCounter {
+public:
+	JobCounter() :
+		m_count(0) {}
+	JobCounter(const JobCounter &) = delete;
+	JobCounter &operator=(const JobCounter &) = delete;
+
+	bool IsDone() const { return m_count.load() == 0; }
+
+private:
+	friend class Job;
+	friend class AsyncJobQueue;
+
+	std::atomic<int> m_count;
 };
 
 // the queue management class. create one from the main thread, and feed your
@@ -155,12 +210,41 @@ public:
 	// - the job is running. OnCancel will be called
 	virtual void Cancel(Job *job) override;
 
-	// call from the main loop. this will call OnFinish for any finished jobs,
-	// and then delete all finished and cancelled jobs. returns the number of
-	// finished jobs (not cancelled)
+	// call from the main loop. this will call OnFinish for finished jobs, in
+	// the order they finished, and delete them and any cancelled jobs until
+	// the finish budget is used up. returns the number of finished jobs (not
+	// cancelled)
 	virtual Uint32 FinishJobs() override;
 
+	// how long FinishJobs may spend calling OnFinish, in milliseconds. it
+	// always finishes at least one job. 0, the default, finishes everything
+	// that's ready, e.g. for loading screens
+	void SetFinishBudget(double ms) { m_finishBudget = ms; }
+	double GetFinishBudget() const { return m_finishBudget; }
+
+	// counted since the last ClearFinishStats
+	struct FinishStats {
+		FinishStats() :
+			finished(0),
+			maxPending(0),
+			totalLatency(0.0),
+			maxLatency(0.0) {}
+
+		Uint32 finished; // jobs finished or cancelled by FinishJobs
+		Uint32 maxPending; // most finished jobs left waiting after a FinishJobs
+		double totalLatency; // seconds from OnRun returning to OnFinish, for the mean
+		double maxLatency;
+	};
+	const FinishStats &GetFinishStats() const { return m_finishStats; }
+	void ClearFinishStats() { m_finishStats = FinishStats(); }
+
+	// jobs not started yet, and finished jobs FinishJobs hasn't got to
+	Uint32 GetNumWaiting() const;
+	Uint32 GetNumPending() const { return m_numPending; }
+
 private:
+	friend class Job;
+
 	// a runner wraps a single thread, and calls into the queue when its ready for
 	// a new job. no user-servicable parts inside!
 	class JobRunner {
@@ -170,9 +254,13 @@ private:
 		SDL_mutex *GetQueueDestroyingLock();
 		void SetQueueDestroyed();
 
+		void Spawn(Job *child);
+		void WaitFor(JobCounter &counter);
+
 	private:
 		static int Trampoline(void *);
 		void Main();
+		bool RunJob(Job *job);
 
 		AsyncJobQueue *m_jobQueue;
 
@@ -187,19 +275,43 @@ private:
 		bool m_queueDestroyed;
 	};
 
-	Job *GetJob();
-	void Finish(Job *job, const uint8_t threadIdx);
-
-	std::deque<Job *> m_queue;
-	SDL_mutex *m_queueLock;
-	SDL_cond *m_queueWaitCond;
-
-	std::deque<Job *> m_finished[MAX_THREADS];
-	SDL_mutex *m_finishedLock[MAX_THREADS];
-
+	// the runner on this thread, if it is one
+	static thread_local JobRunner *s_currentRunner;
+
+	void Push(Job *job, const uint8_t threadIdx, const bool first);
+	Job *TakeJob(const uint8_t threadIdx);
+	Job *GetJob(const uint8_t threadIdx);
+	void WaitForWork(const JobCounter &counter);
+	void WakeWaiting();
+	void Finish(Job *job);
+	void CollectFinished();
+
+	// each runner has its own waiting jobs, one deque per priority. runners
+	// take their own first and then steal from the others, always looking
+	// for the highest priority job anyone has
+	std::deque<Job *> m_queue[MAX_THREADS][Job::PRIORITY_COUNT];
+	SDL_mutex *m_queueLock[MAX_THREADS];
+	std::atomic<Uint32> m_numWaiting[Job::PRIORITY_COUNT];
+	std::atomic<Uint32> m_nextQueue;
+
+	// runners with nothing to do, or waiting for child jobs running
+	// elsewhere, sleep on this
+	SDL_mutex *m_waitLock;
+	SDL_cond *m_waitCond;
+
+	// finished jobs, newest first. the runners push onto it without locking
+	// and FinishJobs takes the whole list at once
+	std::atomic<Job *> m_finished;
+	// taken from m_finished but not finished yet, oldest first. main thread only
+	std::deque<Job *> m_finishing;
+	std::atomic<Uint32> m_numPending;
+	double m_finishBudget;
+	FinishStats m_finishStats;
+
+	Uint32 m_numRunners;
 	std::vector<JobRunner *> m_runners;
 
-	bool m_shutdown;
+	std::atomic<bool> m_shutdown;
 };
 
 class SyncJobQueue : public JobQueue {
@@ -228,10 +340,11 @@ public:
 	// finished jobs (not cancelled)
 	virtual Uint32 FinishJobs() override;
 
+	// runs up to count waiting jobs, highest priority first
 	Uint32 RunJobs(Uint32 count = 1);
 
 private:
-	std::deque<Job *> m_queue;
+	std::deque<Job *> m_queue[Job::PRIORITY_COUNT];
 	std::deque<Job *> m_finished;
 };
 
@@ -0,0 +1,310 @@
+// Copyright © 2008-2019 Pioneer Developers. See AUTHORS.txt for details
+// Licensed under the terms of the GPL v3. See licenses/GPL-3.txt
+
+#include "JobStats.h"
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace JobStats {
+
+	namespace {
+		// per thread, enough for a few seconds of a busy frame
+		const size_t MAX_SPANS = 1 << 15;
+
+		struct Span {
+			const char *name;
+			Clock::time_point start;
+			Clock::time_point end;
+		};
+
+		// each thread records into its own, so the lock is only contended
+		// while somebody reads the stats
+		struct ThreadData {
+			ThreadData() :
+				busy(Clock::duration::zero()),
+				busySince(Clock::now()),
+				nextSpan(0) {}
+
+			std::mutex lock;
+			std::string name;
+			std::unordered_map<const char *, TypeStats> types;
+			Clock::duration busy;
+			Clock::time_point busySince;
+			std::vector<Span> spans; // ring, allocated on first use
+			size_t nextSpan;
+		};
+
+		const Clock::time_point s_epoch = Clock::now();
+
+		// guards the list, not what's in it. indexed by thread id, never shrinks
+		std::mutex s_threadsLock;
+		std::vector<std::unique_ptr<ThreadData>> s_threads;
+
+		thread_local ThreadData *s_thread = nullptr;
+
+		ThreadData *GetThreadData(Uint32 thread)
+		{
+			std::lock_guard<std::mutex> lock(s_threadsLock);
+			if (s_threads.size() <= thread)
+				s_threads.resize(thread + 1);
+			if (!s_threads[thread]) {
+				s_threads[thread].reset(new ThreadData);
+				if (thread == 0)
+					s_threads[thread]->name = "Main";
+			}
+			return s_threads[thread].get();
+		}
+
+		// threads that haven't called SetThread count as the main one
+		ThreadData &CurrentThread()
+		{
+			if (!s_thread)
+				s_thread = GetThreadData(0);
+			return *s_thread;
+		}
+
+		// the caller holds the thread's lock
+		TypeStats &GetType(ThreadData &data, const char *name)
+		{
+			TypeStats &stats = data.types[name];
+			if (stats.name.empty())
+				stats.name = name;
+			return stats;
+		}
+
+		void PushSpan(ThreadData &data, const char *name, Clock::time_point start, Clock::time_point end)
+		{
+			if (data.spans.empty())
+				data.spans.resize(MAX_SPANS);
+			data.spans[data.nextSpan % MAX_SPANS] = Span{ name, start, end };
+			data.nextSpan++;
+		}
+
+		// a snapshot of every thread's data, taken one at a time
+		template <typename F>
+		void ForEachThread(F f)
+		{
+			std::vector<ThreadData *> threads;
+			{
+				std::lock_guard<std::mutex> lock(s_threadsLock);
+				for (const auto &data : s_threads)
+					threads.push_back(data.get());
+			}
+			for (Uint32 i = 0; i < threads.size(); i++) {
+				if (!threads[i])
+					continue;
+				std::lock_guard<std::mutex> lock(threads[i]->lock);
+				f(i, *threads[i]);
+			}
+		}
+
+		double Microseconds(Clock::duration d)
+		{
+			return std::chrono::duration<double, std::micro>(d).count();
+		}
+
+		void WriteString(FILE *f, const std::string &s)
+		{
+			fputc('"', f);
+			for (char c : s) {
+				if (c == '"' || c == '\\')
+					fputc('\\', f);
+				if (Uint8(c) >= 0x20)
+					fputc(c, f);
+			}
+			fputc('"', f);
+		}
+
+		void WriteHistogram(FILE *f, const char *key, const Histogram &h)
+		{
+			int last = Histogram::NUM_BUCKETS;
+			while (last > 0 && !h.count[last - 1])
+				last--;
+			fprintf(f, ",\"%s\":[", key);
+			for (int i = 0; i < last; i++)
+				fprintf(f, i ? ",%u" : "%u", h.count[i]);
+			fputc(']', f);
+		}
+	} // namespace
+
+	Histogram::Histogram()
+	{
+		std::fill(count, count + NUM_BUCKETS, 0);
+	}
+
+	void Histogram::Add(Clock::duration d)
+	{
+		Uint64 us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+		int bucket = 0;
+		while (us && bucket < NUM_BUCKETS - 1) {
+			us >>= 1;
+			bucket++;
+		}
+		count[bucket]++;
+	}
+
+	void SetThread(Uint32 thread, const std::string &name)
+	{
+		s_thread = GetThreadData(thread);
+		std::lock_guard<std::mutex> lock(s_thread->lock);
+		s_thread->name = name;
+	}
+
+	void JobQueued(const char *name)
+	{
+		ThreadData &data = CurrentThread();
+		std::lock_guard<std::mutex> lock(data.lock);
+		GetType(data, name).queued++;
+	}
+
+	void JobRun(const char *name, Clock::time_point queued, Clock::time_point start, Clock::time_point end)
+	{
+		ThreadData &data = CurrentThread();
+		std::lock_guard<std::mutex> lock(data.lock);
+		TypeStats &stats = GetType(data, name);
+		stats.started++;
+		stats.waitTime.Add(start - queued);
+		stats.runTime.Add(end - start);
+		PushSpan(data, name, start, end);
+	}
+
+	void ThreadBusy(Clock::time_point start, Clock::time_point end)
+	{
+		ThreadData &data = CurrentThread();
+		std::lock_guard<std::mutex> lock(data.lock);
+		data.busy += end - std::max(start, data.busySince);
+	}
+
+	void JobFinished(const char *name, Clock::time_point start, Clock::time_point end)
+	{
+		ThreadData &data = CurrentThread();
+		std::lock_guard<std::mutex> lock(data.lock);
+		TypeStats &stats = GetType(data, name);
+		stats.finished++;
+		stats.finishTime.Add(end - start);
+		PushSpan(data, name, start, end);
+	}
+
+	void JobCancelled(const char *name)
+	{
+		ThreadData &data = CurrentThread();
+		std::lock_guard<std::mutex> lock(data.lock);
+		GetType(data, name).cancelled++;
+	}
+
+	void AddSpan(const char *name, Clock::time_point start, Clock::time_point end)
+	{
+		ThreadData &data = CurrentThread();
+		std::lock_guard<std::mutex> lock(data.lock);
+		PushSpan(data, name, start, end);
+	}
+
+	std::vector<TypeStats> GetTypeStats()
+	{
+		std::vector<TypeStats> result;
+		ForEachThread([&](Uint32, const ThreadData &data) {
+			for (const auto &it : data.types) {
+				// merged by name, as each thread (and the same literal in
+				// different files) has its own
+				auto merged = std::find_if(result.begin(), result.end(),
+					[&](const TypeStats &s) { return s.name == it.second.name; });
+				if (merged == result.end()) {
+					result.push_back(it.second);
+					continue;
+				}
+				merged->queued += it.second.queued;
+				merged->started += it.second.started;
+				merged->finished += it.second.finished;
+				merged->cancelled += it.second.cancelled;
+				for (int i = 0; i < Histogram::NUM_BUCKETS; i++) {
+					merged->waitTime.count[i] += it.second.waitTime.count[i];
+					merged->runTime.count[i] += it.second.runTime.count[i];
+					merged->finishTime.count[i] += it.second.finishTime.count[i];
+				}
+			}
+		});
+		std::sort(result.begin(), result.end(),
+			[](const TypeStats &a, const TypeStats &b) { return a.started > b.started; });
+		return result;
+	}
+
+	double GetUtilisation()
+	{
+		const Clock::time_point now = Clock::now();
+		double busy = 0.0, elapsed = 0.0;
+		ForEachThread([&](Uint32 thread, const ThreadData &data) {
+			if (thread == 0)
+				return;
+			busy += Microseconds(data.busy);
+			elapsed += Microseconds(now - data.busySince);
+		});
+		return elapsed > 0.0 ? std::min(busy / elapsed, 1.0) : 0.0;
+	}
+
+	void ClearUtilisation()
+	{
+		const Clock::time_point now = Clock::now();
+		ForEachThread([&](Uint32, ThreadData &data) {
+			data.busy = Clock::duration::zero();
+			data.busySince = now;
+		});
+	}
+
+	void WriteTrace(FILE *f, double seconds)
+	{
+		const Clock::time_point from = Clock::now() - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+
+		// copy it all out so the other threads aren't held up by the writing
+		std::vector<std::pair<Uint32, Span>> spans;
+		std::vector<std::pair<Uint32, std::string>> threadNames;
+		ForEachThread([&](Uint32 thread, const ThreadData &data) {
+			threadNames.emplace_back(thread, data.name);
+			const size_t count = std::min(data.nextSpan, MAX_SPANS);
+			for (size_t i = data.nextSpan - count; i < data.nextSpan; i++) {
+				const Span &span = data.spans[i % MAX_SPANS];
+				if (span.end >= from)
+					spans.emplace_back(thread, span);
+			}
+		});
+		const std::vector<TypeStats> types = GetTypeStats();
+
+		// either list may be empty, so each event after the first is preceded
+		// by a separator rather than followed by one
+		const char *separator = "";
+		fputs("{\"traceEvents\":[\n", f);
+		for (const auto &it : threadNames) {
+			fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":", separator, it.first);
+			WriteString(f, it.second);
+			fputs("}}", f);
+			separator = ",\n";
+		}
+		for (const auto &it : spans) {
+			const Span &span = it.second;
+			fprintf(f, "%s{\"name\":", separator);
+			WriteString(f, span.name);
+			fprintf(f, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%u}",
+				Microseconds(span.start - s_epoch), Microseconds(span.end - span.start), it.first);
+			separator = ",\n";
+		}
+		fputs("\n],\n\"displayTimeUnit\":\"ms\",\n", f);
+
+		// not part of the format, the viewer ignores it. histogram bucket n
+		// counts durations under 2^n microseconds
+		fputs("\"jobStats\":[\n", f);
+		for (size_t i = 0; i < types.size(); i++) {
+			const TypeStats &stats = types[i];
+			fputs("{\"name\":", f);
+			WriteString(f, stats.name);
+			fprintf(f, ",\"queued\":%u,\"started\":%u,\"finished\":%u,\"cancelled\":%u",
+				stats.queued, stats.started, stats.finished, stats.cancelled);
+			WriteHistogram(f, "waitTime", stats.waitTime);
+			WriteHistogram(f, "runTime", stats.runTime);
+			WriteHistogram(f, "finishTime", stats.finishTime);
+			fprintf(f, "}%s\n", i + 1 < types.size() ? "," : "");
+		}
+		fputs("]}\n", f);
+	}
+
+} // namespace JobStats
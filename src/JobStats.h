@@ -0,0 +1,95 @@
+// Copyright © 2008-2019 Pioneer Developers. See AUTHORS.txt for details
+// Licensed under the terms of the GPL v3. See licenses/GPL-3.txt
+
+#ifndef JOBSTATS_H
+#define JOBSTATS_H
+
+#include "SDL_stdinc.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Counters and timings for the jobs run by AsyncJobQueue, plus a trace of
+// the last few seconds of jobs and main loop spans that can be written out
+// for chrome://tracing. Always kept, so stalls can be looked into without a
+// profiler build. Everything here can be called from any thread.
+//
+// Names are expected to be string literals (see Job::GetName) and are kept
+// by pointer.
+namespace JobStats {
+	typedef std::chrono::steady_clock Clock;
+
+	// durations bucketed by powers of two: count[n] holds those under 2^n
+	// microseconds, the last bucket everything longer
+	struct Histogram {
+		static const int NUM_BUCKETS = 24;
+
+		Histogram();
+		void Add(Clock::duration d);
+
+		Uint32 count[NUM_BUCKETS];
+	};
+
+	// since startup, for all the jobs with the same name
+	struct TypeStats {
+		TypeStats() :
+			queued(0),
+			started(0),
+			finished(0),
+			cancelled(0) {}
+
+		std::string name;
+		Uint32 queued;
+		Uint32 started;
+		Uint32 finished; // OnFinish called
+		Uint32 cancelled; // cancelled before or after running, OnFinish not called
+		Histogram waitTime; // queued until OnRun starts
+		Histogram runTime; // OnRun
+		Histogram finishTime; // OnFinish
+	};
+
+	// spans are recorded against the calling thread. the main thread is 0,
+	// others must say who they are before recording anything
+	void SetThread(Uint32 thread, const std::string &name);
+
+	void JobQueued(const char *name);
+	void JobRun(const char *name, Clock::time_point queued, Clock::time_point start, Clock::time_point end);
+	// the calling thread was running a job, counted once however many jobs
+	// it ran inside each other
+	void ThreadBusy(Clock::time_point start, Clock::time_point end);
+	void JobFinished(const char *name, Clock::time_point start, Clock::time_point end);
+	void JobCancelled(const char *name);
+
+	// adds a span to the trace for the calling thread
+	void AddSpan(const char *name, Clock::time_point start, Clock::time_point end);
+
+	class ScopedSpan {
+	public:
+		explicit ScopedSpan(const char *name) :
+			m_name(name),
+			m_start(Clock::now()) {}
+		~ScopedSpan() { AddSpan(m_name, m_start, Clock::now()); }
+
+		ScopedSpan(const ScopedSpan &) = delete;
+		ScopedSpan &operator=(const ScopedSpan &) = delete;
+
+	private:
+		const char *m_name;
+		Clock::time_point m_start;
+	};
+
+	// merged by name, most run first
+	std::vector<TypeStats> GetTypeStats();
+
+	// fraction of the time since the last ClearUtilisation that threads other
+	// than the main one spent running jobs, averaged over those threads
+	double GetUtilisation();
+	void ClearUtilisation();
+
+	// writes the spans of the last seconds, and the per job type stats, as
+	// chrome trace_event JSON
+	void WriteTrace(FILE *f, double seconds);
+} // namespace JobStats
+
+#endif
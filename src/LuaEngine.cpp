@@ -162,6 +162,43 @@ static int l_engine_quit(lua_State *l)
 	return 0;
 }
 
+/*
+ * Function: DumpJobTrace
+ *
+ * Write the background jobs and main loop spans of the last few seconds to a
+ * file in the user's traces folder, for loading into chrome://tracing. Also
+ * includes counts and timings for each kind of job since startup.
+ *
+ * > path = Engine.DumpJobTrace(seconds)
+ *
+ * Parameters:
+ *
+ *   seconds - optional. how far back to go, 10 by default
+ *
+ * Return:
+ *
+ *   path - the file written, relative to the user folder, or nil if it
+ *          couldn't be written
+ *
+ * Availability:
+ *
+ *   2019-08
+ *
+ * Status:
+ *
+ *   debug
+ */
+static int l_engine_dump_job_trace(lua_State *l)
+{
+	const double seconds = luaL_optnumber(l, 1, 10.0);
+	const std::string path = Pi::DumpJobTrace(seconds);
+	if (path.empty())
+		lua_pushnil(l);
+	else
+		lua_pushlstring(l, path.c_str(), path.size());
+	return 1;
+}
+
 /*
  * Method: GetVideoModeList
  *
@@ -1102,6 +1139,7 @@ void LuaEngine::Register()
 
 	static const luaL_Reg l_methods[] = {
 		{ "Quit", l_engine_quit },
+		{ "DumpJobTrace", l_engine_dump_job_trace },
 
 		{ "GetVideoModeList", l_engine_get_video_mode_list },
 		{ "GetMaximumAASamples", l_engine_get_maximum_aa_samples },
@@ -33,6 +33,7 @@ static bool GetNameGenFunc(lua_State *l, const char *func)
 
 std::string LuaNameGen::FullName(bool isFemale, RefCountedPtr<Random> &rng)
 {
+	std::lock_guard<std::mutex> lock(m_lock);
 	lua_State *l = m_luaManager->GetLuaState();
 
 	if (!GetNameGenFunc(l, "FullName"))
@@ -50,6 +51,7 @@ std::string LuaNameGen::FullName(bool isFemale, RefCountedPtr<Random> &rng)
 
 std::string LuaNameGen::Surname(RefCountedPtr<Random> &rng)
 {
+	std::lock_guard<std::mutex> lock(m_lock);
 	lua_State *l = m_luaManager->GetLuaState();
 
 	if (!GetNameGenFunc(l, "Surname"))
@@ -66,6 +68,7 @@ std::string LuaNameGen::Surname(RefCountedPtr<Random> &rng)
 
 std::string LuaNameGen::BodyName(SystemBody *body, RefCountedPtr<Random> &rng)
 {
+	std::lock_guard<std::mutex> lock(m_lock);
 	lua_State *l = m_luaManager->GetLuaState();
 
 	if (!GetNameGenFunc(l, "BodyName"))
@@ -5,6 +5,7 @@
 #define _LUANAMEGEN_H
 
 #include "RefCounted.h"
+#include <mutex>
 #include <string>
 
 class LuaManager;
@@ -22,6 +23,7 @@ public:
 
 private:
 	LuaManager *m_luaManager;
+	std::mutex m_lock; // star systems may be generated on worker threads (see Galaxy::Dump)
 };
 
 #endif
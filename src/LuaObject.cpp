@@ -160,10 +160,7 @@ int LuaObjectBase::l_unsetprop(lua_State *l)
 	PropertiedObject *po = dynamic_cast<PropertiedObject *>(o);
 	assert(po);
 
-	po->Properties().PushLuaTable();
-	lua_pushvalue(l, 2);
-	lua_pushnil(l);
-	lua_settable(l, -3);
+	po->Properties().Unset(key);
 
 	return 0;
 }
@@ -644,7 +644,10 @@ static int l_space_get_bodies(lua_State *l)
 
 	lua_newtable(l);
 
-	for (Body *b : Pi::game->GetSpace()->GetBodies()) {
+	// the filter could spawn bodies, so no iterators
+	Space *space = Pi::game->GetSpace();
+	for (Uint32 i = 0; i < space->GetNumBodies(); i++) {
+		Body *b = space->GetBodies()[i];
 		if (filter) {
 			lua_pushvalue(l, 1);
 			LuaObject<Body>::PushToLua(b);
@@ -8,6 +8,7 @@
 #include "Pi.h"
 #include "galaxy/Galaxy.h"
 #include "galaxy/GalaxyCache.h"
+#include "galaxy/JumpRouter.h"
 #include "galaxy/Sector.h"
 #include "galaxy/StarSystem.h"
 #include "galaxy/SystemPath.h"
@@ -320,6 +321,121 @@ static int l_sbodypath_distance_to(lua_State *l)
 	return 1;
 }
 
+/*
+ * Method: GetRouteTo
+ *
+ * Plan a chain of hyperspace jumps from this system to another
+ *
+ * > route = path:GetRouteTo(target, range, optimise)
+ *
+ * Parameters:
+ *
+ *   target - a <SystemPath> for the system to travel to
+ *
+ *   range - the longest single jump, in light years
+ *
+ *   optimise - optional. "duration" (the default) to minimise the total time
+ *              spent in hyperspace, "distance" to minimise the distance
+ *              travelled, or "jumps" to use as few jumps as possible
+ *
+ * Return:
+ *
+ *   route - an array of <SystemPath> objects for each system jumped to,
+ *           ending with the target, or nil if there is no route
+ *
+ * Availability:
+ *
+ *   2019-10
+ *
+ * Status:
+ *
+ *   experimental
+ */
+static int l_sbodypath_get_route_to(lua_State *l)
+{
+	LUA_DEBUG_START(l);
+
+	const SystemPath *from = LuaObject<SystemPath>::CheckFromLua(1);
+	const SystemPath *to = LuaObject<SystemPath>::CheckFromLua(2);
+	const float range = luaL_checknumber(l, 3);
+	const std::string optimise = luaL_optstring(l, 4, "duration");
+
+	if (!from->HasValidSystem())
+		return luaL_error(l, "SystemPath:GetRouteTo() self argument does not refer to a system");
+	if (!to->HasValidSystem())
+		return luaL_error(l, "SystemPath:GetRouteTo() argument #1 does not refer to a system");
+
+	JumpRouter::CostModel cost;
+	if (optimise == "duration")
+		cost = JumpRouter::CostModel::Duration(range, 1.f); // the scale doesn't change the route
+	else if (optimise == "distance")
+		cost = JumpRouter::CostModel::Distance(range);
+	else if (optimise == "jumps")
+		cost = JumpRouter::CostModel::Jumps(range);
+	else
+		return luaL_error(l, "SystemPath:GetRouteTo() unknown optimisation '%s'", optimise.c_str());
+
+	std::vector<SystemPath> route;
+	if (!Pi::game->GetGalaxy()->GetJumpRouter().FindRoute(*from, *to, cost, route)) {
+		lua_pushnil(l);
+		LUA_DEBUG_END(l, 1);
+		return 1;
+	}
+
+	lua_createtable(l, route.size(), 0);
+	int i = 1;
+	for (const SystemPath &p : route) {
+		LuaObject<SystemPath>::PushToLua(p);
+		lua_rawseti(l, -2, i++);
+	}
+
+	LUA_DEBUG_END(l, 1);
+	return 1;
+}
+
+/*
+ * Function: SearchByName
+ *
+ * Find systems by name among every sector generated so far
+ *
+ * > paths = SystemPath.SearchByName(pattern)
+ *
+ * Parameters:
+ *
+ *   pattern - text to look for anywhere in the names of systems, ignoring
+ *             case. Other names of a system are searched as well.
+ *
+ * Return:
+ *
+ *   paths - an array of <SystemPath> objects for the matching systems, each
+ *           listed once
+ *
+ * Availability:
+ *
+ *   2019-10
+ *
+ * Status:
+ *
+ *   experimental
+ */
+static int l_sbodypath_search_by_name(lua_State *l)
+{
+	LUA_DEBUG_START(l);
+
+	const std::string pattern = luaL_checkstring(l, 1);
+	const std::vector<SystemPath> matches = Pi::game->GetGalaxy()->GetSystemNameIndex().Search(pattern);
+
+	lua_createtable(l, matches.size(), 0);
+	int i = 1;
+	for (const SystemPath &p : matches) {
+		LuaObject<SystemPath>::PushToLua(p);
+		lua_rawseti(l, -2, i++);
+	}
+
+	LUA_DEBUG_END(l, 1);
+	return 1;
+}
+
 /*
  * Method: GetStarSystem
  *
@@ -672,6 +788,8 @@ void LuaObject<SystemPath>::RegisterClass()
 		{ "SectorOnly", l_sbodypath_sector_only },
 
 		{ "DistanceTo", l_sbodypath_distance_to },
+		{ "GetRouteTo", l_sbodypath_get_route_to },
+		{ "SearchByName", l_sbodypath_search_by_name },
 
 		{ "GetStarSystem", l_sbodypath_get_star_system },
 		{ "GetSystemBody", l_sbodypath_get_system_body },
@@ -7,64 +7,55 @@
 #include "LuaObject.h"
 #include "LuaUtils.h"
 #include "Pi.h"
+#include <algorithm>
 
 void LuaTimer::RemoveAll()
 {
-	lua_State *l = Lua::manager->GetLuaState();
+	m_timers.clear();
+}
+
+void LuaTimer::Add(double at, double every, const LuaRef &callback)
+{
+	Push(Timer{ at, every, m_nextOrder++, callback });
+}
 
-	lua_pushnil(l);
-	lua_setfield(l, LUA_REGISTRYINDEX, "PiTimerCallbacks");
+void LuaTimer::Push(const Timer &timer)
+{
+	m_timers.push_back(timer);
+	std::push_heap(m_timers.begin(), m_timers.end(), DueLater);
 }
 
 void LuaTimer::Tick()
 {
 	assert(Pi::game);
-	lua_State *l = Lua::manager->GetLuaState();
 
-	LUA_DEBUG_START(l);
-
-	lua_getfield(l, LUA_REGISTRYINDEX, "PiTimerCallbacks");
-	if (lua_isnil(l, -1)) {
-		lua_pop(l, 1);
-		LUA_DEBUG_END(l, 0);
+	// usually nothing is due, so this is all we do
+	const double now = Pi::game->GetTime();
+	if (m_timers.empty() || m_timers.front().at > now)
 		return;
-	}
-	assert(lua_istable(l, -1));
-
-	double now = Pi::game->GetTime();
-
-	lua_pushnil(l);
-	while (lua_next(l, -2)) {
-		assert(lua_istable(l, -1));
 
-		lua_getfield(l, -1, "at");
-		double at = lua_tonumber(l, -1);
-		lua_pop(l, 1);
+	lua_State *l = Lua::manager->GetLuaState();
 
-		if (at <= now) {
-			lua_getfield(l, -1, "callback");
-			pi_lua_protected_call(l, 0, 1);
-			bool cancel = lua_toboolean(l, -1);
-			lua_pop(l, 1);
+	LUA_DEBUG_START(l);
 
-			lua_getfield(l, -1, "every");
-			if (lua_isnil(l, -1) || cancel) {
-				lua_pop(l, 1);
+	// timers added or repeated by the callbacks are due after now, so this
+	// only fires the ones that were due when we started
+	while (!m_timers.empty() && m_timers.front().at <= now) {
+		std::pop_heap(m_timers.begin(), m_timers.end(), DueLater);
+		Timer timer = m_timers.back();
+		m_timers.pop_back();
 
-				lua_pushvalue(l, -2);
-				lua_pushnil(l);
-				lua_settable(l, -5);
-			} else {
-				double every = lua_tonumber(l, -1);
-				lua_pop(l, 1);
+		timer.callback.PushCopyToStack();
+		pi_lua_protected_call(l, 0, 1);
+		bool cancel = lua_toboolean(l, -1);
+		lua_pop(l, 1);
 
-				pi_lua_settable(l, "at", Pi::game->GetTime() + every);
-			}
+		if (timer.every > 0.0 && !cancel) {
+			timer.at = Pi::game->GetTime() + timer.every;
+			timer.order = m_nextOrder++;
+			Push(timer);
 		}
-
-		lua_pop(l, 1);
 	}
-	lua_pop(l, 1);
 
 	LUA_DEBUG_END(l, 0);
 }
@@ -105,28 +96,6 @@ void LuaTimer::Tick()
  * underlying object exists before trying to use it.
  */
 
-static void _finish_timer_create(lua_State *l)
-{
-	lua_pushstring(l, "callback");
-	lua_pushvalue(l, 3);
-	lua_settable(l, -3);
-
-	lua_getfield(l, LUA_REGISTRYINDEX, "PiTimerCallbacks");
-	if (lua_isnil(l, -1)) {
-		lua_pop(l, 1);
-		lua_newtable(l);
-		lua_pushvalue(l, -1);
-		lua_setfield(l, LUA_REGISTRYINDEX, "PiTimerCallbacks");
-	}
-
-	lua_insert(l, -2);
-	lua_pushinteger(l, lua_rawlen(l, -2) + 1);
-	lua_insert(l, -2);
-	lua_settable(l, -3);
-
-	lua_pop(l, 1);
-}
-
 /*
  * Method: CallAt
  *
@@ -171,14 +140,7 @@ static int l_timer_call_at(lua_State *l)
 	if (at <= Pi::game->GetTime())
 		luaL_error(l, "Specified time is in the past");
 
-	LUA_DEBUG_START(l);
-
-	lua_newtable(l);
-	pi_lua_settable(l, "at", at);
-
-	_finish_timer_create(l);
-
-	LUA_DEBUG_END(l, 0);
+	Pi::luaTimer->Add(at, 0.0, LuaRef(l, 3));
 
 	return 0;
 }
@@ -236,15 +198,7 @@ static int l_timer_call_every(lua_State *l)
 	if (every <= 0)
 		luaL_error(l, "Specified interval must be greater than zero");
 
-	LUA_DEBUG_START(l);
-
-	lua_newtable(l);
-	pi_lua_settable(l, "every", every);
-	pi_lua_settable(l, "at", Pi::game->GetTime() + every);
-
-	_finish_timer_create(l);
-
-	LUA_DEBUG_END(l, 0);
+	Pi::luaTimer->Add(Pi::game->GetTime() + every, every, LuaRef(l, 3));
 
 	return 0;
 }
@@ -6,11 +6,35 @@
 
 #include "DeleteEmitter.h"
 #include "LuaManager.h"
+#include "LuaRef.h"
+#include <vector>
 
 class LuaTimer : public DeleteEmitter {
 public:
+	LuaTimer() :
+		m_nextOrder(0) {}
+
 	void Tick();
 	void RemoveAll();
+
+	// every is 0 for a timer that only fires once
+	void Add(double at, double every, const LuaRef &callback);
+
+private:
+	struct Timer {
+		double at;
+		double every;
+		Uint64 order; // timers due at the same time fire in the order they were added
+		LuaRef callback;
+	};
+
+	// the heap puts the one that is due first at the front
+	static bool DueLater(const Timer &a, const Timer &b) { return a.at > b.at || (a.at == b.at && a.order > b.order); }
+
+	void Push(const Timer &timer);
+
+	std::vector<Timer> m_timers; // a heap, see DueLater
+	Uint64 m_nextOrder;
 };
 
 #endif
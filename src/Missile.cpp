@@ -129,14 +129,19 @@ void Missile::StaticUpdate(const float timeStep)
 	}
 }
 
-void Missile::TimeStepUpdate(const float timeStep)
+void Missile::ParallelTimeStepUpdate(const float timeStep)
 {
 
 	const vector3d thrust = GetPropulsion()->GetActualLinThrust();
 	AddRelForce(thrust);
 	AddRelTorque(GetPropulsion()->GetActualAngThrust());
 
-	DynamicBody::TimeStepUpdate(timeStep);
+	DynamicBody::ParallelTimeStepUpdate(timeStep);
+}
+
+void Missile::SerialTimeStepUpdate(const float timeStep)
+{
+	DynamicBody::SerialTimeStepUpdate(timeStep);
 	GetPropulsion()->UpdateFuel(timeStep);
 
 	const float MISSILE_DETECTION_RADIUS = 100.0f;
@@ -17,10 +17,12 @@ public:
 	Missile(const Json &jsonObj, Space *space);
 	virtual ~Missile();
 	void StaticUpdate(const float timeStep) override;
-	void TimeStepUpdate(const float timeStep) override;
+	void ParallelTimeStepUpdate(const float timeStep) override;
+	void SerialTimeStepUpdate(const float timeStep) override;
 	virtual bool OnCollision(Object *o, Uint32 flags, double relVel) override;
 	virtual bool OnDamage(Object *attacker, float kgDamage, const CollisionContact &contactData) override;
 	virtual void NotifyRemoved(const Body *const removedBody) override;
+	virtual bool WantsAllRemovalNotifications() const override { return true; }
 	virtual void PostLoadFixup(Space *space) override;
 	virtual void Render(Graphics::Renderer *r, const Camera *camera, const vector3d &viewCoords, const matrix4x4d &viewTransform) override;
 	void ECMAttack(int power_val);
@@ -17,7 +17,10 @@
 #include "GameConfig.h"
 #include "GameLog.h"
 #include "GameSaveError.h"
+#include "GeoPatch.h"
+#include "GeoSphere.h"
 #include "Intro.h"
+#include "JobStats.h"
 #include "KeyBindings.h"
 #include "Lang.h"
 #include "LuaColor.h"
@@ -76,6 +79,7 @@
 #include "Tombstone.h"
 #include "UIView.h"
 #include "WorldView.h"
+#include "collider/CollisionSpace.h"
 #include "galaxy/GalaxyGenerator.h"
 #include "galaxy/StarSystem.h"
 #include "gameui/Lua.h"
@@ -172,6 +176,98 @@ std::unique_ptr<SyncJobQueue> Pi::syncJobQueue;
 // Leaving define in place in case of future rendering problems.
 #define USE_RTT 0
 
+//#define BENCHMARK_COLLIDER
+
+#ifdef BENCHMARK_COLLIDER
+#include "CollMesh.h"
+#include "collider/CollisionContact.h"
+#include "collider/Geom.h"
+#include "collider/GeomTree.h"
+
+namespace {
+	Uint32 s_benchmarkContacts;
+	void BenchmarkContactCallback(CollisionContact *c) { s_benchmarkContacts++; }
+
+	// load every shipped ship and station model, then time rays traced at
+	// its collision mesh and the mesh collided with a copy of itself, placed
+	// and turned at random so that most pairs overlap
+	void BenchmarkCollider()
+	{
+		const Uint32 NUM_RAYS = 10000;
+		const Uint32 NUM_COLLIDES = 100;
+
+		std::vector<std::string> names;
+		const char *dirs[] = { "models/ships", "models/stations" };
+		for (const char *dir : dirs) {
+			for (FileSystem::FileEnumerator files(FileSystem::gameDataFiles, dir, FileSystem::FileEnumerator::Recurse); !files.Finished(); files.Next()) {
+				const std::string &name = files.Current().GetName();
+				if (ends_with_ci(name, ".model"))
+					names.push_back(name.substr(0, name.size() - 6));
+				else if (ends_with_ci(name, ".sgm"))
+					names.push_back(name.substr(0, name.size() - 4));
+			}
+		}
+		std::sort(names.begin(), names.end());
+		names.erase(std::unique(names.begin(), names.end()), names.end());
+
+		Random rand(1);
+		Profiler::Timer totalTraceTimer, totalCollideTimer;
+		Uint32 numModels = 0;
+		for (const std::string &name : names) {
+			SceneGraph::Model *model = Pi::FindModel(name, false);
+			if (!model) continue;
+			RefCountedPtr<CollMesh> collMesh = model->GetCollisionMesh();
+			if (!collMesh) collMesh = model->CreateCollisionMesh();
+			const GeomTree *tree = collMesh->GetGeomTree();
+			if (!tree || !tree->GetNumTris()) continue;
+			numModels++;
+
+			// rays start well outside the mesh and are aimed at points
+			// inside its bounding box, so some hit and some pass through gaps
+			const Aabb &aabb = collMesh->GetAabb();
+			const double radius = aabb.GetRadius();
+			Uint32 hits = 0;
+			Profiler::Timer traceTimer;
+			for (Uint32 i = 0; i < NUM_RAYS; i++) {
+				const vector3d start = 2.0 * radius * vector3d(rand.Normal(), rand.Normal(), rand.Normal()).Normalized();
+				const vector3d target(
+					aabb.min.x + rand.Double() * (aabb.max.x - aabb.min.x),
+					aabb.min.y + rand.Double() * (aabb.max.y - aabb.min.y),
+					aabb.min.z + rand.Double() * (aabb.max.z - aabb.min.z));
+				isect_t isect;
+				isect.dist = float(4.0 * radius);
+				isect.triIdx = -1;
+				traceTimer.Start();
+				tree->TraceRay(vector3f(start), vector3f((target - start).Normalized()), &isect);
+				traceTimer.Stop();
+				if (isect.triIdx != -1) hits++;
+			}
+
+			// Geom::Collide runs CollideEdgesWithTrisOf each way round
+			s_benchmarkContacts = 0;
+			Geom a(tree, matrix4x4d::Identity(), vector3d(0.0), nullptr);
+			Profiler::Timer collideTimer;
+			for (Uint32 i = 0; i < NUM_COLLIDES; i++) {
+				const matrix4x4d orient = matrix4x4d::RotateXMatrix(rand.Double(2.0 * M_PI)) *
+					matrix4x4d::RotateYMatrix(rand.Double(2.0 * M_PI)) * matrix4x4d::RotateZMatrix(rand.Double(2.0 * M_PI));
+				const vector3d pos = radius * vector3d(rand.Normal(), rand.Normal(), rand.Normal()) * 0.5;
+				Geom b(tree, orient, pos, nullptr);
+				collideTimer.Start();
+				a.Collide(&b, BenchmarkContactCallback);
+				collideTimer.Stop();
+			}
+
+			Output("BenchmarkCollider: %s, %d tris, %u TraceRay (%u hit) took %lf, %u Collide (%u contacts) took %lf milliseconds\n",
+				name.c_str(), tree->GetNumTris(), NUM_RAYS, hits, traceTimer.millicycles(), NUM_COLLIDES, s_benchmarkContacts, collideTimer.millicycles());
+			totalTraceTimer += traceTimer;
+			totalCollideTimer += collideTimer;
+		}
+		Output("BenchmarkCollider: %u models, TraceRay took %lf, Collide took %lf milliseconds in all\n",
+			numModels, totalTraceTimer.millicycles(), totalCollideTimer.millicycles());
+	}
+} // namespace
+#endif
+
 //static
 void Pi::CreateRenderTarget(const Uint16 width, const Uint16 height)
 {
@@ -262,6 +358,23 @@ void Pi::EndRenderTarget()
 #endif
 }
 
+// SDL_GetTicks() when a game started delivering jobs without a budget, 0 if not
+static Uint32 s_loadingJobsSince = 0;
+// a game still filling in after this long gets the budget back anyway
+static const Uint32 MAX_LOADING_JOBS_TICKS = 5000;
+
+void Pi::BeginLoadingJobs()
+{
+	asyncJobQueue->SetFinishBudget(0.0);
+	s_loadingJobsSince = std::max(SDL_GetTicks(), 1U);
+}
+
+void Pi::EndLoadingJobs()
+{
+	asyncJobQueue->SetFinishBudget(config->Float("JobFinishBudgetMs"));
+	s_loadingJobsSince = 0;
+}
+
 static void draw_progress(float progress)
 {
 
@@ -381,6 +494,27 @@ std::string Pi::GetSaveDir()
 	return FileSystem::JoinPath(FileSystem::GetUserDir(), Pi::SAVE_DIR_NAME);
 }
 
+std::string Pi::DumpJobTrace(double seconds)
+{
+	char buf[256];
+	const time_t t = time(0);
+	struct tm *_tm = localtime(&t);
+	strftime(buf, sizeof(buf), "jobtrace-%Y%m%d-%H%M%S.json", _tm);
+	const std::string dir = "traces";
+	FileSystem::userFiles.MakeDirectory(dir);
+	const std::string fname = FileSystem::JoinPathBelow(dir, buf);
+
+	FILE *f = FileSystem::userFiles.OpenWriteStream(fname, FileSystem::FileSourceFS::WRITE_TEXT);
+	if (!f) {
+		Output("Couldn't open %s to write the job trace\n", fname.c_str());
+		return std::string();
+	}
+	JobStats::WriteTrace(f, seconds);
+	fclose(f);
+	Output("Job trace of the last %.0f seconds written to %s\n", seconds, fname.c_str());
+	return fname;
+}
+
 void TestGPUJobsSupport()
 {
 	bool supportsGPUJobs = (Pi::config->Int("EnableGPUJobs") == 1);
@@ -543,6 +677,7 @@ void Pi::Init(const std::map<std::string, std::string> &options, bool no_gui)
 	assert(numCores > 0);
 	if (numThreads == 0) numThreads = std::max(Uint32(numCores) - 1, 1U);
 	asyncJobQueue.reset(new AsyncJobQueue(numThreads));
+	BeginLoadingJobs();
 	Output("started %d worker threads\n", numThreads);
 	syncJobQueue.reset(new SyncJobQueue);
 
@@ -631,6 +766,10 @@ void Pi::Init(const std::map<std::string, std::string> &options, bool no_gui)
 	SpaceStation::Init();
 	draw_progress(0.7f);
 
+#ifdef BENCHMARK_COLLIDER
+	BenchmarkCollider();
+#endif
+
 	Output("NavLights::Init\n");
 	NavLights::Init(Pi::renderer);
 	draw_progress(0.75f);
@@ -777,6 +916,8 @@ void Pi::Init(const std::map<std::string, std::string> &options, bool no_gui)
 	Profiler::dumphtml(profilerPath.c_str());
 #endif
 	Output("\n\nLoading took: %lf milliseconds\n", timer.millicycles());
+
+	EndLoadingJobs();
 }
 
 bool Pi::IsConsoleActive()
@@ -899,6 +1040,10 @@ void Pi::HandleKeyDown(SDL_Keysym *key)
 			Pi::showDebugInfo = !Pi::showDebugInfo;
 			break;
 
+		case SDLK_j: // Dump a trace of the last few seconds of jobs
+			DumpJobTrace(10.0);
+			break;
+
 #ifdef PIONEER_PROFILER
 		case SDLK_p: // alert it that we want to profile
 			if (input.KeyState(SDLK_LSHIFT) || input.KeyState(SDLK_RSHIFT))
@@ -1295,6 +1440,9 @@ void Pi::Start(const SystemPath &startPath)
 	delete Pi::intro;
 	Pi::intro = 0;
 
+	// until the game has received what it queued while starting up
+	BeginLoadingJobs();
+
 	InitGame();
 	StartGame();
 	MainLoop();
@@ -1333,6 +1481,9 @@ void Pi::EndGame()
 	delete game;
 	game = 0;
 	player = 0;
+
+	if (s_loadingJobsSince)
+		EndLoadingJobs();
 }
 
 void Pi::MainLoop()
@@ -1365,6 +1516,7 @@ void Pi::MainLoop()
 
 	while (Pi::game) {
 		PROFILE_SCOPED()
+		JobStats::ScopedSpan frameSpan("Frame");
 
 #ifdef ENABLE_SERVER_AGENT
 		Pi::serverAgent->ProcessResponses();
@@ -1380,6 +1532,7 @@ void Pi::MainLoop()
 		const float step = Pi::game->GetTimeStep();
 		if (step > 0.0f) {
 			PROFILE_SCOPED_RAW("unpaused")
+			JobStats::ScopedSpan physicsSpan("Physics");
 			int phys_ticks = 0;
 			while (accumulator >= step) {
 				if (++phys_ticks >= MAX_PHYSICS_TICKS) {
@@ -1427,6 +1580,7 @@ void Pi::MainLoop()
 			}
 		}
 
+		const JobStats::Clock::time_point renderStart = JobStats::Clock::now();
 		Pi::BeginRenderTarget();
 		Pi::renderer->SetViewport(0, 0, Graphics::GetScreenWidth(), Graphics::GetScreenHeight());
 		Pi::renderer->BeginFrame();
@@ -1495,6 +1649,7 @@ void Pi::MainLoop()
 #endif
 
 		Pi::renderer->SwapBuffers();
+		JobStats::AddSpan("Render", renderStart, JobStats::Clock::now());
 
 		// game exit will have cleared Pi::game. we can't continue.
 		if (!Pi::game)
@@ -1514,6 +1669,8 @@ void Pi::MainLoop()
 		syncJobQueue->RunJobs(SYNC_JOBS_PER_LOOP);
 		asyncJobQueue->FinishJobs();
 		syncJobQueue->FinishJobs();
+		if (s_loadingJobsSince && (!asyncJobQueue->GetNumWaiting() || SDL_GetTicks() - s_loadingJobsSince > MAX_LOADING_JOBS_TICKS))
+			EndLoadingJobs();
 
 		HandleRequests();
 
@@ -1526,6 +1683,8 @@ void Pi::MainLoop()
 			const Graphics::Stats::TFrameData &stats = Pi::renderer->GetStats().FrameStatsPrevious();
 			const Uint32 numDrawCalls = stats.m_stats[Graphics::Stats::STAT_DRAWCALL];
 			const Uint32 numBuffersCreated = stats.m_stats[Graphics::Stats::STAT_CREATE_BUFFER];
+			const Uint32 numBuffersDestroyed = stats.m_stats[Graphics::Stats::STAT_DESTROY_BUFFER];
+			const Uint32 numBuffersReused = stats.m_stats[Graphics::Stats::STAT_REUSE_BUFFER];
 			const Uint32 numDrawTris = stats.m_stats[Graphics::Stats::STAT_DRAWTRIS];
 			const Uint32 numDrawPointSprites = stats.m_stats[Graphics::Stats::STAT_DRAWPOINTSPRITES];
 			const Uint32 numDrawBuildings = stats.m_stats[Graphics::Stats::STAT_BUILDINGS];
@@ -1539,6 +1698,11 @@ void Pi::MainLoop()
 			const Uint32 numDrawStars = stats.m_stats[Graphics::Stats::STAT_STARS];
 			const Uint32 numDrawShips = stats.m_stats[Graphics::Stats::STAT_SHIPS];
 			const Uint32 numDrawBillBoards = stats.m_stats[Graphics::Stats::STAT_BILLBOARD];
+			const Uint32 numCollisionPairs = CollisionSpace::GetNumPairsTested() / std::max(phys_stat, 1);
+			const AsyncJobQueue::FinishStats &jobStats = asyncJobQueue->GetFinishStats();
+			const double jobMeanLatency = jobStats.finished ? jobStats.totalLatency * 1000.0 / jobStats.finished : 0.0;
+			GeoPatchMemoryUsage terrainMem;
+			GeoSphere::GetAllMemoryUsage(terrainMem);
 			snprintf(
 				fps_readout, sizeof(fps_readout),
 				"%d fps (%.1f ms/f), %d phys updates, %d triangles, %.3f M tris/sec, %d glyphs/sec, %d patches/frame\n"
@@ -1546,15 +1710,25 @@ void Pi::MainLoop()
 				"Draw Calls (%u), of which were:\n Tris (%u)\n Point Sprites (%u)\n Billboards (%u)\n"
 				"Buildings (%u), Cities (%u), GroundStations (%u), SpaceStations (%u), Atmospheres (%u)\n"
 				"Patches (%u), Planets (%u), GasGiants (%u), Stars (%u), Ships (%u)\n"
-				"Buffers Created(%u)\n",
+				"Buffers Created(%u), Destroyed(%u), Reused(%u)\n"
+				"Collision Pairs Tested (%u/tick)\n"
+				"Terrain Patches (%u): heights %u KB, mesh data %u KB, vertex buffers %u KB\n"
+				"Jobs: %u waiting, %u finished (%.1f ms mean, %.1f ms max until OnFinish), at most %u left over a frame, threads %.0f%% busy\n",
 				frame_stat, (1000.0 / frame_stat), phys_stat, Pi::statSceneTris, Pi::statSceneTris * frame_stat * 1e-6,
 				Text::TextureFont::GetGlyphCount(), Pi::statNumPatches,
 				lua_memMB, lua_memKB, lua_memB, lua_gettop(Lua::manager->GetLuaState()),
 				numDrawCalls, numDrawTris, numDrawPointSprites, numDrawBillBoards,
 				numDrawBuildings, numDrawCities, numDrawGroundStations, numDrawSpaceStations, numDrawAtmospheres,
-				numDrawPatches, numDrawPlanets, numDrawGasGiants, numDrawStars, numDrawShips, numBuffersCreated);
+				numDrawPatches, numDrawPlanets, numDrawGasGiants, numDrawStars, numDrawShips, numBuffersCreated, numBuffersDestroyed, numBuffersReused,
+				numCollisionPairs,
+				terrainMem.patches, Uint32(terrainMem.heights >> 10), Uint32(terrainMem.meshData >> 10), Uint32(terrainMem.vertexBuffers >> 10),
+				asyncJobQueue->GetNumWaiting(), jobStats.finished, jobMeanLatency, jobStats.maxLatency * 1000.0, jobStats.maxPending,
+				JobStats::GetUtilisation() * 100.0);
+			asyncJobQueue->ClearFinishStats();
+			JobStats::ClearUtilisation();
 			frame_stat = 0;
 			phys_stat = 0;
+			CollisionSpace::ClearStats();
 			Text::TextureFont::ClearGlyphCount();
 			if (SDL_GetTicks() - last_stats > 1200)
 				last_stats = SDL_GetTicks();
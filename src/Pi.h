@@ -102,6 +102,10 @@ public:
 	static float GetMoveSpeedShiftModifier();
 
 	static std::string GetSaveDir();
+
+	// writes the jobs and main loop spans of the last seconds to a chrome
+	// trace file under the user dir, returning its path, or empty on failure
+	static std::string DumpJobTrace(double seconds);
 	static SceneGraph::Model *FindModel(const std::string &, bool allowPlaceholder = true);
 
 	static void CreateRenderTarget(const Uint16 width, const Uint16 height);
@@ -188,6 +192,11 @@ private:
 	static void HandleRequests();
 	static void HandleEscKey();
 
+	// on the loading screen and while a game starts, finished jobs are
+	// delivered as soon as they're ready, not to the JobFinishBudgetMs
+	static void BeginLoadingJobs();
+	static void EndLoadingJobs();
+
 	// private members
 	static std::vector<InternalRequests> internalRequests;
 	static const Uint32 SYNC_JOBS_PER_LOOP = 1;
@@ -110,7 +110,8 @@ void Projectile::FreeModel()
 }
 
 Projectile::Projectile(Body *parent, const ProjectileData &prData, const vector3d &pos, const vector3d &baseVel, const vector3d &dirVel) :
-	Body()
+	Body(),
+	m_haveContact(false)
 {
 	if (!s_sideMat) BuildModel();
 	m_flags |= FLAG_DRAW_LAST;
@@ -135,7 +136,8 @@ Projectile::Projectile(Body *parent, const ProjectileData &prData, const vector3
 }
 
 Projectile::Projectile(const Json &jsonObj, Space *space) :
-	Body(jsonObj, space)
+	Body(jsonObj, space),
+	m_haveContact(false)
 {
 	if (!s_sideMat) BuildModel();
 
@@ -185,6 +187,7 @@ void Projectile::PostLoadFixup(Space *space)
 {
 	Body::PostLoadFixup(space);
 	m_parent = space->GetBodyByIndex(m_parentIndex);
+	space->WatchForRemoval(this, m_parent);
 }
 
 void Projectile::UpdateInterpTransform(double alpha)
@@ -200,9 +203,19 @@ void Projectile::NotifyRemoved(const Body *const removedBody)
 }
 
 void Projectile::TimeStepUpdate(const float timeStep)
+{
+	ParallelTimeStepUpdate(timeStep);
+	SerialTimeStepUpdate(timeStep);
+}
+
+void Projectile::ParallelTimeStepUpdate(const float timeStep)
 {
 	m_age += timeStep;
 	SetPosition(GetPosition() + (m_baseVel + m_dirVel) * double(timeStep));
+}
+
+void Projectile::SerialTimeStepUpdate(const float timeStep)
+{
 	if (m_age > m_lifespan) Pi::game->GetSpace()->KillBody(this);
 }
 
@@ -252,13 +265,35 @@ void MiningLaserSpawnTastyStuff(Frame *f, const SystemBody *asteroid, const vect
 	Pi::game->GetSpace()->AddBody(cargo);
 }
 
+bool Projectile::GetStaticUpdateRay(const float timeStep, CollisionRay &ray) const
+{
+	// Collision spaces don't store velocity, so dirvel-only is still wrong but less awful than dirvel+basevel
+	const vector3d vel = m_dirVel * timeStep;
+	ray.start = GetPosition();
+	ray.dir = vel.Normalized();
+	ray.len = vel.Length();
+	ray.ignore = nullptr;
+	return true;
+}
+
+void Projectile::SetStaticUpdateContact(const CollisionContact &c)
+{
+	m_contact = c;
+	m_haveContact = true;
+}
+
 void Projectile::StaticUpdate(const float timeStep)
 {
 	PROFILE_SCOPED()
 	CollisionContact c;
-	// Collision spaces don't store velocity, so dirvel-only is still wrong but less awful than dirvel+basevel
-	vector3d vel = m_dirVel * timeStep;
-	GetFrame()->GetCollisionSpace()->TraceRay(GetPosition(), vel.Normalized(), vel.Length(), &c);
+	if (m_haveContact) {
+		c = m_contact;
+		m_haveContact = false;
+	} else {
+		CollisionRay ray;
+		GetStaticUpdateRay(timeStep, ray);
+		GetFrame()->GetCollisionSpace()->TraceRay(ray.start, ray.dir, ray.len, &c, ray.ignore);
+	}
 
 	if (c.userData1) {
 		Object *o = static_cast<Object *>(c.userData1);
@@ -369,10 +404,12 @@ void Projectile::Add(Body *parent, float lifespan, float dam, float length, floa
 	prData.color = color;
 	Projectile *p = new Projectile(parent, prData, pos, baseVel, dirVel);
 	Pi::game->GetSpace()->AddBody(p);
+	Pi::game->GetSpace()->WatchForRemoval(p, parent);
 }
 
 void Projectile::Add(Body *parent, const ProjectileData &prData, const vector3d &pos, const vector3d &baseVel, const vector3d &dirVel)
 {
 	Projectile *p = new Projectile(parent, prData, pos, baseVel, dirVel);
 	Pi::game->GetSpace()->AddBody(p);
+	Pi::game->GetSpace()->WatchForRemoval(p, parent);
 }
@@ -5,6 +5,7 @@
 #define _PROJECTILE_H
 
 #include "Body.h"
+#include "collider/CollisionContact.h"
 #include "graphics/Material.h"
 
 struct ProjectileData {
@@ -48,6 +49,11 @@ public:
 	virtual ~Projectile();
 	virtual void Render(Graphics::Renderer *r, const Camera *camera, const vector3d &viewCoords, const matrix4x4d &viewTransform) override final;
 	void TimeStepUpdate(const float timeStep) override final;
+	bool CanUpdateInParallel() const override final { return true; }
+	void ParallelTimeStepUpdate(const float timeStep) override final;
+	void SerialTimeStepUpdate(const float timeStep) override final;
+	bool GetStaticUpdateRay(const float timeStep, CollisionRay &ray) const override final;
+	void SetStaticUpdateContact(const CollisionContact &c) override final;
 	void StaticUpdate(const float timeStep) override final;
 	virtual void NotifyRemoved(const Body *const removedBody) override final;
 	virtual void UpdateInterpTransform(double alpha) override final;
@@ -72,6 +78,9 @@ private:
 	bool m_mining;
 	Color m_color;
 
+	CollisionContact m_contact; // from SetStaticUpdateContact
+	bool m_haveContact;
+
 	int m_parentIndex; // deserialisation
 
 	static void BuildModel();
@@ -4,6 +4,42 @@
 #include "PropertyMap.h"
 #include "LuaSerializer.h"
 #include "LuaUtils.h"
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+
+namespace {
+	// function statics, so keys can be made during static initialisation
+	std::unordered_map<std::string, Uint32> &KeyIds()
+	{
+		static std::unordered_map<std::string, Uint32> ids;
+		return ids;
+	}
+
+	std::deque<std::string> &KeyNames()
+	{
+		static std::deque<std::string> names;
+		return names;
+	}
+} // namespace
+
+//static
+Uint32 PropertyKey::Intern(const std::string &name)
+{
+	auto it = KeyIds().find(name);
+	if (it != KeyIds().end())
+		return it->second;
+
+	const Uint32 id = Uint32(KeyNames().size());
+	KeyNames().push_back(name);
+	KeyIds().insert(std::make_pair(name, id));
+	return id;
+}
+
+const std::string &PropertyKey::GetName() const
+{
+	return KeyNames()[m_id];
+}
 
 PropertyMap::PropertyMap(LuaManager *lua)
 {
@@ -15,13 +51,45 @@ PropertyMap::PropertyMap(LuaManager *lua)
 	LUA_DEBUG_END(l, 0);
 }
 
-void PropertyMap::SendSignal(const std::string &k)
+PropertyMap::Property &PropertyMap::Find(const PropertyKey &k)
+{
+	auto it = std::lower_bound(m_properties.begin(), m_properties.end(), k.GetId(), IdLess);
+	if (it == m_properties.end() || it->first != k.GetId())
+		it = m_properties.insert(it, std::make_pair(k.GetId(), Property()));
+	return it->second;
+}
+
+const PropertyMap::Property *PropertyMap::FindConst(const PropertyKey &k) const
+{
+	auto it = std::lower_bound(m_properties.begin(), m_properties.end(), k.GetId(), IdLess);
+	if (it == m_properties.end() || it->first != k.GetId())
+		return nullptr;
+	return &it->second;
+}
+
+void PropertyMap::Unset(const PropertyKey &k)
 {
-	std::map<std::string, sigc::signal<void, PropertyMap &, const std::string &>>::iterator i = m_signals.find(k);
+	auto it = std::lower_bound(m_properties.begin(), m_properties.end(), k.GetId(), IdLess);
+	if (it != m_properties.end() && it->first == k.GetId())
+		m_properties.erase(it);
+
+	lua_State *l = m_table.GetLua();
+	LUA_DEBUG_START(l);
+	m_table.PushCopyToStack();
+	lua_pushlstring(l, k.GetName().c_str(), k.GetName().size());
+	lua_pushnil(l);
+	lua_settable(l, -3);
+	lua_pop(l, 1);
+	LUA_DEBUG_END(l, 0);
+}
+
+void PropertyMap::SendSignal(const PropertyKey &k)
+{
+	std::map<Uint32, sigc::signal<void, PropertyMap &, const std::string &>>::iterator i = m_signals.find(k.GetId());
 	if (i == m_signals.end())
 		return;
 
-	(*i).second.emit(*this, k);
+	(*i).second.emit(*this, k.GetName());
 }
 
 void PropertyMap::PushLuaTable()
@@ -37,4 +105,149 @@ void PropertyMap::SaveToJson(Json &jsonObj)
 void PropertyMap::LoadFromJson(const Json &jsonObj)
 {
 	m_table.LoadFromJson(jsonObj);
+
+	// rebuild the C++ side from what was loaded
+	m_properties.clear();
+	lua_State *l = m_table.GetLua();
+	LUA_DEBUG_START(l);
+	m_table.PushCopyToStack();
+	lua_pushnil(l);
+	while (lua_next(l, -2)) {
+		if (lua_type(l, -2) == LUA_TSTRING) {
+			Property &p = Find(PropertyKey(lua_tostring(l, -2)));
+			switch (lua_type(l, -1)) {
+			case LUA_TBOOLEAN:
+				ToProperty(bool(lua_toboolean(l, -1)), p);
+				break;
+			case LUA_TNUMBER:
+				ToProperty(lua_tonumber(l, -1), p);
+				break;
+			case LUA_TSTRING: {
+				size_t len;
+				const char *str = lua_tolstring(l, -1, &len);
+				p.type = Property::TYPE_STRING;
+				p.string.assign(str, len);
+				break;
+			}
+			default:
+				p.type = Property::TYPE_LUA;
+				break;
+			}
+		}
+		lua_pop(l, 1);
+	}
+	lua_pop(l, 1);
+	LUA_DEBUG_END(l, 0);
 }
+
+#ifdef UNIT_TEST
+// Reads of the per tick ship properties (as in Ship::StaticUpdate) for 500
+// NPC ships, natively by key and by string, against the same reads from the
+// Lua table, plus sets that don't change anything. Checks the native values
+// agree with the table.
+#include "BenchmarkClock.h"
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+
+int main()
+{
+	static const char *caps[] = { "atmo_shield_cap", "fuel_scoop_cap", "cargo_life_support_cap",
+		"shield_energy_booster_cap", "hull_autorepair_cap", "radar_cap", "mass_cap" };
+	const int numCaps = COUNTOF(caps);
+	const int numShips = 500, ticks = 600;
+	int failures = 0;
+
+	LuaManager lua;
+	lua_State *l = lua.GetLuaState();
+
+	// a couple of dozen other properties each, and only some of the caps
+	std::vector<std::unique_ptr<PropertyMap>> ships;
+	for (int i = 0; i < numShips; i++) {
+		ships.emplace_back(new PropertyMap(&lua));
+		PropertyMap &p = *ships.back();
+		for (int j = 0; j < 25; j++)
+			p.Set(std::string("other_") + char('a' + j), j * 1.5);
+		p.Set("shipName", "Test");
+		p.Set("isArmed", true);
+		for (int j = (i % 2); j < numCaps; j += 2)
+			p.Set(caps[j], j + 1);
+	}
+	std::vector<PropertyKey> keys(caps, caps + numCaps);
+
+	Uint64 luaSum = 0, keySum = 0, stringSum = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int t = 0; t < ticks; t++) {
+		for (auto &p : ships) {
+			p->PushLuaTable();
+			for (int k = 0; k < numCaps; k++)
+				luaSum += LuaTable(l, -1).Get<int>(caps[k], 0);
+			lua_pop(l, 1);
+		}
+	}
+	const double luaTime = seconds_since(start);
+
+	start = std::chrono::steady_clock::now();
+	for (int t = 0; t < ticks; t++) {
+		for (auto &p : ships) {
+			for (int k = 0; k < numCaps; k++) {
+				int v = 0;
+				p->Get(keys[k], v);
+				keySum += v;
+			}
+		}
+	}
+	const double keyTime = seconds_since(start);
+
+	start = std::chrono::steady_clock::now();
+	for (int t = 0; t < ticks; t++) {
+		for (auto &p : ships) {
+			for (int k = 0; k < numCaps; k++) {
+				int v = 0;
+				p->Get(caps[k], v);
+				stringSum += v;
+			}
+		}
+	}
+	const double stringTime = seconds_since(start);
+
+	start = std::chrono::steady_clock::now();
+	for (int t = 0; t < ticks; t++) {
+		for (auto &p : ships) {
+			p->Set("fuel", 50.0);
+			p->Set("hullPercent", 100.0f);
+		}
+	}
+	const double setTime = seconds_since(start);
+
+	if (keySum != luaSum || stringSum != luaSum)
+		failures++;
+	printf("%d ships, %d reads each: Lua table %.3f ms/tick, by key %.3f ms/tick, by string %.3f ms/tick\n",
+		numShips, numCaps, luaTime * 1e3 / ticks, keyTime * 1e3 / ticks, stringTime * 1e3 / ticks);
+	printf("%d ships, 2 unchanged sets each: %.3f ms/tick\n", numShips, setTime * 1e3 / ticks);
+	printf("sums: Lua table %llu, by key %llu, by string %llu\n",
+		(unsigned long long)luaSum, (unsigned long long)keySum, (unsigned long long)stringSum);
+
+	// the other types, and unsetting
+	PropertyMap &p = *ships[1]; // has the odd caps
+	bool isArmed = false;
+	std::string shipName;
+	int radarCap = 0;
+	p.Get("isArmed", isArmed);
+	p.Get("shipName", shipName);
+	p.Get("radar_cap", radarCap);
+	p.Unset("radar_cap");
+	int unsetCap = -1;
+	p.Get("radar_cap", unsetCap);
+	p.PushLuaTable();
+	const bool unsetInLua = LuaTable(l, -1).Get<int>("radar_cap", -1) == -1;
+	lua_pop(l, 1);
+	if (!isArmed || shipName != "Test" || radarCap != 6 || unsetCap != -1 || !unsetInLua)
+		failures++;
+	printf("isArmed %d, shipName %s, radar_cap %d, after Unset %d (Lua %s)\n",
+		isArmed, shipName.c_str(), radarCap, unsetCap, unsetInLua ? "unset" : "still set");
+
+	return failures;
+}
+
+#endif /* UNIT_TEST */
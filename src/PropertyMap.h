@@ -7,39 +7,175 @@
 #include "LuaManager.h"
 #include "LuaRef.h"
 #include "LuaTable.h"
+#include <type_traits>
+#include <utility>
+#include <vector>
 
+// A property name, looked up once. Keys made from the same string are
+// equal, so the ones read every tick are best kept in a static rather than
+// made from a string on each call.
+class PropertyKey {
+public:
+	PropertyKey(const std::string &name) :
+		m_id(Intern(name)) {}
+	PropertyKey(const char *name) :
+		m_id(Intern(name)) {}
+
+	Uint32 GetId() const { return m_id; }
+	const std::string &GetName() const;
+
+private:
+	static Uint32 Intern(const std::string &name);
+
+	Uint32 m_id;
+};
+
+// Booleans, numbers and strings are kept in C++, so reading them doesn't
+// touch Lua. The Lua table that scripts see (PushLuaTable) mirrors them and
+// holds anything else, such as tables. All changes have to go through Set
+// and Unset so the two stay the same.
 class PropertyMap {
 public:
 	PropertyMap(LuaManager *lua);
 
+	// setting a boolean, number or string to the value it already has does
+	// nothing, and doesn't send the signal
 	template <class Value>
-	void Set(const std::string &k, const Value &v)
+	void Set(const PropertyKey &k, const Value &v)
 	{
-		ScopedTable(m_table).Set(k, v);
+		Property p;
+		if (ToProperty(v, p)) {
+			Property &old = Find(k);
+			if (old.type == p.type && old.number == p.number && old.string == p.string)
+				return;
+			old = std::move(p);
+		} else {
+			// only Lua can hold it
+			Property &old = Find(k);
+			old = Property();
+			old.type = Property::TYPE_LUA;
+		}
+		ScopedTable(m_table).Set(k.GetName(), v);
 		SendSignal(k);
 	}
 
+	// v is left alone if the property isn't set
 	template <class Value>
-	void Get(const std::string &k, Value &v) const
+	void Get(const PropertyKey &k, Value &v) const
 	{
-		v = ScopedTable(m_table).Get<Value>(k, v);
+		const Property *p = FindConst(k);
+		if (!p || p->type == Property::TYPE_NIL)
+			return;
+		if (p->type == Property::TYPE_LUA || !FromProperty(*p, v))
+			v = ScopedTable(m_table).Get<Value>(k.GetName(), v);
 	}
 
+	void Unset(const PropertyKey &k);
+
 	void PushLuaTable();
 
-	sigc::connection Connect(const std::string &k, const sigc::slot<void, PropertyMap &, const std::string &> &fn)
+	sigc::connection Connect(const PropertyKey &k, const sigc::slot<void, PropertyMap &, const std::string &> &fn)
 	{
-		return m_signals[k].connect(fn);
+		return m_signals[k.GetId()].connect(fn);
 	}
 
 	void SaveToJson(Json &jsonObj);
 	void LoadFromJson(const Json &jsonObj);
 
 private:
-	LuaRef m_table;
+	struct Property {
+		enum Type {
+			TYPE_NIL,
+			TYPE_BOOL, // in number, 0 or 1
+			TYPE_NUMBER,
+			TYPE_STRING,
+			TYPE_LUA // only in the Lua table
+		};
+
+		Property() :
+			type(TYPE_NIL),
+			number(0.0) {}
+
+		Type type;
+		double number;
+		std::string string;
+	};
 
-	void SendSignal(const std::string &k);
-	std::map<std::string, sigc::signal<void, PropertyMap &, const std::string &>> m_signals;
+	static bool ToProperty(bool v, Property &p)
+	{
+		p.type = Property::TYPE_BOOL;
+		p.number = v ? 1.0 : 0.0;
+		return true;
+	}
+	static bool ToProperty(const std::string &v, Property &p)
+	{
+		p.type = Property::TYPE_STRING;
+		p.string = v;
+		return true;
+	}
+	static bool ToProperty(const char *v, Property &p)
+	{
+		p.type = Property::TYPE_STRING;
+		p.string = v;
+		return true;
+	}
+	template <class Value>
+	static bool ToProperty(const Value &v, Property &p)
+	{
+		return ToNumber(v, p, std::is_arithmetic<Value>());
+	}
+	template <class Value>
+	static bool ToNumber(const Value &v, Property &p, std::true_type)
+	{
+		p.type = Property::TYPE_NUMBER;
+		p.number = double(v);
+		return true;
+	}
+	template <class Value>
+	static bool ToNumber(const Value &, Property &, std::false_type) { return false; }
+
+	// false if the conversion has to be left to Lua
+	static bool FromProperty(const Property &p, bool &v)
+	{
+		if (p.type != Property::TYPE_BOOL)
+			return false;
+		v = p.number != 0.0;
+		return true;
+	}
+	static bool FromProperty(const Property &p, std::string &v)
+	{
+		if (p.type != Property::TYPE_STRING)
+			return false;
+		v = p.string;
+		return true;
+	}
+	template <class Value>
+	static bool FromProperty(const Property &p, Value &v)
+	{
+		return FromNumber(p, v, std::is_arithmetic<Value>());
+	}
+	template <class Value>
+	static bool FromNumber(const Property &p, Value &v, std::true_type)
+	{
+		if (p.type != Property::TYPE_NUMBER)
+			return false;
+		v = Value(p.number);
+		return true;
+	}
+	template <class Value>
+	static bool FromNumber(const Property &, Value &, std::false_type) { return false; }
+
+	static bool IdLess(const std::pair<Uint32, Property> &a, Uint32 id) { return a.first < id; }
+
+	// adds an unset property if there isn't one
+	Property &Find(const PropertyKey &k);
+	const Property *FindConst(const PropertyKey &k) const;
+
+	void SendSignal(const PropertyKey &k);
+
+	LuaRef m_table;
+	std::vector<std::pair<Uint32, Property>> m_properties; // in key id order
+	std::map<Uint32, sigc::signal<void, PropertyMap &, const std::string &>> m_signals;
 };
 
 #endif
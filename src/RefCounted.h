@@ -22,6 +22,18 @@ public:
 	}
 	inline int GetRefCount() const { return m_refCount; }
 
+	// Take a reference unless the count has already dropped to zero, i.e. the
+	// object is being destroyed. For weak lookup tables shared between threads.
+	inline bool TryIncRefCount() const
+	{
+		int count = m_refCount.load();
+		while (count > 0) {
+			if (m_refCount.compare_exchange_weak(count, count + 1))
+				return true;
+		}
+		return false;
+	}
+
 private:
 	// vs2012 doesn't support the `= delete` syntax
 	RefCounted(const RefCounted &);
@@ -9,13 +9,13 @@
 #include "KeyBindings.h"
 #include "LuaConstants.h"
 #include "LuaObject.h"
-#include "MathUtil.h"
 #include "Pi.h"
 #include "Player.h"
 #include "Space.h"
 #include "StringF.h"
 #include "galaxy/Galaxy.h"
 #include "galaxy/GalaxyCache.h"
+#include "galaxy/JumpRouter.h"
 #include "galaxy/Sector.h"
 #include "galaxy/StarSystem.h"
 #include "graphics/Graphics.h"
@@ -24,7 +24,6 @@
 #include "gui/Gui.h"
 #include <algorithm>
 #include <sstream>
-#include <unordered_set>
 
 using namespace Graphics;
 
@@ -128,6 +127,7 @@ void SectorView::InitDefaults()
 	m_cacheYMax = 0;
 
 	m_sectorCache = m_galaxy->NewSectorSlaveCache();
+	m_prefetchCache = m_galaxy->NewSectorSlaveCache();
 
 	m_drawRouteLines = true; // where should this go?!
 	m_route = std::vector<SystemPath>();
@@ -586,133 +586,14 @@ std::vector<SystemPath> SectorView::GetRoute()
 
 void SectorView::AutoRoute(const SystemPath &start, const SystemPath &target, std::vector<SystemPath> &outRoute) const
 {
-	const RefCountedPtr<const Sector> start_sec = m_galaxy->GetSector(start);
-	const RefCountedPtr<const Sector> target_sec = m_galaxy->GetSector(target);
-
-	// Get the player's hyperdrive from Lua, later used to calculate the duration between systems
+	// Get the player's hyperdrive from Lua once; the router works from a snapshot of its costs
 	const ScopedTable hyperdrive = ScopedTable(LuaObject<Player>::CallMethod<LuaRef>(Pi::player, "GetEquip", "engine", 1));
-	// Cache max range so it doesn't get recalculated every time we call GetDuration
 	const float max_range = hyperdrive.CallMethod<float>("GetMaximumRange", Pi::player);
+	const float max_duration = hyperdrive.CallMethod<float>("GetDuration", Pi::player, max_range, max_range);
 
-	const float dist = Sector::DistanceBetween(start_sec, start.systemIndex, target_sec, target.systemIndex);
-
-	// nodes[0] is always start
-	std::vector<SystemPath> nodes;
-	nodes.push_back(start);
-
-	const Sint32 minX = std::min(start.sectorX, target.sectorX) - 2, maxX = std::max(start.sectorX, target.sectorX) + 2;
-	const Sint32 minY = std::min(start.sectorY, target.sectorY) - 2, maxY = std::max(start.sectorY, target.sectorY) + 2;
-	const Sint32 minZ = std::min(start.sectorZ, target.sectorZ) - 2, maxZ = std::max(start.sectorZ, target.sectorZ) + 2;
-	const vector3f start_pos = start_sec->m_systems[start.systemIndex].GetFullPosition();
-	const vector3f target_pos = target_sec->m_systems[target.systemIndex].GetFullPosition();
-
-	// go sector by sector for the minimum cube of sectors and add systems
-	// if they are within 110% of dist of both start and target
-	for (Sint32 sx = minX; sx <= maxX; sx++) {
-		for (Sint32 sy = minY; sy <= maxY; sy++) {
-			for (Sint32 sz = minZ; sz < maxZ; sz++) {
-				const SystemPath sec_path = SystemPath(sx, sy, sz);
-				RefCountedPtr<const Sector> sec = m_galaxy->GetSector(sec_path);
-				for (std::vector<Sector::System>::size_type s = 0; s < sec->m_systems.size(); s++) {
-					if (start.IsSameSystem(sec->m_systems[s].GetPath()))
-						continue; // start is already nodes[0]
-
-					const float lineDist = MathUtil::DistanceFromLine(start_pos, target_pos, sec->m_systems[s].GetFullPosition());
-
-					if (Sector::DistanceBetween(start_sec, start.systemIndex, sec, sec->m_systems[s].idx) <= dist * 1.10 &&
-						Sector::DistanceBetween(target_sec, target.systemIndex, sec, sec->m_systems[s].idx) <= dist * 1.10 &&
-						lineDist < (Sector::SIZE * 3)) {
-						nodes.push_back(sec->m_systems[s].GetPath());
-					}
-				}
-			}
-		}
-	}
-	Output("SectorView::AutoRoute, nodes to search = %lu\n", nodes.size());
-
-	// setup inital values and set everything as unvisited
-	std::vector<float> path_dist; // distance from source to node
-	std::vector<std::vector<SystemPath>::size_type> path_prev; // previous node in optimal path
-	std::unordered_set<std::vector<SystemPath>::size_type> unvisited;
-	for (std::vector<SystemPath>::size_type i = 0; i < nodes.size(); i++) {
-		path_dist.push_back(INFINITY);
-		path_prev.push_back(0);
-		unvisited.insert(i);
-	}
-
-	// distance to the start is 0
-	path_dist[0] = 0.f;
-
-	size_t totalSkipped = 0u;
-	while (unvisited.size() > 0) {
-		// find the closest node (for the first loop this will be start)
-		std::vector<SystemPath>::size_type closest_i = *unvisited.begin();
-		for (auto it : unvisited) {
-			if (path_dist[it] < path_dist[closest_i])
-				closest_i = it;
-		}
-
-		// mark it as visited
-		unvisited.erase(closest_i);
-
-		// if this is the target then we have found the route
-		const SystemPath &closest = nodes[closest_i];
-		if (closest.IsSameSystem(target))
-			break;
-
-		RefCountedPtr<const Sector> closest_sec = m_galaxy->GetSector(closest);
-
-		// if not, loop through all unvisited nodes
-		// since every system is technically reachable from every other system
-		// everything is a neighbor :)
-		for (auto it : unvisited) {
-			const SystemPath &v = nodes[it];
-			// everything is a neighbor isn't quite true as the ship has a max_range for each jump!
-			if ((SystemPath::SectorDistance(closest, v) * Sector::SIZE) > max_range) {
-				++totalSkipped;
-				continue;
-			}
-
-			RefCountedPtr<const Sector> v_sec = m_galaxy->GetSector(v); // this causes it to generate a sector (slooooooow)
-
-			const float v_dist_ly = Sector::DistanceBetween(closest_sec, closest.systemIndex, v_sec, v.systemIndex);
-
-			// in this case, duration is used for the distance since that's what we are optimizing
-			float v_dist = hyperdrive.CallMethod<float>("GetDuration", Pi::player, v_dist_ly, max_range);
-
-			v_dist += path_dist[closest_i]; // we want the total duration from start to this node
-			if (v_dist < path_dist[it]) {
-				// if our calculated duration is less than a previous value, this path is more efficent
-				// so store/override it
-				path_dist[it] = v_dist;
-				path_prev[it] = closest_i;
-			}
-		}
-	}
-	Output("SectorView::AutoRoute, total times that nodes were skipped = %lu\n", totalSkipped);
-
-	bool foundRoute = false;
-	std::vector<SystemPath>::size_type u = 0;
-
-	// find the index of our target
-	for (std::vector<SystemPath>::size_type i = 0, numNodes = nodes.size(); i < numNodes; i++) {
-		if (target.IsSameSystem(nodes[i])) {
-			u = i;
-			foundRoute = true;
-			break;
-		}
-	}
-
-	// It's posible that there is no valid route
-	if (foundRoute) {
-		outRoute.reserve(nodes.size());
-		// Build the route, in reverse starting with the target
-		while (u != 0) {
-			outRoute.push_back(nodes[u]);
-			u = path_prev[u];
-		}
-		std::reverse(std::begin(outRoute), std::end(outRoute));
-	}
+	const JumpRouter::CostModel cost = JumpRouter::CostModel::Duration(max_range, max_duration);
+	if (!m_galaxy->GetJumpRouter().FindRoute(start, target, cost, outRoute))
+		Output("SectorView::AutoRoute, no route found\n");
 }
 
 void SectorView::DrawRouteLines(const vector3f &playerAbsPos, const matrix4x4f &trans)
@@ -1166,6 +1047,7 @@ void SectorView::Update()
 	}
 
 	ShrinkCache();
+	PrefetchSectors();
 
 	m_playerHyperspaceRange = LuaObject<Player>::CallMethod<float>(Pi::player, "GetHyperspaceRange");
 
@@ -1243,6 +1125,45 @@ double SectorView::GetZoomLevel() const
 	return ((m_zoomClamped / FAR_THRESHOLD) * (OUTER_RADIUS)) + 0.5 * Sector::SIZE;
 }
 
+// Generates, in the background, the sectors around where the view is heading
+// and along the planned route, so drawing and route planning find them cached
+void SectorView::PrefetchSectors()
+{
+	PROFILE_SCOPED()
+	const SystemPath centre(int(floorf(m_posMovingTo.x)), int(floorf(m_posMovingTo.y)), int(floorf(m_posMovingTo.z)));
+	if (centre == m_prefetchCentre && m_hyperspaceTarget == m_prefetchTarget && m_route == m_prefetchRoute)
+		return;
+
+	m_prefetchCentre = centre;
+	m_prefetchTarget = m_hyperspaceTarget;
+	m_prefetchRoute = m_route;
+
+	SectorCache::PathVector paths;
+	paths.reserve((2 * DRAW_RAD + 1) * (2 * DRAW_RAD + 1) * (2 * DRAW_RAD + 1) + m_route.size() + 1);
+	for (int sx = -DRAW_RAD; sx <= DRAW_RAD; sx++) {
+		for (int sy = -DRAW_RAD; sy <= DRAW_RAD; sy++) {
+			for (int sz = -DRAW_RAD; sz <= DRAW_RAD; sz++) {
+				paths.push_back(SystemPath(centre.sectorX + sx, centre.sectorY + sy, centre.sectorZ + sz));
+			}
+		}
+	}
+	paths.push_back(m_hyperspaceTarget.SectorOnly());
+	for (const SystemPath &path : m_route)
+		paths.push_back(path.SectorOnly());
+
+	// drop whatever we prefetched earlier that is no longer wanted
+	const std::set<SystemPath, SystemPath::LessSectorOnly> wanted(paths.begin(), paths.end());
+	auto iter = m_prefetchCache->Begin();
+	while (iter != m_prefetchCache->End()) {
+		if (wanted.find(iter->first) == wanted.end())
+			m_prefetchCache->Erase(iter++);
+		else
+			iter++;
+	}
+
+	m_prefetchCache->Prefetch(paths);
+}
+
 void SectorView::ZoomIn()
 {
 	const float frameTime = Pi::GetFrameTime();
@@ -1286,30 +1207,11 @@ void SectorView::LockHyperspaceTarget(bool lock)
 }
 std::vector<SystemPath> SectorView::GetNearbyStarSystemsByName(std::string pattern)
 {
+	// the index covers every sector generated so far, keep the ones on the map
 	std::vector<SystemPath> result;
-	for (auto i = m_sectorCache->Begin(); i != m_sectorCache->End(); ++i) {
-		for (unsigned int systemIndex = 0; systemIndex < (*i).second->m_systems.size(); systemIndex++) {
-			const Sector::System *ss = &((*i).second->m_systems[systemIndex]);
-
-			// compare with the start of the current system
-			if (strncasecmp(pattern.c_str(), ss->GetName().c_str(), pattern.size()) == 0
-				// look for the pattern term somewhere within the current system
-				|| pi_strcasestr(ss->GetName().c_str(), pattern.c_str())) {
-				SystemPath match((*i).first);
-				match.systemIndex = systemIndex;
-				result.push_back(match);
-			}
-			// now also check other names of this system, if there are any
-			for (const std::string &other_name : ss->GetOtherNames()) {
-				if (strncasecmp(pattern.c_str(), other_name.c_str(), pattern.size()) == 0
-					// look for the pattern term somewhere within the current system
-					|| pi_strcasestr(other_name.c_str(), pattern.c_str())) {
-					SystemPath match((*i).first);
-					match.systemIndex = systemIndex;
-					result.push_back(match);
-				}
-			}
-		}
+	for (const SystemPath &path : m_galaxy->GetSystemNameIndex().Search(pattern)) {
+		if (m_sectorCache->GetIfCached(path))
+			result.push_back(path);
 	}
 	return result;
 }
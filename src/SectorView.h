@@ -108,6 +108,7 @@ private:
 
 	RefCountedPtr<Sector> GetCached(const SystemPath &loc) { return m_sectorCache->GetCached(loc); }
 	void ShrinkCache();
+	void PrefetchSectors();
 
 	void MouseWheel(bool up);
 	void OnKeyPressed(SDL_Keysym *keysym);
@@ -154,6 +155,10 @@ private:
 	sigc::connection m_onKeyPressConnection;
 
 	RefCountedPtr<SectorCache::Slave> m_sectorCache;
+	RefCountedPtr<SectorCache::Slave> m_prefetchCache;
+	SystemPath m_prefetchCentre;
+	SystemPath m_prefetchTarget;
+	std::vector<SystemPath> m_prefetchRoute;
 	std::string m_previousSearch;
 
 	float m_playerHyperspaceRange;
@@ -135,7 +135,7 @@ void Sensors::Update(float time)
 		} else {
 			const Ship *ship = dynamic_cast<Ship *>(it->body);
 			if (ship && Ship::FLYING == ship->GetFlightState()) {
-				it->distance = m_owner->GetPositionRelTo(it->body).Length();
+				it->distance = Pi::game->GetSpace()->GetCachedPositionRelTo(m_owner, it->body).Length();
 				it->trail->Update(time);
 			} else {
 				it->trail->Reset(nullptr);
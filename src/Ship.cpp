@@ -31,6 +31,19 @@
 #include "ship/PlayerShipController.h"
 
 static const float TONS_HULL_PER_SHIELD = 10.f;
+
+// properties used every tick
+static const PropertyKey s_atmoShieldCap("atmo_shield_cap");
+static const PropertyKey s_fuelScoopCap("fuel_scoop_cap");
+static const PropertyKey s_cargoLifeSupportCap("cargo_life_support_cap");
+static const PropertyKey s_shieldEnergyBoosterCap("shield_energy_booster_cap");
+static const PropertyKey s_hullAutorepairCap("hull_autorepair_cap");
+static const PropertyKey s_radarCap("radar_cap");
+static const PropertyKey s_fuel("fuel");
+static const PropertyKey s_shieldMassLeft("shieldMassLeft");
+static const PropertyKey s_hullMassLeft("hullMassLeft");
+static const PropertyKey s_hullPercent("hullPercent");
+
 HeatGradientParameters_t Ship::s_heatGradientParams;
 const float Ship::DEFAULT_SHIELD_COOLDOWN_TIME = 1.0f;
 const double Ship::DEFAULT_LIFT_TO_DRAG_RATIO = 0.001;
@@ -954,7 +967,7 @@ void Ship::SetFrame(Frame *f)
 	m_sensors->ResetTrails();
 }
 
-void Ship::TimeStepUpdate(const float timeStep)
+void Ship::ParallelTimeStepUpdate(const float timeStep)
 {
 	// If docked, station is responsible for updating position/orient of ship
 	// but we call this crap anyway and hope it doesn't do anything bad
@@ -966,10 +979,15 @@ void Ship::TimeStepUpdate(const float timeStep)
 	//apply extra atmospheric flight forces
 	AddTorque(CalcAtmoTorque());
 
+	m_dragCoeff = DynamicBody::DEFAULT_DRAG_COEFF * (1.0 + 0.25 * m_wheelState);
+	DynamicBody::ParallelTimeStepUpdate(timeStep);
+}
+
+void Ship::SerialTimeStepUpdate(const float timeStep)
+{
 	if (m_landingGearAnimation)
 		m_landingGearAnimation->SetProgress(m_wheelState);
-	m_dragCoeff = DynamicBody::DEFAULT_DRAG_COEFF * (1.0 + 0.25 * m_wheelState);
-	DynamicBody::TimeStepUpdate(timeStep);
+	DynamicBody::SerialTimeStepUpdate(timeStep);
 
 	// fuel use decreases mass, so do this as the last thing in the frame
 	UpdateFuel(timeStep);
@@ -1038,7 +1056,7 @@ double Ship::GetHullTemperature() const
 	// TODO: fix this to properly account for heating due to air friction instead of G-force.
 	double dragGs = GetAtmosForce().Length() / (GetMass() * 9.81);
 	int atmo_shield_cap = 0;
-	const_cast<Ship *>(this)->Properties().Get(R"(atmo_shield_cap)", atmo_shield_cap);
+	Properties().Get(s_atmoShieldCap, atmo_shield_cap);
 	return dragGs / (15.0 * (1.0 + atmo_shield_cap + (2.0 * (1.0 - m_wheelState))));
 }
 
@@ -1052,7 +1070,7 @@ void Ship::UpdateAlertState()
 {
 	// no alerts if no radar
 	int radar_cap = 0;
-	Properties().Get("radar_cap", radar_cap);
+	Properties().Get(s_radarCap, radar_cap);
 	if (radar_cap <= 0) {
 		// clear existing alert state if there was one
 		if (GetAlertState() != ALERT_NONE) {
@@ -1091,7 +1109,7 @@ void Ship::UpdateAlertState()
 			if (ship->GetShipType()->tag == ShipType::TAG_STATIC_SHIP) continue;
 			if (ship->GetFlightState() == LANDED || ship->GetFlightState() == DOCKED) continue;
 
-			if (GetPositionRelTo(ship).LengthSqr() < ALERT_DISTANCE * ALERT_DISTANCE) {
+			if (Pi::game->GetSpace()->GetCachedPositionRelTo(this, ship).LengthSqr() < ALERT_DISTANCE * ALERT_DISTANCE) {
 				ship_is_near = true;
 
 				Uint32 gunstate = ship->GetFixedGuns()->IsFiring();
@@ -1156,7 +1174,7 @@ void Ship::UpdateFuel(const float timeStep)
 {
 	GetPropulsion()->UpdateFuel(timeStep);
 	UpdateFuelStats();
-	Properties().Set("fuel", GetFuel() * 100); // XXX to match SetFuelPercent
+	Properties().Set(s_fuel, GetFuel() * 100); // XXX to match SetFuelPercent
 
 	if (GetPropulsion()->IsFuelStateChanged())
 		LuaEvent::Queue("onShipFuelChanged", this, EnumStrings::GetString("PropulsionFuelStatus", GetPropulsion()->GetFuelState()));
@@ -1185,7 +1203,7 @@ void Ship::StaticUpdate(const float timeStep)
 			p->GetAtmosphericState(dist, &pressure, &density);
 
 			int atmo_shield_cap = 0;
-			const_cast<Ship *>(this)->Properties().Get("atmo_shield_cap", atmo_shield_cap);
+			Properties().Get(s_atmoShieldCap, atmo_shield_cap);
 			atmo_shield_cap = std::max(atmo_shield_cap, 1); // needs to have some shielding by default
 			if (pressure > (m_type->atmosphericPressureLimit * atmo_shield_cap)) {
 				float damage = float(pressure - m_type->atmosphericPressureLimit);
@@ -1198,7 +1216,7 @@ void Ship::StaticUpdate(const float timeStep)
 
 	/* FUEL SCOOPING!!!!!!!!! */
 	int capacity = 0;
-	Properties().Get("fuel_scoop_cap", capacity);
+	Properties().Get(s_fuelScoopCap, capacity);
 	if (m_flightState == FLYING && capacity > 0) {
 		Body *astro = GetFrame()->GetBody();
 		if (astro && astro->IsType(Object::PLANET)) {
@@ -1233,7 +1251,7 @@ void Ship::StaticUpdate(const float timeStep)
 
 	// Cargo bay life support
 	capacity = 0;
-	Properties().Get("cargo_life_support_cap", capacity);
+	Properties().Get(s_cargoLifeSupportCap, capacity);
 	if (!capacity) {
 		// Hull is pressure-sealed, it just doesn't provide
 		// temperature regulation and breathable atmosphere
@@ -1305,10 +1323,10 @@ void Ship::StaticUpdate(const float timeStep)
 		// 250 second recharge
 		float recharge_rate = 0.004f;
 		float booster = 1.0f;
-		Properties().Get("shield_energy_booster_cap", booster);
+		Properties().Get(s_shieldEnergyBoosterCap, booster);
 		recharge_rate *= booster;
 		m_stats.shield_mass_left = Clamp(m_stats.shield_mass_left + m_stats.shield_mass * recharge_rate * timeStep, 0.0f, m_stats.shield_mass);
-		Properties().Set("shieldMassLeft", m_stats.shield_mass_left);
+		Properties().Set(s_shieldMassLeft, m_stats.shield_mass_left);
 	}
 
 	if (m_wheelTransition) {
@@ -1321,11 +1339,11 @@ void Ship::StaticUpdate(const float timeStep)
 	if (m_testLanded) TestLanded();
 
 	capacity = 0;
-	Properties().Get("hull_autorepair_cap", capacity);
+	Properties().Get(s_hullAutorepairCap, capacity);
 	if (capacity) {
 		m_stats.hull_mass_left = std::min(m_stats.hull_mass_left + 0.1f * timeStep, float(m_type->hullMass));
-		Properties().Set("hullMassLeft", m_stats.hull_mass_left);
-		Properties().Set("hullPercent", 100.0f * (m_stats.hull_mass_left / float(m_type->hullMass)));
+		Properties().Set(s_hullMassLeft, m_stats.hull_mass_left);
+		Properties().Set(s_hullPercent, 100.0f * (m_stats.hull_mass_left / float(m_type->hullMass)));
 	}
 
 	// After calling StartHyperspaceTo this Ship must not spawn objects
@@ -103,7 +103,8 @@ public:
 	virtual bool SetWheelState(bool down); // returns success of state change, NOT state itself
 	void Blastoff();
 	bool Undock();
-	virtual void TimeStepUpdate(const float timeStep) override;
+	virtual void ParallelTimeStepUpdate(const float timeStep) override;
+	virtual void SerialTimeStepUpdate(const float timeStep) override;
 	virtual void StaticUpdate(const float timeStep) override;
 
 	void TimeAccelAdjust(const float timeStep);
@@ -111,6 +112,8 @@ public:
 	bool IsDecelerating() const { return m_decelerating; }
 
 	virtual void NotifyRemoved(const Body *const removedBody) override;
+	// AI can be holding on to pretty much anything
+	virtual bool WantsAllRemovalNotifications() const override { return true; }
 	virtual bool OnCollision(Object *o, Uint32 flags, double relVel) override;
 	virtual bool OnDamage(Object *attacker, float kgDamage, const CollisionContact &contactData) override;
 
@@ -7,8 +7,10 @@
 #include "CityOnPlanet.h"
 #include "Frame.h"
 #include "Game.h"
+#include "GameConfig.h"
 #include "GameSaveError.h"
 #include "HyperspaceCloud.h"
+#include "JobQueue.h"
 #include "Lang.h"
 #include "LuaEvent.h"
 #include "LuaTimer.h"
@@ -22,41 +24,126 @@
 #include "galaxy/Galaxy.h"
 #include "graphics/Graphics.h"
 #include <algorithm>
+#include <deque>
 #include <functional>
+#include <map>
 
 //#define DEBUG_CACHE
 
+// edge length of a BodyNearFinder grid cell. most queries are for radar or
+// weapons range, i.e. tens to hundreds of km
+static const double BODY_GRID_CELL_SIZE = 100000.0;
+
+Space::BodyNearFinder::Cell Space::BodyNearFinder::GetCell(const vector3d &pos) const
+{
+	Cell c;
+	c.x = Sint64(floor(pos.x / BODY_GRID_CELL_SIZE));
+	c.y = Sint64(floor(pos.y / BODY_GRID_CELL_SIZE));
+	c.z = Sint64(floor(pos.z / BODY_GRID_CELL_SIZE));
+	return c;
+}
+
 void Space::BodyNearFinder::Prepare()
 {
-	m_bodyDist.clear();
+	PROFILE_SCOPED()
+	m_bodyPos.clear();
+	m_cells.clear();
+
+	for (Body *b : m_space->GetBodies()) {
+		BodyPos bp;
+		bp.pos = m_space->GetCachedRootPosition(b);
+		bp.cell = GetCell(bp.pos);
+		bp.body = b;
+		m_bodyPos.push_back(bp);
+	}
 
-	for (Body *b : m_space->GetBodies())
-		m_bodyDist.emplace_back(b, b->GetPositionRelTo(m_space->GetRootFrame()).Length());
+	// stable, so each cell lists its bodies in the same order every time
+	std::stable_sort(m_bodyPos.begin(), m_bodyPos.end(),
+		[](const BodyPos &a, const BodyPos &b) { return a.cell < b.cell; });
 
-	std::sort(m_bodyDist.begin(), m_bodyDist.end());
+	for (Uint32 i = 0; i < m_bodyPos.size(); i++) {
+		CellRange &range = m_cells[m_bodyPos[i].cell];
+		if (!range.count) range.first = i;
+		range.count++;
+	}
+}
+
+bool Space::BodyNearFinder::FindBodies(const vector3d &pos, double dist, const Body *ignore)
+{
+	m_found.clear();
+	if (m_bodyPos.empty()) return false;
+
+	const double distSqr = dist * dist;
+	auto addCell = [&](const CellRange &range) {
+		for (Uint32 i = range.first; i < range.first + range.count; i++) {
+			const BodyPos &bp = m_bodyPos[i];
+			if (bp.body == ignore) continue;
+			const double d = (bp.pos - pos).LengthSqr();
+			if (d <= distSqr) m_found.emplace_back(d, bp.body);
+		}
+	};
+
+	// big queries just check everybody
+	const double cellsPerAxis = floor(2.0 * dist / BODY_GRID_CELL_SIZE) + 2.0;
+	if (cellsPerAxis * cellsPerAxis * cellsPerAxis > double(m_bodyPos.size())) {
+		addCell(CellRange{ 0, Uint32(m_bodyPos.size()) });
+		return false;
+	}
+
+	const Cell lo = GetCell(pos - vector3d(dist));
+	const Cell hi = GetCell(pos + vector3d(dist));
+	Cell c;
+	for (c.x = lo.x; c.x <= hi.x; c.x++) {
+		for (c.y = lo.y; c.y <= hi.y; c.y++) {
+			for (c.z = lo.z; c.z <= hi.z; c.z++) {
+				auto cell = m_cells.find(c);
+				if (cell != m_cells.end()) addCell(cell->second);
+			}
+		}
+	}
+	return true;
 }
 
 Space::BodyNearList Space::BodyNearFinder::GetBodiesMaybeNear(const Body *b, double dist)
 {
-	return std::move(GetBodiesMaybeNear(b->GetPositionRelTo(m_space->GetRootFrame()), dist));
+	return std::move(GetBodiesMaybeNear(m_space->GetCachedRootPosition(b), dist));
 }
 
 Space::BodyNearList Space::BodyNearFinder::GetBodiesMaybeNear(const vector3d &pos, double dist)
 {
-	if (m_bodyDist.empty()) {
-		m_nearBodies.clear();
-		return std::move(m_nearBodies);
-	}
+	PROFILE_SCOPED()
+	FindBodies(pos, dist, nullptr);
+
+	m_nearBodies.clear();
+	m_nearBodies.reserve(m_found.size());
+	for (const auto &found : m_found)
+		m_nearBodies.push_back(found.second);
 
-	const double len = pos.Length();
+	return std::move(m_nearBodies);
+}
 
-	std::vector<BodyDist>::const_iterator min = std::lower_bound(m_bodyDist.begin(), m_bodyDist.end(), len - dist);
-	std::vector<BodyDist>::const_iterator max = std::upper_bound(min, m_bodyDist.cend(), len + dist);
+Space::BodyNearList Space::BodyNearFinder::GetNearestBodies(const Body *b, size_t count)
+{
+	return std::move(GetNearestBodies(m_space->GetCachedRootPosition(b), count, b));
+}
 
-	m_nearBodies.clear();
-	m_nearBodies.reserve(max - min);
+Space::BodyNearList Space::BodyNearFinder::GetNearestBodies(const vector3d &pos, size_t count, const Body *ignore)
+{
+	PROFILE_SCOPED()
+	// widen the search until it has enough bodies. once there are count of
+	// them inside the radius the nearest count can't be outside it
+	double dist = BODY_GRID_CELL_SIZE;
+	while (FindBodies(pos, dist, ignore) && m_found.size() < count)
+		dist *= 2.0;
 
-	std::for_each(min, max, [&](BodyDist const &bd) { m_nearBodies.push_back(bd.body); });
+	std::stable_sort(m_found.begin(), m_found.end(),
+		[](const std::pair<double, Body *> &a, const std::pair<double, Body *> &b) { return a.first < b.first; });
+	if (m_found.size() > count) m_found.resize(count);
+
+	m_nearBodies.clear();
+	m_nearBodies.reserve(m_found.size());
+	for (const auto &found : m_found)
+		m_nearBodies.push_back(found.second);
 
 	return std::move(m_nearBodies);
 }
@@ -111,6 +198,11 @@ Space::Space(Game *game, RefCountedPtr<Galaxy> galaxy, const SystemPath &path, S
 	GenSectorCache(galaxy, &path);
 
 	//DebugDumpFrames();
+
+#ifdef BENCHMARK_SPACE
+	BenchmarkBodyNearFinder(10000);
+	BenchmarkBodyChurn(5000);
+#endif
 }
 
 Space::Space(Game *game, RefCountedPtr<Galaxy> galaxy, const Json &jsonObj, double at_time) :
@@ -145,7 +237,7 @@ Space::Space(Game *game, RefCountedPtr<Galaxy> galaxy, const Json &jsonObj, doub
 	try {
 		Json bodyArray = spaceObj["bodies"].get<Json::array_t>();
 		for (Uint32 i = 0; i < bodyArray.size(); i++)
-			m_bodies.push_back(Body::FromJson(bodyArray[i], this));
+			AddBody(Body::FromJson(bodyArray[i], this));
 	} catch (Json::type_error &) {
 		throw SavedGameCorruptException();
 	}
@@ -164,8 +256,8 @@ Space::Space(Game *game, RefCountedPtr<Galaxy> galaxy, const Json &jsonObj, doub
 Space::~Space()
 {
 	UpdateBodies(); // make sure anything waiting to be removed gets removed before we go and kill everything else
-	for (std::list<Body *>::iterator i = m_bodies.begin(); i != m_bodies.end(); ++i)
-		KillBody(*i);
+	for (Body *b : m_bodies)
+		KillBody(b);
 	UpdateBodies();
 }
 
@@ -312,7 +404,71 @@ void Space::RebuildSystemBodyIndex()
 
 void Space::AddBody(Body *b)
 {
+	b->SetSpaceIndex(m_bodies.size());
 	m_bodies.push_back(b);
+	if (b->WantsAllRemovalNotifications())
+		m_allRemovalWatchers.push_back(b);
+}
+
+void Space::WatchForRemoval(Body *watcher, const Body *watched)
+{
+	if (!watcher || !watched) return;
+	m_removalWatchers[watched].push_back(watcher);
+	m_watchedBodies[watcher].push_back(watched);
+}
+
+// find-and-swap-pop, order doesn't matter
+template <typename T>
+static void EraseUnordered(std::vector<T> &v, const T &x)
+{
+	auto it = std::find(v.begin(), v.end(), x);
+	if (it == v.end()) return;
+	*it = v.back();
+	v.pop_back();
+}
+
+void Space::NotifyRemovalWatchers(Body *removed)
+{
+	for (Body *b : m_allRemovalWatchers)
+		b->NotifyRemoved(removed);
+
+	auto watchers = m_removalWatchers.find(removed);
+	if (watchers != m_removalWatchers.end()) {
+		for (Body *b : watchers->second)
+			b->NotifyRemoved(removed);
+		// they don't care any more, and don't need to know when they go either
+		for (Body *b : watchers->second) {
+			auto watched = m_watchedBodies.find(b);
+			if (watched != m_watchedBodies.end())
+				EraseUnordered(watched->second, static_cast<const Body *>(removed));
+		}
+		m_removalWatchers.erase(watchers);
+	}
+}
+
+void Space::RemoveBodyFromList(Body *b)
+{
+	// might have been queued twice, or never added
+	const Uint32 idx = b->GetSpaceIndex();
+	if (idx >= m_bodies.size() || m_bodies[idx] != b) return;
+
+	// nobody needs to hear about it from here on
+	auto watched = m_watchedBodies.find(b);
+	if (watched != m_watchedBodies.end()) {
+		for (const Body *w : watched->second) {
+			auto watchers = m_removalWatchers.find(w);
+			if (watchers != m_removalWatchers.end())
+				EraseUnordered(watchers->second, b);
+		}
+		m_watchedBodies.erase(watched);
+	}
+	if (b->WantsAllRemovalNotifications())
+		EraseUnordered(m_allRemovalWatchers, b);
+
+	m_bodies[idx] = m_bodies.back();
+	m_bodies[idx]->SetSpaceIndex(idx);
+	m_bodies.pop_back();
+	b->SetSpaceIndex(Uint32(-1));
 }
 
 void Space::RemoveBody(Body *b)
@@ -409,13 +565,13 @@ Body *Space::FindNearestTo(const Body *b, Object::Type t) const
 {
 	Body *nearest = 0;
 	double dist = FLT_MAX;
-	for (std::list<Body *>::const_iterator i = m_bodies.begin(); i != m_bodies.end(); ++i) {
-		if ((*i)->IsDead()) continue;
-		if ((*i)->IsType(t)) {
-			double d = (*i)->GetPositionRelTo(b).Length();
+	for (Body *body : m_bodies) {
+		if (body->IsDead()) continue;
+		if (body->IsType(t)) {
+			double d = body->GetPositionRelTo(b).Length();
 			if (d < dist) {
 				dist = d;
-				nearest = *i;
+				nearest = body;
 			}
 		}
 	}
@@ -988,11 +1144,236 @@ static void CollideWithTerrain(Body *body, float timeStep)
 	hitCallback(&c);
 }
 
-void Space::CollideFrame(Frame *f)
+namespace {
+	// numbered batches of work shared between the main thread and jobs on the
+	// async queue. refcounted because a job may not get round to running
+	// until we've long finished, at which point there's nothing left for it
+	class ParallelBatches : public RefCounted {
+	public:
+		ParallelBatches(int numBatches, const std::function<void(int)> &runBatch) :
+			m_numBatches(numBatches),
+			m_runBatch(runBatch),
+			m_nextBatch(0),
+			m_batchesDone(0)
+		{
+			m_doneLock = SDL_CreateMutex();
+			m_doneCond = SDL_CreateCond();
+		}
+		~ParallelBatches()
+		{
+			SDL_DestroyCond(m_doneCond);
+			SDL_DestroyMutex(m_doneLock);
+		}
+
+		// claim and run batches until there are none left
+		void RunBatches()
+		{
+			for (;;) {
+				const int i = m_nextBatch++;
+				if (i >= m_numBatches) break;
+
+				m_runBatch(i);
+
+				if (++m_batchesDone == m_numBatches) {
+					SDL_LockMutex(m_doneLock);
+					SDL_CondBroadcast(m_doneCond);
+					SDL_UnlockMutex(m_doneLock);
+				}
+			}
+		}
+
+		void WaitUntilDone()
+		{
+			SDL_LockMutex(m_doneLock);
+			while (m_batchesDone < m_numBatches)
+				SDL_CondWait(m_doneCond, m_doneLock);
+			SDL_UnlockMutex(m_doneLock);
+		}
+
+	private:
+		const int m_numBatches;
+		std::function<void(int)> m_runBatch;
+		std::atomic<int> m_nextBatch;
+		std::atomic<int> m_batchesDone;
+		SDL_mutex *m_doneLock;
+		SDL_cond *m_doneCond;
+	};
+
+	class ParallelBatchJob : public Job {
+	public:
+		ParallelBatchJob(ParallelBatches *batches) :
+			m_batches(batches) {}
+		virtual void OnRun() override { m_batches->RunBatches(); }
+		virtual void OnFinish() override {}
+		// the main thread is waiting for these
+		virtual Priority GetPriority() const override { return PRIORITY_INTERACTIVE; }
+		virtual const char *GetName() const override { return "ParallelBatchJob"; }
+
+	private:
+		RefCountedPtr<ParallelBatches> m_batches;
+	};
+} // namespace
+
+void Space::RunBatches(int numBatches, bool parallel, const std::function<void(int)> &runBatch)
+{
+	RefCountedPtr<ParallelBatches> batches(new ParallelBatches(numBatches, runBatch));
+
+	if (parallel && numBatches > 1) {
+		if (!m_parallelJobs)
+			m_parallelJobs.reset(new JobSet(Pi::GetAsyncJobQueue()));
+
+		// we chew through batches ourselves too, so don't wait on the queue
+		// if the workers are busy with terrain
+		const int numJobs = std::min(numBatches - 1, SDL_GetCPUCount() - 1);
+		for (int i = 0; i < numJobs; i++)
+			m_parallelJobs->Order(new ParallelBatchJob(batches.Get()));
+	}
+
+	batches->RunBatches();
+	batches->WaitUntilDone();
+}
+
+// With ParallelCollision on, the trees of every frame are prepared, and all
+// the pairs found and tested, across the job queue. Each frame is then
+// finished in order on this thread: hitCallback gets the pairs that touched,
+// and any pair that an earlier response has moved or switched on is tested
+// again then and there (see CollisionSpace::FinishCollide()). The callbacks
+// are exactly the ones Collide() would have made, so it plays the same with
+// it on or off.
+static const int COLLISION_BATCH_GEOMS = 16;
+
+namespace {
+	struct CollisionBatch {
+		CollisionBatch(CollisionSpace *space_, int firstGeom_, int numGeoms_) :
+			space(space_),
+			firstGeom(firstGeom_),
+			numGeoms(numGeoms_) {}
+		CollisionSpace *space;
+		int firstGeom;
+		int numGeoms;
+	};
+} // namespace
+
+static void GatherCollisionSpaces(Frame *f, std::vector<CollisionSpace *> &spaces)
 {
-	f->GetCollisionSpace()->Collide(&hitCallback);
+	spaces.push_back(f->GetCollisionSpace());
 	for (Frame *kid : f->GetChildren())
-		CollideFrame(kid);
+		GatherCollisionSpaces(kid, spaces);
+}
+
+void Space::CollideFrames()
+{
+	PROFILE_SCOPED()
+
+	std::vector<CollisionSpace *> spaces;
+	GatherCollisionSpaces(m_rootFrame.get(), spaces);
+
+	if (!Pi::config->Int("ParallelCollision")) {
+		for (CollisionSpace *space : spaces)
+			space->Collide(&hitCallback);
+		return;
+	}
+
+	RunBatches(spaces.size(), true, [&spaces](int i) {
+		spaces[i]->PrepareCollide();
+	});
+
+	std::vector<CollisionBatch> batches;
+	for (CollisionSpace *space : spaces) {
+		const int numGeoms = space->GetNumCollideGeoms();
+		for (int first = 0; first < numGeoms; first += COLLISION_BATCH_GEOMS)
+			batches.emplace_back(space, first, std::min(COLLISION_BATCH_GEOMS, numGeoms - first));
+	}
+
+	RunBatches(batches.size(), true, [&batches](int i) {
+		const CollisionBatch &batch = batches[i];
+		batch.space->CollectPairs(batch.firstGeom, batch.numGeoms);
+	});
+
+	for (CollisionSpace *space : spaces)
+		space->FinishCollide(&hitCallback);
+}
+
+// Projectiles and beams trace a ray every StaticUpdate(). Tracing a whole
+// frame's rays in one go walks the object trees once per batch of rays rather
+// than once for each, and the geom trees a packet of rays at a time. The
+// geoms are as they were before anyone's StaticUpdate(); a body docking or
+// jumping in its StaticUpdate() may switch its geom off before or after the
+// projectiles see it, but which came first was down to body order anyway.
+void Space::TraceStaticUpdateRays(float step)
+{
+	PROFILE_SCOPED()
+
+	struct FrameRays {
+		std::vector<Body *> bodies;
+		std::vector<CollisionRay> rays;
+	};
+	std::map<CollisionSpace *, FrameRays> frames;
+	CollisionRay ray;
+	for (Body *b : m_bodies) {
+		if (!b->GetStaticUpdateRay(step, ray))
+			continue;
+		FrameRays &frame = frames[b->GetFrame()->GetCollisionSpace()];
+		frame.bodies.push_back(b);
+		frame.rays.push_back(ray);
+	}
+
+	std::vector<CollisionContact> contacts;
+	for (auto &it : frames) {
+		FrameRays &frame = it.second;
+		contacts.assign(frame.rays.size(), CollisionContact());
+		it.first->TraceRays(frame.rays.size(), frame.rays.data(), contacts.data());
+		for (size_t i = 0; i < frame.bodies.size(); i++)
+			frame.bodies[i]->SetStaticUpdateContact(contacts[i]);
+	}
+}
+
+// Parallel body update: bodies that can split their TimeStepUpdate() (see
+// Body::CanUpdateInParallel()) do the first half across the job queue, then
+// everyone finishes on the main thread in body order. Nothing that depends on
+// another body happens in the first half, so the result doesn't depend on how
+// the bodies were divided up.
+static const int BODY_UPDATE_BATCH_SIZE = 32;
+
+void Space::TimeStepUpdateBodies(float step)
+{
+	PROFILE_SCOPED()
+
+	// indexed loops, bodies can be added (never removed) while we go
+	if (!Pi::config->Int("ParallelBodyUpdate")) {
+		for (size_t i = 0; i < m_bodies.size(); i++)
+			m_bodies[i]->TimeStepUpdate(step);
+		return;
+	}
+
+	// a body can stop being able to update in parallel while the serial
+	// halves run (docking, say), so remember which ones started in parallel
+	const size_t numStarted = m_bodies.size();
+	std::vector<Body *> parallelBodies;
+	std::vector<bool> ranInParallel(numStarted, false);
+	for (size_t i = 0; i < numStarted; i++) {
+		if (m_bodies[i]->CanUpdateInParallel()) {
+			parallelBodies.push_back(m_bodies[i]);
+			ranInParallel[i] = true;
+		}
+	}
+
+	const int numBodies = parallelBodies.size();
+	const int numBatches = (numBodies + BODY_UPDATE_BATCH_SIZE - 1) / BODY_UPDATE_BATCH_SIZE;
+	RunBatches(numBatches, true, [&parallelBodies, numBodies, step](int i) {
+		const int end = std::min(numBodies, (i + 1) * BODY_UPDATE_BATCH_SIZE);
+		for (int j = i * BODY_UPDATE_BATCH_SIZE; j < end; j++)
+			parallelBodies[j]->ParallelTimeStepUpdate(step);
+	});
+
+	// anyone added from here on missed the first half and gets the whole thing
+	for (size_t i = 0; i < m_bodies.size(); i++) {
+		Body *b = m_bodies[i];
+		if (i < numStarted && ranInParallel[i])
+			b->SerialTimeStepUpdate(step);
+		else
+			b->TimeStepUpdate(step);
+	}
 }
 
 void Space::TimeStep(float step)
@@ -1005,31 +1386,79 @@ void Space::TimeStep(float step)
 	m_frameIndexValid = m_bodyIndexValid = m_sbodyIndexValid = false;
 
 	// XXX does not need to be done this often
-	CollideFrame(m_rootFrame.get());
-	for (Body *b : m_bodies)
-		CollideWithTerrain(b, step);
+	// indexed loops from here, anything can spawn new bodies (guns firing
+	// from StaticUpdate etc.) and they go on the end
+	CollideFrames();
+	for (size_t i = 0; i < m_bodies.size(); i++)
+		CollideWithTerrain(m_bodies[i], step);
 
 	// update frames of reference
-	for (Body *b : m_bodies)
-		b->UpdateFrame();
+	for (size_t i = 0; i < m_bodies.size(); i++)
+		m_bodies[i]->UpdateFrame();
 
 	// AI acts here, then move all bodies and frames
-	for (Body *b : m_bodies)
-		b->StaticUpdate(step);
+	TraceStaticUpdateRays(step);
+	for (size_t i = 0; i < m_bodies.size(); i++)
+		m_bodies[i]->StaticUpdate(step);
 
 	m_rootFrame->UpdateOrbitRails(m_game->GetTime(), m_game->GetTimeStep());
 
-	for (Body *b : m_bodies)
-		b->TimeStepUpdate(step);
+	TimeStepUpdateBodies(step);
 
 	LuaEvent::Emit();
 	Pi::luaTimer->Tick();
 
 	UpdateBodies();
 
+	UpdateRootTransforms();
 	m_bodyNearFinder.Prepare();
 }
 
+void Space::UpdateRootTransforms()
+{
+	PROFILE_SCOPED()
+	m_rootTransformBodies.clear();
+	m_rootPositions.clear();
+	m_rootOrients.clear();
+	m_rootFrameOrients.clear();
+
+	const Frame *root = m_rootFrame.get();
+	// same order as m_bodies, so the space index finds the entry
+	for (Body *b : m_bodies) {
+		m_rootTransformBodies.push_back(b);
+		m_rootPositions.push_back(b->GetPositionRelTo(root));
+		const matrix3x3d frameOrient = b->GetFrame()->GetOrientRelTo(root);
+		m_rootFrameOrients.push_back(frameOrient);
+		m_rootOrients.push_back(frameOrient * b->GetOrient());
+	}
+}
+
+bool Space::HasRootTransform(const Body *b) const
+{
+	const Uint32 idx = b->GetSpaceIndex();
+	return idx < m_rootTransformBodies.size() && m_rootTransformBodies[idx] == b;
+}
+
+vector3d Space::GetCachedRootPosition(const Body *b) const
+{
+	if (!HasRootTransform(b)) return b->GetPositionRelTo(m_rootFrame.get());
+	return m_rootPositions[b->GetSpaceIndex()];
+}
+
+matrix3x3d Space::GetCachedRootOrient(const Body *b) const
+{
+	if (!HasRootTransform(b)) return b->GetOrientRelTo(m_rootFrame.get());
+	return m_rootOrients[b->GetSpaceIndex()];
+}
+
+vector3d Space::GetCachedPositionRelTo(const Body *b, const Body *relTo) const
+{
+	if (!HasRootTransform(b) || !HasRootTransform(relTo)) return b->GetPositionRelTo(relTo);
+	// into the axes of relTo's frame, same as Body::GetPositionRelTo()
+	const vector3d diff = m_rootPositions[b->GetSpaceIndex()] - m_rootPositions[relTo->GetSpaceIndex()];
+	return diff * m_rootFrameOrients[relTo->GetSpaceIndex()];
+}
+
 void Space::UpdateBodies()
 {
 #ifndef NDEBUG
@@ -1038,16 +1467,14 @@ void Space::UpdateBodies()
 
 	for (Body *rmb : m_removeBodies) {
 		rmb->SetFrame(0);
-		for (Body *b : m_bodies)
-			b->NotifyRemoved(rmb);
-		m_bodies.remove(rmb);
+		NotifyRemovalWatchers(rmb);
+		RemoveBodyFromList(rmb);
 	}
 	m_removeBodies.clear();
 
 	for (Body *killb : m_killBodies) {
-		for (Body *b : m_bodies)
-			b->NotifyRemoved(killb);
-		m_bodies.remove(killb);
+		NotifyRemovalWatchers(killb);
+		RemoveBodyFromList(killb);
 		delete killb;
 	}
 	m_killBodies.clear();
@@ -1057,6 +1484,224 @@ void Space::UpdateBodies()
 #endif
 }
 
+#ifdef BENCHMARK_SPACE
+namespace {
+	// sits still, draws nothing and counts what it's told about
+	class BenchmarkBody : public Body {
+	public:
+		BenchmarkBody(bool wantsAll = false) :
+			m_wantsAll(wantsAll),
+			m_notified(0) {}
+		virtual void Render(Graphics::Renderer *r, const Camera *camera, const vector3d &viewCoords, const matrix4x4d &viewTransform) override {}
+		virtual void NotifyRemoved(const Body *const removedBody) override { m_notified++; }
+		virtual bool WantsAllRemovalNotifications() const override { return m_wantsAll; }
+
+		bool m_wantsAll;
+		Uint32 m_notified;
+	};
+} // namespace
+
+void Space::BenchmarkBodyNearFinder(Uint32 count)
+{
+	const double QUERY_DIST = 100000.0;
+	const size_t QUERY_COUNT = 8;
+	const Uint32 NUM_QUERIES = 1000;
+
+	// a few dozen busy spots on orbits from 0.1 to 30 AU, each with a twin
+	// at the same radius on the far side of the star, where bodies gather
+	// within a few hundred km. a tenth are out on their own
+	Random rand(count);
+	std::vector<vector3d> spots;
+	for (int i = 0; i < 20; i++) {
+		const double radius = 1.5e10 * pow(300.0, rand.Double());
+		const double angle = rand.Double(2.0 * M_PI);
+		const vector3d spot(radius * cos(angle), radius * 0.01 * rand.Normal(), radius * sin(angle));
+		spots.push_back(spot);
+		spots.push_back(vector3d(-spot.x, spot.y, -spot.z));
+	}
+
+	std::vector<Body *> added;
+	for (Uint32 i = 0; i < count; i++) {
+		Body *b = new BenchmarkBody;
+		vector3d pos;
+		if (i % 10 == 0) {
+			const double radius = 1.5e10 * pow(300.0, rand.Double());
+			const double angle = rand.Double(2.0 * M_PI);
+			pos = vector3d(radius * cos(angle), radius * 0.01 * rand.Normal(), radius * sin(angle));
+		} else {
+			const double spread = 1000.0 * pow(1000.0, rand.Double());
+			pos = spots[rand.Int32(spots.size())] + spread * vector3d(rand.Normal(), rand.Normal(), rand.Normal());
+		}
+		b->SetFrame(m_rootFrame.get());
+		b->SetPosition(pos);
+		AddBody(b);
+		added.push_back(b);
+	}
+
+	Profiler::Timer prepareTimer, nearTimer, nearestTimer, linearNearTimer, linearNearestTimer;
+	UpdateRootTransforms();
+	prepareTimer.Start();
+	m_bodyNearFinder.Prepare();
+	prepareTimer.Stop();
+
+	Uint32 numNear = 0, nearMismatches = 0, nearestMismatches = 0;
+	std::vector<Body *> linear;
+	std::vector<double> linearDists, dists;
+	for (Uint32 q = 0; q < NUM_QUERIES; q++) {
+		const vector3d pos = GetCachedRootPosition(added[rand.Int32(added.size())]) +
+			QUERY_DIST * vector3d(rand.Normal(), rand.Normal(), rand.Normal());
+
+		nearTimer.Start();
+		std::vector<Body *> maybeNear = GetBodiesMaybeNear(pos, QUERY_DIST);
+		nearTimer.Stop();
+
+		linearNearTimer.Start();
+		linear.clear();
+		for (Body *b : m_bodies) {
+			if ((GetCachedRootPosition(b) - pos).LengthSqr() <= QUERY_DIST * QUERY_DIST)
+				linear.push_back(b);
+		}
+		linearNearTimer.Stop();
+
+		// it may return bodies further away, but mustn't miss any
+		numNear += linear.size();
+		std::sort(maybeNear.begin(), maybeNear.end());
+		for (Body *b : linear) {
+			if (!std::binary_search(maybeNear.begin(), maybeNear.end(), b))
+				nearMismatches++;
+		}
+
+		nearestTimer.Start();
+		const std::vector<Body *> nearest = GetNearestBodies(pos, QUERY_COUNT);
+		nearestTimer.Stop();
+
+		linearNearestTimer.Start();
+		linearDists.clear();
+		for (Body *b : m_bodies)
+			linearDists.push_back((GetCachedRootPosition(b) - pos).LengthSqr());
+		const size_t k = std::min(QUERY_COUNT, linearDists.size());
+		std::partial_sort(linearDists.begin(), linearDists.begin() + k, linearDists.end());
+		linearNearestTimer.Stop();
+
+		// bodies at the same distance can come in either order, so compare
+		// distances rather than bodies
+		dists.clear();
+		for (Body *b : nearest)
+			dists.push_back((GetCachedRootPosition(b) - pos).LengthSqr());
+		if (dists.size() != k || !std::equal(dists.begin(), dists.end(), linearDists.begin()))
+			nearestMismatches++;
+	}
+
+	Output("BenchmarkBodyNearFinder: %u bodies, Prepare took %lf milliseconds\n", Uint32(m_bodies.size()), prepareTimer.millicycles());
+	Output("BenchmarkBodyNearFinder: %u GetBodiesMaybeNear(%.0lf m) found %u bodies, %u missed, took %lf, testing every body took %lf milliseconds\n",
+		NUM_QUERIES, QUERY_DIST, numNear, nearMismatches, nearTimer.millicycles(), linearNearTimer.millicycles());
+	Output("BenchmarkBodyNearFinder: %u GetNearestBodies(%u), %u mismatches, took %lf, testing every body took %lf milliseconds\n",
+		NUM_QUERIES, Uint32(QUERY_COUNT), nearestMismatches, nearestTimer.millicycles(), linearNearestTimer.millicycles());
+
+	for (Body *b : added)
+		KillBody(b);
+	UpdateBodies();
+	UpdateRootTransforms();
+	m_bodyNearFinder.Prepare();
+}
+
+void Space::BenchmarkBodyChurn(Uint32 count)
+{
+	const Uint32 NUM_SHOOTERS = 50;
+	const Uint32 LIFETIME = 20; // ticks
+	const Uint32 NUM_TICKS = 200;
+	const Uint32 perTick = std::max(count / LIFETIME, 1U);
+
+	Random rand(count);
+	auto addShooter = [this]() {
+		BenchmarkBody *b = new BenchmarkBody(true);
+		b->SetFrame(m_rootFrame.get());
+		AddBody(b);
+		return b;
+	};
+	std::vector<BenchmarkBody *> shooters;
+	for (Uint32 i = 0; i < NUM_SHOOTERS; i++)
+		shooters.push_back(addShooter());
+
+	struct Shot {
+		BenchmarkBody *body;
+		const Body *shooter; // null once it's gone
+		Uint32 fired;
+	};
+	std::deque<Shot> shots;
+	Profiler::Timer spawnTimer, killTimer, updateTimer;
+	Uint32 numSpawned = 0, numKilled = 0, shootersKilled = 0;
+	Uint64 expectedNotifications = 0, notifications = 0;
+	for (Uint32 tick = 0; tick < NUM_TICKS; tick++) {
+		spawnTimer.Start();
+		for (Uint32 i = 0; i < perTick; i++) {
+			BenchmarkBody *shooter = shooters[rand.Int32(NUM_SHOOTERS)];
+			BenchmarkBody *b = new BenchmarkBody;
+			b->SetFrame(m_rootFrame.get());
+			AddBody(b);
+			WatchForRemoval(b, shooter);
+			shots.push_back(Shot{ b, shooter, tick });
+		}
+		spawnTimer.Stop();
+		numSpawned += perTick;
+
+		// the oldest go first, so they're all at the front
+		size_t numExpired = 0;
+		while (numExpired < shots.size() && shots[numExpired].fired + LIFETIME <= tick) {
+			notifications += shots[numExpired].body->m_notified;
+			numExpired++;
+		}
+		killTimer.Start();
+		for (size_t i = 0; i < numExpired; i++)
+			KillBody(shots[i].body);
+		killTimer.Stop();
+		shots.erase(shots.begin(), shots.begin() + numExpired);
+		numKilled += numExpired;
+
+		// now and then a ship goes too, and only the shots it fired should
+		// hear about it (besides the other ships)
+		if (tick % 10 == 5) {
+			const Uint32 s = rand.Int32(NUM_SHOOTERS);
+			for (Shot &shot : shots) {
+				if (shot.shooter == shooters[s]) {
+					shot.shooter = nullptr;
+					expectedNotifications++;
+				}
+			}
+			killTimer.Start();
+			KillBody(shooters[s]);
+			killTimer.Stop();
+			shooters[s] = nullptr;
+			shootersKilled++;
+		}
+
+		updateTimer.Start();
+		UpdateBodies();
+		updateTimer.Stop();
+
+		for (BenchmarkBody *&shooter : shooters) {
+			if (!shooter)
+				shooter = addShooter();
+		}
+	}
+
+	for (const Shot &shot : shots) {
+		notifications += shot.body->m_notified;
+		KillBody(shot.body);
+	}
+	for (BenchmarkBody *shooter : shooters)
+		KillBody(shooter);
+	UpdateBodies();
+
+	Output("BenchmarkBodyChurn: %u shots spawned, %u killed, up to %u at once, %u ships of %u killed\n",
+		numSpawned, numKilled, perTick * (LIFETIME + 1), shootersKilled, NUM_SHOOTERS);
+	Output("BenchmarkBodyChurn: shots were told about %llu removals, expected %llu\n",
+		(unsigned long long)notifications, (unsigned long long)expectedNotifications);
+	Output("BenchmarkBodyChurn: spawning took %lf, killing took %lf, UpdateBodies took %lf milliseconds\n",
+		spawnTimer.millicycles(), killTimer.millicycles(), updateTimer.millicycles());
+}
+#endif
+
 static char space[256];
 
 static void DebugDumpFrame(Frame *f, unsigned int indent)
@@ -10,13 +10,19 @@
 #include "RefCounted.h"
 #include "galaxy/GalaxyCache.h"
 #include "galaxy/StarSystem.h"
+#include "matrix3x3.h"
 #include "vector3.h"
+#include <functional>
 #include <list>
+#include <unordered_map>
+
+//#define BENCHMARK_SPACE
 
 class Body;
 class Frame;
 class Ship;
 class HyperspaceCloud;
+class JobSet;
 class Game;
 
 class Space {
@@ -50,6 +56,9 @@ public:
 
 	void AddBody(Body *);
 	void RemoveBody(Body *);
+	// have watcher->NotifyRemoved() called when watched is removed. not
+	// needed for bodies that WantAllRemovalNotifications()
+	void WatchForRemoval(Body *watcher, const Body *watched);
 	void KillBody(Body *);
 
 	void TimeStep(float step);
@@ -71,12 +80,24 @@ public:
 	Body *FindBodyForPath(const SystemPath *path) const;
 
 	Uint32 GetNumBodies() const { return static_cast<Uint32>(m_bodies.size()); }
-	IterationProxy<std::list<Body *>> GetBodies() { return MakeIterationProxy(m_bodies); }
-	const IterationProxy<const std::list<Body *>> GetBodies() const { return MakeIterationProxy(m_bodies); }
+	// NOTE: adding a body can invalidate these iterators, so anything that
+	// might spawn bodies while walking them should index instead
+	IterationProxy<std::vector<Body *>> GetBodies() { return MakeIterationProxy(m_bodies); }
+	const IterationProxy<const std::vector<Body *>> GetBodies() const { return MakeIterationProxy(m_bodies); }
 
 	Background::Container *GetBackground() { return m_background.get(); }
 	void RefreshBackground();
 
+	// positions and orientations of every body relative to the root frame,
+	// cached at the end of each tick, so they don't see movement in the
+	// current one. everything goes through the root frame, which loses
+	// precision far from the system origin: fine for ranges and bearings,
+	// not for placing things. bodies added since fall back to the slow way
+	vector3d GetCachedRootPosition(const Body *b) const;
+	matrix3x3d GetCachedRootOrient(const Body *b) const;
+	// b->GetPositionRelTo(relTo), from the cache
+	vector3d GetCachedPositionRelTo(const Body *b, const Body *relTo) const;
+
 	// body finder delegates
 	typedef const std::vector<Body *> BodyNearList;
 	BodyNearList GetBodiesMaybeNear(const Body *b, double dist)
@@ -87,6 +108,15 @@ public:
 	{
 		return std::move(m_bodyNearFinder.GetBodiesMaybeNear(pos, dist));
 	}
+	// the count bodies closest to b (not including b), nearest first
+	BodyNearList GetNearestBodies(const Body *b, size_t count)
+	{
+		return std::move(m_bodyNearFinder.GetNearestBodies(b, count));
+	}
+	BodyNearList GetNearestBodies(const vector3d &pos, size_t count)
+	{
+		return std::move(m_bodyNearFinder.GetNearestBodies(pos, count));
+	}
 
 private:
 	void GenSectorCache(RefCountedPtr<Galaxy> galaxy, const SystemPath *here);
@@ -97,7 +127,22 @@ private:
 
 	void UpdateBodies();
 
-	void CollideFrame(Frame *f);
+	void UpdateRootTransforms();
+	bool HasRootTransform(const Body *b) const;
+	std::vector<const Body *> m_rootTransformBodies;
+	std::vector<vector3d> m_rootPositions;
+	std::vector<matrix3x3d> m_rootOrients;
+	std::vector<matrix3x3d> m_rootFrameOrients; // of each body's frame
+
+	void CollideFrames();
+	void TraceStaticUpdateRays(float step);
+	void TimeStepUpdateBodies(float step);
+
+	// run runBatch(0) .. runBatch(numBatches-1), spread over the async job
+	// queue if parallel is set, and wait for them all
+	void RunBatches(int numBatches, bool parallel, const std::function<void(int)> &runBatch);
+	// keeps the handles of any batch jobs still on the queue
+	std::unique_ptr<JobSet> m_parallelJobs;
 
 	std::unique_ptr<Frame> m_rootFrame;
 
@@ -108,8 +153,16 @@ private:
 
 	Game *m_game;
 
-	// all the bodies we know about
-	std::list<Body *> m_bodies;
+	// all the bodies we know about. each body's space index is its position
+	// here, removal moves the last body into the gap
+	std::vector<Body *> m_bodies;
+	void RemoveBodyFromList(Body *b);
+	void NotifyRemovalWatchers(Body *removed);
+
+	// bodies that hear about every removal, and who's watching who otherwise
+	std::vector<Body *> m_allRemovalWatchers;
+	std::unordered_map<const Body *, std::vector<Body *>> m_removalWatchers;
+	std::unordered_map<const Body *, std::vector<const Body *>> m_watchedBodies;
 
 	// bodies that were removed/killed this timestep and need pruning at the end
 	std::list<Body *> m_removeBodies;
@@ -131,6 +184,7 @@ private:
 	//e.g. starfield and milky way)
 	std::unique_ptr<Background::Container> m_background;
 
+	// hashed grid over the bodies' root frame positions, rebuilt every tick
 	class BodyNearFinder {
 	public:
 		BodyNearFinder(const Space *space) :
@@ -139,28 +193,64 @@ private:
 
 		BodyNearList GetBodiesMaybeNear(const Body *b, double dist);
 		BodyNearList GetBodiesMaybeNear(const vector3d &pos, double dist);
+		BodyNearList GetNearestBodies(const Body *b, size_t count);
+		BodyNearList GetNearestBodies(const vector3d &pos, size_t count, const Body *ignore = nullptr);
 
 	private:
-		struct BodyDist {
-			BodyDist(Body *_body, double _dist) :
-				body(_body),
-				dist(_dist) {}
+		struct Cell {
+			Sint64 x, y, z;
+			bool operator==(const Cell &a) const { return x == a.x && y == a.y && z == a.z; }
+			bool operator<(const Cell &a) const
+			{
+				if (x != a.x) return x < a.x;
+				if (y != a.y) return y < a.y;
+				return z < a.z;
+			}
+		};
+		struct CellHash {
+			size_t operator()(const Cell &c) const
+			{
+				Uint64 h = Uint64(c.x) * 73856093ULL;
+				h ^= Uint64(c.y) * 19349663ULL;
+				h ^= Uint64(c.z) * 83492791ULL;
+				return size_t(h);
+			}
+		};
+		struct CellRange {
+			Uint32 first;
+			Uint32 count;
+		};
+		struct BodyPos {
+			Cell cell;
+			vector3d pos;
 			Body *body;
-			double dist;
-
-			bool operator<(const BodyDist &a) const { return dist < a.dist; }
-
-			friend bool operator<(const BodyDist &a, double d) { return a.dist < d; }
-			friend bool operator<(double d, const BodyDist &a) { return d < a.dist; }
 		};
 
+		Cell GetCell(const vector3d &pos) const;
+		// every body within dist of pos into m_found. returns false if it
+		// had to look at every body, i.e. there's nobody further away to find
+		bool FindBodies(const vector3d &pos, double dist, const Body *ignore);
+
 		const Space *m_space;
-		std::vector<BodyDist> m_bodyDist;
+		std::vector<BodyPos> m_bodyPos; // sorted by cell
+		std::unordered_map<Cell, CellRange, CellHash> m_cells;
+		std::vector<std::pair<double, Body *>> m_found;
 		std::vector<Body *> m_nearBodies;
 	};
 
 	BodyNearFinder m_bodyNearFinder;
 
+#ifdef BENCHMARK_SPACE
+	// add count bodies bunched up the way ships are around planets and
+	// stations, time the near finder's queries and check them against
+	// testing every body, then take the bodies away again
+	void BenchmarkBodyNearFinder(Uint32 count);
+	// keep count projectile-like bodies alive, each watching one of a few
+	// dozen ships that hear about every removal, spawning and killing them
+	// over a couple of hundred ticks, and time adding and removing them
+	void BenchmarkBodyChurn(Uint32 count);
+#endif
+
 #ifndef NDEBUG
 	//to check RemoveBody and KillBody are not called from within
 	//the NotifyRemoved callback (#735)
@@ -46,6 +46,7 @@ public:
 	virtual const SystemBody *GetSystemBody() const override { return m_sbody; }
 	virtual void PostLoadFixup(Space *space) override;
 	virtual void NotifyRemoved(const Body *const removedBody) override;
+	virtual bool WantsAllRemovalNotifications() const override { return true; }
 
 	virtual void SetLabel(const std::string &label) override;
 
@@ -3,149 +3,241 @@
 
 #include "BVHTree.h"
 #include "buildopts.h"
+#include "scenegraph/Serializer.h"
+#include <algorithm>
 #include <float.h>
+#include <stdexcept>
 #include <stdio.h>
 
-const int MAX_SPLITPOS_RETRIES = 15;
+// binned surface area heuristic, see Wald, "On fast Construction of SAH-based
+// Bounding Volume Hierarchies" (2007)
+static const int SAH_NUM_BINS = 16;
+static const double SAH_TRAVERSAL_COST = 1.0;
+static const double SAH_INTERSECT_COST = 1.0;
+// leaves bigger than this get split even if the heuristic doesn't ask for it
+static const size_t MAX_LEAF_OBJS = 4;
 
-BVHTree::BVHTree(int numObjs, const objPtr_t *objPtrs, const Aabb *objAabbs)
+static inline double SurfaceArea(const vector3d &min, const vector3d &max)
+{
+	const vector3d d = max - min;
+	return 2.0 * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static inline void ExpandBounds(vector3d &min, vector3d &max, const vector3d &bmin, const vector3d &bmax)
+{
+	min.x = std::min(min.x, bmin.x);
+	min.y = std::min(min.y, bmin.y);
+	min.z = std::min(min.z, bmin.z);
+	max.x = std::max(max.x, bmax.x);
+	max.y = std::max(max.y, bmax.y);
+	max.z = std::max(max.z, bmax.z);
+}
+
+BVHTree::BVHTree(int numObjs, const objPtr_t *objPtrs, const Aabb *objAabbs) :
+	m_depth(0)
 {
 	PROFILE_SCOPED()
 	Profiler::Timer timer;
 	timer.Start();
 
-	std::vector<int> activeObjIdxs(numObjs);
-	for (int i = 0; i < numObjs; i++)
-		activeObjIdxs[i] = i;
+	if (numObjs <= 0) Error("BVHTree built with no objects.");
 
-	m_objPtrAlloc = new objPtr_t[numObjs];
-	m_objPtrAllocPos = 0;
-	m_objPtrAllocMax = numObjs;
+	std::vector<BuildObj> objs(numObjs);
+	for (int i = 0; i < numObjs; i++) {
+		objs[i].min = objAabbs[i].min;
+		objs[i].max = objAabbs[i].max;
+		objs[i].centroid = 0.5 * (objAabbs[i].min + objAabbs[i].max);
+		objs[i].objPtr = objPtrs[i];
+	}
 
-	m_bvhNodes = new BVHNode[numObjs * 2 + 1];
-	m_nodeAllocPos = 0;
-	m_nodeAllocMax = numObjs * 2 + 1;
+	m_nodes.reserve(numObjs * 2 - 1);
+	m_objPtrs.reserve(numObjs);
 
-	m_root = AllocNode();
-	BuildNode(m_root, objPtrs, objAabbs, activeObjIdxs);
+	BuildNode(objs, 0, numObjs, 1);
 
 	timer.Stop();
 	//Output(" - - - BVHTree::BVHTree took: %lf milliseconds\n", timer.millicycles());
 }
 
-void BVHTree::MakeLeaf(BVHNode *node, const objPtr_t *objPtrs, std::vector<objPtr_t> &objs)
+BVHTree::BVHTree(Serializer::Reader &rd)
 {
-	const size_t numTris = objs.size();
-	if (numTris <= 0) Error("MakeLeaf called with no elements in objs.");
-
-	if (numTris > m_objPtrAllocMax - m_objPtrAllocPos) {
-		Error("Out of space in m_objPtrAlloc. Left: " SIZET_FMT "; required: " SIZET_FMT ".", m_objPtrAllocMax - m_objPtrAllocPos, numTris);
+	PROFILE_SCOPED()
+	const Uint32 numNodes = rd.Int32();
+	m_nodes.resize(numNodes);
+	for (Uint32 i = 0; i < numNodes; i++) {
+		BVHNode &node = m_nodes[i];
+		rd >> node.min >> node.max >> node.offset >> node.numTris;
 	}
 
-	node->numTris = numTris;
-	node->triIndicesStart = &m_objPtrAlloc[m_objPtrAllocPos];
-	//if (objs.size()>3) Output("fat node %d\n", objs.size());
+	const Uint32 numObjPtrs = rd.Int32();
+	m_objPtrs.resize(numObjPtrs);
+	for (Uint32 i = 0; i < numObjPtrs; i++) {
+		m_objPtrs[i] = rd.Int32();
+	}
 
-	// copy tri indices to the stinking flat array
-	for (int i = numTris - 1; i >= 0; i--) {
-		m_objPtrAlloc[m_objPtrAllocPos++] = objPtrs[objs[i]];
+	// a tree too deep to traverse can only come from a stale or damaged
+	// cache, so let the loader discard it rather than treat it as fatal
+	m_depth = rd.Int32();
+	if (m_depth > MAX_DEPTH) {
+		char buf[128];
+		snprintf(buf, sizeof(buf), "BVHTree loaded with depth %d, more than the %d it can be traversed to.", m_depth, MAX_DEPTH);
+		throw std::runtime_error(buf);
 	}
 }
 
-void BVHTree::BuildNode(BVHNode *node,
-	const objPtr_t *objPtrs,
-	const Aabb *objAabbs,
-	std::vector<objPtr_t> &activeObjIdx)
+void BVHTree::Save(Serializer::Writer &wr) const
 {
-	const int numTris = activeObjIdx.size();
-	if (numTris <= 0) Error("BuildNode called with no elements in activeObjIndex.");
+	PROFILE_SCOPED()
+	wr.Int32(m_nodes.size());
+	for (const BVHNode &node : m_nodes) {
+		wr << node.min << node.max << node.offset << node.numTris;
+	}
 
-	if (numTris == 1) {
-		MakeLeaf(node, objPtrs, activeObjIdx);
-		return;
+	wr.Int32(m_objPtrs.size());
+	for (const objPtr_t objPtr : m_objPtrs) {
+		wr.Int32(objPtr);
 	}
 
-	std::vector<int> splitSides(numTris);
+	wr.Int32(m_depth);
+}
 
-	Aabb aabb;
-	aabb.min = vector3d(FLT_MAX, FLT_MAX, FLT_MAX);
-	aabb.max = vector3d(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+void BVHTree::MakeLeaf(BVHNode &node, const std::vector<BuildObj> &objs, size_t start, size_t count)
+{
+	node.offset = m_objPtrs.size();
+	node.numTris = count;
 
-	for (int i = 0; i < numTris; i++) {
-		const int idx = activeObjIdx[i];
-		aabb.Update(objAabbs[idx].min);
-		aabb.Update(objAabbs[idx].max);
+	// copy tri indices to the stinking flat array
+	for (size_t i = start; i < start + count; i++) {
+		m_objPtrs.push_back(objs[i].objPtr);
 	}
-	node->numTris = numTris;
-	node->aabb = aabb;
-
-	Aabb splitBox = aabb;
-	double splitPos;
-	int splitAxis;
-	int s1count, s2count;
-	int attempt = 0;
-
-	for (;;) {
-		splitAxis = 0;
-
-		const vector3d boxSize = splitBox.max - splitBox.min;
-
-		if (boxSize[1] > boxSize[0]) splitAxis = 1;
-		if ((boxSize[2] > boxSize[1]) && (boxSize[2] > boxSize[0])) splitAxis = 2;
-
-		// split pos in middle of splitBox
-		splitPos = 0.5f * (splitBox.min[splitAxis] + splitBox.max[splitAxis]);
-		s1count = 0, s2count = 0;
-
-		for (int i = 0; i < numTris; i++) {
-			const int idx = activeObjIdx[i];
-			const double mid = 0.5 * (objAabbs[idx].min[splitAxis] + objAabbs[idx].max[splitAxis]);
-			if (mid < splitPos) {
-				splitSides[i] = 0;
-				s1count++;
-			} else {
-				splitSides[i] = 1;
-				s2count++;
-			}
+}
+
+Uint32 BVHTree::BuildNode(std::vector<BuildObj> &objs, size_t start, size_t count, int depth)
+{
+	// careful, m_nodes grows while we recurse so only hold on to the index
+	const Uint32 nodeIdx = m_nodes.size();
+	m_nodes.push_back(BVHNode());
+	m_depth = std::max(m_depth, depth);
+
+	const size_t end = start + count;
+	vector3d min(FLT_MAX), max(-FLT_MAX);
+	vector3d cmin(FLT_MAX), cmax(-FLT_MAX);
+	for (size_t i = start; i < end; i++) {
+		ExpandBounds(min, max, objs[i].min, objs[i].max);
+		ExpandBounds(cmin, cmax, objs[i].centroid, objs[i].centroid);
+	}
+	m_nodes[nodeIdx].min = vector3f(min);
+	m_nodes[nodeIdx].max = vector3f(max);
+
+	// only degenerate input gets this deep, a slow leaf is better than
+	// overflowing a traversal stack
+	if (depth >= MAX_DEPTH) {
+		MakeLeaf(m_nodes[nodeIdx], objs, start, count);
+		return nodeIdx;
+	}
+
+	// find the cheapest bin boundary on any axis. splitting has to beat
+	// just testing every object in a leaf
+	int bestAxis = -1;
+	int bestSplit = 0;
+	double bestCost = SAH_INTERSECT_COST * double(count);
+
+	const double parentArea = SurfaceArea(min, max);
+	const double invParentArea = parentArea > 0.0 ? 1.0 / parentArea : 0.0;
+
+	struct Bin {
+		vector3d min, max;
+		size_t count;
+	};
+
+	for (int axis = 0; (count > 1) && (axis < 3); axis++) {
+		const double extent = cmax[axis] - cmin[axis];
+		if (extent <= 0.0) continue;
+		const double binScale = SAH_NUM_BINS / extent;
+
+		Bin bins[SAH_NUM_BINS];
+		for (int b = 0; b < SAH_NUM_BINS; b++) {
+			bins[b].min = vector3d(FLT_MAX);
+			bins[b].max = vector3d(-FLT_MAX);
+			bins[b].count = 0;
+		}
+		for (size_t i = start; i < end; i++) {
+			const int b = std::min(int((objs[i].centroid[axis] - cmin[axis]) * binScale), SAH_NUM_BINS - 1);
+			ExpandBounds(bins[b].min, bins[b].max, objs[i].min, objs[i].max);
+			bins[b].count++;
 		}
 
-		if (s1count == numTris) {
-			if (attempt < MAX_SPLITPOS_RETRIES) {
-				// try splitting at average point
-				splitBox.max[splitAxis] = splitPos;
-				attempt++;
-				continue;
-			} else {
-				MakeLeaf(node, objPtrs, activeObjIdx);
-				return;
-			}
-		} else if (s2count == numTris) {
-			if (attempt < MAX_SPLITPOS_RETRIES) {
-				// try splitting at average point
-				splitBox.min[splitAxis] = splitPos;
-				attempt++;
-				continue;
-			} else {
-				MakeLeaf(node, objPtrs, activeObjIdx);
-				return;
+		// sweep from the right to get the cost of everything above each boundary
+		double rightArea[SAH_NUM_BINS];
+		size_t rightCount[SAH_NUM_BINS];
+		vector3d rmin(FLT_MAX), rmax(-FLT_MAX);
+		size_t rcount = 0;
+		for (int b = SAH_NUM_BINS - 1; b > 0; b--) {
+			if (bins[b].count) ExpandBounds(rmin, rmax, bins[b].min, bins[b].max);
+			rcount += bins[b].count;
+			rightArea[b] = rcount ? SurfaceArea(rmin, rmax) : 0.0;
+			rightCount[b] = rcount;
+		}
+
+		// then from the left, evaluating each boundary as we go
+		vector3d lmin(FLT_MAX), lmax(-FLT_MAX);
+		size_t lcount = 0;
+		for (int b = 0; b < SAH_NUM_BINS - 1; b++) {
+			if (bins[b].count) ExpandBounds(lmin, lmax, bins[b].min, bins[b].max);
+			lcount += bins[b].count;
+			if (!lcount || !rightCount[b + 1]) continue;
+
+			const double cost = SAH_TRAVERSAL_COST +
+				SAH_INTERSECT_COST * invParentArea *
+					(SurfaceArea(lmin, lmax) * lcount + rightArea[b + 1] * rightCount[b + 1]);
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b + 1;
 			}
 		}
-		break;
 	}
 
-	std::vector<int> side[2];
-	side[0].reserve(numTris);
-	side[1].reserve(numTris);
+	BuildObj *first = &objs[start];
+	BuildObj *last = first + count;
+	BuildObj *mid;
+
+	if (bestAxis >= 0) {
+		const int axis = bestAxis;
+		const double binScale = SAH_NUM_BINS / (cmax[axis] - cmin[axis]);
+		const double axisMin = cmin[axis];
+		const int split = bestSplit;
+		mid = std::partition(first, last, [=](const BuildObj &o) {
+			return std::min(int((o.centroid[axis] - axisMin) * binScale), SAH_NUM_BINS - 1) < split;
+		});
+	} else {
+		// the heuristic wants a leaf. keep it small unless every object
+		// has the same centroid, in which case there's nothing to split on
+		const vector3d csize = cmax - cmin;
+		int axis = 0;
+		if (csize.y > csize.x) axis = 1;
+		if ((csize.z > csize.y) && (csize.z > csize.x)) axis = 2;
+
+		if ((count <= MAX_LEAF_OBJS) || (csize[axis] <= 0.0)) {
+			MakeLeaf(m_nodes[nodeIdx], objs, start, count);
+			return nodeIdx;
+		}
 
-	for (int i = 0; i < numTris; i++) {
-		side[splitSides[i]].push_back(activeObjIdx[i]);
+		// median split
+		mid = first + count / 2;
+		std::nth_element(first, mid, last, [axis](const BuildObj &a, const BuildObj &b) {
+			return a.centroid[axis] < b.centroid[axis];
+		});
 	}
 
-	// recurse!
-	node->triIndicesStart = 0;
-	node->kids[0] = AllocNode();
-	node->kids[1] = AllocNode();
+	const size_t leftCount = size_t(mid - first);
+	assert(leftCount > 0 && leftCount < count);
+
+	// recurse! first kid goes straight after us, second wherever it lands
+	m_nodes[nodeIdx].numTris = 0;
+	BuildNode(objs, start, leftCount, depth + 1);
+	const Uint32 rightIdx = BuildNode(objs, start + leftCount, count - leftCount, depth + 1);
+	m_nodes[nodeIdx].offset = rightIdx;
 
-	BuildNode(node->kids[0], objPtrs, objAabbs, side[0]);
-	BuildNode(node->kids[1], objPtrs, objAabbs, side[1]);
+	return nodeIdx;
 }
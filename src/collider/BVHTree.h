@@ -10,59 +10,73 @@
 #include <assert.h>
 #include <vector>
 
-struct BVHNode {
-	Aabb aabb;
-
-	/* if triIndicesStart == 0 then not leaf,
-	 * kids[] valid */
-	int numTris;
-	int *triIndicesStart;
+namespace Serializer {
+	class Reader;
+	class Writer;
+} // namespace Serializer
 
-	BVHNode *kids[2];
+/*
+ * Nodes are stored depth first in one flat array: an inner node's first kid
+ * always directly follows it, and 'offset' gives the index of the second.
+ * For leaves 'offset' is the index of the first object in the tree's object
+ * array instead.
+ */
+struct BVHNode {
+	vector3f min, max;
+	Uint32 offset;
+	Uint32 numTris; // zero for inner nodes
 
-	BVHNode() :
-		numTris(0),
-		triIndicesStart(nullptr)
+	bool IsLeaf() const
 	{
-		kids[0] = nullptr;
-		kids[1] = nullptr;
+		return numTris != 0;
 	}
-	bool IsLeaf() const
+	Aabb GetAabb() const
 	{
-		return triIndicesStart != nullptr;
+		Aabb aabb;
+		aabb.min = vector3d(min);
+		aabb.max = vector3d(max);
+		return aabb;
 	}
 };
 
+static_assert(sizeof(BVHNode) == 32, "BVHNode should be 32 bytes, two to a cache line");
+
 class BVHTree {
 public:
 	typedef int objPtr_t;
+	// the builder makes a leaf rather than go any deeper, so a traversal
+	// never needs more than this many stack entries per tree
+	static const int MAX_DEPTH = 48;
+
 	BVHTree(const int numObjs, const objPtr_t *objPtrs, const Aabb *objAabbs);
-	~BVHTree()
+	BVHTree(Serializer::Reader &rd);
+
+	void Save(Serializer::Writer &wr) const;
+
+	const BVHNode *GetRoot() const { return &m_nodes[0]; }
+	const BVHNode *GetKid(const BVHNode *node, int kid) const
 	{
-		delete[] m_objPtrAlloc;
-		delete[] m_bvhNodes;
+		assert(!node->IsLeaf());
+		return kid ? &m_nodes[node->offset] : node + 1;
 	}
-	BVHNode *GetRoot() { return m_root; }
-
-private:
-	void BuildNode(BVHNode *node,
-		const objPtr_t *objPtrs,
-		const Aabb *objAabbs,
-		std::vector<objPtr_t> &activeObjIdxs);
-	void MakeLeaf(BVHNode *node, const objPtr_t *objPtrs, std::vector<objPtr_t> &objs);
-	BVHNode *AllocNode()
+	const objPtr_t *GetObjPtrs(const BVHNode *leaf) const
 	{
-		if (m_nodeAllocPos >= m_nodeAllocMax) Error("Out of space in m_bvhNodes.");
-		return &m_bvhNodes[m_nodeAllocPos++];
+		assert(leaf->IsLeaf());
+		return &m_objPtrs[leaf->offset];
 	}
-	BVHNode *m_root;
-	objPtr_t *m_objPtrAlloc;
-	size_t m_objPtrAllocPos;
-	size_t m_objPtrAllocMax;
+	size_t GetNumNodes() const { return m_nodes.size(); }
+
+private:
+	struct BuildObj {
+		vector3d min, max, centroid;
+		objPtr_t objPtr;
+	};
+	Uint32 BuildNode(std::vector<BuildObj> &objs, size_t start, size_t count, int depth);
+	void MakeLeaf(BVHNode &node, const std::vector<BuildObj> &objs, size_t start, size_t count);
 
-	BVHNode *m_bvhNodes;
-	size_t m_nodeAllocPos;
-	size_t m_nodeAllocMax;
+	std::vector<BVHNode> m_nodes;
+	std::vector<objPtr_t> m_objPtrs;
+	int m_depth; // levels of nodes, 1 if the root is a leaf
 };
 
 #endif /* _BVHTREE_H */
@@ -5,15 +5,16 @@
 #include "../libs.h"
 #include "Geom.h"
 #include "GeomTree.h"
+#include "CollisionContact.h"
 
 /* volnode!!!!!!!!!!! */
 struct BvhNode {
 	Aabb aabb;
 
 	/* if geomStart == 0 then not leaf,
-	 * kids[] valid */
+	 * kids[] valid. otherwise indices into the GeomStore */
 	int numGeoms;
-	Geom **geomStart;
+	int *geomStart;
 
 	BvhNode *kids[2];
 
@@ -52,7 +53,8 @@ struct BvhNode {
  */
 class BvhTree {
 public:
-	Geom **m_geoms;
+	const GeomStore *m_store;
+	int *m_geoms;
 	BvhNode *m_root;
 	BvhNode *m_nodesAlloc;
 	int m_nodesAllocPos;
@@ -64,46 +66,123 @@ public:
 		return &m_nodesAlloc[m_nodesAllocPos++];
 	}
 
-	BvhTree(const std::list<Geom *> &geoms);
+	BvhTree(const GeomStore &store);
 	~BvhTree()
 	{
 		if (m_geoms) delete[] m_geoms;
 		if (m_nodesAlloc) delete[] m_nodesAlloc;
 	}
-	void CollideGeom(Geom *, const Aabb &, int minMailboxValue, void (*callback)(CollisionContact *));
+	// calls f(geom) for every geom whose bounding sphere touches the one
+	// given, always in the same order for the same tree. only geoms at index
+	// minIndex and above, and not in group, are looked at. returns the number
+	// of pairs that got as far as the bounding sphere test
+	template <typename F>
+	Uint32 ForEachPair(const vector3d &pos, double radius, int group, int minIndex, F f) const;
+
+	// recompute node aabbs from current geom positions, keeping the tree shape
+	void Refit();
+	// sum of node surface areas over the root's, a rough measure of how much
+	// work traversal does. relative to the root so it doesn't change when
+	// everything just spreads out or closes in
+	double GetCost() const { return m_cost; }
+	// GetCost() when the tree was built
+	double GetBuildCost() const { return m_buildCost; }
 
 private:
-	void BuildNode(BvhNode *node, const std::list<Geom *> &a_geoms, int &outGeomPos);
+	void BuildNode(BvhNode *node, int *geoms, int numGeoms);
+	double CalcCost() const;
+
+	double m_cost;
+	double m_buildCost;
 };
 
-BvhTree::BvhTree(const std::list<Geom *> &geoms)
+static inline void ExpandAabbByGeom(Aabb &aabb, const GeomStore &store, int i)
+{
+	const vector3d &p = store.GetPosition(i);
+	const double rad = store.GetRadius(i);
+	aabb.Update(p + vector3d(rad, rad, rad));
+	aabb.Update(p - vector3d(rad, rad, rad));
+}
+
+static inline double AabbSurfaceArea(const Aabb &aabb)
+{
+	const vector3d d = aabb.max - aabb.min;
+	return 2.0 * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+BvhTree::BvhTree(const GeomStore &store)
 {
 	PROFILE_SCOPED()
+	m_store = &store;
 	m_geoms = 0;
 	m_nodesAlloc = 0;
-	int numGeoms = geoms.size();
+	m_cost = m_buildCost = 0.0;
+	int numGeoms = store.GetSize();
 	if (numGeoms == 0) {
 		m_root = 0;
 		return;
 	}
-	m_geoms = new Geom *[numGeoms];
-	int geomPos = 0;
+	m_geoms = new int[numGeoms];
+	for (int i = 0; i < numGeoms; i++)
+		m_geoms[i] = i;
 	m_nodesAllocPos = 0;
 	m_nodesAllocMax = numGeoms * 2;
 	m_nodesAlloc = new BvhNode[m_nodesAllocMax];
 	m_root = AllocNode();
-	BuildNode(m_root, geoms, geomPos);
-	assert(geomPos == numGeoms);
+	BuildNode(m_root, m_geoms, numGeoms);
+
+	m_cost = m_buildCost = CalcCost();
+}
+
+double BvhTree::CalcCost() const
+{
+	const double rootArea = AabbSurfaceArea(m_root->aabb);
+	if (rootArea <= 0.0) return 0.0;
+	double area = 0.0;
+	for (int i = 0; i < m_nodesAllocPos; i++)
+		area += AabbSurfaceArea(m_nodesAlloc[i].aabb);
+	return area / rootArea;
 }
 
-void BvhTree::CollideGeom(Geom *g, const Aabb &geomAabb, int minMailboxValue, void (*callback)(CollisionContact *))
+void BvhTree::Refit()
 {
 	PROFILE_SCOPED()
 	if (!m_root) return;
 
+	// kids are always allocated after their parent, so walking the node
+	// array backwards visits every node after both of its kids
+	for (int i = m_nodesAllocPos - 1; i >= 0; i--) {
+		BvhNode *node = &m_nodesAlloc[i];
+		Aabb aabb;
+		aabb.min = vector3d(FLT_MAX, FLT_MAX, FLT_MAX);
+		aabb.max = vector3d(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		if (node->geomStart) {
+			for (int j = 0; j < node->numGeoms; j++)
+				ExpandAabbByGeom(aabb, *m_store, node->geomStart[j]);
+		} else {
+			const Aabb &a = node->kids[0]->aabb;
+			const Aabb &b = node->kids[1]->aabb;
+			aabb.min = vector3d(std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z));
+			aabb.max = vector3d(std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z));
+		}
+		node->aabb = aabb;
+	}
+	m_cost = CalcCost();
+}
+
+template <typename F>
+Uint32 BvhTree::ForEachPair(const vector3d &pos, double radius, int group, int minIndex, F f) const
+{
+	PROFILE_SCOPED()
+	if (!m_root) return 0;
+
 	// our big aabb
-	vector3d pos = g->GetPosition();
-	double radius = g->GetGeomTree()->GetRadius();
+	Aabb geomAabb;
+	geomAabb.min = pos - vector3d(radius, radius, radius);
+	geomAabb.max = pos + vector3d(radius, radius, radius);
+
+	const GeomStore &store = *m_store;
+	Uint32 numTested = 0;
 
 	int stackPos = -1;
 	BvhNode *stack[16];
@@ -113,16 +192,13 @@ void BvhTree::CollideGeom(Geom *g, const Aabb &geomAabb, int minMailboxValue, vo
 		if (geomAabb.Intersects(node->aabb)) {
 			if (node->geomStart) {
 				for (int i = 0; i < node->numGeoms; i++) {
-					Geom *g2 = node->geomStart[i];
-					if (!g2->IsEnabled()) continue;
-					if (g2->GetMailboxIndex() < minMailboxValue) continue;
-					if (g2 == g) continue;
-					if (g->GetGroup() && g2->GetGroup() == g->GetGroup()) continue;
-					double radius2 = g2->GetGeomTree()->GetRadius();
-					vector3d pos2 = g2->GetPosition();
-					if ((pos - pos2).Length() <= (radius + radius2)) {
-						g->Collide(g2, callback);
-					}
+					const int j = node->geomStart[i];
+					if (j < minIndex) continue;
+					if (group && store.GetGroup(j) == group) continue;
+					numTested++;
+					const double radii = radius + store.GetRadius(j);
+					if ((pos - store.GetPosition(j)).LengthSqr() <= radii * radii)
+						f(store.GetGeom(j));
 				}
 			} else if (node->kids[0]) {
 				stack[++stackPos] = node->kids[0];
@@ -134,12 +210,13 @@ void BvhTree::CollideGeom(Geom *g, const Aabb &geomAabb, int minMailboxValue, vo
 		if (stackPos < 0) break;
 		node = stack[stackPos--];
 	}
+
+	return numTested;
 }
 
-void BvhTree::BuildNode(BvhNode *node, const std::list<Geom *> &a_geoms, int &outGeomPos)
+void BvhTree::BuildNode(BvhNode *node, int *geoms, int numGeoms)
 {
 	PROFILE_SCOPED()
-	const int numGeoms = a_geoms.size();
 	// make aabb from spheres
 	// XXX suboptimal for static objects, as they have fixed rotation so
 	// we can use a precise rotated aabb rather than worst case XXX
@@ -147,13 +224,8 @@ void BvhTree::BuildNode(BvhNode *node, const std::list<Geom *> &a_geoms, int &ou
 	aabb.min = vector3d(FLT_MAX, FLT_MAX, FLT_MAX);
 	aabb.max = vector3d(-FLT_MAX, -FLT_MAX, -FLT_MAX);
 
-	for (std::list<Geom *>::const_iterator i = a_geoms.begin();
-		 i != a_geoms.end(); ++i) {
-		vector3d p = (*i)->GetPosition();
-		double rad = (*i)->GetGeomTree()->GetRadius();
-		aabb.Update(p + vector3d(rad, rad, rad));
-		aabb.Update(p - vector3d(rad, rad, rad));
-	}
+	for (int i = 0; i < numGeoms; i++)
+		ExpandAabbByGeom(aabb, *m_store, geoms[i]);
 
 	// divide by longest axis
 	int axis;
@@ -166,51 +238,114 @@ void BvhTree::BuildNode(BvhNode *node, const std::list<Geom *> &a_geoms, int &ou
 		axis = 2;
 	const double pivot = 0.5 * (aabb.max[axis] + aabb.min[axis]);
 
-	std::list<Geom *> side[2];
-
-	for (std::list<Geom *>::const_iterator i = a_geoms.begin();
-		 i != a_geoms.end(); ++i) {
-		if ((*i)->GetPosition()[axis] < pivot) {
-			side[0].push_back(*i);
-		} else {
-			side[1].push_back(*i);
-		}
-	}
+	// partition in place, so each subtree owns a contiguous run of m_geoms
+	const GeomStore &store = *m_store;
+	int *split = std::partition(geoms, geoms + numGeoms,
+		[&store, axis, pivot](int i) { return store.GetPosition(i)[axis] < pivot; });
+	const int numLeft = int(split - geoms);
 
 	node->numGeoms = numGeoms;
 	node->aabb = aabb;
 
 	// side 1 has all nodes. just make a fucking child
-	if ((side[0].size() == 0) || (side[1].size() == 0)) {
-		node->geomStart = &m_geoms[outGeomPos];
-
-		// copy geoms to the stinking flat array
-		for (std::list<Geom *>::const_iterator i = a_geoms.begin();
-			 i != a_geoms.end(); ++i) {
-			m_geoms[outGeomPos++] = *i;
-		}
+	if ((numLeft == 0) || (numLeft == numGeoms)) {
+		node->geomStart = geoms;
 	} else {
 		// recurse!
 		node->geomStart = 0;
 		node->kids[0] = AllocNode();
 		node->kids[1] = AllocNode();
 
-		BuildNode(node->kids[0], side[0], outGeomPos);
-		BuildNode(node->kids[1], side[1], outGeomPos);
+		BuildNode(node->kids[0], geoms, numLeft);
+		BuildNode(node->kids[1], split, numGeoms - numLeft);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+
+void GeomStore::Add(Geom *g)
+{
+	int handle;
+	if (!m_freeHandles.empty()) {
+		handle = m_freeHandles.back();
+		m_freeHandles.pop_back();
+	} else {
+		handle = m_handleIndices.size();
+		m_handleIndices.push_back(-1);
+	}
+	m_handleIndices[handle] = m_geoms.size();
+	m_indexHandles.push_back(handle);
+	g->SetStoreHandle(handle);
+
+	m_geoms.push_back(g);
+	m_positions.push_back(g->GetPosition());
+	m_radii.push_back(g->GetGeomTree()->GetRadius());
+	m_groups.push_back(g->GetGroup());
+}
+
+void GeomStore::Remove(Geom *g)
+{
+	const int handle = g->GetStoreHandle();
+	if (handle < 0 || handle >= int(m_handleIndices.size())) return;
+	const int i = m_handleIndices[handle];
+	// not ours (it's in some other space's store)
+	if (i < 0 || m_geoms[i] != g) return;
+
+	// move the last one into the hole
+	const int last = m_geoms.size() - 1;
+	if (i != last) {
+		m_geoms[i] = m_geoms[last];
+		m_positions[i] = m_positions[last];
+		m_radii[i] = m_radii[last];
+		m_groups[i] = m_groups[last];
+		m_indexHandles[i] = m_indexHandles[last];
+		m_handleIndices[m_indexHandles[i]] = i;
+	}
+	m_geoms.pop_back();
+	m_positions.pop_back();
+	m_radii.pop_back();
+	m_groups.pop_back();
+	m_indexHandles.pop_back();
+
+	m_handleIndices[handle] = -1;
+	m_freeHandles.push_back(handle);
+	g->SetStoreHandle(-1);
+}
+
+void GeomStore::Sync()
+{
+	PROFILE_SCOPED()
+	const int numGeoms = m_geoms.size();
+	for (int i = 0; i < numGeoms; i++) {
+		const Geom *g = m_geoms[i];
+		m_positions[i] = g->GetPosition();
+		m_groups[i] = g->GetGroup();
 	}
 }
 
 ///////////////////////////////////////////////////////////////////////
 
 int CollisionSpace::s_nextHandle = 1;
+std::atomic<Uint32> CollisionSpace::s_numPairsTested(0);
+
+// rebuild the dynamic tree once refitting has made it this much worse than
+// it was when built. adding or removing geoms always rebuilds it
+static const double DYNAMIC_TREE_REBUILD_RATIO = 2.0;
 
 CollisionSpace::CollisionSpace()
 {
 	PROFILE_SCOPED()
 	sphere.radius = 0;
 	m_needStaticGeomRebuild = true;
+	m_needDynamicGeomRebuild = true;
 	m_staticObjectTree = 0;
 	m_dynamicObjectTree = 0;
+	m_prevNeedStaticGeomRebuild = true;
+	m_prevNeedDynamicGeomRebuild = true;
+	m_prevStaticObjectTree = 0;
+	m_prevDynamicObjectTree = 0;
+	m_staticGeomsChanged = false;
+	m_dynamicGeomsChanged = false;
 }
 
 CollisionSpace::~CollisionSpace()
@@ -218,32 +353,40 @@ CollisionSpace::~CollisionSpace()
 	PROFILE_SCOPED()
 	if (m_staticObjectTree) delete m_staticObjectTree;
 	if (m_dynamicObjectTree) delete m_dynamicObjectTree;
+	if (m_prevStaticObjectTree) delete m_prevStaticObjectTree;
+	if (m_prevDynamicObjectTree) delete m_prevDynamicObjectTree;
 }
 
 void CollisionSpace::AddGeom(Geom *geom)
 {
 	PROFILE_SCOPED()
-	m_geoms.push_back(geom);
+	m_geoms.Add(geom);
+	m_needDynamicGeomRebuild = true;
+	m_dynamicGeomsChanged = true;
 }
 
 void CollisionSpace::RemoveGeom(Geom *geom)
 {
 	PROFILE_SCOPED()
-	m_geoms.remove(geom);
+	m_geoms.Remove(geom);
+	m_needDynamicGeomRebuild = true;
+	m_dynamicGeomsChanged = true;
 }
 
 void CollisionSpace::AddStaticGeom(Geom *geom)
 {
 	PROFILE_SCOPED()
-	m_staticGeoms.push_back(geom);
+	m_staticGeoms.Add(geom);
 	m_needStaticGeomRebuild = true;
+	m_staticGeomsChanged = true;
 }
 
 void CollisionSpace::RemoveStaticGeom(Geom *geom)
 {
 	PROFILE_SCOPED()
-	m_staticGeoms.remove(geom);
+	m_staticGeoms.Remove(geom);
 	m_needStaticGeomRebuild = true;
+	m_staticGeomsChanged = true;
 }
 
 void CollisionSpace::CollideRaySphere(const vector3d &start, const vector3d &dir, isect_t *isect)
@@ -280,6 +423,8 @@ void CollisionSpace::CollideRaySphere(const vector3d &start, const vector3d &dir
 void CollisionSpace::TraceRay(const vector3d &start, const vector3d &dir, double len, CollisionContact *c, const Geom *ignore /*= nullptr*/)
 {
 	PROFILE_SCOPED()
+	if (m_needStaticGeomRebuild) RebuildStaticObjectTree();
+
 	vector3d invDir(1.0 / dir.x, 1.0 / dir.y, 1.0 / dir.z);
 	c->distance = len;
 
@@ -300,7 +445,7 @@ void CollisionSpace::TraceRay(const vector3d &start, const vector3d &dir, double
 			// it is a leaf node
 			// collide with all geoms
 			for (int i = 0; i < node->numGeoms; i++) {
-				Geom *g = node->geomStart[i];
+				Geom *g = m_staticGeoms.GetGeom(node->geomStart[i]);
 
 				const matrix4x4d &invTrans = g->GetInvTransform();
 				vector3d ms = invTrans * start;
@@ -337,10 +482,11 @@ void CollisionSpace::TraceRay(const vector3d &start, const vector3d &dir, double
 		node = vn_stack[stackPos--];
 	}
 
-	for (std::list<Geom *>::iterator i = m_geoms.begin(); i != m_geoms.end(); ++i) {
-		if ((*i) == ignore) continue;
-		if ((*i)->IsEnabled()) {
-			const matrix4x4d &invTrans = (*i)->GetInvTransform();
+	for (int i = 0; i < m_geoms.GetSize(); i++) {
+		Geom *g = m_geoms.GetGeom(i);
+		if (g == ignore) continue;
+		if (g->IsEnabled()) {
+			const matrix4x4d &invTrans = g->GetInvTransform();
 			vector3d ms = invTrans * start;
 			vector3d md = invTrans.ApplyRotationOnly(dir);
 			vector3f modelStart = vector3f(ms.x, ms.y, ms.z);
@@ -349,19 +495,19 @@ void CollisionSpace::TraceRay(const vector3d &start, const vector3d &dir, double
 			isect_t isect;
 			isect.dist = float(c->distance);
 			isect.triIdx = -1;
-			(*i)->GetGeomTree()->TraceRay(modelStart, modelDir, &isect);
+			g->GetGeomTree()->TraceRay(modelStart, modelDir, &isect);
 			if (isect.triIdx != -1) {
 				c->pos = start + dir * double(isect.dist);
 
-				vector3f n = (*i)->GetGeomTree()->GetTriNormal(isect.triIdx);
+				vector3f n = g->GetGeomTree()->GetTriNormal(isect.triIdx);
 				c->normal = vector3d(n.x, n.y, n.z);
-				c->normal = (*i)->GetTransform().ApplyRotationOnly(c->normal);
+				c->normal = g->GetTransform().ApplyRotationOnly(c->normal);
 
 				c->depth = len - isect.dist;
 				c->triIdx = isect.triIdx;
-				c->userData1 = (*i)->GetUserData();
+				c->userData1 = g->GetUserData();
 				c->userData2 = 0;
-				c->geomFlag = (*i)->GetGeomTree()->GetTriFlag(isect.triIdx);
+				c->geomFlag = g->GetGeomTree()->GetTriFlag(isect.triIdx);
 				c->distance = isect.dist;
 			}
 		}
@@ -384,56 +530,643 @@ void CollisionSpace::TraceRay(const vector3d &start, const vector3d &dir, double
 	}
 }
 
+// rays go through the object trees this many at a time, one mask bit each
+static const int RAY_BATCH_SIZE = 32;
+
+static void SetGeomRayContact(CollisionContact *c, const CollisionRay &ray, const Geom *g, const isect_t &isect)
+{
+	c->pos = ray.start + ray.dir * double(isect.dist);
+
+	vector3f n = g->GetGeomTree()->GetTriNormal(isect.triIdx);
+	c->normal = vector3d(n.x, n.y, n.z);
+	c->normal = g->GetTransform().ApplyRotationOnly(c->normal);
+
+	c->depth = ray.len - isect.dist;
+	c->triIdx = isect.triIdx;
+	c->userData1 = g->GetUserData();
+	c->userData2 = 0;
+	c->geomFlag = g->GetGeomTree()->GetTriFlag(isect.triIdx);
+	c->distance = isect.dist;
+}
+
+void CollisionSpace::TraceRays(int numRays, const CollisionRay *rays, CollisionContact *contacts)
+{
+	PROFILE_SCOPED()
+	for (int first = 0; first < numRays; first += RAY_BATCH_SIZE) {
+		TraceRayBatch(std::min(RAY_BATCH_SIZE, numRays - first), &rays[first], &contacts[first]);
+	}
+}
+
 /*
- * Do not collide objects with mailbox value < minMailboxValue
+ * Same walk as TraceRay, but each node is visited once for all the rays that
+ * still reach it, and the rays hitting a geom go down its tri tree in packets.
  */
-void CollisionSpace::CollideGeoms(Geom *a, int minMailboxValue, void (*callback)(CollisionContact *))
+void CollisionSpace::TraceRayBatch(int numRays, const CollisionRay *rays, CollisionContact *contacts)
 {
 	PROFILE_SCOPED()
-	if (!a->IsEnabled()) return;
-	// our big aabb
-	vector3d pos = a->GetPosition();
-	double radius = a->GetGeomTree()->GetRadius();
-	Aabb ourAabb;
-	ourAabb.min = pos - vector3d(radius, radius, radius);
-	ourAabb.max = pos + vector3d(radius, radius, radius);
+	assert(numRays <= RAY_BATCH_SIZE);
+	if (m_needStaticGeomRebuild) RebuildStaticObjectTree();
+
+	vector3d invDirs[RAY_BATCH_SIZE];
+	for (int i = 0; i < numRays; i++) {
+		const vector3d &dir = rays[i].dir;
+		invDirs[i] = vector3d(1.0 / dir.x, 1.0 / dir.y, 1.0 / dir.z);
+		contacts[i].distance = rays[i].len;
+	}
+	const Uint32 allRays = numRays == RAY_BATCH_SIZE ? ~Uint32(0) : (Uint32(1) << numRays) - 1;
+
+	if (m_staticObjectTree) {
+		struct stackobj {
+			BvhNode *node;
+			Uint32 mask;
+		} vn_stack[16];
+		BvhNode *node = m_staticObjectTree->m_root;
+		Uint32 mask = allRays;
+		int stackPos = -1;
+
+		for (; node;) {
+			// which rays still hit it?
+			for (int i = 0; i < numRays; i++) {
+				if (!(mask & (Uint32(1) << i))) continue;
+				isect_t isect;
+				isect.dist = float(contacts[i].distance);
+				isect.triIdx = -1;
+				if (!node->CollideRay(rays[i].start, invDirs[i], &isect)) mask &= ~(Uint32(1) << i);
+			}
+
+			if (mask) {
+				if (node->geomStart) {
+					for (int i = 0; i < node->numGeoms; i++) {
+						TraceRayBatchAgainstGeom(m_staticGeoms.GetGeom(node->geomStart[i]), mask, rays, contacts);
+					}
+				} else if (node->kids[0]) {
+					++stackPos;
+					vn_stack[stackPos].node = node->kids[0];
+					vn_stack[stackPos].mask = mask;
+					node = node->kids[1];
+					continue;
+				}
+			}
 
-	if (m_staticObjectTree) m_staticObjectTree->CollideGeom(a, ourAabb, 0, callback);
-	if (m_dynamicObjectTree) m_dynamicObjectTree->CollideGeom(a, ourAabb, minMailboxValue, callback);
+			if (stackPos < 0) break;
+			node = vn_stack[stackPos].node;
+			mask = vn_stack[stackPos].mask;
+			stackPos--;
+		}
+	}
+
+	for (int i = 0; i < m_geoms.GetSize(); i++) {
+		const Geom *g = m_geoms.GetGeom(i);
+		if (!g->IsEnabled()) continue;
+		Uint32 mask = allRays;
+		for (int j = 0; j < numRays; j++) {
+			if (rays[j].ignore == g) mask &= ~(Uint32(1) << j);
+		}
+		if (mask) TraceRayBatchAgainstGeom(g, mask, rays, contacts);
+	}
+
+	for (int i = 0; i < numRays; i++) {
+		CollisionContact *c = &contacts[i];
+		isect_t isect;
+		isect.dist = float(c->distance);
+		isect.triIdx = -1;
+		CollideRaySphere(rays[i].start, rays[i].dir, &isect);
+		if (isect.triIdx != -1) {
+			c->pos = rays[i].start + rays[i].dir * double(isect.dist);
+			c->normal = vector3d(0.0);
+			c->depth = rays[i].len - isect.dist;
+			c->triIdx = -1;
+			c->userData1 = sphere.userData;
+			c->userData2 = 0;
+			c->geomFlag = 0;
+			c->distance = isect.dist;
+		}
+	}
+}
+
+void CollisionSpace::TraceRayBatchAgainstGeom(const Geom *g, Uint32 rayMask, const CollisionRay *rays, CollisionContact *contacts)
+{
+	vector3f modelStarts[RAY_BATCH_SIZE];
+	vector3f modelDirs[RAY_BATCH_SIZE];
+	isect_t isects[RAY_BATCH_SIZE];
+	int rayIdxs[RAY_BATCH_SIZE];
+	int numRays = 0;
+
+	const matrix4x4d &invTrans = g->GetInvTransform();
+	for (int i = 0; i < RAY_BATCH_SIZE; i++) {
+		if (!(rayMask & (Uint32(1) << i))) continue;
+		const vector3d ms = invTrans * rays[i].start;
+		const vector3d md = invTrans.ApplyRotationOnly(rays[i].dir);
+		modelStarts[numRays] = vector3f(ms.x, ms.y, ms.z);
+		modelDirs[numRays] = vector3f(md.x, md.y, md.z);
+		isects[numRays].dist = float(contacts[i].distance);
+		isects[numRays].triIdx = -1;
+		rayIdxs[numRays] = i;
+		numRays++;
+	}
+	if (!numRays) return;
+
+	g->GetGeomTree()->TraceRays(numRays, modelStarts, modelDirs, isects);
+
+	for (int j = 0; j < numRays; j++) {
+		if (isects[j].triIdx != -1) {
+			const int i = rayIdxs[j];
+			SetGeomRayContact(&contacts[i], rays[i], g, isects[j]);
+		}
+	}
+}
+
+/*
+ * Geoms are only collided with those after them in the store, so after
+ * collision(a,b) we will not attempt collision(b,a)
+ */
+void CollisionSpace::CollideGeoms(int a, void (*callback)(CollisionContact *))
+{
+	PROFILE_SCOPED()
+	Geom *g = m_geoms.GetGeom(a);
+	if (!g->IsEnabled()) return;
+	const vector3d &pos = m_geoms.GetPosition(a);
+	const double radius = m_geoms.GetRadius(a);
+	const int group = m_geoms.GetGroup(a);
+
+	// whether they're enabled isn't copied into the store: an earlier
+	// contact's response (docking, say) can switch either of them off part
+	// way through the tick
+	auto collide = [g, callback](Geom *other) {
+		if (g->IsEnabled() && other->IsEnabled())
+			g->Collide(other, callback);
+	};
+	Uint32 numTested = 0;
+	if (m_staticObjectTree) numTested += m_staticObjectTree->ForEachPair(pos, radius, group, 0, collide);
+	if (m_dynamicObjectTree) numTested += m_dynamicObjectTree->ForEachPair(pos, radius, group, a + 1, collide);
+	s_numPairsTested += numTested;
 
 	/* test the fucker against the planet sphere thing */
-	if (sphere.radius > 0.0) {
-		a->CollideSphere(sphere, callback);
+	if (sphere.radius > 0.0 && g->IsEnabled()) {
+		g->CollideSphere(sphere, callback);
 	}
 }
 
+void CollisionSpace::RebuildStaticObjectTree()
+{
+	PROFILE_SCOPED()
+	m_staticGeoms.Sync();
+	if (m_staticObjectTree) delete m_staticObjectTree;
+	m_staticObjectTree = new BvhTree(m_staticGeoms);
+	m_needStaticGeomRebuild = false;
+}
+
+// the tree being replaced is kept for UndoPrepareCollide()
+static void KeepPrevTree(BvhTree *&tree, BvhTree *&prevTree)
+{
+	if (prevTree) delete prevTree;
+	prevTree = tree;
+	tree = 0;
+}
+
 void CollisionSpace::RebuildObjectTrees()
 {
 	PROFILE_SCOPED()
 	if (m_needStaticGeomRebuild) {
-		if (m_staticObjectTree) delete m_staticObjectTree;
-		m_staticObjectTree = new BvhTree(m_staticGeoms);
+		KeepPrevTree(m_staticObjectTree, m_prevStaticObjectTree);
+		RebuildStaticObjectTree();
+	} else {
+		// static geoms don't move, but they can still change group
+		m_staticGeoms.Sync();
 	}
-	if (m_dynamicObjectTree) delete m_dynamicObjectTree;
-	m_dynamicObjectTree = new BvhTree(m_geoms);
 
-	m_needStaticGeomRebuild = false;
+	// dynamic geoms move every tick but the set rarely changes, so keep the
+	// tree shape and just refit it until the bounds have degraded too far
+	m_geoms.Sync();
+	if (!m_needDynamicGeomRebuild && m_dynamicObjectTree) {
+		m_dynamicObjectTree->Refit();
+		if (m_dynamicObjectTree->GetCost() > DYNAMIC_TREE_REBUILD_RATIO * m_dynamicObjectTree->GetBuildCost())
+			m_needDynamicGeomRebuild = true;
+	}
+	if (m_needDynamicGeomRebuild) {
+		KeepPrevTree(m_dynamicObjectTree, m_prevDynamicObjectTree);
+		m_dynamicObjectTree = new BvhTree(m_geoms);
+	}
+
+	m_needDynamicGeomRebuild = false;
 }
 
-void CollisionSpace::Collide(void (*callback)(CollisionContact *))
+void CollisionSpace::PrepareCollide()
 {
 	PROFILE_SCOPED()
+	// only the last one can be undone
+	if (m_prevStaticObjectTree) delete m_prevStaticObjectTree;
+	if (m_prevDynamicObjectTree) delete m_prevDynamicObjectTree;
+	m_prevStaticObjectTree = m_prevDynamicObjectTree = 0;
+	m_prevNeedStaticGeomRebuild = m_needStaticGeomRebuild;
+	m_prevNeedDynamicGeomRebuild = m_needDynamicGeomRebuild;
+	m_staticGeomsChanged = m_dynamicGeomsChanged = false;
+
 	RebuildObjectTrees();
 
-	int mailboxMin = 0;
-	for (std::list<Geom *>::iterator i = m_geoms.begin(); i != m_geoms.end(); ++i) {
-		(*i)->SetMailboxIndex(mailboxMin++);
+	m_pairs.resize(m_geoms.GetSize());
+	m_pairVersions.resize(m_geoms.GetSize());
+}
+
+void CollisionSpace::Collide(void (*callback)(CollisionContact *))
+{
+	PROFILE_SCOPED()
+	PrepareCollide();
+
+	const int numGeoms = m_geoms.GetSize();
+	for (int i = 0; i < numGeoms; i++) {
+		CollideGeoms(i, callback);
+	}
+}
+
+// set by CollectPairs() on this thread when the pair it's testing touches
+static thread_local bool s_pairTouched = false;
+
+static void PairTouchedCallback(CollisionContact *)
+{
+	s_pairTouched = true;
+}
+
+void CollisionSpace::CollectPairs(int firstGeom, int numGeoms)
+{
+	PROFILE_SCOPED()
+	assert(firstGeom >= 0 && firstGeom + numGeoms <= m_geoms.GetSize());
+	assert(int(m_pairs.size()) == m_geoms.GetSize());
+	Uint32 numTested = 0;
+	for (int a = firstGeom; a < firstGeom + numGeoms; a++) {
+		Geom *g = m_geoms.GetGeom(a);
+		std::vector<CollidePair> &pairs = m_pairs[a];
+		pairs.clear();
+		m_pairVersions[a] = g->GetVersion();
+
+		// switched off pairs are kept too, a callback may switch them on
+		auto test = [&](Geom *other) {
+			CollidePair pair;
+			pair.other = other;
+			pair.otherVersion = other ? other->GetVersion() : 0;
+			if (!g->IsEnabled() || (other && !other->IsEnabled())) {
+				pair.result = CollidePair::NOT_TESTED;
+			} else {
+				s_pairTouched = false;
+				if (other)
+					g->Collide(other, &PairTouchedCallback);
+				else
+					g->CollideSphere(sphere, &PairTouchedCallback);
+				pair.result = s_pairTouched ? CollidePair::TOUCHED : CollidePair::MISSED;
+			}
+			pairs.push_back(pair);
+		};
+
+		// the same pairs in the same order as CollideGeoms()
+		const vector3d &pos = m_geoms.GetPosition(a);
+		const double radius = m_geoms.GetRadius(a);
+		const int group = m_geoms.GetGroup(a);
+		if (m_staticObjectTree) numTested += m_staticObjectTree->ForEachPair(pos, radius, group, 0, test);
+		if (m_dynamicObjectTree) numTested += m_dynamicObjectTree->ForEachPair(pos, radius, group, a + 1, test);
+		if (sphere.radius > 0.0) test(nullptr);
+	}
+	s_numPairsTested += numTested;
+}
+
+void CollisionSpace::FinishCollide(void (*callback)(CollisionContact *))
+{
+	PROFILE_SCOPED()
+	// Collide() would have prepared the trees just now
+	if (!IsPrepareCurrent()) {
+		UndoPrepareCollide();
+		Collide(callback);
+		return;
+	}
+
+	const int numGeoms = m_geoms.GetSize();
+	for (int i = 0; i < numGeoms; i++) {
+		FinishCollideGeom(i, callback);
+	}
+}
+
+void CollisionSpace::FinishCollideGeom(int a, void (*callback)(CollisionContact *))
+{
+	Geom *g = m_geoms.GetGeom(a);
+	for (const CollidePair &pair : m_pairs[a]) {
+		// as CollideGeoms(). nothing can switch it back on without a callback
+		if (!g->IsEnabled()) return;
+		if (pair.other && !pair.other->IsEnabled()) continue;
+
+		// the same test on geoms that haven't moved misses again
+		if (pair.result == CollidePair::MISSED && g->GetVersion() == m_pairVersions[a] &&
+			(!pair.other || pair.other->GetVersion() == pair.otherVersion))
+			continue;
+
+		if (pair.other)
+			g->Collide(pair.other, callback);
+		else
+			g->CollideSphere(sphere, callback);
+	}
+}
+
+// PrepareCollide() now would copy the same into the stores and do the same
+// to the trees
+bool CollisionSpace::IsPrepareCurrent() const
+{
+	if (m_staticGeomsChanged || m_dynamicGeomsChanged) return false;
+	for (const GeomStore *store : { &m_staticGeoms, &m_geoms }) {
+		const int numGeoms = store->GetSize();
+		for (int i = 0; i < numGeoms; i++) {
+			const Geom *g = store->GetGeom(i);
+			if (!g->GetPosition().ExactlyEqual(store->GetPosition(i)) || g->GetGroup() != store->GetGroup(i))
+				return false;
+		}
 	}
+	return true;
+}
 
-	/* This mailbox nonsense is so: after collision(a,b), we will not
-	 * attempt collision(b,a) */
-	mailboxMin = 1;
-	for (std::list<Geom *>::iterator i = m_geoms.begin(); i != m_geoms.end(); ++i, mailboxMin++) {
-		CollideGeoms(*i, mailboxMin, callback);
+void CollisionSpace::UndoPrepareCollide()
+{
+	PROFILE_SCOPED()
+	// refitting is redone from scratch, so only rebuilt trees need putting back
+	if (m_prevStaticObjectTree) {
+		if (m_staticObjectTree) delete m_staticObjectTree;
+		m_staticObjectTree = m_prevStaticObjectTree;
+		m_prevStaticObjectTree = 0;
+	}
+	if (m_prevDynamicObjectTree) {
+		if (m_dynamicObjectTree) delete m_dynamicObjectTree;
+		m_dynamicObjectTree = m_prevDynamicObjectTree;
+		m_prevDynamicObjectTree = 0;
+	}
+	m_needStaticGeomRebuild = m_prevNeedStaticGeomRebuild || m_staticGeomsChanged;
+	m_needDynamicGeomRebuild = m_prevNeedDynamicGeomRebuild || m_dynamicGeomsChanged;
+}
+
+#ifdef UNIT_TEST
+// Times the per tick cost of the dynamic object tree, refitting it as
+// RebuildObjectTrees() does against rebuilding it every tick, for 100, 1k
+// and 10k moving geoms, and checks both find the same contacts. Then times
+// CollectPairs() split into batches across threads and FinishCollide(), the
+// way Space::CollideFrames() does with ParallelCollision on, against
+// Collide(), with callbacks that move and switch off geoms as collision
+// responses do, and checks the callbacks are exactly the same.
+#include <atomic>
+#include "../BenchmarkClock.h"
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <thread>
+
+// a sphere of radius 10, a few hundred tris like a small ship
+static GeomTree *MakeSphereTree()
+{
+	const int rings = 8, segments = 16;
+	std::vector<vector3f> vertices;
+	for (int i = 0; i <= rings; i++) {
+		const float lat = float(M_PI) * i / rings - float(M_PI) * 0.5f;
+		for (int j = 0; j < segments; j++) {
+			const float lon = 2.0f * float(M_PI) * j / segments;
+			vertices.push_back(10.0f * vector3f(cos(lat) * cos(lon), sin(lat), cos(lat) * sin(lon)));
+		}
+	}
+	std::vector<Uint32> indices;
+	for (int i = 0; i < rings; i++) {
+		for (int j = 0; j < segments; j++) {
+			const Uint32 a = i * segments + j, b = i * segments + (j + 1) % segments;
+			const Uint32 c = a + segments, d = b + segments;
+			const Uint32 quad[] = { a, b, c, b, d, c };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
 	}
+	const int numTris = indices.size() / 3;
+	const std::vector<Uint32> triFlags(numTris, 0);
+	return new GeomTree(vertices.size(), numTris, vertices, indices.data(), triFlags.data());
 }
+
+// geoms drifting about a box sized so the number of neighbours stays the
+// same whatever the count. each space has its own copy of every geom
+struct MovingGeoms {
+	MovingGeoms(const GeomTree *tree, int count, int numSpaces, std::mt19937 &rng) :
+		spaces(numSpaces)
+	{
+		const double halfSize = 30.0 * cbrt(double(count));
+		std::uniform_real_distribution<double> unit(-1.0, 1.0);
+		for (int i = 0; i < count; i++) {
+			positions.push_back(halfSize * vector3d(unit(rng), unit(rng), unit(rng)));
+			velocities.push_back(5.0 * vector3d(unit(rng), unit(rng), unit(rng)));
+		}
+		for (int s = 0; s < numSpaces; s++) {
+			spaces[s] = new CollisionSpace;
+			for (int i = 0; i < count; i++) {
+				Geom *g = new Geom(tree, Transform(i), positions[i], reinterpret_cast<void *>(intptr_t(i + 1)));
+				geoms.push_back(g);
+				spaces[s]->AddGeom(g);
+			}
+		}
+	}
+
+	~MovingGeoms()
+	{
+		for (CollisionSpace *space : spaces)
+			delete space;
+		for (Geom *g : geoms)
+			delete g;
+	}
+
+	matrix4x4d Transform(int i) const
+	{
+		matrix4x4d m = matrix4x4d::Identity();
+		m.SetTranslate(positions[i]);
+		return m;
+	}
+
+	void Step()
+	{
+		for (size_t i = 0; i < positions.size(); i++)
+			positions[i] += velocities[i];
+		for (size_t g = 0; g < geoms.size(); g++) {
+			const int i = g % positions.size();
+			geoms[g]->MoveTo(Transform(i), positions[i]);
+			geoms[g]->Enable();
+		}
+	}
+
+	std::vector<CollisionSpace *> spaces;
+	std::vector<Geom *> geoms;
+	std::vector<vector3d> positions;
+	std::vector<vector3d> velocities;
+};
+
+// what the callbacks see
+static std::vector<CollisionContact> *s_contacts;
+static Geom **s_spaceGeoms; // the geoms of the space being collided
+static bool s_respond;
+
+// every so often pushes the first geom out along the normal, as hitCallback
+// does, or switches the second off, as docking does
+static void ContactCallback(CollisionContact *c)
+{
+	s_contacts->push_back(*c);
+	if (!s_respond)
+		return;
+	const int n = int(s_contacts->size());
+	if (n % 5 == 0) {
+		Geom *g = s_spaceGeoms[intptr_t(c->userData1) - 1];
+		const vector3d pos = g->GetPosition() + 0.5 * c->normal;
+		matrix4x4d m = g->GetTransform();
+		m.SetTranslate(pos);
+		g->MoveTo(m, pos);
+	}
+	if (n % 13 == 0)
+		s_spaceGeoms[intptr_t(c->userData2) - 1]->Disable();
+}
+
+// as Space::CollideFrames()
+static const int COLLISION_BATCH_GEOMS = 16;
+
+static void CollectPairsThreaded(CollisionSpace *space, int numThreads)
+{
+	const int numGeoms = space->GetNumCollideGeoms();
+	const int numBatches = (numGeoms + COLLISION_BATCH_GEOMS - 1) / COLLISION_BATCH_GEOMS;
+	std::atomic<int> nextBatch(0);
+	auto run = [&]() {
+		for (;;) {
+			const int i = nextBatch++;
+			if (i >= numBatches) break;
+			const int first = i * COLLISION_BATCH_GEOMS;
+			space->CollectPairs(first, std::min(COLLISION_BATCH_GEOMS, numGeoms - first));
+		}
+	};
+	std::vector<std::thread> threads;
+	for (int t = 1; t < numThreads; t++)
+		threads.emplace_back(run);
+	run();
+	for (std::thread &t : threads)
+		t.join();
+}
+
+static bool SameContact(const CollisionContact &a, const CollisionContact &b)
+{
+	return !memcmp(&a.pos, &b.pos, sizeof(a.pos)) && !memcmp(&a.normal, &b.normal, sizeof(a.normal)) &&
+		!memcmp(&a.depth, &b.depth, sizeof(a.depth)) && !memcmp(&a.distance, &b.distance, sizeof(a.distance)) &&
+		a.triIdx == b.triIdx && a.geomFlag == b.geomFlag && a.userData1 == b.userData1 && a.userData2 == b.userData2;
+}
+
+static int ParallelScaling(const GeomTree *tree, std::mt19937 &rng)
+{
+	const int count = 10000, ticks = 20;
+	const int numThreadCounts = 5;
+	const int threadCounts[numThreadCounts] = { 0, 1, 2, 4, 8 }; // 0 is Collide()
+	// each one gets its own copy, as the callbacks change them
+	MovingGeoms moving(tree, count, numThreadCounts, rng);
+	std::vector<CollisionContact> contacts[numThreadCounts];
+	double times[numThreadCounts] = {};
+	int mismatches[numThreadCounts] = {};
+	Uint32 numContacts = 0;
+	int failures = 0;
+
+	s_respond = true;
+	for (int t = 0; t < ticks; t++) {
+		moving.Step();
+		for (int i = 0; i < numThreadCounts; i++) {
+			CollisionSpace *space = moving.spaces[i];
+			s_spaceGeoms = &moving.geoms[i * count];
+			s_contacts = &contacts[i];
+			contacts[i].clear();
+
+			// now and then something else moves one of the geoms, or adds one,
+			// after the trees were prepared, as a response in an earlier
+			// frame might
+			auto interfere = [&]() {
+				if (t % 4 == 3) {
+					Geom *g = s_spaceGeoms[t];
+					const vector3d pos = g->GetPosition() + vector3d(1.0, 0.0, 0.0);
+					g->MoveTo(moving.Transform(t), pos);
+				}
+				if (t % 8 == 7)
+					space->FlagRebuildObjectTrees();
+			};
+
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			if (i == 0) {
+				interfere();
+				space->Collide(&ContactCallback);
+			} else {
+				space->PrepareCollide();
+				CollectPairsThreaded(space, threadCounts[i]);
+				interfere();
+				space->FinishCollide(&ContactCallback);
+			}
+			times[i] += seconds_since(start);
+			if (i == 0) {
+				numContacts += contacts[0].size();
+				continue;
+			}
+
+			if (contacts[i].size() != contacts[0].size())
+				mismatches[i]++;
+			for (size_t n = 0; n < std::min(contacts[i].size(), contacts[0].size()); n++) {
+				if (!SameContact(contacts[i][n], contacts[0][n]))
+					mismatches[i]++;
+			}
+		}
+	}
+	s_respond = false;
+
+	for (int i = 0; i < numThreadCounts; i++) {
+		if (i == 0)
+			printf("%5d geoms, Collide():  %7.3f ms/tick, %u contacts\n", count, times[0] * 1e3 / ticks, numContacts);
+		else
+			printf("%5d geoms, %d threads: %7.3f ms/tick, %.2fx, %d mismatches\n", count, threadCounts[i],
+				times[i] * 1e3 / ticks, times[0] / times[i], mismatches[i]);
+		if (mismatches[i])
+			failures++;
+	}
+	return failures;
+}
+
+int main()
+{
+	std::mt19937 rng(1);
+	std::unique_ptr<GeomTree> tree(MakeSphereTree());
+	const int ticks = 100;
+	int failures = 0;
+
+	for (int count : { 100, 1000, 10000 }) {
+		// space 0 refits, space 1 rebuilds
+		MovingGeoms moving(tree.get(), count, 2, rng);
+		double updateTime[2] = { 0.0, 0.0 }, collideTime[2] = { 0.0, 0.0 };
+		Uint32 numContacts[2] = { 0, 0 };
+		int mismatchedTicks = 0;
+		std::vector<CollisionContact> contacts[2];
+		for (int t = 0; t < ticks; t++) {
+			moving.Step();
+			for (int s = 0; s < 2; s++) {
+				CollisionSpace *space = moving.spaces[s];
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				if (s == 1)
+					space->FlagRebuildObjectTrees();
+				space->PrepareCollide();
+				updateTime[s] += seconds_since(start);
+
+				contacts[s].clear();
+				s_contacts = &contacts[s];
+				start = std::chrono::steady_clock::now();
+				space->CollectPairs(0, space->GetNumCollideGeoms());
+				space->FinishCollide(&ContactCallback);
+				collideTime[s] += seconds_since(start);
+				numContacts[s] += contacts[s].size();
+			}
+			// the trees differ, so contacts come in a different order
+			if (contacts[0].size() != contacts[1].size())
+				mismatchedTicks++;
+		}
+		if (mismatchedTicks)
+			failures++;
+
+		printf("%5d geoms: refit %7.3f + %7.3f ms/tick, rebuild %7.3f + %7.3f ms/tick (tree + collide), %u contacts, %d mismatched ticks\n",
+			count, updateTime[0] * 1e3 / ticks, collideTime[0] * 1e3 / ticks, updateTime[1] * 1e3 / ticks,
+			collideTime[1] * 1e3 / ticks, numContacts[0], mismatchedTicks);
+	}
+
+	failures += ParallelScaling(tree.get(), rng);
+	return failures;
+}
+
+#endif /* UNIT_TEST */
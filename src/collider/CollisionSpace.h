@@ -5,7 +5,9 @@
 #define _COLLISION_SPACE
 
 #include "../vector3.h"
-#include <list>
+#include <SDL_stdinc.h>
+#include <atomic>
+#include <vector>
 
 class Geom;
 struct isect_t;
@@ -17,8 +19,49 @@ struct Sphere {
 	void *userData;
 };
 
+struct CollisionRay {
+	CollisionRay() :
+		len(0.0),
+		ignore(nullptr) {}
+	vector3d start;
+	vector3d dir; // unit length
+	double len;
+	const Geom *ignore; // a dynamic geom the ray goes through, or null
+};
+
 class BvhTree;
 
+/*
+ * The geoms of a collision space as a structure of arrays, so tree builds and
+ * the broad phase walk contiguous memory instead of going Geom -> GeomTree for
+ * every test. Removing a geom moves the last one into its slot, so indices
+ * are dense but change; each geom keeps a handle into the store that doesn't.
+ * Position and group are copies, refreshed by Sync(). Whether a geom is
+ * enabled isn't copied, as it can change in the middle of Collide().
+ */
+class GeomStore {
+public:
+	void Add(Geom *g);
+	void Remove(Geom *g);
+	void Sync();
+
+	int GetSize() const { return int(m_geoms.size()); }
+	Geom *GetGeom(int i) const { return m_geoms[i]; }
+	const vector3d &GetPosition(int i) const { return m_positions[i]; }
+	double GetRadius(int i) const { return m_radii[i]; }
+	int GetGroup(int i) const { return m_groups[i]; }
+
+private:
+	std::vector<Geom *> m_geoms;
+	std::vector<vector3d> m_positions;
+	std::vector<double> m_radii;
+	std::vector<int> m_groups;
+
+	std::vector<int> m_handleIndices; // handle -> index, -1 if free
+	std::vector<int> m_indexHandles; // index -> handle
+	std::vector<int> m_freeHandles;
+};
+
 /*
  * Collision spaces have a bunch of geoms and at most one sphere (for a planet).
  */
@@ -31,14 +74,41 @@ public:
 	void AddStaticGeom(Geom *);
 	void RemoveStaticGeom(Geom *);
 	void TraceRay(const vector3d &start, const vector3d &dir, double len, CollisionContact *c, const Geom *ignore = nullptr);
+	// trace many rays in one go, one contact per ray. each contact is the
+	// same as TraceRay would give for that ray on its own
+	void TraceRays(int numRays, const CollisionRay *rays, CollisionContact *contacts);
 	void Collide(void (*callback)(CollisionContact *));
+
+	// Collide() split up so most of the work can be done on other threads,
+	// with exactly the same callbacks in the same order:
+	// - PrepareCollide() updates the trees. different spaces can be prepared
+	//   at the same time
+	// - CollectPairs() walks the trees for a range of the dynamic geoms and
+	//   tests each pair it finds, noting whether they touched. it only reads
+	//   the space, so separate ranges can be collected at the same time
+	// - FinishCollide() is then called on the main thread, where Collide()
+	//   would have been. it calls back for the pairs that touched, and tests
+	//   again any pair that an earlier callback (in this or any other space)
+	//   has moved or switched on. if a callback moved, added or removed
+	//   geoms here before then, it undoes the preparation and does Collide()
+	// nothing must move, or add or remove geoms, between the first two steps.
+	// geoms must not be added to or removed from a space inside its own
+	// callbacks either
+	void PrepareCollide();
+	int GetNumCollideGeoms() const { return m_geoms.GetSize(); }
+	void CollectPairs(int firstGeom, int numGeoms);
+	void FinishCollide(void (*callback)(CollisionContact *));
 	void SetSphere(const vector3d &pos, double radius, void *user_data)
 	{
 		sphere.pos = pos;
 		sphere.radius = radius;
 		sphere.userData = user_data;
 	}
-	void FlagRebuildObjectTrees() { m_needStaticGeomRebuild = true; }
+	void FlagRebuildObjectTrees()
+	{
+		m_needStaticGeomRebuild = m_staticGeomsChanged = true;
+		m_needDynamicGeomRebuild = m_dynamicGeomsChanged = true;
+	}
 	void RebuildObjectTrees();
 
 	// Geoms with the same handle will not be collision tested against each other
@@ -51,17 +121,58 @@ public:
 		return s_nextHandle++;
 	}
 
+	// geom pairs that got as far as the bounding sphere test, over all
+	// spaces since the last ClearStats()
+	static Uint32 GetNumPairsTested() { return s_numPairsTested; }
+	static void ClearStats() { s_numPairsTested = 0; }
+
 private:
-	void CollideGeoms(Geom *a, int minMailboxValue, void (*callback)(CollisionContact *));
+	// a pair found by CollectPairs(), other is null for the sphere
+	struct CollidePair {
+		enum Result : Uint8 {
+			NOT_TESTED, // one of them was switched off
+			MISSED,
+			TOUCHED
+		};
+		Geom *other;
+		Uint32 otherVersion;
+		Result result;
+	};
+
+	void CollideGeoms(int a, void (*callback)(CollisionContact *));
+	void FinishCollideGeom(int a, void (*callback)(CollisionContact *));
+	// whether the geoms are still where PrepareCollide() found them
+	bool IsPrepareCurrent() const;
+	// back to how things were before the last PrepareCollide(), as long as
+	// nothing has been collided since
+	void UndoPrepareCollide();
+	void RebuildStaticObjectTree();
 	void CollideRaySphere(const vector3d &start, const vector3d &dir, isect_t *isect);
-	std::list<Geom *> m_geoms;
-	std::list<Geom *> m_staticGeoms;
+	void TraceRayBatch(int numRays, const CollisionRay *rays, CollisionContact *contacts);
+	void TraceRayBatchAgainstGeom(const Geom *g, Uint32 rayMask, const CollisionRay *rays, CollisionContact *contacts);
+	GeomStore m_geoms;
+	GeomStore m_staticGeoms;
 	bool m_needStaticGeomRebuild;
+	bool m_needDynamicGeomRebuild;
 	BvhTree *m_staticObjectTree;
 	BvhTree *m_dynamicObjectTree;
 	Sphere sphere;
 
+	// how things were before PrepareCollide(), for UndoPrepareCollide()
+	bool m_prevNeedStaticGeomRebuild;
+	bool m_prevNeedDynamicGeomRebuild;
+	BvhTree *m_prevStaticObjectTree;
+	BvhTree *m_prevDynamicObjectTree;
+	// added, removed or flagged for a rebuild since PrepareCollide()
+	bool m_staticGeomsChanged;
+	bool m_dynamicGeomsChanged;
+
+	// from CollectPairs(), by dynamic geom, in the order Collide() tests them
+	std::vector<std::vector<CollidePair>> m_pairs;
+	std::vector<Uint32> m_pairVersions; // each dynamic geom's GetVersion() then
+
 	static int s_nextHandle;
+	static std::atomic<Uint32> s_numPairsTested;
 };
 
 #endif /* _COLLISION_SPACE */
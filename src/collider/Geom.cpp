@@ -18,7 +18,8 @@ Geom::Geom(const GeomTree *geomtree, const matrix4x4d &m, const vector3d &pos, v
 	m_geomtree(geomtree),
 	m_data(data),
 	m_group(0),
-	m_mailboxIndex(0),
+	m_storeHandle(-1),
+	m_version(0),
 	m_active(true)
 {
 	m_orient.SetTranslate(pos);
@@ -39,6 +40,7 @@ void Geom::MoveTo(const matrix4x4d &m)
 	m_orient = m;
 	m_pos = m_orient.GetTranslate();
 	m_invOrient = m.Inverse();
+	m_version++;
 }
 
 void Geom::MoveTo(const matrix4x4d &m, const vector3d &pos)
@@ -48,6 +50,7 @@ void Geom::MoveTo(const matrix4x4d &m, const vector3d &pos)
 	m_pos = pos;
 	m_orient.SetTranslate(pos);
 	m_invOrient = m_orient.Inverse();
+	m_version++;
 }
 
 void Geom::CollideSphere(Sphere &sphere, void (*callback)(CollisionContact *)) const
@@ -96,7 +99,7 @@ void Geom::Collide(Geom *b, void (*callback)(CollisionContact *)) const
 	//	Output("%d 'rays' in %dms (%f rps)\n", numEdges, t, 1000.0*numEdges / (double)t);
 }
 
-static bool rotatedAabbIsectsNormalOne(Aabb &a, const matrix4x4d &transA, Aabb &b)
+static bool rotatedAabbIsectsNormalOne(const Aabb &a, const matrix4x4d &transA, const Aabb &b)
 {
 	PROFILE_SCOPED()
 	Aabb arot;
@@ -122,53 +125,60 @@ static bool rotatedAabbIsectsNormalOne(Aabb &a, const matrix4x4d &transA, Aabb &
 void Geom::CollideEdgesWithTrisOf(int &maxContacts, const Geom *b, const matrix4x4d &transTo, void (*callback)(CollisionContact *)) const
 {
 	PROFILE_SCOPED()
+	// splitting the edge node pushes two and pops one, going down the tri
+	// tree pushes one and pops one, so it never holds more than one entry
+	// per level of the edge tree plus one
 	struct stackobj {
-		BVHNode *edgeNode;
-		BVHNode *triNode;
-	} stack[32];
+		const BVHNode *edgeNode;
+		const BVHNode *triNode;
+	} stack[BVHTree::MAX_DEPTH + 1];
 	int stackpos = 0;
 
-	stack[0].edgeNode = GetGeomTree()->GetEdgeTree()->GetRoot();
-	stack[0].triNode = b->GetGeomTree()->GetTriTree()->GetRoot();
+	const BVHTree *edgeTree = GetGeomTree()->GetEdgeTree();
+	const BVHTree *triTree = b->GetGeomTree()->GetTriTree();
+	stack[0].edgeNode = edgeTree->GetRoot();
+	stack[0].triNode = triTree->GetRoot();
 
 	while ((stackpos >= 0) && (maxContacts > 0)) {
-		BVHNode *edgeNode = stack[stackpos].edgeNode;
-		BVHNode *triNode = stack[stackpos].triNode;
+		const BVHNode *edgeNode = stack[stackpos].edgeNode;
+		const BVHNode *triNode = stack[stackpos].triNode;
 		stackpos--;
 
 		// does the edgeNode (with its aabb described in 6 planes transformed and rotated to
 		// b's coordinates) intersect with one or other of b's child nodes?
-		if (triNode->triIndicesStart || edgeNode->triIndicesStart) {
+		if (triNode->IsLeaf() || edgeNode->IsLeaf()) {
 			// reached triangle leaf node or edge leaf node.
 			// Intersect all edges under edgeNode with this leaf
 			CollideEdgesTris(maxContacts, edgeNode, transTo, b, triNode, callback);
 		} else {
-			BVHNode *left = triNode->kids[0];
-			BVHNode *right = triNode->kids[1];
-			bool edgeNodeIsectsLeftChild = rotatedAabbIsectsNormalOne(edgeNode->aabb, transTo, left->aabb);
-			bool edgeNodeIsectsRightChild = rotatedAabbIsectsNormalOne(edgeNode->aabb, transTo, right->aabb);
+			const BVHNode *left = triTree->GetKid(triNode, 0);
+			const BVHNode *right = triTree->GetKid(triNode, 1);
+			const Aabb edgeAabb = edgeNode->GetAabb();
+			bool edgeNodeIsectsLeftChild = rotatedAabbIsectsNormalOne(edgeAabb, transTo, left->GetAabb());
+			bool edgeNodeIsectsRightChild = rotatedAabbIsectsNormalOne(edgeAabb, transTo, right->GetAabb());
 			//edgeNodeIsectsRightChild = edgeNodeIsectsLeftChild = true;
 			if (edgeNodeIsectsRightChild) {
 				if (edgeNodeIsectsLeftChild) {
 					// isects both. split edgeNode and try again
+					assert(stackpos + 2 <= BVHTree::MAX_DEPTH);
 					++stackpos;
-					stack[stackpos].edgeNode = edgeNode->kids[0];
+					stack[stackpos].edgeNode = edgeTree->GetKid(edgeNode, 0);
 					stack[stackpos].triNode = triNode;
 					++stackpos;
-					stack[stackpos].edgeNode = edgeNode->kids[1];
+					stack[stackpos].edgeNode = edgeTree->GetKid(edgeNode, 1);
 					stack[stackpos].triNode = triNode;
 				} else {
 					// hits only right child. go down into that
 					// side with same edge node
 					++stackpos;
 					stack[stackpos].edgeNode = edgeNode;
-					stack[stackpos].triNode = triNode->kids[1];
+					stack[stackpos].triNode = triTree->GetKid(triNode, 1);
 				}
 			} else if (edgeNodeIsectsLeftChild) {
 				// hits only left child
 				++stackpos;
 				stack[stackpos].edgeNode = edgeNode;
-				stack[stackpos].triNode = triNode->kids[0];
+				stack[stackpos].triNode = triTree->GetKid(triNode, 0);
 			} else {
 				// hits none
 			}
@@ -185,31 +195,33 @@ void Geom::CollideEdgesTris(int &maxContacts, const BVHNode *edgeNode, const mat
 {
 	PROFILE_SCOPED()
 	if (maxContacts <= 0) return;
-	if (edgeNode->triIndicesStart) {
+	const BVHTree *edgeTree = GetGeomTree()->GetEdgeTree();
+	if (edgeNode->IsLeaf()) {
 		const GeomTree::Edge *edges = this->GetGeomTree()->GetEdges();
+		const BVHTree::objPtr_t *edgeIndices = edgeTree->GetObjPtrs(edgeNode);
 		int numContacts = 0;
 		vector3f dir;
 		isect_t isect;
 		const std::vector<vector3f> &rVertices = GetGeomTree()->GetVertices();
-		for (int i = 0; i < edgeNode->numTris; i++) {
-			const int vtxNum = edges[edgeNode->triIndicesStart[i]].v1i;
+		for (Uint32 i = 0; i < edgeNode->numTris; i++) {
+			const int vtxNum = edges[edgeIndices[i]].v1i;
 			const vector3d v1 = transToB * vector3d(rVertices[vtxNum]);
 			const vector3f _from(float(v1.x), float(v1.y), float(v1.z));
 
 			vector3d _dir(
-				double(edges[edgeNode->triIndicesStart[i]].dir.x),
-				double(edges[edgeNode->triIndicesStart[i]].dir.y),
-				double(edges[edgeNode->triIndicesStart[i]].dir.z));
+				double(edges[edgeIndices[i]].dir.x),
+				double(edges[edgeIndices[i]].dir.y),
+				double(edges[edgeIndices[i]].dir.z));
 			_dir = transToB.ApplyRotationOnly(_dir);
 			dir = vector3f(&_dir.x);
-			isect.dist = edges[edgeNode->triIndicesStart[i]].len;
+			isect.dist = edges[edgeIndices[i]].len;
 			isect.triIdx = -1;
 
 			b->GetGeomTree()->TraceRay(btriNode, _from, dir, &isect);
 
 			if (isect.triIdx == -1) continue;
 			numContacts++;
-			const double depth = edges[edgeNode->triIndicesStart[i]].len - isect.dist;
+			const double depth = edges[edgeIndices[i]].len - isect.dist;
 			// in world coords
 			CollisionContact contact;
 			contact.pos = b->GetTransform() * (v1 + vector3d(&dir.x) * double(isect.dist));
@@ -224,12 +236,12 @@ void Geom::CollideEdgesTris(int &maxContacts, const BVHNode *edgeNode, const mat
 			contact.userData2 = b->m_data;
 			// contact geomFlag is bitwise OR of triangle's and edge's flags
 			contact.geomFlag = b->m_geomtree->GetTriFlag(isect.triIdx) |
-				edges[edgeNode->triIndicesStart[i]].triFlag;
+				edges[edgeIndices[i]].triFlag;
 			callback(&contact);
 			if (--maxContacts <= 0) return;
 		}
 	} else {
-		CollideEdgesTris(maxContacts, edgeNode->kids[0], transToB, b, btriNode, callback);
-		CollideEdgesTris(maxContacts, edgeNode->kids[1], transToB, b, btriNode, callback);
+		CollideEdgesTris(maxContacts, edgeTree->GetKid(edgeNode, 0), transToB, b, btriNode, callback);
+		CollideEdgesTris(maxContacts, edgeTree->GetKid(edgeNode, 1), transToB, b, btriNode, callback);
 	}
 }
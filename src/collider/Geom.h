@@ -29,10 +29,13 @@ public:
 	void Collide(Geom *b, void (*callback)(CollisionContact *)) const;
 	void CollideSphere(Sphere &sphere, void (*callback)(CollisionContact *)) const;
 	inline void *GetUserData() const { return m_data; }
-	inline void SetMailboxIndex(int idx) { m_mailboxIndex = idx; }
-	inline int GetMailboxIndex() const { return m_mailboxIndex; }
+	inline void SetStoreHandle(int handle) { m_storeHandle = handle; }
+	inline int GetStoreHandle() const { return m_storeHandle; }
 	inline void SetGroup(int g) { m_group = g; }
 	inline int GetGroup() const { return m_group; }
+	// changes every time the geom moves, so it can be told whether a test
+	// against it is still current
+	inline Uint32 GetVersion() const { return m_version; }
 
 	matrix4x4d m_animTransform;
 
@@ -47,7 +50,8 @@ private:
 	const GeomTree *m_geomtree;
 	void *m_data;
 	int m_group;
-	int m_mailboxIndex; // used to avoid duplicate collisions
+	int m_storeHandle; // our handle in the collision space's GeomStore, -1 if none
+	Uint32 m_version;
 	bool m_active;
 };
 
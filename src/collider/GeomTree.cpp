@@ -4,6 +4,7 @@
 #include "GeomTree.h"
 #include "../libs.h"
 #include "BVHTree.h"
+#include "CpuFeatures.h"
 #include "Weld.h"
 #include "scenegraph/Serializer.h"
 
@@ -115,7 +116,7 @@ GeomTree::GeomTree(const int numVerts, const int numTris, const std::vector<vect
 	m_numEdges = edges.size();
 	m_edges.resize(m_numEdges);
 	// to build Edge bvh tree with.
-	m_aabbs.resize(m_numEdges);
+	std::vector<Aabb> edgeAabbs(m_numEdges);
 	int *edgeIdxs = new int[m_numEdges];
 
 	int pos = 0;
@@ -137,12 +138,12 @@ GeomTree::GeomTree(const int numVerts, const int numTris, const std::vector<vect
 		m_edges[pos].dir = dir;
 
 		edgeIdxs[pos] = pos;
-		m_aabbs[pos].min = m_aabbs[pos].max = vector3d(v1);
-		m_aabbs[pos].Update(vector3d(v2));
+		edgeAabbs[pos].min = edgeAabbs[pos].max = vector3d(v1);
+		edgeAabbs[pos].Update(vector3d(v2));
 	}
 
 	//t = SDL_GetTicks();
-	m_edgeTree.reset(new BVHTree(m_numEdges, edgeIdxs, &m_aabbs[0]));
+	m_edgeTree.reset(new BVHTree(m_numEdges, edgeIdxs, &edgeAabbs[0]));
 	delete[] edgeIdxs;
 	//Output("Edge tree of %d edges build in %dms\n", m_numEdges, SDL_GetTicks() - t);
 
@@ -162,12 +163,6 @@ GeomTree::GeomTree(Serializer::Reader &rd)
 	m_aabb.min = rd.Vector3d();
 	m_aabb.radius = rd.Double();
 
-	const Uint32 numAabbs = rd.Int32();
-	m_aabbs.resize(numAabbs);
-	for (Uint32 iAabb = 0; iAabb < numAabbs; ++iAabb) {
-		rd >> m_aabbs[iAabb];
-	}
-
 	{
 		PROFILE_SCOPED_DESC("GeomTree::LoadEdges")
 		m_edges.resize(m_numEdges);
@@ -193,51 +188,27 @@ GeomTree::GeomTree(Serializer::Reader &rd)
 		m_triFlags[iTri] = rd.Int32();
 	}
 
-	// activeTris = tris we are still trying to put into leaves
-	std::vector<int> activeTris;
-	activeTris.reserve(m_numTris);
-	for (int i = 0; i < m_numTris; i++) {
-		activeTris.push_back(i * 3);
-	}
-
-	// regenerate the aabb data
-	Aabb *aabbs = new Aabb[activeTris.size()];
-	for (Uint32 i = 0; i < activeTris.size(); i++) {
-		const vector3d v1 = vector3d(m_vertices[m_indices[activeTris[i] + 0]]);
-		const vector3d v2 = vector3d(m_vertices[m_indices[activeTris[i] + 1]]);
-		const vector3d v3 = vector3d(m_vertices[m_indices[activeTris[i] + 2]]);
-		aabbs[i].min = aabbs[i].max = v1;
-		aabbs[i].Update(v2);
-		aabbs[i].Update(v3);
-	}
-	m_triTree.reset(new BVHTree(activeTris.size(), &activeTris[0], aabbs));
-	delete[] aabbs;
-
-	//
-	int *edgeIdxs = new int[m_numEdges];
-	memset(edgeIdxs, 0, sizeof(int) * m_numEdges);
-	for (int i = 0; i < m_numEdges; i++) {
-		edgeIdxs[i] = i;
-	}
-	m_edgeTree.reset(new BVHTree(m_numEdges, edgeIdxs, &m_aabbs[0]));
+	// the trees were built when the model was converted
+	m_triTree.reset(new BVHTree(rd));
+	m_edgeTree.reset(new BVHTree(rd));
 }
 
 static bool SlabsRayAabbTest(const BVHNode *n, const vector3f &start, const vector3f &invDir, isect_t *isect)
 {
 	PROFILE_SCOPED()
 	float
-		l1 = (n->aabb.min.x - start.x) * invDir.x,
-		l2 = (n->aabb.max.x - start.x) * invDir.x,
+		l1 = (n->min.x - start.x) * invDir.x,
+		l2 = (n->max.x - start.x) * invDir.x,
 		lmin = std::min(l1, l2),
 		lmax = std::max(l1, l2);
 
-	l1 = (n->aabb.min.y - start.y) * invDir.y;
-	l2 = (n->aabb.max.y - start.y) * invDir.y;
+	l1 = (n->min.y - start.y) * invDir.y;
+	l2 = (n->max.y - start.y) * invDir.y;
 	lmin = std::max(std::min(l1, l2), lmin);
 	lmax = std::min(std::max(l1, l2), lmax);
 
-	l1 = (n->aabb.min.z - start.z) * invDir.z;
-	l2 = (n->aabb.max.z - start.z) * invDir.z;
+	l1 = (n->min.z - start.z) * invDir.z;
+	l2 = (n->max.z - start.z) * invDir.z;
 	lmin = std::max(std::min(l1, l2), lmin);
 	lmax = std::min(std::max(l1, l2), lmax);
 
@@ -253,7 +224,8 @@ void GeomTree::TraceRay(const vector3f &start, const vector3f &dir, isect_t *ise
 void GeomTree::TraceRay(const BVHNode *currnode, const vector3f &a_origin, const vector3f &a_dir, isect_t *isect) const
 {
 	PROFILE_SCOPED()
-	BVHNode *stack[32];
+	// one entry per level below the root at most
+	const BVHNode *stack[BVHTree::MAX_DEPTH];
 	int stackpos = -1;
 	const vector3f invDir( // avoid division by zero please
 		is_zero_exact(a_dir.x) ? 0.0f : (1.0f / a_dir.x),
@@ -265,12 +237,16 @@ void GeomTree::TraceRay(const BVHNode *currnode, const vector3f &a_origin, const
 			if (!SlabsRayAabbTest(currnode, a_origin, invDir, isect)) goto pop_bstack;
 
 			stackpos++;
-			stack[stackpos] = currnode->kids[1];
-			currnode = currnode->kids[0];
+			assert(stackpos < BVHTree::MAX_DEPTH);
+			stack[stackpos] = m_triTree->GetKid(currnode, 1);
+			currnode = m_triTree->GetKid(currnode, 0);
 		}
 		// triangle intersection jizz
-		for (int i = 0; i < currnode->numTris; i++) {
-			RayTriIntersect(1, a_origin, &a_dir, currnode->triIndicesStart[i], isect);
+		{
+			const BVHTree::objPtr_t *triIndices = m_triTree->GetObjPtrs(currnode);
+			for (Uint32 i = 0; i < currnode->numTris; i++) {
+				RayTriIntersect(1, a_origin, &a_dir, triIndices[i], isect);
+			}
 		}
 	pop_bstack:
 		if (stackpos < 0) break;
@@ -279,6 +255,317 @@ void GeomTree::TraceRay(const BVHNode *currnode, const vector3f &a_origin, const
 	}
 }
 
+/*
+ * Rays of a packet kept in SoA layout so each lane of an SSE or AVX register
+ * holds one ray. Lanes past numRays are padding and never become active.
+ */
+struct GeomTree::RayPacket {
+	float ox[RAY_PACKET_SIZE], oy[RAY_PACKET_SIZE], oz[RAY_PACKET_SIZE];
+	float dx[RAY_PACKET_SIZE], dy[RAY_PACKET_SIZE], dz[RAY_PACKET_SIZE];
+	float ix[RAY_PACKET_SIZE], iy[RAY_PACKET_SIZE], iz[RAY_PACKET_SIZE];
+	float dist[RAY_PACKET_SIZE];
+	int triIdx[RAY_PACKET_SIZE];
+	int numRays;
+};
+
+#ifdef CPU_HAS_SSE2
+// The packet functions below come in an SSE2 version that does four lanes
+// and an AVX2 one that does all eight. Both use the same maths as the scalar
+// SlabsRayAabbTest and RayTriIntersect, lane by lane and in the same order,
+// so a ray gets the same result whichever traced it.
+
+// bitmask of the four rays that hit the node.
+// note _mm_min_ps(b, a) == std::min(a, b), likewise for max
+static int PacketSlabsRayAabbTestSse2(const BVHNode *n, const float *ox, const float *oy, const float *oz,
+	const float *ix, const float *iy, const float *iz, const float *dist)
+{
+	const __m128 o[3] = { _mm_loadu_ps(ox), _mm_loadu_ps(oy), _mm_loadu_ps(oz) };
+	const __m128 inv[3] = { _mm_loadu_ps(ix), _mm_loadu_ps(iy), _mm_loadu_ps(iz) };
+	__m128 lmin, lmax;
+	for (int axis = 0; axis < 3; axis++) {
+		const __m128 l1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(n->min[axis]), o[axis]), inv[axis]);
+		const __m128 l2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(n->max[axis]), o[axis]), inv[axis]);
+		if (axis == 0) {
+			lmin = _mm_min_ps(l2, l1);
+			lmax = _mm_max_ps(l2, l1);
+		} else {
+			lmin = _mm_max_ps(lmin, _mm_min_ps(l2, l1));
+			lmax = _mm_min_ps(lmax, _mm_max_ps(l2, l1));
+		}
+	}
+	const __m128 hit = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(lmax, _mm_setzero_ps()), _mm_cmpge_ps(lmax, lmin)),
+		_mm_cmplt_ps(lmin, _mm_loadu_ps(dist)));
+	return _mm_movemask_ps(hit);
+}
+
+static CPU_AVX2_TARGET int PacketSlabsRayAabbTestAvx2(const BVHNode *n, const float *ox, const float *oy, const float *oz,
+	const float *ix, const float *iy, const float *iz, const float *dist)
+{
+	const __m256 o[3] = { _mm256_loadu_ps(ox), _mm256_loadu_ps(oy), _mm256_loadu_ps(oz) };
+	const __m256 inv[3] = { _mm256_loadu_ps(ix), _mm256_loadu_ps(iy), _mm256_loadu_ps(iz) };
+	__m256 lmin, lmax;
+	for (int axis = 0; axis < 3; axis++) {
+		const __m256 l1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(n->min[axis]), o[axis]), inv[axis]);
+		const __m256 l2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(n->max[axis]), o[axis]), inv[axis]);
+		if (axis == 0) {
+			lmin = _mm256_min_ps(l2, l1);
+			lmax = _mm256_max_ps(l2, l1);
+		} else {
+			lmin = _mm256_max_ps(lmin, _mm256_min_ps(l2, l1));
+			lmax = _mm256_min_ps(lmax, _mm256_max_ps(l2, l1));
+		}
+	}
+	const __m256 hit = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(lmax, _mm256_setzero_ps(), _CMP_GE_OS), _mm256_cmp_ps(lmax, lmin, _CMP_GE_OS)),
+		_mm256_cmp_ps(lmin, _mm256_loadu_ps(dist), _CMP_LT_OS));
+	return _mm256_movemask_ps(hit);
+}
+
+// (u x w) . d, four lanes at a time
+static inline __m128 PacketCrossDot(__m128 ux, __m128 uy, __m128 uz, __m128 wx, __m128 wy, __m128 wz,
+	__m128 dx, __m128 dy, __m128 dz)
+{
+	const __m128 x = _mm_sub_ps(_mm_mul_ps(uy, wz), _mm_mul_ps(uz, wy));
+	const __m128 y = _mm_sub_ps(_mm_mul_ps(uz, wx), _mm_mul_ps(ux, wz));
+	const __m128 z = _mm_sub_ps(_mm_mul_ps(ux, wy), _mm_mul_ps(uy, wx));
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, dx), _mm_mul_ps(y, dy)), _mm_mul_ps(z, dz));
+}
+
+static CPU_AVX2_TARGET inline __m256 PacketCrossDotAvx2(__m256 ux, __m256 uy, __m256 uz, __m256 wx, __m256 wy, __m256 wz,
+	__m256 dx, __m256 dy, __m256 dz)
+{
+	const __m256 x = _mm256_sub_ps(_mm256_mul_ps(uy, wz), _mm256_mul_ps(uz, wy));
+	const __m256 y = _mm256_sub_ps(_mm256_mul_ps(uz, wx), _mm256_mul_ps(ux, wz));
+	const __m256 z = _mm256_sub_ps(_mm256_mul_ps(ux, wy), _mm256_mul_ps(uy, wx));
+	return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, dx), _mm256_mul_ps(y, dy)), _mm256_mul_ps(z, dz));
+}
+
+// bitmask of the four rays that pass through the triangle abc (normal n),
+// with the distance along each of those stored in dist
+static int PacketTriTestSse2(const vector3f &a, const vector3f &b, const vector3f &c, const vector3f &n,
+	const float *pox, const float *poy, const float *poz, const float *pdx, const float *pdy, const float *pdz, float *dist)
+{
+	const __m128 ox = _mm_loadu_ps(pox), oy = _mm_loadu_ps(poy), oz = _mm_loadu_ps(poz);
+	const __m128 dx = _mm_loadu_ps(pdx), dy = _mm_loadu_ps(pdy), dz = _mm_loadu_ps(pdz);
+
+	// vertices relative to each ray's origin
+	const __m128 ax = _mm_sub_ps(_mm_set1_ps(a.x), ox), ay = _mm_sub_ps(_mm_set1_ps(a.y), oy), az = _mm_sub_ps(_mm_set1_ps(a.z), oz);
+	const __m128 bx = _mm_sub_ps(_mm_set1_ps(b.x), ox), by = _mm_sub_ps(_mm_set1_ps(b.y), oy), bz = _mm_sub_ps(_mm_set1_ps(b.z), oz);
+	const __m128 cx = _mm_sub_ps(_mm_set1_ps(c.x), ox), cy = _mm_sub_ps(_mm_set1_ps(c.y), oy), cz = _mm_sub_ps(_mm_set1_ps(c.z), oz);
+
+	const __m128 nx = _mm_set1_ps(n.x), ny = _mm_set1_ps(n.y), nz = _mm_set1_ps(n.z);
+	const __m128 nominator = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, ax), _mm_mul_ps(ny, ay)), _mm_mul_ps(nz, az));
+
+	const __m128 v0d = PacketCrossDot(cx, cy, cz, bx, by, bz, dx, dy, dz);
+	const __m128 v1d = PacketCrossDot(bx, by, bz, ax, ay, az, dx, dy, dz);
+	const __m128 v2d = PacketCrossDot(ax, ay, az, cx, cy, cz, dx, dy, dz);
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 allPos = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(v0d, zero), _mm_cmpgt_ps(v1d, zero)), _mm_cmpgt_ps(v2d, zero));
+	const __m128 allNeg = _mm_and_ps(_mm_and_ps(_mm_cmplt_ps(v0d, zero), _mm_cmplt_ps(v1d, zero)), _mm_cmplt_ps(v2d, zero));
+	const __m128 insideLanes = _mm_or_ps(allPos, allNeg);
+	const int inside = _mm_movemask_ps(insideLanes);
+	if (!inside) return 0;
+
+	// only divide in lanes the scalar code would, so FPE builds don't trip
+	__m128 denom = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, nx), _mm_mul_ps(dy, ny)), _mm_mul_ps(dz, nz));
+	denom = _mm_or_ps(_mm_and_ps(insideLanes, denom), _mm_andnot_ps(insideLanes, _mm_set1_ps(1.0f)));
+	_mm_storeu_ps(dist, _mm_div_ps(nominator, denom));
+	return inside;
+}
+
+static CPU_AVX2_TARGET int PacketTriTestAvx2(const vector3f &a, const vector3f &b, const vector3f &c, const vector3f &n,
+	const float *pox, const float *poy, const float *poz, const float *pdx, const float *pdy, const float *pdz, float *dist)
+{
+	const __m256 ox = _mm256_loadu_ps(pox), oy = _mm256_loadu_ps(poy), oz = _mm256_loadu_ps(poz);
+	const __m256 dx = _mm256_loadu_ps(pdx), dy = _mm256_loadu_ps(pdy), dz = _mm256_loadu_ps(pdz);
+
+	const __m256 ax = _mm256_sub_ps(_mm256_set1_ps(a.x), ox), ay = _mm256_sub_ps(_mm256_set1_ps(a.y), oy), az = _mm256_sub_ps(_mm256_set1_ps(a.z), oz);
+	const __m256 bx = _mm256_sub_ps(_mm256_set1_ps(b.x), ox), by = _mm256_sub_ps(_mm256_set1_ps(b.y), oy), bz = _mm256_sub_ps(_mm256_set1_ps(b.z), oz);
+	const __m256 cx = _mm256_sub_ps(_mm256_set1_ps(c.x), ox), cy = _mm256_sub_ps(_mm256_set1_ps(c.y), oy), cz = _mm256_sub_ps(_mm256_set1_ps(c.z), oz);
+
+	const __m256 nx = _mm256_set1_ps(n.x), ny = _mm256_set1_ps(n.y), nz = _mm256_set1_ps(n.z);
+	const __m256 nominator = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, ax), _mm256_mul_ps(ny, ay)), _mm256_mul_ps(nz, az));
+
+	const __m256 v0d = PacketCrossDotAvx2(cx, cy, cz, bx, by, bz, dx, dy, dz);
+	const __m256 v1d = PacketCrossDotAvx2(bx, by, bz, ax, ay, az, dx, dy, dz);
+	const __m256 v2d = PacketCrossDotAvx2(ax, ay, az, cx, cy, cz, dx, dy, dz);
+
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 allPos = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(v0d, zero, _CMP_GT_OS), _mm256_cmp_ps(v1d, zero, _CMP_GT_OS)), _mm256_cmp_ps(v2d, zero, _CMP_GT_OS));
+	const __m256 allNeg = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(v0d, zero, _CMP_LT_OS), _mm256_cmp_ps(v1d, zero, _CMP_LT_OS)), _mm256_cmp_ps(v2d, zero, _CMP_LT_OS));
+	const __m256 insideLanes = _mm256_or_ps(allPos, allNeg);
+	const int inside = _mm256_movemask_ps(insideLanes);
+	if (!inside) return 0;
+
+	__m256 denom = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, nx), _mm256_mul_ps(dy, ny)), _mm256_mul_ps(dz, nz));
+	denom = _mm256_blendv_ps(_mm256_set1_ps(1.0f), denom, insideLanes);
+	_mm256_storeu_ps(dist, _mm256_div_ps(nominator, denom));
+	return inside;
+}
+#endif /* CPU_HAS_SSE2 */
+
+// returns a bitmask of the packet's rays that hit the node
+static int PacketSlabsRayAabbTest(const BVHNode *n, const float *ox, const float *oy, const float *oz,
+	const float *ix, const float *iy, const float *iz, const float *dist, bool avx2)
+{
+#ifdef CPU_HAS_SSE2
+	if (avx2)
+		return PacketSlabsRayAabbTestAvx2(n, ox, oy, oz, ix, iy, iz, dist);
+	return PacketSlabsRayAabbTestSse2(n, ox, oy, oz, ix, iy, iz, dist) |
+		(PacketSlabsRayAabbTestSse2(n, ox + 4, oy + 4, oz + 4, ix + 4, iy + 4, iz + 4, dist + 4) << 4);
+#else
+	int mask = 0;
+	for (int i = 0; i < GeomTree::RAY_PACKET_SIZE; i++) {
+		isect_t isect;
+		isect.dist = dist[i];
+		if (SlabsRayAabbTest(n, vector3f(ox[i], oy[i], oz[i]), vector3f(ix[i], iy[i], iz[i]), &isect))
+			mask |= 1 << i;
+	}
+	return mask;
+#endif
+}
+
+// SSE2/AVX2 are only there on x86, elsewhere the packet is traced a lane at
+// a time with the same code as TraceRay
+static bool UseAvx2()
+{
+#ifdef CPU_HAS_SSE2
+	static const bool avx2 = CpuHasAvx2();
+	return avx2;
+#else
+	return false;
+#endif
+}
+
+void GeomTree::TraceRays(int numRays, const vector3f *starts, const vector3f *dirs, isect_t *isects) const
+{
+	PROFILE_SCOPED()
+	const bool avx2 = UseAvx2();
+	RayPacket packet;
+	for (int first = 0; first < numRays; first += RAY_PACKET_SIZE) {
+		if (numRays - first == 1) {
+			// a packet of one only costs more
+			TraceRay(starts[first], dirs[first], &isects[first]);
+			break;
+		}
+		packet.numRays = std::min(RAY_PACKET_SIZE, numRays - first);
+		for (int i = 0; i < RAY_PACKET_SIZE; i++) {
+			// pad the packet by repeating the last ray
+			const int r = first + std::min(i, packet.numRays - 1);
+			packet.ox[i] = starts[r].x;
+			packet.oy[i] = starts[r].y;
+			packet.oz[i] = starts[r].z;
+			packet.dx[i] = dirs[r].x;
+			packet.dy[i] = dirs[r].y;
+			packet.dz[i] = dirs[r].z;
+			// avoid division by zero please
+			packet.ix[i] = is_zero_exact(dirs[r].x) ? 0.0f : (1.0f / dirs[r].x);
+			packet.iy[i] = is_zero_exact(dirs[r].y) ? 0.0f : (1.0f / dirs[r].y);
+			packet.iz[i] = is_zero_exact(dirs[r].z) ? 0.0f : (1.0f / dirs[r].z);
+			packet.dist[i] = isects[r].dist;
+			packet.triIdx[i] = isects[r].triIdx;
+		}
+
+		TraceRayPacket(packet, avx2);
+
+		for (int i = 0; i < packet.numRays; i++) {
+			isects[first + i].dist = packet.dist[i];
+			isects[first + i].triIdx = packet.triIdx[i];
+		}
+	}
+}
+
+void GeomTree::TraceRayPacket(RayPacket &packet, bool avx2) const
+{
+	PROFILE_SCOPED()
+	// each stack entry remembers which rays were still in the running
+	// when it was pushed, exactly as if each ray had its own stack
+	struct stackobj {
+		const BVHNode *node;
+		int mask;
+	} stack[BVHTree::MAX_DEPTH];
+	int stackpos = -1;
+
+	const BVHNode *currnode = m_triTree->GetRoot();
+	int mask = (1 << packet.numRays) - 1;
+
+	for (;;) {
+		while (!currnode->IsLeaf()) {
+			mask &= PacketSlabsRayAabbTest(currnode, packet.ox, packet.oy, packet.oz,
+				packet.ix, packet.iy, packet.iz, packet.dist, avx2);
+			if (!mask) goto pop_bstack;
+
+			stackpos++;
+			assert(stackpos < BVHTree::MAX_DEPTH);
+			stack[stackpos].node = m_triTree->GetKid(currnode, 1);
+			stack[stackpos].mask = mask;
+			currnode = m_triTree->GetKid(currnode, 0);
+		}
+		{
+			const BVHTree::objPtr_t *triIndices = m_triTree->GetObjPtrs(currnode);
+			for (Uint32 i = 0; i < currnode->numTris; i++) {
+				RayPacketTriIntersect(packet, mask, triIndices[i], avx2);
+			}
+		}
+	pop_bstack:
+		if (stackpos < 0) break;
+		currnode = stack[stackpos].node;
+		mask = stack[stackpos].mask;
+		stackpos--;
+	}
+}
+
+// RayTriIntersect for a packet of rays with their own origins
+void GeomTree::RayPacketTriIntersect(RayPacket &packet, int activeMask, int triIdx, bool avx2) const
+{
+	const vector3f a(m_vertices[m_indices[triIdx + 0]]);
+	const vector3f b(m_vertices[m_indices[triIdx + 1]]);
+	const vector3f c(m_vertices[m_indices[triIdx + 2]]);
+
+	const vector3f n = (c - a).Cross(b - a);
+
+	float dist[RAY_PACKET_SIZE];
+	int inside = 0;
+#ifdef CPU_HAS_SSE2
+	if (avx2) {
+		inside = PacketTriTestAvx2(a, b, c, n, packet.ox, packet.oy, packet.oz, packet.dx, packet.dy, packet.dz, dist);
+	} else {
+		for (int first = 0; first < RAY_PACKET_SIZE; first += 4) {
+			if (!((activeMask >> first) & 0xf)) continue;
+			const int half = PacketTriTestSse2(a, b, c, n, &packet.ox[first], &packet.oy[first], &packet.oz[first],
+				&packet.dx[first], &packet.dy[first], &packet.dz[first], &dist[first]);
+			inside |= half << first;
+		}
+	}
+#else
+	for (int i = 0; i < RAY_PACKET_SIZE; i++) {
+		if (!(activeMask & (1 << i))) continue;
+		const vector3f origin(packet.ox[i], packet.oy[i], packet.oz[i]);
+		const vector3f dir(packet.dx[i], packet.dy[i], packet.dz[i]);
+		const float nominator = n.Dot(a - origin);
+
+		const float v0d = (c - origin).Cross(b - origin).Dot(dir);
+		const float v1d = (b - origin).Cross(a - origin).Dot(dir);
+		const float v2d = (a - origin).Cross(c - origin).Dot(dir);
+
+		if (((v0d > 0) && (v1d > 0) && (v2d > 0)) ||
+			((v0d < 0) && (v1d < 0) && (v2d < 0))) {
+			dist[i] = nominator / dir.Dot(n);
+			inside |= 1 << i;
+		}
+	}
+#endif
+	inside &= activeMask;
+
+	for (int i = 0; i < RAY_PACKET_SIZE; i++) {
+		if (!(inside & (1 << i))) continue;
+		if ((dist[i] > 0) && (dist[i] < packet.dist[i])) {
+			packet.dist[i] = dist[i];
+			packet.triIdx[i] = triIdx / 3;
+		}
+	}
+}
+
 void GeomTree::RayTriIntersect(int numRays, const vector3f &origin, const vector3f *dirs, int triIdx, isect_t *isects) const
 {
 	PROFILE_SCOPED()
@@ -331,11 +618,6 @@ void GeomTree::Save(Serializer::Writer &wr) const
 	wr.Vector3d(m_aabb.min);
 	wr.Double(m_aabb.radius);
 
-	wr.Int32(m_numEdges);
-	for (Sint32 iAabb = 0; iAabb < m_numEdges; ++iAabb) {
-		wr << m_aabbs[iAabb];
-	}
-
 	for (Sint32 iEdge = 0; iEdge < m_numEdges; ++iEdge) {
 		auto &ed = m_edges[iEdge];
 		wr << ed.v1i << ed.v2i << ed.len << ed.dir << ed.triFlag;
@@ -352,4 +634,106 @@ void GeomTree::Save(Serializer::Writer &wr) const
 	for (Sint32 iTri = 0; iTri < m_numTris; ++iTri) {
 		wr.Int32(m_triFlags[iTri]);
 	}
+
+	m_triTree->Save(wr);
+	m_edgeTree->Save(wr);
 }
+
+#ifdef UNIT_TEST
+// Checks TraceRays against TraceRay, and reports how many rays a second
+// each manages against a sphere, for a burst of parallel rays (like a
+// volley of projectiles) and for rays in all directions.
+#include "../BenchmarkClock.h"
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+
+int main()
+{
+	// a unit sphere, about as many tris as a ship's collision mesh
+	const int rings = 64, segments = 128;
+	std::vector<vector3f> vertices;
+	for (int i = 0; i <= rings; i++) {
+		const float lat = float(M_PI) * i / rings - float(M_PI) * 0.5f;
+		for (int j = 0; j < segments; j++) {
+			const float lon = 2.0f * float(M_PI) * j / segments;
+			vertices.push_back(vector3f(cos(lat) * cos(lon), sin(lat), cos(lat) * sin(lon)));
+		}
+	}
+	std::vector<Uint32> indices;
+	for (int i = 0; i < rings; i++) {
+		for (int j = 0; j < segments; j++) {
+			const Uint32 a = i * segments + j, b = i * segments + (j + 1) % segments;
+			const Uint32 c = a + segments, d = b + segments;
+			const Uint32 quad[] = { a, b, c, b, d, c };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+	const int numTris = indices.size() / 3;
+	const std::vector<Uint32> triFlags(numTris, 0);
+	const GeomTree tree(vertices.size(), numTris, vertices, indices.data(), triFlags.data());
+
+	// rays start outside the sphere and are aimed near its middle, some miss
+	const int numRays = 1 << 16;
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	const auto randomVector = [&]() { return vector3f(unit(rng), unit(rng), unit(rng)); };
+
+	struct RaySet {
+		const char *name;
+		std::vector<vector3f> starts, dirs;
+	} sets[2];
+	sets[0].name = "burst";
+	sets[1].name = "scattered";
+	for (int i = 0; i < numRays; i++) {
+		// groups of 32 parallel rays, each group from its own direction
+		if (i % 32 == 0) {
+			const vector3f dir = randomVector().Normalized();
+			for (int j = 0; j < 32; j++) {
+				const vector3f offset = randomVector() * 0.1f;
+				sets[0].starts.push_back(dir * -3.0f + offset);
+				sets[0].dirs.push_back(dir);
+			}
+		}
+		const vector3f start = randomVector().Normalized() * 3.0f;
+		sets[1].starts.push_back(start);
+		sets[1].dirs.push_back((randomVector() * 0.8f - start).Normalized());
+	}
+
+	printf("%d tris, %s packets\n", numTris, UseAvx2() ? "AVX2" : "SSE2 or scalar");
+
+	int failures = 0;
+	for (const RaySet &set : sets) {
+		std::vector<isect_t> expected(numRays), actual(numRays);
+		for (int i = 0; i < numRays; i++) {
+			expected[i].dist = actual[i].dist = 6.0f;
+			expected[i].triIdx = actual[i].triIdx = -1;
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int i = 0; i < numRays; i++)
+			tree.TraceRay(set.starts[i], set.dirs[i], &expected[i]);
+		const double singleTime = seconds_since(start);
+
+		start = std::chrono::steady_clock::now();
+		tree.TraceRays(numRays, set.starts.data(), set.dirs.data(), actual.data());
+		const double batchTime = seconds_since(start);
+
+		int hits = 0, mismatches = 0;
+		for (int i = 0; i < numRays; i++) {
+			if (expected[i].triIdx != -1)
+				hits++;
+			if (expected[i].triIdx != actual[i].triIdx || memcmp(&expected[i].dist, &actual[i].dist, sizeof(float)) != 0)
+				mismatches++;
+		}
+		if (mismatches)
+			failures++;
+
+		printf("%-10s %8.2f Mrays/s single, %8.2f Mrays/s batch, %d hits, %d mismatches\n", set.name,
+			numRays / singleTime * 1e-6, numRays / batchTime * 1e-6, hits, mismatches);
+	}
+	return failures;
+}
+
+#endif /* UNIT_TEST */
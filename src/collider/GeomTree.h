@@ -33,6 +33,11 @@ public:
 	// isect.triIdx should be -1 unless repeat calls with same isect_t
 	void TraceRay(const vector3f &start, const vector3f &dir, isect_t *isect) const;
 	void TraceRay(const BVHNode *startNode, const vector3f &a_origin, const vector3f &a_dir, isect_t *isect) const;
+	// trace a batch of rays RAY_PACKET_SIZE at a time, with AVX2 where the
+	// CPU has it and SSE2 otherwise. the result for each ray is the same as
+	// calling TraceRay() with it on its own
+	void TraceRays(int numRays, const vector3f *starts, const vector3f *dirs, isect_t *isects) const;
+	static const int RAY_PACKET_SIZE = 8;
 	vector3f GetTriNormal(int triIdx) const;
 	Uint32 GetTriFlag(int triIdx) const { return m_triFlags[triIdx]; }
 	double GetRadius() const { return m_radius; }
@@ -66,6 +71,9 @@ public:
 	void Save(Serializer::Writer &wr) const;
 
 private:
+	struct RayPacket;
+	void TraceRayPacket(RayPacket &packet, bool avx2) const;
+	void RayPacketTriIntersect(RayPacket &packet, int activeMask, int triIdx, bool avx2) const;
 	void RayTriIntersect(int numRays, const vector3f &origin, const vector3f *dirs, int triIdx, isect_t *isects) const;
 
 	int m_numVertices;
@@ -74,7 +82,6 @@ private:
 
 	double m_radius;
 	Aabb m_aabb;
-	std::vector<Aabb> m_aabbs;
 
 	std::unique_ptr<BVHTree> m_triTree;
 	std::unique_ptr<BVHTree> m_edgeTree;
@@ -478,11 +478,16 @@ void FactionsDatabase::PostInit()
 	assert(m_initialized);
 	assert(m_galaxy->IsInitialized());
 	SetHomeSectors();
+	m_spatial_index.MarkDirty(); // picks up claims made after a faction was added
 
 #ifdef DUMP_FACTIONS // useful for dumping the factions from an autogenerated script
 	for (size_t i = 0; i < m_factions.size(); i++)
 		ExportFactionToLua(m_factions[i], i);
 #endif
+
+#ifdef BENCHMARK_FACTIONS
+	BenchmarkClaimants(50);
+#endif
 }
 
 void FactionsDatabase::ClearHomeSectors()
@@ -523,10 +528,12 @@ void FactionsDatabase::AddFaction(Faction *faction)
 		}
 		m_missingFactionsMap.erase(it);
 	}
-	m_spatial_index.Add(faction);
-
+	if (UsesOctsapling())
+		m_legacy_index.Add(faction);
 	if (faction->hasHomeworld) m_homesystems.insert(faction->homeworld.SystemOnly());
 	faction->idx = m_factions.size() - 1;
+
+	m_spatial_index.MarkDirty();
 }
 
 const Faction *FactionsDatabase::GetFaction(const Uint32 index) const
@@ -567,10 +574,38 @@ const Faction *FactionsDatabase::GetNearestClaimant(const Sector::System *sys) c
 		return sys->GetCustomSystem()->faction;
 	}
 
+	if (UsesOctsapling())
+		return GetNearestClaimantOctsapling(sys);
+
+	// a claim is very specific, no further checks for distance from another factions homeworld are needed.
+	if (const Faction *claimant = m_spatial_index.Claimant(sys->GetPath()))
+		return claimant;
+
 	// if it didn't, or it wasn't a custom StarStystem, then we go ahead and assign it a faction allegiance like normal below...
 	const Faction *result = &m_no_faction;
 	double closestFactionDist = HUGE_VAL;
-	ConstFactionList &candidates = m_spatial_index.CandidateFactions(sys);
+	std::shared_ptr<ConstFactionList> candidates = m_spatial_index.CandidateFactions(sys->GetPath());
+
+	for (ConstFactionIterator it = candidates->begin(); it != candidates->end(); ++it) {
+		if ((*it)->IsCloserAndContains(closestFactionDist, sys))
+			result = *it;
+	}
+	return result;
+}
+
+bool FactionsDatabase::UsesOctsapling() const
+{
+	return m_galaxy->GetGeneratorVersion() < 2;
+}
+
+// as GetNearestClaimant was before generator version 2, a claim only counts
+// if the claimant shares the system's octant
+const Faction *FactionsDatabase::GetNearestClaimantOctsapling(const Sector::System *sys) const
+{
+	PROFILE_SCOPED()
+	const Faction *result = &m_no_faction;
+	double closestFactionDist = HUGE_VAL;
+	ConstFactionList &candidates = m_legacy_index.CandidateFactions(sys);
 
 	for (ConstFactionIterator it = candidates.begin(); it != candidates.end(); ++it) {
 		if ((*it)->IsClaimed(sys->GetPath()))
@@ -602,6 +637,51 @@ bool Faction::IsClaimed(SystemPath path) const
 	return false;
 }
 
+#ifdef BENCHMARK_FACTIONS
+void FactionsDatabase::BenchmarkClaimants(Sint32 radius) const
+{
+	Uint32 numSystems = 0, numMismatches = 0;
+	Profiler::Timer indexedTimer, linearTimer;
+	for (Sint32 sx = -radius; sx <= radius; sx++) {
+		for (Sint32 sy = -radius; sy <= radius; sy++) {
+			for (Sint32 sz = -radius; sz <= radius; sz++) {
+				if (sx * sx + sy * sy + sz * sz > radius * radius)
+					continue;
+				RefCountedPtr<const Sector> sec = m_galaxy->GetSector(SystemPath(sx, sy, sz));
+				for (const Sector::System &sys : sec->m_systems) {
+					if (sys.GetCustomSystem() && sys.GetCustomSystem()->faction)
+						continue;
+
+					indexedTimer.Start();
+					const Faction *indexed = GetNearestClaimant(&sys);
+					indexedTimer.Stop();
+
+					// the reference answer, testing every faction in order
+					linearTimer.Start();
+					const Faction *linear = &m_no_faction;
+					double closestFactionDist = HUGE_VAL;
+					for (const Faction *faction : m_factions) {
+						if (faction->IsClaimed(sys.GetPath())) {
+							linear = faction;
+							break;
+						}
+						if (faction->IsCloserAndContains(closestFactionDist, &sys))
+							linear = faction;
+					}
+					linearTimer.Stop();
+
+					numSystems++;
+					if (indexed != linear)
+						numMismatches++;
+				}
+			}
+		}
+	}
+	Output("BenchmarkClaimants: %u systems within %d sectors, %u mismatches\n", numSystems, radius, numMismatches);
+	Output("BenchmarkClaimants: indexed took %lf, testing every faction took %lf milliseconds\n", indexedTimer.millicycles(), linearTimer.millicycles());
+}
+#endif
+
 /*	Answer whether the faction both contains the sysPath, and has a homeworld
 	closer than the passed distance.
 
@@ -776,6 +856,136 @@ Faction::Faction(Galaxy *galaxy) :
 
 // ------ Factions Spatial Indexing ------
 
+void FactionsDatabase::TerritoryIndex::Update()
+{
+	if (!m_dirty)
+		return;
+	std::lock_guard<std::mutex> lock(m_buildLock);
+	if (m_dirty) {
+		Build();
+		m_dirty = false;
+	}
+}
+
+void FactionsDatabase::TerritoryIndex::Build()
+{
+	PROFILE_SCOPED()
+	m_tree.reset();
+	m_territories.clear();
+	m_everywhere.clear();
+	m_claims.clear();
+	{
+		std::lock_guard<std::mutex> lock(m_cacheLock);
+		m_cache.clear();
+	}
+
+	std::vector<Aabb> aabbs;
+	for (const Faction *faction : m_factions) {
+		// factions come in index order, so the first claim on a path is kept
+		for (const SystemPath &claim : faction->m_ownedsystemlist)
+			m_claims.insert(std::make_pair(claim, faction));
+
+		/* Factions without homeworlds, and ones whose homeworlds don't exist
+		   (yet), might hold any system.
+		*/
+		if (!faction->hasHomeworld) {
+			m_everywhere.push_back(faction);
+			continue;
+		}
+		RefCountedPtr<const Sector> sec = faction->GetHomeSector();
+		if (faction->homeworld.systemIndex >= sec->m_systems.size()) {
+			m_everywhere.push_back(faction);
+			continue;
+		}
+
+		/* The territory is the sphere around the homeworld, plus the whole home
+		   sector which the faction always holds.
+		*/
+		const vector3d home(sec->m_systems[faction->homeworld.systemIndex].GetFullPosition());
+		const double radius = std::max(faction->Radius(), 0.0);
+		Aabb aabb;
+		aabb.Update(home - vector3d(radius));
+		aabb.Update(home + vector3d(radius));
+		const vector3d secMin = Sector::SIZE * vector3d(double(sec->sx), double(sec->sy), double(sec->sz));
+		aabb.Update(secMin);
+		aabb.Update(secMin + vector3d(Sector::SIZE));
+		aabbs.push_back(aabb);
+		m_territories.push_back(faction);
+	}
+
+	if (!m_territories.empty()) {
+		std::vector<BVHTree::objPtr_t> objPtrs(m_territories.size());
+		for (size_t i = 0; i < objPtrs.size(); i++)
+			objPtrs[i] = BVHTree::objPtr_t(i);
+		m_tree.reset(new BVHTree(int(objPtrs.size()), &objPtrs[0], &aabbs[0]));
+	}
+}
+
+std::shared_ptr<const FactionsDatabase::TerritoryIndex::CandidateList> FactionsDatabase::TerritoryIndex::CandidateFactions(const SystemPath &sectorPath)
+{
+	PROFILE_SCOPED()
+	Update();
+	const SystemPath sector = sectorPath.SectorOnly();
+	{
+		std::lock_guard<std::mutex> lock(m_cacheLock);
+		auto it = m_cache.find(sector);
+		if (it != m_cache.end())
+			return it->second;
+	}
+
+	std::shared_ptr<CandidateList> candidates(new CandidateList(m_everywhere));
+	if (m_tree) {
+		const vector3f secMin = Sector::SIZE * vector3f(float(sector.sectorX), float(sector.sectorY), float(sector.sectorZ));
+		const vector3f secMax = secMin + vector3f(Sector::SIZE);
+
+		std::vector<const BVHNode *> stack;
+		stack.push_back(m_tree->GetRoot());
+		while (!stack.empty()) {
+			const BVHNode *node = stack.back();
+			stack.pop_back();
+			if (node->min.x > secMax.x || node->max.x < secMin.x ||
+				node->min.y > secMax.y || node->max.y < secMin.y ||
+				node->min.z > secMax.z || node->max.z < secMin.z)
+				continue;
+
+			if (node->IsLeaf()) {
+				const BVHTree::objPtr_t *objs = m_tree->GetObjPtrs(node);
+				for (Uint32 i = 0; i < node->numTris; i++)
+					candidates->push_back(m_territories[objs[i]]);
+			} else {
+				stack.push_back(m_tree->GetKid(node, 0));
+				stack.push_back(m_tree->GetKid(node, 1));
+			}
+		}
+	}
+
+	// GetNearestClaimant gives ties to the later faction, so keep index order
+	std::sort(candidates->begin(), candidates->end(), [](const Faction *a, const Faction *b) { return a->idx < b->idx; });
+
+	std::lock_guard<std::mutex> lock(m_cacheLock);
+	if (m_cache.size() >= MAX_CACHED_SECTORS)
+		m_cache.clear();
+	return m_cache.insert(std::make_pair(sector, candidates)).first->second;
+}
+
+const Faction *FactionsDatabase::TerritoryIndex::Claimant(const SystemPath &sysPath)
+{
+	Update();
+	if (m_claims.empty())
+		return nullptr;
+
+	SystemPath sector = sysPath.SystemOnly();
+	sector.systemIndex = -99; // magic number for a whole sector claim, see l_fac_claim
+
+	auto sysClaim = m_claims.find(sysPath.SystemOnly());
+	auto secClaim = m_claims.find(sector);
+	if (sysClaim == m_claims.end())
+		return secClaim == m_claims.end() ? nullptr : secClaim->second;
+	if (secClaim == m_claims.end())
+		return sysClaim->second;
+	return sysClaim->second->idx < secClaim->second->idx ? sysClaim->second : secClaim->second;
+}
+
 void FactionsDatabase::Octsapling::Add(const Faction *faction)
 {
 	PROFILE_SCOPED()
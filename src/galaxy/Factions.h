@@ -10,11 +10,18 @@
 #include "galaxy/Economy.h"
 #include "galaxy/Sector.h"
 #include "galaxy/StarSystem.h"
+#include "collider/BVHTree.h"
 #include "vector3.h"
+#include <atomic>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+//#define BENCHMARK_FACTIONS
+
 class Galaxy;
 class CustomSystem;
 
@@ -79,17 +86,13 @@ private:
 	const bool IsCloserAndContains(double &closestFactionDist, const Sector::System *sys) const;
 };
 
-/* One day it might grow up to become a full tree, on the  other hand it might be
-   cut down before it's full growth to be replaced by
-   a proper spatial data structure.
-*/
-
 class FactionsDatabase {
 public:
 	FactionsDatabase(Galaxy *galaxy, const std::string &factionDir) :
 		m_galaxy(galaxy),
 		m_factionDirectory(factionDir),
 		m_no_faction(galaxy),
+		m_spatial_index(m_factions),
 		m_may_assign_factions(false),
 		m_initialized(false) {}
 	~FactionsDatabase();
@@ -107,11 +110,68 @@ public:
 	const Faction *GetNearestClaimant(const Sector::System *sys) const;
 	bool IsHomeSystem(const SystemPath &sysPath) const;
 
+#ifdef BENCHMARK_FACTIONS
+	// time faction assignment for every system within radius sectors of the
+	// origin, and check it against testing every faction
+	void BenchmarkClaimants(Sint32 radius) const;
+#endif
+
 	const Uint32 GetNumFactions() const;
 
 	bool MayAssignFactions() const;
 
 private:
+	typedef std::vector<Faction *> FactionList;
+	typedef FactionList::iterator FactionIterator;
+	typedef const std::vector<const Faction *> ConstFactionList;
+	typedef ConstFactionList::const_iterator ConstFactionIterator;
+
+	/* Finds the factions that might hold a system without checking all of them.
+	   Faction territories go in a bounding volume tree, explicit claims in a
+	   hash map. Every system in a sector has the same candidates, so the
+	   candidate list is remembered per sector.
+
+	   Built by the first query after the factions change, so loading them
+	   doesn't rebuild it for every faction added. Factions only change on the
+	   main thread while they are loaded, after that it may be used from any
+	   thread.
+	*/
+	class TerritoryIndex {
+	public:
+		typedef std::vector<const Faction *> CandidateList;
+
+		explicit TerritoryIndex(const FactionList &factions) :
+			m_factions(factions),
+			m_dirty(true) {}
+
+		void MarkDirty() { m_dirty = true; }
+		// candidates in faction index order
+		std::shared_ptr<const CandidateList> CandidateFactions(const SystemPath &sectorPath);
+		// the first faction to claim the system or its sector, if any
+		const Faction *Claimant(const SystemPath &sysPath);
+
+	private:
+		static const size_t MAX_CACHED_SECTORS = 4096;
+
+		void Update();
+		void Build();
+
+		const FactionList &m_factions;
+		std::atomic<bool> m_dirty;
+		std::mutex m_buildLock;
+
+		std::unique_ptr<BVHTree> m_tree; // objects are indices into m_territories
+		std::vector<const Faction *> m_territories;
+		CandidateList m_everywhere; // factions without a usable homeworld
+		std::unordered_map<SystemPath, const Faction *, SystemPath::HashSystemOnly> m_claims;
+
+		mutable std::mutex m_cacheLock;
+		mutable std::unordered_map<SystemPath, std::shared_ptr<const CandidateList>, SystemPath::HashSectorOnly> m_cache;
+	};
+
+	/* The index galaxy generator versions before 2 found factions with. Its
+	   borders differ from TerritoryIndex's, so it is kept for their saves.
+	*/
 	class Octsapling {
 	public:
 		void Add(const Faction *faction);
@@ -123,16 +183,14 @@ private:
 		void PruneDuplicates(const int bx, const int by, const int bz);
 	};
 
-	typedef std::vector<Faction *> FactionList;
-	typedef FactionList::iterator FactionIterator;
-	typedef const std::vector<const Faction *> ConstFactionList;
-	typedef ConstFactionList::const_iterator ConstFactionIterator;
 	typedef std::map<std::string, Faction *> FactionMap;
 	typedef std::set<SystemPath> HomeSystemSet;
 	typedef std::map<std::string, std::list<CustomSystem *>> MissingFactionsMap;
 
 	void ClearHomeSectors();
 	void SetHomeSectors();
+	bool UsesOctsapling() const;
+	const Faction *GetNearestClaimantOctsapling(const Sector::System *sys) const;
 
 	Galaxy *const m_galaxy;
 	const std::string m_factionDirectory;
@@ -140,7 +198,8 @@ private:
 	FactionList m_factions;
 	FactionMap m_factions_byName;
 	HomeSystemSet m_homesystems;
-	Octsapling m_spatial_index;
+	mutable TerritoryIndex m_spatial_index; // built on demand
+	Octsapling m_legacy_index; // only for generator versions before 2
 	bool m_may_assign_factions;
 	bool m_initialized = false;
 	MissingFactionsMap m_missingFactionsMap;
@@ -3,9 +3,11 @@
 
 #include "Galaxy.h"
 
+#include "CRC32.h"
 #include "FileSystem.h"
 #include "GalaxyGenerator.h"
 #include "GameSaveError.h"
+#include "JobQueue.h"
 #include "Json.h"
 #include "Sector.h"
 #include "utils.h"
@@ -19,8 +21,11 @@ Galaxy::Galaxy(RefCountedPtr<GalaxyGenerator> galaxyGenerator, float radius, flo
 	m_galaxyGenerator(galaxyGenerator),
 	m_sectorCache(this),
 	m_starSystemCache(this),
+	m_jumpRouter(this),
 	m_factions(this, factionsDir),
-	m_customSystems(this, customSysDir)
+	m_customSystems(this, customSysDir),
+	m_factionsDir(factionsDir),
+	m_customSysDir(customSysDir)
 {
 }
 
@@ -55,6 +60,14 @@ void Galaxy::Init()
 	m_factions.Init();
 	m_initialized = true;
 	m_factions.PostInit(); // So, cached home sectors take persisted state into account
+
+	// Sectors depend on the custom systems and on the faction home systems,
+	// so a change to either (including by a mod) invalidates the disk cache.
+	// Opened only now, sectors made while the factions were loading are incomplete.
+	CRC32 checksum;
+	ChecksumDataFiles(m_customSysDir, checksum);
+	ChecksumDataFiles(m_factionsDir, checksum);
+	m_sectorDiskCache.Open(GetGeneratorName(), GetGeneratorVersion(), checksum.GetChecksum());
 #if 0
 	{
 		Profiler::Timer timer;
@@ -77,23 +90,126 @@ void Galaxy::Init()
 void Galaxy::FlushCaches()
 {
 	m_factions.ClearCache();
+	m_jumpRouter.Clear();
 	m_starSystemCache.OutputCacheStatistics();
 	m_starSystemCache.ClearCache();
 	m_sectorCache.OutputCacheStatistics();
 	m_sectorCache.ClearCache();
+	// dropped sectors add themselves again when they are next generated, but
+	// anything still holding one gets it back from the attic as it is
+	m_systemNameIndex.RetainSectors(m_sectorCache.GetCachedPaths());
 	assert(m_sectorCache.IsEmpty());
+	m_sectorDiskCache.Save();
 }
 
-void Galaxy::Dump(FILE *file, Sint32 centerX, Sint32 centerY, Sint32 centerZ, Sint32 radius)
+void Galaxy::DumpColumn(FILE *file, Sint32 sx, Sint32 sy, Sint32 minZ, Sint32 maxZ)
 {
-	for (Sint32 sx = centerX - radius; sx <= centerX + radius; ++sx) {
-		for (Sint32 sy = centerY - radius; sy <= centerY + radius; ++sy) {
-			for (Sint32 sz = centerZ - radius; sz <= centerZ + radius; ++sz) {
-				RefCountedPtr<const Sector> sector = GetSector(SystemPath(sx, sy, sz));
-				sector->Dump(file);
+	for (Sint32 sz = minZ; sz <= maxZ; ++sz) {
+		RefCountedPtr<const Sector> sector = GetSector(SystemPath(sx, sy, sz));
+		sector->Dump(file);
+	}
+}
+
+// Dumps a column of sectors into a temporary file, to be copied to the real
+// output once all columns before it are done
+class Galaxy::DumpColumnJob : public Job {
+public:
+	DumpColumnJob(Galaxy *galaxy, Sint32 sx, Sint32 sy, Sint32 minZ, Sint32 maxZ, FILE *file, bool *done) :
+		m_galaxy(galaxy),
+		m_sx(sx),
+		m_sy(sy),
+		m_minZ(minZ),
+		m_maxZ(maxZ),
+		m_file(file),
+		m_done(done) {}
+
+	virtual void OnRun() override { m_galaxy->DumpColumn(m_file, m_sx, m_sy, m_minZ, m_maxZ); } // RUNS IN ANOTHER THREAD!!
+	virtual void OnFinish() override { *m_done = true; }
+	virtual const char *GetName() const override { return "DumpColumnJob"; }
+
+private:
+	Galaxy *m_galaxy;
+	const Sint32 m_sx, m_sy, m_minZ, m_maxZ;
+	FILE *m_file;
+	bool *m_done;
+};
+
+// enough to keep the workers busy, without running out of file handles
+static const int MAX_DUMP_COLUMNS_IN_FLIGHT = 64;
+
+void Galaxy::Dump(FILE *file, Sint32 centerX, Sint32 centerY, Sint32 centerZ, Sint32 radius, JobQueue *jobQueue)
+{
+	const Sint32 minZ = centerZ - radius, maxZ = centerZ + radius;
+
+	if (!jobQueue) {
+		for (Sint32 sx = centerX - radius; sx <= centerX + radius; ++sx) {
+			for (Sint32 sy = centerY - radius; sy <= centerY + radius; ++sy) {
+				DumpColumn(file, sx, sy, minZ, maxZ);
+				m_starSystemCache.ClearCache();
+			}
+		}
+		m_sectorDiskCache.Save();
+		return;
+	}
+
+	// columns are numbered in the order the serial dump visits them
+	const int side = 2 * radius + 1;
+	const int numColumns = side * side;
+	std::vector<FILE *> columnFiles(numColumns, nullptr);
+	std::unique_ptr<bool[]> columnDone(new bool[numColumns]());
+	JobSet jobs(jobQueue);
+
+	int nextToQueue = 0;
+	int nextToWrite = 0;
+	while (nextToWrite < numColumns) {
+		for (; nextToQueue < numColumns && nextToQueue - nextToWrite < MAX_DUMP_COLUMNS_IN_FLIGHT; ++nextToQueue) {
+			// without a temporary file the column is dumped directly when its turn comes
+			columnFiles[nextToQueue] = tmpfile();
+			if (columnFiles[nextToQueue]) {
+				const Sint32 sx = centerX - radius + nextToQueue / side;
+				const Sint32 sy = centerY - radius + nextToQueue % side;
+				jobs.Order(new DumpColumnJob(this, sx, sy, minZ, maxZ, columnFiles[nextToQueue], &columnDone[nextToQueue]));
 			}
-			m_starSystemCache.ClearCache();
 		}
+
+		jobQueue->FinishJobs();
+
+		bool wrote = false;
+		while (nextToWrite < numColumns && (columnDone[nextToWrite] || !columnFiles[nextToWrite])) {
+			FILE *columnFile = columnFiles[nextToWrite];
+			if (columnFile) {
+				char buf[16384];
+				rewind(columnFile);
+				size_t len;
+				while ((len = fread(buf, 1, sizeof(buf), columnFile)) > 0)
+					fwrite(buf, 1, len, file);
+				fclose(columnFile);
+			} else {
+				DumpColumn(file, centerX - radius + nextToWrite / side, centerY - radius + nextToWrite % side, minZ, maxZ);
+			}
+			++nextToWrite;
+			wrote = true;
+		}
+
+		if (!wrote)
+			SDL_Delay(1);
+	}
+	m_sectorDiskCache.Save();
+}
+
+//static
+void Galaxy::ChecksumDataFiles(const std::string &dir, CRC32 &checksum)
+{
+	std::vector<FileSystem::FileInfo> files;
+	for (FileSystem::FileEnumerator en(FileSystem::gameDataFiles, dir, FileSystem::FileEnumerator::Recurse); !en.Finished(); en.Next())
+		files.push_back(en.Current());
+	std::sort(files.begin(), files.end()); // the enumeration order is up to the platform
+
+	for (const FileSystem::FileInfo &info : files) {
+		checksum.AddData(info.GetPath().data(), info.GetPath().size());
+		RefCountedPtr<FileSystem::FileData> data = info.Read();
+		if (data)
+			checksum.AddData(data->GetData(), data->GetSize());
 	}
 }
 
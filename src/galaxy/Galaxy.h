@@ -8,11 +8,16 @@
 #include "Factions.h"
 #include "GalaxyCache.h"
 #include "JsonFwd.h"
+#include "JumpRouter.h"
 #include "RefCounted.h"
+#include "SectorDiskCache.h"
+#include "SystemNameIndex.h"
 #include <cstdio>
 
 struct SDL_Surface;
+class CRC32;
 class GalaxyGenerator;
+class JobQueue;
 
 class Galaxy : public RefCounted {
 protected:
@@ -42,24 +47,40 @@ public:
 	RefCountedPtr<const Sector> GetSector(const SystemPath &path) { return m_sectorCache.GetCached(path); }
 	RefCountedPtr<Sector> GetMutableSector(const SystemPath &path) { return m_sectorCache.GetCached(path); }
 	RefCountedPtr<SectorCache::Slave> NewSectorSlaveCache() { return m_sectorCache.NewSlaveCache(); }
+	SectorDiskCache *GetSectorDiskCache() { return m_sectorDiskCache.IsOpen() ? &m_sectorDiskCache : nullptr; }
 
 	RefCountedPtr<StarSystem> GetStarSystem(const SystemPath &path) { return m_starSystemCache.GetCached(path); }
 	RefCountedPtr<StarSystemCache::Slave> NewStarSystemSlaveCache() { return m_starSystemCache.NewSlaveCache(); }
 
+	JumpRouter &GetJumpRouter() { return m_jumpRouter; }
+	SystemNameIndex &GetSystemNameIndex() { return m_systemNameIndex; }
+
 	void FlushCaches();
-	void Dump(FILE *file, Sint32 centerX, Sint32 centerY, Sint32 centerZ, Sint32 radius);
+	// With a job queue, columns of sectors are generated on its workers; the
+	// output is the same as from the serial dump
+	void Dump(FILE *file, Sint32 centerX, Sint32 centerY, Sint32 centerZ, Sint32 radius, JobQueue *jobQueue = nullptr);
 
 	RefCountedPtr<GalaxyGenerator> GetGenerator() const;
 	const std::string &GetGeneratorName() const;
 	int GetGeneratorVersion() const;
 
 private:
+	class DumpColumnJob;
+
+	static void ChecksumDataFiles(const std::string &dir, CRC32 &checksum);
+	void DumpColumn(FILE *file, Sint32 sx, Sint32 sy, Sint32 minZ, Sint32 maxZ);
+
 	bool m_initialized;
 	RefCountedPtr<GalaxyGenerator> m_galaxyGenerator;
 	SectorCache m_sectorCache;
 	StarSystemCache m_starSystemCache;
+	SectorDiskCache m_sectorDiskCache;
+	JumpRouter m_jumpRouter;
+	SystemNameIndex m_systemNameIndex;
 	FactionsDatabase m_factions;
 	CustomSystemsDatabase m_customSystems;
+	std::string m_factionsDir;
+	std::string m_customSysDir;
 };
 
 class DensityMapGalaxy : public Galaxy {
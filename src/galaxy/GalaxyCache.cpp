@@ -21,19 +21,63 @@ GalaxyObjectCache<T, CompareT>::~GalaxyObjectCache()
 {
 	for (Slave *s : m_slaves)
 		s->MasterDeleted();
-	assert(m_attic.empty()); // otherwise the objects will deregister at a cache that no longer exists
+	assert(IsEmpty()); // otherwise the objects will deregister at a cache that no longer exists
+}
+
+template <typename T, typename CompareT>
+bool GalaxyObjectCache<T, CompareT>::IsEmpty()
+{
+	for (AtticStripe &stripe : m_attic) {
+		std::lock_guard<std::mutex> lock(stripe.lock);
+		if (!stripe.objects.empty())
+			return false;
+	}
+	return true;
+}
+
+template <typename T, typename CompareT>
+std::vector<SystemPath> GalaxyObjectCache<T, CompareT>::GetCachedPaths()
+{
+	std::vector<SystemPath> paths;
+	for (AtticStripe &stripe : m_attic) {
+		std::lock_guard<std::mutex> lock(stripe.lock);
+		for (const auto &it : stripe.objects)
+			paths.push_back(it.first);
+	}
+	return paths;
 }
 
 template <typename T, typename CompareT>
 void GalaxyObjectCache<T, CompareT>::AddToCache(std::vector<RefCountedPtr<T>> &objects)
 {
-	for (auto it = objects.begin(), itEnd = objects.end(); it != itEnd; ++it) {
-		auto inserted = m_attic.insert(std::make_pair(it->Get()->GetPath(), it->Get()));
+	for (auto it = objects.begin(), itEnd = objects.end(); it != itEnd; ++it)
+		AddToAttic(*it);
+}
+
+// Registers a freshly generated object, or replaces it with the one that is
+// already cached for its path (e.g. because another thread generated it first)
+template <typename T, typename CompareT>
+void GalaxyObjectCache<T, CompareT>::AddToAttic(RefCountedPtr<T> &object)
+{
+	RefCountedPtr<T> discarded; // released after the lock, its destructor may want it
+	{
+		AtticStripe &stripe = GetStripe(object->GetPath());
+		std::lock_guard<std::mutex> lock(stripe.lock);
+		auto inserted = stripe.objects.insert(std::make_pair(object->GetPath(), object.Get()));
 		if (!inserted.second) {
-			it->Reset(inserted.first->second);
-		} else {
-			(*it)->SetCache(this);
+			T *cached = inserted.first->second;
+			if (cached == object.Get())
+				return;
+			if (cached->TryIncRefCount()) {
+				discarded = object;
+				object.Reset(cached);
+				cached->DecRefCount();
+				return;
+			}
+			// the cached object is being destroyed and will not remove us, as it checks the pointer
+			inserted.first->second = object.Get();
 		}
+		object->SetCache(this);
 	}
 }
 
@@ -42,12 +86,21 @@ RefCountedPtr<T> GalaxyObjectCache<T, CompareT>::GetIfCached(const SystemPath &p
 {
 	PROFILE_SCOPED()
 
-	RefCountedPtr<T> s;
-	typename AtticMap::iterator i = m_attic.find(path);
-	if (i != m_attic.end()) {
-		s.Reset(i->second);
+	T *cached = nullptr;
+	{
+		AtticStripe &stripe = GetStripe(path);
+		std::lock_guard<std::mutex> lock(stripe.lock);
+		typename AtticMap::iterator i = stripe.objects.find(path);
+		// an object with no references left is on its way out and must not be revived
+		if (i != stripe.objects.end() && i->second->TryIncRefCount())
+			cached = i->second;
 	}
 
+	RefCountedPtr<T> s;
+	if (cached) {
+		s.Reset(cached);
+		cached->DecRefCount();
+	}
 	return s;
 }
 
@@ -59,8 +112,8 @@ RefCountedPtr<T> GalaxyObjectCache<T, CompareT>::GetCached(const SystemPath &pat
 	RefCountedPtr<T> s = this->GetIfCached(path);
 	if (!s) {
 		++m_cacheMisses;
-		s = m_galaxy->GetGenerator()->Generate<T, GalaxyObjectCache<T, CompareT>>(RefCountedPtr<Galaxy>(m_galaxy), path, this);
-		m_attic.insert(std::make_pair(path, s.Get()));
+		s = m_galaxy->GetGenerator()->Generate<T, GalaxyObjectCache<T, CompareT>>(RefCountedPtr<Galaxy>(m_galaxy), path, nullptr);
+		AddToAttic(s);
 	} else {
 		++m_cacheHits;
 	}
@@ -68,17 +121,23 @@ RefCountedPtr<T> GalaxyObjectCache<T, CompareT>::GetCached(const SystemPath &pat
 }
 
 template <typename T, typename CompareT>
-bool GalaxyObjectCache<T, CompareT>::HasCached(const SystemPath &path) const
+bool GalaxyObjectCache<T, CompareT>::HasCached(const SystemPath &path)
 {
 	PROFILE_SCOPED()
 
-	return (m_attic.find(path) != m_attic.end());
+	AtticStripe &stripe = GetStripe(path);
+	std::lock_guard<std::mutex> lock(stripe.lock);
+	return (stripe.objects.find(path) != stripe.objects.end());
 }
 
 template <typename T, typename CompareT>
-void GalaxyObjectCache<T, CompareT>::RemoveFromAttic(const SystemPath &path)
+void GalaxyObjectCache<T, CompareT>::RemoveFromAttic(const SystemPath &path, const T *object)
 {
-	m_attic.erase(path);
+	AtticStripe &stripe = GetStripe(path);
+	std::lock_guard<std::mutex> lock(stripe.lock);
+	typename AtticMap::iterator i = stripe.objects.find(path);
+	if (i != stripe.objects.end() && i->second == object)
+		stripe.objects.erase(i);
 }
 
 template <typename T, typename CompareT>
@@ -91,7 +150,7 @@ void GalaxyObjectCache<T, CompareT>::ClearCache()
 template <typename T, typename CompareT>
 void GalaxyObjectCache<T, CompareT>::OutputCacheStatistics(bool reset)
 {
-	Output("%s: misses: %llu, slave hits: %llu, master hits: %llu\n", CACHE_NAME.c_str(), m_cacheMisses, m_cacheHitsSlave, m_cacheHits);
+	Output("%s: misses: %llu, slave hits: %llu, master hits: %llu\n", CACHE_NAME.c_str(), m_cacheMisses.load(), m_cacheHitsSlave.load(), m_cacheHits.load());
 	if (reset)
 		m_cacheMisses = m_cacheHitsSlave = m_cacheHits = 0;
 }
@@ -174,12 +233,44 @@ GalaxyObjectCache<T, CompareT>::Slave::~Slave()
 template <typename T, typename CompareT>
 void GalaxyObjectCache<T, CompareT>::Slave::AddToCache(std::vector<RefCountedPtr<T>> &objects)
 {
-	if (m_master) {
-		m_master->AddToCache(objects); // This modifies the vector to the sectors already in the master cache
-		for (auto it = objects.begin(), itEnd = objects.end(); it != itEnd; ++it) {
+	// The job has already put the objects in the master cache and swapped in
+	// any that were there first
+	for (auto it = objects.begin(), itEnd = objects.end(); it != itEnd; ++it) {
+		m_prefetching.erase(it->Get()->GetPath());
+		if (m_master)
 			m_cache.insert(std::make_pair(it->Get()->GetPath(), *it));
+	}
+}
+
+template <typename T, typename CompareT>
+void GalaxyObjectCache<T, CompareT>::Slave::Prefetch(const typename GalaxyObjectCache<T, CompareT>::PathVector &paths)
+{
+	if (!m_master)
+		return;
+
+	std::unique_ptr<PathVector> current_paths;
+	for (auto it = paths.begin(), itEnd = paths.end(); it != itEnd; ++it) {
+		if (m_cache.find(*it) != m_cache.end() || m_prefetching.find(*it) != m_prefetching.end())
+			continue;
+
+		RefCountedPtr<T> s = m_master->GetIfCached(*it);
+		if (s) {
+			m_cache[*it] = s;
+			continue;
 		}
+
+		if (!current_paths) {
+			current_paths.reset(new PathVector);
+			current_paths->reserve(CACHE_JOB_SIZE);
+		}
+		current_paths->push_back(*it);
+		m_prefetching.insert(*it);
+		if (current_paths->size() >= CACHE_JOB_SIZE)
+			m_jobs.Order(new GalaxyObjectCache<T, CompareT>::CacheJob(std::move(current_paths), this, m_galaxy, CacheFilledCallback(), Job::PRIORITY_BACKGROUND));
 	}
+
+	if (current_paths)
+		m_jobs.Order(new GalaxyObjectCache<T, CompareT>::CacheJob(std::move(current_paths), this, m_galaxy, CacheFilledCallback(), Job::PRIORITY_BACKGROUND));
 }
 
 template <typename T, typename CompareT>
@@ -242,13 +333,15 @@ void GalaxyObjectCache<T, CompareT>::Slave::FillCache(const typename GalaxyObjec
 template <typename T, typename CompareT>
 GalaxyObjectCache<T, CompareT>::CacheJob::CacheJob(std::unique_ptr<std::vector<SystemPath>> path,
 	typename GalaxyObjectCache<T, CompareT>::Slave *slaveCache, RefCountedPtr<Galaxy> galaxy,
-	typename GalaxyObjectCache<T, CompareT>::CacheFilledCallback callback) :
+	typename GalaxyObjectCache<T, CompareT>::CacheFilledCallback callback, Job::Priority priority) :
 	Job(),
 	m_paths(std::move(path)),
+	m_master(slaveCache->m_master),
 	m_slaveCache(slaveCache),
 	m_galaxy(galaxy),
 	m_galaxyGenerator(galaxy->GetGenerator()),
-	m_callback(callback)
+	m_callback(callback),
+	m_priority(priority)
 {
 	m_objects.reserve(m_paths->size());
 }
@@ -257,8 +350,15 @@ GalaxyObjectCache<T, CompareT>::CacheJob::CacheJob(std::unique_ptr<std::vector<S
 template <typename T, typename CompareT>
 void GalaxyObjectCache<T, CompareT>::CacheJob::OnRun() // RUNS IN ANOTHER THREAD!! MUST BE THREAD SAFE!
 {
-	for (auto it = m_paths->begin(), itEnd = m_paths->end(); it != itEnd; ++it)
-		m_objects.push_back(m_galaxyGenerator->Generate<T, GalaxyObjectCache<T, CompareT>>(m_galaxy, *it, nullptr));
+	// m_master lives as long as m_galaxy, which we hold on to
+	for (auto it = m_paths->begin(), itEnd = m_paths->end(); it != itEnd; ++it) {
+		RefCountedPtr<T> object = m_master->GetIfCached(*it);
+		if (!object) {
+			object = m_galaxyGenerator->Generate<T, GalaxyObjectCache<T, CompareT>>(m_galaxy, *it, nullptr);
+			m_master->AddToAttic(object); // visible to everyone from here on
+		}
+		m_objects.push_back(object);
+	}
 }
 
 //virtual
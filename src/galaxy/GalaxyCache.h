@@ -7,15 +7,35 @@
 #include "JobQueue.h"
 #include "RefCounted.h"
 #include "galaxy/SystemPath.h"
+#include <atomic>
 #include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 class GalaxyGenerator;
 class Galaxy;
 
+// Picks the SystemPath hash matching the granularity of a cache's comparison
+template <typename CompareT>
+struct GalaxyCacheHash;
+
+template <>
+struct GalaxyCacheHash<SystemPath::LessSectorOnly> {
+	typedef SystemPath::HashSectorOnly type;
+};
+
+template <>
+struct GalaxyCacheHash<SystemPath::LessSystemOnly> {
+	typedef SystemPath::HashSystemOnly type;
+};
+
+// The master cache (GetCached, GetIfCached and the attic) may be used from any
+// thread, so generation jobs can publish their results as soon as they are
+// done. Slave caches belong to the thread that created them.
 template <typename T, typename CompareT>
 class GalaxyObjectCache {
 	friend T;
@@ -34,13 +54,14 @@ public:
 	RefCountedPtr<T> GetIfCached(const SystemPath &path);
 
 	void ClearCache(); // Completely clear slave caches
-	bool IsEmpty() { return m_attic.empty(); }
+	bool IsEmpty();
+	// Paths of the objects still alive, wherever they are held
+	std::vector<SystemPath> GetCachedPaths();
 
 	void OutputCacheStatistics(bool reset = true);
 
 	typedef std::vector<SystemPath> PathVector;
 	typedef std::map<SystemPath, RefCountedPtr<T>, CompareT> CacheMap;
-	typedef std::map<SystemPath, T *, CompareT> AtticMap;
 	typedef std::function<void()> CacheFilledCallback;
 
 	class Slave : public RefCounted {
@@ -53,6 +74,11 @@ public:
 		typename CacheMap::const_iterator End() const { return m_cache.end(); }
 
 		void FillCache(const PathVector &paths, CacheFilledCallback callback = CacheFilledCallback());
+		// Generate the given paths in the background without a completion callback,
+		// behind any jobs something is waiting on.
+		// Paths already cached or still being generated are skipped, so this is
+		// cheap to call again with an overlapping set.
+		void Prefetch(const PathVector &paths);
 		void Erase(const SystemPath &path);
 		void Erase(const typename CacheMap::const_iterator &it);
 		void ClearCache();
@@ -63,6 +89,7 @@ public:
 		GalaxyObjectCache *m_master;
 		RefCountedPtr<Galaxy> m_galaxy;
 		CacheMap m_cache;
+		std::set<SystemPath, CompareT> m_prefetching;
 		JobSet m_jobs;
 
 		Slave(GalaxyObjectCache *master, RefCountedPtr<Galaxy> galaxy, JobQueue *jobQueue);
@@ -74,40 +101,61 @@ public:
 
 private:
 	static const unsigned CACHE_JOB_SIZE = 100;
+	static const unsigned ATTIC_STRIPES = 16;
+
+	typedef typename GalaxyCacheHash<CompareT>::type HashT;
+
+	struct EqualT {
+		bool operator()(const SystemPath &a, const SystemPath &b) const { return !CompareT()(a, b) && !CompareT()(b, a); }
+	};
+
+	typedef std::unordered_map<SystemPath, T *, HashT, EqualT> AtticMap;
+
+	struct AtticStripe {
+		std::mutex lock;
+		AtticMap objects;
+	};
 
 	void AddToCache(std::vector<RefCountedPtr<T>> &objects);
-	bool HasCached(const SystemPath &path) const;
-	void RemoveFromAttic(const SystemPath &path);
+	void AddToAttic(RefCountedPtr<T> &object);
+	bool HasCached(const SystemPath &path);
+	void RemoveFromAttic(const SystemPath &path, const T *object);
+	AtticStripe &GetStripe(const SystemPath &path) { return m_attic[HashT()(path) % ATTIC_STRIPES]; }
 
 	// ********************************************************************************
 	// Overloaded Job class to handle generating a collection of sectors
 	// ********************************************************************************
 	class CacheJob : public Job {
 	public:
-		CacheJob(std::unique_ptr<std::vector<SystemPath>> path, Slave *slaveCache, RefCountedPtr<Galaxy> galaxy, CacheFilledCallback callback = CacheFilledCallback());
+		CacheJob(std::unique_ptr<std::vector<SystemPath>> path, Slave *slaveCache, RefCountedPtr<Galaxy> galaxy, CacheFilledCallback callback = CacheFilledCallback(), Priority priority = PRIORITY_NORMAL);
 
 		virtual void OnRun(); // RUNS IN ANOTHER THREAD!! MUST BE THREAD SAFE!
 		virtual void OnFinish(); // runs in primary thread of the context
 		virtual void OnCancel() {} // runs in primary thread of the context
+		virtual const char *GetName() const { return "GalaxyCacheJob"; }
+		virtual Priority GetPriority() const { return m_priority; }
 
 	protected:
 		std::unique_ptr<std::vector<SystemPath>> m_paths;
 		std::vector<RefCountedPtr<T>> m_objects;
+		GalaxyObjectCache *m_master;
 		Slave *m_slaveCache;
 		RefCountedPtr<Galaxy> m_galaxy;
 		RefCountedPtr<GalaxyGenerator> m_galaxyGenerator;
 		CacheFilledCallback m_callback;
+		Priority m_priority;
 	};
 
 	Galaxy *m_galaxy;
 	std::set<Slave *> m_slaves;
-	AtticMap m_attic; // Those contains non-refcounted pointers which are kept alive by RefCountedPtrs in slave caches
+	AtticStripe m_attic[ATTIC_STRIPES]; // Those contains non-refcounted pointers which are kept alive by RefCountedPtrs in slave caches
 		// or elsewhere. The Sector destructor ensures that it is removed from here.
 		// This ensures, that there is only ever one object for each Sector.
+		// Each stripe has its own lock so lookups from different threads rarely contend.
 
-	unsigned long long m_cacheHits;
-	unsigned long long m_cacheHitsSlave;
-	unsigned long long m_cacheMisses;
+	std::atomic<unsigned long long> m_cacheHits;
+	std::atomic<unsigned long long> m_cacheHitsSlave;
+	std::atomic<unsigned long long> m_cacheMisses;
 };
 
 class Sector;
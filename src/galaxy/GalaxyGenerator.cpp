@@ -10,7 +10,9 @@
 #include "galaxy/StarSystemGenerator.h"
 #include "utils.h"
 
-static const GalaxyGenerator::Version LAST_VERSION_LEGACY = 1;
+// version 2 finds faction territories with FactionsDatabase::TerritoryIndex,
+// which gives some systems to a different faction than before
+static const GalaxyGenerator::Version LAST_VERSION_LEGACY = 2;
 
 std::string GalaxyGenerator::s_defaultGenerator = "legacy";
 GalaxyGenerator::Version GalaxyGenerator::s_defaultVersion = LAST_VERSION_LEGACY;
@@ -49,7 +51,7 @@ RefCountedPtr<Galaxy> GalaxyGenerator::Create(const std::string &name, Version v
 	RefCountedPtr<GalaxyGenerator> galgen;
 	if (name == "legacy") {
 		Output("Creating new galaxy generator '%s' version %d\n", name.c_str(), version);
-		if (version == 0 || version == 1) {
+		if (version >= 0 && version <= LAST_VERSION_LEGACY) {
 			galgen.Reset((new GalaxyGenerator(name, version))
 							 ->AddSectorStage(new SectorCustomSystemsGenerator(CustomSystem::CUSTOM_ONLY_RADIUS))
 							 ->AddSectorStage(new SectorRandomSystemsGenerator)
@@ -172,9 +174,33 @@ RefCountedPtr<Sector> GalaxyGenerator::GenerateSector(RefCountedPtr<Galaxy> gala
 	Random rng(_init, 4);
 	SectorConfig config;
 	RefCountedPtr<Sector> sector(new Sector(galaxy, path, cache));
-	for (SectorGeneratorStage *secgen : m_sectorStage)
-		if (!secgen->Apply(rng, galaxy, sector, &config))
-			break;
+
+	// The stages up to the first one that depends on game state always give
+	// the same result, so they can come from the disk cache
+	auto stage = m_sectorStage.begin();
+	bool complete = true;
+	SectorDiskCache *diskCache = galaxy->GetSectorDiskCache();
+	if (diskCache && diskCache->Load(galaxy.Get(), sector.Get(), complete)) {
+		while (stage != m_sectorStage.end() && !(*stage)->DependsOnGameState())
+			++stage;
+	} else {
+		complete = true;
+		for (; stage != m_sectorStage.end() && !(*stage)->DependsOnGameState(); ++stage) {
+			if (!(*stage)->Apply(rng, galaxy, sector, &config)) {
+				complete = false;
+				break;
+			}
+		}
+		if (diskCache)
+			diskCache->Store(sector.Get(), complete);
+	}
+
+	if (complete) {
+		galaxy->GetSystemNameIndex().AddSector(sector.Get());
+		for (; stage != m_sectorStage.end(); ++stage)
+			if (!(*stage)->Apply(rng, galaxy, sector, &config))
+				break;
+	}
 	return sector;
 }
 
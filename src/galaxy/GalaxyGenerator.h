@@ -117,6 +117,10 @@ public:
 	virtual ~SectorGeneratorStage() {}
 
 	virtual bool Apply(Random &rng, RefCountedPtr<Galaxy> galaxy, RefCountedPtr<Sector> sector, GalaxyGenerator::SectorConfig *config) = 0;
+
+	// Stages that use saved game state can't be replaced by the sector disk
+	// cache. Stages after them mustn't rely on the rng or config of earlier ones.
+	virtual bool DependsOnGameState() const { return false; }
 };
 
 class StarSystemGeneratorStage : public GalaxyGeneratorStage {
@@ -0,0 +1,269 @@
+// Copyright © 2008-2019 Pioneer Developers. See AUTHORS.txt for details
+// Licensed under the terms of the GPL v3. See licenses/GPL-3.txt
+
+#include "JumpRouter.h"
+
+#include "Galaxy.h"
+#include "MathUtil.h"
+#include "Sector.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+
+// the index is thrown away when it grows beyond this many systems
+static const size_t MAX_NODES = 256 * 1024;
+
+// systems further than this from the line between start and target are not considered
+static const float CORRIDOR_RADIUS = Sector::SIZE * 3.f;
+
+JumpRouter::CostModel JumpRouter::CostModel::Duration(float maxRange, float durationAtMaxRange)
+{
+	CostModel cost = { maxRange, 0.f, 0.f, durationAtMaxRange / (maxRange * maxRange) };
+	return cost;
+}
+
+JumpRouter::CostModel JumpRouter::CostModel::Distance(float maxRange)
+{
+	CostModel cost = { maxRange, 0.f, 1.f, 0.f };
+	return cost;
+}
+
+JumpRouter::CostModel JumpRouter::CostModel::Jumps(float maxRange)
+{
+	CostModel cost = { maxRange, 1.f, 0.f, 0.f };
+	return cost;
+}
+
+float JumpRouter::CostModel::LowerBound(float dist) const
+{
+	if (dist <= 0.f)
+		return 0.f;
+
+	// Covering dist in m jumps costs at least perJump * m + perLy * dist +
+	// perLySquared * dist^2 / m, and m can't be less than dist / maxRange.
+	// Taking the best real valued m keeps the bound consistent for A*.
+	// Without a per jump cost, splitting a jump always makes it cheaper, so
+	// the squared term adds nothing to the bound.
+	float bound = perLy * dist;
+	const float minJumps = dist / maxRange;
+	if (perJump > 0.f && perLySquared > 0.f) {
+		const float jumps = std::max(minJumps, dist * sqrtf(perLySquared / perJump));
+		bound += perJump * jumps + perLySquared * dist * dist / jumps;
+	} else if (perJump > 0.f) {
+		bound += perJump * minJumps;
+	}
+	return bound;
+}
+
+JumpRouter::JumpRouter(Galaxy *galaxy) :
+	m_galaxy(galaxy)
+{
+}
+
+void JumpRouter::Clear()
+{
+	m_sectors.clear();
+	m_paths.clear();
+	m_positions.clear();
+}
+
+const JumpRouter::SectorNodes &JumpRouter::GetSectorNodes(Sint32 sx, Sint32 sy, Sint32 sz)
+{
+	const SystemPath secPath(sx, sy, sz);
+	SectorMap::const_iterator it = m_sectors.find(secPath);
+	if (it != m_sectors.end())
+		return it->second;
+
+	RefCountedPtr<const Sector> sec = m_galaxy->GetSector(secPath);
+	SectorNodes nodes = { Uint32(m_paths.size()), Uint32(sec->m_systems.size()) };
+	for (const Sector::System &sys : sec->m_systems) {
+		m_paths.push_back(sys.GetPath());
+		m_positions.push_back(sys.GetFullPosition());
+	}
+	return m_sectors.insert(std::make_pair(secPath, nodes)).first->second;
+}
+
+bool JumpRouter::GetNode(const SystemPath &path, Uint32 &node)
+{
+	const SectorNodes &nodes = GetSectorNodes(path.sectorX, path.sectorY, path.sectorZ);
+	if (path.systemIndex >= nodes.count)
+		return false;
+	node = nodes.first + path.systemIndex;
+	return true;
+}
+
+namespace {
+	// uniform grid over the candidate systems, with cells as big as the longest jump
+	// so every neighbour of a system is in the 27 cells around it
+	struct JumpGrid {
+		float cellSize;
+		std::unordered_map<Uint64, std::pair<Uint32, Uint32>> cells; // ranges in members
+		std::vector<Uint32> members;
+
+		static Sint32 Cell(float x, float size) { return Sint32(floorf(x / size)); }
+
+		static Uint64 Key(Sint32 x, Sint32 y, Sint32 z)
+		{
+			const Uint64 mask = (1 << 21) - 1;
+			return ((Uint64(x) & mask) << 42) | ((Uint64(y) & mask) << 21) | (Uint64(z) & mask);
+		}
+
+		Uint64 Key(const vector3f &p) const { return Key(Cell(p.x, cellSize), Cell(p.y, cellSize), Cell(p.z, cellSize)); }
+
+		void Build(const std::vector<vector3f> &positions)
+		{
+			std::vector<std::pair<Uint64, Uint32>> keyed;
+			keyed.reserve(positions.size());
+			for (Uint32 i = 0; i < positions.size(); i++)
+				keyed.push_back(std::make_pair(Key(positions[i]), i));
+			std::sort(keyed.begin(), keyed.end());
+
+			members.reserve(keyed.size());
+			for (Uint32 i = 0; i < keyed.size(); i++) {
+				if (i == 0 || keyed[i].first != keyed[i - 1].first)
+					cells[keyed[i].first] = std::make_pair(i, i);
+				cells[keyed[i].first].second = i + 1;
+				members.push_back(keyed[i].second);
+			}
+		}
+	};
+
+	struct OpenNode {
+		float estimate;
+		Uint32 node;
+		bool operator>(const OpenNode &other) const { return estimate > other.estimate; }
+	};
+} // namespace
+
+bool JumpRouter::FindRoute(const SystemPath &start, const SystemPath &target, const CostModel &cost, std::vector<SystemPath> &outRoute)
+{
+	PROFILE_SCOPED()
+	outRoute.clear();
+
+	if (!(cost.maxRange > 0.f))
+		return false;
+
+	if (m_paths.size() > MAX_NODES)
+		Clear();
+
+	Uint32 startNode, targetNode;
+	if (!GetNode(start, startNode) || !GetNode(target, targetNode))
+		return false;
+	if (startNode == targetNode)
+		return true;
+
+	const vector3f startPos = m_positions[startNode];
+	const vector3f targetPos = m_positions[targetNode];
+	const float dist = (targetPos - startPos).Length();
+	const float maxDist = dist * 1.1f;
+
+	// Candidates are the systems within 110% of dist of both ends and near the
+	// line between them. Whole sectors that can't hold any of them are skipped
+	// without being generated.
+	// candidates[0] is always start
+	std::vector<Uint32> candidates;
+	std::vector<vector3f> positions;
+	candidates.push_back(startNode);
+	positions.push_back(startPos);
+
+	const float halfDiagonal = Sector::SIZE * 0.5f * sqrtf(3.f);
+	const Sint32 minX = std::min(start.sectorX, target.sectorX) - 2, maxX = std::max(start.sectorX, target.sectorX) + 2;
+	const Sint32 minY = std::min(start.sectorY, target.sectorY) - 2, maxY = std::max(start.sectorY, target.sectorY) + 2;
+	const Sint32 minZ = std::min(start.sectorZ, target.sectorZ) - 2, maxZ = std::max(start.sectorZ, target.sectorZ) + 2;
+	for (Sint32 sx = minX; sx <= maxX; sx++) {
+		for (Sint32 sy = minY; sy <= maxY; sy++) {
+			for (Sint32 sz = minZ; sz <= maxZ; sz++) {
+				const vector3f centre = Sector::SIZE * vector3f(sx + 0.5f, sy + 0.5f, sz + 0.5f);
+				if ((centre - startPos).Length() > maxDist + halfDiagonal ||
+					(centre - targetPos).Length() > maxDist + halfDiagonal ||
+					MathUtil::DistanceFromLine(startPos, targetPos, centre) > CORRIDOR_RADIUS + halfDiagonal)
+					continue;
+
+				const SectorNodes nodes = GetSectorNodes(sx, sy, sz);
+				for (Uint32 i = nodes.first; i < nodes.first + nodes.count; i++) {
+					if (i == startNode)
+						continue;
+					const vector3f &pos = m_positions[i];
+					if (i != targetNode &&
+						((pos - startPos).Length() > maxDist ||
+							(pos - targetPos).Length() > maxDist ||
+							MathUtil::DistanceFromLine(startPos, targetPos, pos) >= CORRIDOR_RADIUS))
+						continue;
+					candidates.push_back(i);
+					positions.push_back(pos);
+				}
+			}
+		}
+	}
+
+	Uint32 goal = 0;
+	for (Uint32 i = 1; i < candidates.size(); i++) {
+		if (candidates[i] == targetNode) {
+			goal = i;
+			break;
+		}
+	}
+	if (goal == 0)
+		return false;
+
+	JumpGrid grid;
+	grid.cellSize = cost.maxRange;
+	grid.Build(positions);
+
+	// A* over the candidates; jumps are found through the grid as nodes are expanded
+	const float maxRangeSqr = cost.maxRange * cost.maxRange;
+	std::vector<float> pathCost(candidates.size(), INFINITY);
+	std::vector<Uint32> pathPrev(candidates.size(), 0);
+	std::vector<bool> closed(candidates.size(), false);
+	std::priority_queue<OpenNode, std::vector<OpenNode>, std::greater<OpenNode>> open;
+
+	pathCost[0] = 0.f;
+	open.push(OpenNode{ cost.LowerBound(dist), 0 });
+	while (!open.empty()) {
+		const Uint32 current = open.top().node;
+		open.pop();
+		if (closed[current])
+			continue; // stale entry, a cheaper one was already expanded
+		closed[current] = true;
+		if (current == goal)
+			break;
+
+		const vector3f &pos = positions[current];
+		const Sint32 cx = JumpGrid::Cell(pos.x, grid.cellSize);
+		const Sint32 cy = JumpGrid::Cell(pos.y, grid.cellSize);
+		const Sint32 cz = JumpGrid::Cell(pos.z, grid.cellSize);
+		for (Sint32 dx = -1; dx <= 1; dx++) {
+			for (Sint32 dy = -1; dy <= 1; dy++) {
+				for (Sint32 dz = -1; dz <= 1; dz++) {
+					auto cell = grid.cells.find(JumpGrid::Key(cx + dx, cy + dy, cz + dz));
+					if (cell == grid.cells.end())
+						continue;
+					for (Uint32 m = cell->second.first; m < cell->second.second; m++) {
+						const Uint32 next = grid.members[m];
+						if (closed[next])
+							continue;
+						const float jumpSqr = (positions[next] - pos).LengthSqr();
+						if (jumpSqr > maxRangeSqr)
+							continue;
+						const float nextCost = pathCost[current] + cost.JumpCost(sqrtf(jumpSqr));
+						if (nextCost < pathCost[next]) {
+							pathCost[next] = nextCost;
+							pathPrev[next] = current;
+							open.push(OpenNode{ nextCost + cost.LowerBound((targetPos - positions[next]).Length()), next });
+						}
+					}
+				}
+			}
+		}
+	}
+
+	if (!closed[goal])
+		return false;
+
+	// Build the route, in reverse starting with the target
+	for (Uint32 u = goal; u != 0; u = pathPrev[u])
+		outRoute.push_back(m_paths[candidates[u]]);
+	std::reverse(outRoute.begin(), outRoute.end());
+	return true;
+}
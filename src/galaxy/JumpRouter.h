@@ -0,0 +1,65 @@
+// Copyright © 2008-2019 Pioneer Developers. See AUTHORS.txt for details
+// Licensed under the terms of the GPL v3. See licenses/GPL-3.txt
+
+#ifndef JUMPROUTER_H
+#define JUMPROUTER_H
+
+#include "galaxy/SystemPath.h"
+#include "vector3.h"
+#include <unordered_map>
+#include <vector>
+
+class Galaxy;
+
+// Plans chains of hyperspace jumps. The positions of every system the router
+// has looked at are kept in flat arrays, indexed by sector, so planning many
+// routes through the same part of the galaxy only touches each sector once.
+//
+// Not thread safe; use it from the main thread.
+class JumpRouter {
+public:
+	// Cost of a single jump: perJump + perLy * d + perLySquared * d^2,
+	// for jumps no longer than maxRange. Built once per query so nothing has to
+	// call back into Lua while searching.
+	struct CostModel {
+		float maxRange;
+		float perJump;
+		float perLy;
+		float perLySquared;
+
+		// hyperdrive durations grow with the square of the distance
+		static CostModel Duration(float maxRange, float durationAtMaxRange);
+		static CostModel Distance(float maxRange);
+		static CostModel Jumps(float maxRange);
+
+		float JumpCost(float dist) const { return perJump + perLy * dist + perLySquared * dist * dist; }
+		// never more than the cheapest way to cover dist with jumps of at most maxRange
+		float LowerBound(float dist) const;
+	};
+
+	JumpRouter(Galaxy *galaxy);
+
+	// Finds the cheapest chain of jumps from start to target through the
+	// systems near the straight line between them. On success outRoute holds
+	// each system jumped to, ending with target.
+	bool FindRoute(const SystemPath &start, const SystemPath &target, const CostModel &cost, std::vector<SystemPath> &outRoute);
+
+	void Clear();
+
+private:
+	struct SectorNodes {
+		Uint32 first;
+		Uint32 count;
+	};
+	typedef std::unordered_map<SystemPath, SectorNodes, SystemPath::HashSectorOnly> SectorMap;
+
+	const SectorNodes &GetSectorNodes(Sint32 sx, Sint32 sy, Sint32 sz);
+	bool GetNode(const SystemPath &path, Uint32 &node);
+
+	Galaxy *m_galaxy;
+	SectorMap m_sectors;
+	std::vector<SystemPath> m_paths;
+	std::vector<vector3f> m_positions; // absolute, in light years
+};
+
+#endif
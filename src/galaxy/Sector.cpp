@@ -24,7 +24,7 @@ Sector::Sector(RefCountedPtr<Galaxy> galaxy, const SystemPath &path, SectorCache
 Sector::~Sector()
 {
 	if (m_cache)
-		m_cache->RemoveFromAttic(SystemPath(sx, sy, sz));
+		m_cache->RemoveFromAttic(SystemPath(sx, sy, sz), this);
 }
 
 float Sector::DistanceBetween(RefCountedPtr<const Sector> a, int sysIdxA, RefCountedPtr<const Sector> b, int sysIdxB)
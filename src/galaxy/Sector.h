@@ -96,6 +96,7 @@ public:
 		friend class SectorCustomSystemsGenerator;
 		friend class SectorRandomSystemsGenerator;
 		friend class SectorPersistenceGenerator;
+		friend class SectorDiskCache;
 
 		void AssignFaction() const;
 
@@ -0,0 +1,242 @@
+// Copyright © 2008-2019 Pioneer Developers. See AUTHORS.txt for details
+// Licensed under the terms of the GPL v3. See licenses/GPL-3.txt
+
+#include "SectorDiskCache.h"
+
+#include "CustomSystem.h"
+#include "FileSystem.h"
+#include "Galaxy.h"
+#include "Sector.h"
+#include "StringF.h"
+#include "scenegraph/Serializer.h"
+#include "utils.h"
+
+// Format versions:
+// 1:	initial version
+static const Uint32 SECTOR_CACHE_VERSION = 1;
+union SECTOR_CACHE_STRING_VALUE {
+	char name[4];
+	Uint32 value;
+};
+static const SECTOR_CACHE_STRING_VALUE SECTOR_CACHE_STRING_ID = { { 's', 'e', 'c', SECTOR_CACHE_VERSION } };
+static const std::string SECTOR_CACHE_DIR = "galaxycache";
+static const std::string SECTOR_CACHE_EXTENSION = ".sectors";
+
+// stop adding sectors once the file gets this big
+static const size_t SECTOR_CACHE_MAX_SIZE = 64 * 1024 * 1024;
+
+SectorDiskCache::SectorDiskCache() :
+	m_generatorVersion(0),
+	m_dataChecksum(0),
+	m_open(false),
+	m_dirty(false)
+{
+}
+
+void SectorDiskCache::WriteHeader(std::string &data) const
+{
+	Serializer::Writer wr;
+	wr.Int32(SECTOR_CACHE_STRING_ID.value);
+	wr.Int32(SECTOR_CACHE_VERSION);
+	wr.String(m_generatorName);
+	wr.Int32(m_generatorVersion);
+	wr.Int32(m_dataChecksum);
+	data = wr.GetData();
+}
+
+void SectorDiskCache::Open(const std::string &generatorName, int generatorVersion, Uint32 dataChecksum)
+{
+	PROFILE_SCOPED()
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	m_generatorName = generatorName;
+	m_generatorVersion = generatorVersion;
+	m_dataChecksum = dataChecksum;
+	m_filename = FileSystem::JoinPathBelow(SECTOR_CACHE_DIR, stringf("%0-%1%2", generatorName, generatorVersion, SECTOR_CACHE_EXTENSION));
+	m_index.clear();
+	m_dirty = false;
+
+	// the header holds everything the cached data depends on, so any
+	// difference in it makes the file useless
+	WriteHeader(m_data);
+	const size_t headerSize = m_data.size();
+
+	RefCountedPtr<FileSystem::FileData> file = FileSystem::userFiles.ReadFile(m_filename);
+	if (file && file->GetSize() >= headerSize && memcmp(file->GetData(), m_data.data(), headerSize) == 0) {
+		m_data.assign(file->GetData(), file->GetSize());
+		if (!ReadRecords(headerSize)) {
+			Output("SectorDiskCache: %s is truncated, dropping the damaged part\n", m_filename.c_str());
+			m_dirty = true;
+		}
+		Output("SectorDiskCache: loaded " SIZET_FMT " sectors from %s\n", m_index.size(), m_filename.c_str());
+	} else if (file) {
+		Output("SectorDiskCache: %s is out of date and will be replaced\n", m_filename.c_str());
+	}
+
+	m_open = true;
+}
+
+bool SectorDiskCache::ReadRecords(size_t start)
+{
+	size_t offset = start;
+	try {
+		while (offset < m_data.size()) {
+			if (m_data.size() - offset < sizeof(Uint32))
+				throw std::out_of_range("SectorDiskCache: truncated record length");
+			Serializer::Reader rd(ByteRange(m_data.data() + offset, m_data.data() + m_data.size()));
+			Serializer::Reader record(rd.Blob());
+			const Sint32 sx = record.Int32();
+			const Sint32 sy = record.Int32();
+			const Sint32 sz = record.Int32();
+			m_index[SystemPath(sx, sy, sz)] = offset;
+			offset += rd.Pos();
+		}
+	} catch (std::out_of_range &) {
+		m_data.resize(offset);
+		return false;
+	}
+	return true;
+}
+
+void SectorDiskCache::Save()
+{
+	PROFILE_SCOPED()
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	if (!m_open || !m_dirty)
+		return;
+
+	FILE *f = nullptr;
+	if (FileSystem::userFiles.MakeDirectory(SECTOR_CACHE_DIR))
+		f = FileSystem::userFiles.OpenWriteStream(m_filename);
+	if (!f) {
+		Output("SectorDiskCache: couldn't write %s\n", m_filename.c_str());
+		return;
+	}
+
+	const size_t nwritten = fwrite(m_data.data(), 1, m_data.size(), f);
+	fclose(f);
+	if (nwritten != m_data.size()) {
+		// left dirty, so the next Save tries again
+		Output("SectorDiskCache: writing %s failed\n", m_filename.c_str());
+		return;
+	}
+	m_dirty = false;
+}
+
+bool SectorDiskCache::Load(Galaxy *galaxy, Sector *sector, bool &complete)
+{
+	PROFILE_SCOPED()
+	assert(sector->m_systems.empty());
+
+	// copy the record out, Store() may move m_data around once we let go of the lock
+	std::string data;
+	size_t offset;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		if (!m_open)
+			return false;
+		IndexMap::const_iterator it = m_index.find(sector->GetPath());
+		if (it == m_index.end())
+			return false;
+		offset = it->second;
+		Serializer::Reader rd(ByteRange(m_data.data() + offset, m_data.size() - offset));
+		const ByteRange record = rd.Blob();
+		data.assign(record.begin, record.Size());
+	}
+
+	bool ok;
+	try {
+		ok = ReadSector(data, galaxy, sector, complete);
+	} catch (std::out_of_range &) {
+		ok = false;
+	}
+	if (ok)
+		return true;
+
+	// forget the record so the sector is stored again once it has been
+	// generated. it stays in the file, but the newer one replaces it when
+	// the file is next read
+	std::lock_guard<std::mutex> lock(m_lock);
+	IndexMap::iterator it = m_index.find(sector->GetPath());
+	if (it != m_index.end() && it->second == offset)
+		m_index.erase(it);
+	return false;
+}
+
+bool SectorDiskCache::ReadSector(const std::string &data, Galaxy *galaxy, Sector *sector, bool &complete)
+{
+	Serializer::Reader rd(ByteRange(data.data(), data.size()));
+	rd.Int32(); // sector coordinates, already known
+	rd.Int32();
+	rd.Int32();
+	complete = rd.Bool();
+
+	const CustomSystemsDatabase::SystemList &customSystems = galaxy->GetCustomSystems()->GetCustomSystemsForSector(sector->sx, sector->sy, sector->sz);
+	const Uint32 numSystems = rd.Int32();
+	std::vector<Sector::System> systems;
+	systems.reserve(std::min<size_t>(numSystems, data.size()));
+	for (Uint32 i = 0; i < numSystems; i++) {
+		Sector::System s(sector, sector->sx, sector->sy, sector->sz, i);
+		s.m_name = rd.String();
+		const Uint32 numOtherNames = rd.Int32();
+		if (numOtherNames > data.size())
+			return false;
+		s.m_other_names.resize(numOtherNames);
+		for (std::string &name : s.m_other_names)
+			name = rd.String();
+		s.m_pos = rd.Vector3f();
+		s.m_numStars = rd.Int32();
+		if (s.m_numStars > COUNTOF(s.m_starType))
+			return false;
+		for (unsigned star = 0; star < s.m_numStars; star++)
+			s.m_starType[star] = SystemBody::BodyType(rd.Int32());
+		s.m_seed = rd.Int32();
+		if (rd.Bool()) {
+			if (i >= customSystems.size())
+				return false; // custom systems changed under us
+			s.m_customSys = customSystems[i];
+		}
+		s.m_explored = StarSystem::ExplorationState(rd.Int32());
+		systems.push_back(s);
+	}
+
+	sector->m_systems = std::move(systems);
+	return true;
+}
+
+void SectorDiskCache::Store(const Sector *sector, bool complete)
+{
+	PROFILE_SCOPED()
+	Serializer::Writer wr;
+	wr.Int32(sector->sx);
+	wr.Int32(sector->sy);
+	wr.Int32(sector->sz);
+	wr.Bool(complete);
+	wr.Int32(sector->m_systems.size());
+	for (const Sector::System &s : sector->m_systems) {
+		wr.String(s.m_name);
+		wr.Int32(s.m_other_names.size());
+		for (const std::string &name : s.m_other_names)
+			wr.String(name);
+		wr.Vector3f(s.m_pos);
+		wr.Int32(s.m_numStars);
+		for (unsigned star = 0; star < s.m_numStars; star++)
+			wr.Int32(s.m_starType[star]);
+		wr.Int32(s.m_seed);
+		wr.Bool(s.m_customSys != nullptr);
+		wr.Int32(s.m_explored);
+	}
+
+	Serializer::Writer record;
+	record.Blob(ByteRange(wr.GetData().data(), wr.GetData().size()));
+
+	std::lock_guard<std::mutex> lock(m_lock);
+	if (!m_open || m_data.size() + record.GetData().size() > SECTOR_CACHE_MAX_SIZE)
+		return;
+	auto inserted = m_index.insert(std::make_pair(sector->GetPath(), m_data.size()));
+	if (!inserted.second)
+		return; // another thread got there first
+	m_data += record.GetData();
+	m_dirty = true;
+}
@@ -0,0 +1,58 @@
+// Copyright © 2008-2019 Pioneer Developers. See AUTHORS.txt for details
+// Licensed under the terms of the GPL v3. See licenses/GPL-3.txt
+
+#ifndef SECTORDISKCACHE_H
+#define SECTORDISKCACHE_H
+
+#include "galaxy/SystemPath.h"
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class Galaxy;
+class Sector;
+
+// Keeps the output of the deterministic sector generator stages in a file in
+// the user directory, so sectors seen in earlier sessions don't have to be
+// generated again. The file is tied to a generator name and version and to a
+// checksum of the faction and custom system definitions; if any of them
+// differ it is thrown away.
+//
+// The whole file is read into memory on Open() and written back by Save()
+// when new sectors have been added. Load() and Store() may be called from any
+// thread.
+class SectorDiskCache {
+public:
+	SectorDiskCache();
+
+	void Open(const std::string &generatorName, int generatorVersion, Uint32 dataChecksum);
+	void Save();
+	bool IsOpen() const { return m_open; }
+
+	// Fill an empty sector with the cached systems. complete is set to false if
+	// the generator stopped early when the sector was first made. A record
+	// that can't be used is dropped, and the next Store() replaces it.
+	bool Load(Galaxy *galaxy, Sector *sector, bool &complete);
+	void Store(const Sector *sector, bool complete);
+
+private:
+	typedef std::unordered_map<SystemPath, size_t, SystemPath::HashSectorOnly> IndexMap;
+
+	void WriteHeader(std::string &data) const;
+	bool ReadRecords(size_t start);
+	// throws std::out_of_range if the record is cut short
+	static bool ReadSector(const std::string &data, Galaxy *galaxy, Sector *sector, bool &complete);
+
+	std::string m_filename;
+	std::string m_generatorName;
+	int m_generatorVersion;
+	Uint32 m_dataChecksum;
+	bool m_open;
+	bool m_dirty;
+
+	std::mutex m_lock;
+	std::string m_data; // header followed by one length prefixed record per sector
+	IndexMap m_index; // offsets of the records in m_data
+};
+
+#endif
@@ -353,7 +353,7 @@ StarSystem::~StarSystem()
 	// reference to things that are about to be deleted
 	m_rootBody->ClearParentAndChildPointers();
 	if (m_cache)
-		m_cache->RemoveFromAttic(m_path);
+		m_cache->RemoveFromAttic(m_path, this);
 }
 
 void StarSystem::ToJson(Json &jsonObj, StarSystem *s)
@@ -0,0 +1,112 @@
+// Copyright © 2008-2019 Pioneer Developers. See AUTHORS.txt for details
+// Licensed under the terms of the GPL v3. See licenses/GPL-3.txt
+
+#include "SystemNameIndex.h"
+
+#include "Sector.h"
+#include <algorithm>
+#include <cctype>
+
+std::string SystemNameIndex::Fold(const std::string &name)
+{
+	std::string folded(name);
+	for (char &c : folded)
+		c = char(tolower(static_cast<unsigned char>(c)));
+	return folded;
+}
+
+void SystemNameIndex::AddName(const SystemPath &path, const std::string &name)
+{
+	const Uint32 entry = Uint32(m_entries.size());
+	m_entries.push_back(Entry{ path, Fold(name) });
+
+	const std::string &folded = m_entries.back().name;
+	for (size_t i = 0; i + 3 <= folded.size(); i++) {
+		std::vector<Uint32> &postings = m_trigrams[Trigram(&folded[i])];
+		if (postings.empty() || postings.back() != entry)
+			postings.push_back(entry);
+	}
+}
+
+void SystemNameIndex::AddSector(const Sector *sector)
+{
+	PROFILE_SCOPED()
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	if (!m_sectors.insert(sector->GetPath()).second)
+		return; // a copy made by another thread got here first
+
+	for (const Sector::System &sys : sector->m_systems) {
+		const SystemPath path = sys.GetPath();
+		AddName(path, sys.GetName());
+		for (const std::string &name : sys.GetOtherNames())
+			AddName(path, name);
+	}
+}
+
+void SystemNameIndex::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_sectors.clear();
+	m_entries.clear();
+	m_trigrams.clear();
+}
+
+void SystemNameIndex::RetainSectors(const std::vector<SystemPath> &sectors)
+{
+	PROFILE_SCOPED()
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	std::unordered_set<SystemPath, SystemPath::HashSectorOnly> retained;
+	for (const SystemPath &path : sectors) {
+		if (m_sectors.count(path.SectorOnly()))
+			retained.insert(path.SectorOnly());
+	}
+	m_sectors.swap(retained);
+
+	std::vector<Entry> entries;
+	entries.swap(m_entries);
+	m_trigrams.clear();
+	for (const Entry &e : entries) {
+		if (m_sectors.count(e.path.SectorOnly()))
+			AddName(e.path, e.name);
+	}
+}
+
+std::vector<SystemPath> SystemNameIndex::Search(const std::string &pattern) const
+{
+	PROFILE_SCOPED()
+	std::vector<SystemPath> result;
+	const std::string folded = Fold(pattern);
+	if (folded.empty())
+		return result;
+
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	if (folded.size() < 3) {
+		// too short for the trigrams to help
+		for (const Entry &e : m_entries)
+			if (e.name.find(folded) != std::string::npos)
+				result.push_back(e.path);
+	} else {
+		// every match contains all of the pattern's trigrams, so checking the
+		// names holding the rarest one is enough
+		const std::vector<Uint32> *rarest = nullptr;
+		for (size_t i = 0; i + 3 <= folded.size(); i++) {
+			auto it = m_trigrams.find(Trigram(&folded[i]));
+			if (it == m_trigrams.end())
+				return result;
+			if (!rarest || it->second.size() < rarest->size())
+				rarest = &it->second;
+		}
+		for (Uint32 entry : *rarest) {
+			const Entry &e = m_entries[entry];
+			if (e.name.find(folded) != std::string::npos)
+				result.push_back(e.path);
+		}
+	}
+
+	std::sort(result.begin(), result.end());
+	result.erase(std::unique(result.begin(), result.end()), result.end());
+	return result;
+}
@@ -0,0 +1,53 @@
+// Copyright © 2008-2019 Pioneer Developers. See AUTHORS.txt for details
+// Licensed under the terms of the GPL v3. See licenses/GPL-3.txt
+
+#ifndef SYSTEMNAMEINDEX_H
+#define SYSTEMNAMEINDEX_H
+
+#include "galaxy/SystemPath.h"
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class Sector;
+
+// Case insensitive index of the names of every system in the sectors
+// generated since the galaxy caches were last flushed, including their other
+// names. Sectors are added by the generator as they are made, from any
+// thread.
+//
+// Names are broken into trigrams; a search looks up the rarest trigram of the
+// pattern and only checks the names that contain it.
+class SystemNameIndex {
+public:
+	void AddSector(const Sector *sector);
+	void Clear();
+	// Drops every sector but these. For flushing the caches: sectors that
+	// are still alive afterwards aren't generated again, so they wouldn't
+	// add themselves back.
+	void RetainSectors(const std::vector<SystemPath> &sectors);
+
+	// Systems with a name containing pattern, ignoring case, each listed once
+	// and in path order. An empty pattern matches nothing.
+	std::vector<SystemPath> Search(const std::string &pattern) const;
+
+private:
+	struct Entry {
+		SystemPath path;
+		std::string name; // folded to lower case
+	};
+
+	static std::string Fold(const std::string &name);
+	static Uint32 Trigram(const char *s) { return (Uint32(Uint8(s[0])) << 16) | (Uint32(Uint8(s[1])) << 8) | Uint32(Uint8(s[2])); }
+
+	void AddName(const SystemPath &path, const std::string &name);
+
+	mutable std::mutex m_lock;
+	std::unordered_set<SystemPath, SystemPath::HashSectorOnly> m_sectors;
+	std::vector<Entry> m_entries;
+	std::unordered_map<Uint32, std::vector<Uint32>> m_trigrams; // entry indices, ascending
+};
+
+#endif
@@ -124,6 +124,31 @@ public:
 		}
 	};
 
+	// hashes to go with the comparisons above, for unordered containers
+	class HashSectorOnly {
+	public:
+		size_t operator()(const SystemPath &a) const
+		{
+			Uint32 h = Uint32(a.sectorX) * 73856093u ^ Uint32(a.sectorY) * 19349663u ^ Uint32(a.sectorZ) * 83492791u;
+			h ^= h >> 16;
+			h *= 0x85ebca6bu;
+			h ^= h >> 13;
+			return size_t(h);
+		}
+	};
+
+	class HashSystemOnly {
+	public:
+		size_t operator()(const SystemPath &a) const
+		{
+			Uint32 h = Uint32(HashSectorOnly()(a)) ^ (a.systemIndex * 2654435761u);
+			h ^= h >> 16;
+			h *= 0xc2b2ae35u;
+			h ^= h >> 16;
+			return size_t(h);
+		}
+	};
+
 	bool IsSectorPath() const
 	{
 		return (systemIndex == Uint32(-1) && bodyIndex == Uint32(-1));
@@ -3,6 +3,7 @@
 
 #include "Renderer.h"
 #include "Texture.h"
+#include "VertexBuffer.h"
 
 namespace Graphics {
 
@@ -48,6 +49,12 @@ namespace Graphics {
 		m_textures.clear();
 	}
 
+	void Renderer::NextFrameStats()
+	{
+		m_stats.AddToStatCount(Stats::STAT_DESTROY_BUFFER, Mappable::TakeNumDestroyed());
+		m_stats.NextFrame();
+	}
+
 	void Renderer::SetGrab(const bool grabbed)
 	{
 		SDL_SetWindowGrab(m_window, SDL_bool(grabbed));
@@ -210,6 +210,10 @@ namespace Graphics {
 		virtual void PushState() = 0;
 		virtual void PopState() = 0;
 
+		// for SwapBuffers: counts the buffers destroyed during the frame
+		// and moves the stats on to the next
+		void NextFrameStats();
+
 	private:
 		typedef std::pair<std::string, std::string> TextureCacheKey;
 		typedef std::map<TextureCacheKey, RefCountedPtr<Texture> *> TextureCacheMap;
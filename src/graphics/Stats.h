@@ -22,6 +22,7 @@ namespace Graphics {
 			// buffers
 			STAT_CREATE_BUFFER,
 			STAT_DESTROY_BUFFER,
+			STAT_REUSE_BUFFER,
 
 			// objects
 			STAT_BUILDINGS,
@@ -5,6 +5,8 @@
 
 namespace Graphics {
 
+	std::atomic<Uint32> Mappable::s_numDestroyed(0);
+
 	Uint32 VertexBufferDesc::GetAttribSize(VertexAttribFormat f)
 	{
 		switch (f) {
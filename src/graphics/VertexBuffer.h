@@ -20,6 +20,7 @@
  */
 #include "Types.h"
 #include "libs.h"
+#include <atomic>
 
 namespace Graphics {
 
@@ -58,12 +59,17 @@ namespace Graphics {
 
 	class Mappable : public RefCounted {
 	public:
-		virtual ~Mappable() {}
+		virtual ~Mappable() { s_numDestroyed++; }
 		virtual void Unmap() = 0;
 
 		inline Uint32 GetSize() const { return m_size; }
 		inline Uint32 GetCapacity() const { return m_capacity; }
 
+		// buffers destroyed since the last call, for the renderer's
+		// STAT_DESTROY_BUFFER. some buffers are only destroyed after the
+		// renderer, so they can't count themselves into its Stats
+		static Uint32 TakeNumDestroyed() { return s_numDestroyed.exchange(0); }
+
 	protected:
 		explicit Mappable(const Uint32 size) :
 			m_mapMode(BUFFER_MAP_NONE),
@@ -75,6 +81,10 @@ namespace Graphics {
 		Uint32 m_size;
 		// capacity is the maximum number of elements that can be put in the buffer
 		Uint32 m_capacity;
+
+	private:
+		// a buffer may be destroyed on any thread
+		static std::atomic<Uint32> s_numDestroyed;
 	};
 
 	class VertexBuffer : public Mappable {
@@ -105,6 +115,11 @@ namespace Graphics {
 		virtual void Bind() = 0;
 		virtual void Release() = 0;
 
+		// throws away the contents of a buffer that is about to be filled
+		// with new data, so writing it doesn't have to wait for draws that
+		// are still using the old
+		virtual void Orphan() = 0;
+
 	protected:
 		virtual Uint8 *MapInternal(BufferMapMode) = 0;
 		VertexBufferDesc m_desc;
@@ -32,7 +32,11 @@ namespace Graphics {
 
 		virtual bool BeginFrame() override final { return true; }
 		virtual bool EndFrame() override final { return true; }
-		virtual bool SwapBuffers() override final { return true; }
+		virtual bool SwapBuffers() override final
+		{
+			NextFrameStats();
+			return true;
+		}
 
 		virtual bool SetRenderState(RenderState *) override final { return true; }
 		virtual bool SetRenderTarget(RenderTarget *) override final { return true; }
@@ -71,9 +75,21 @@ namespace Graphics {
 		virtual Texture *CreateTexture(const TextureDescriptor &d) override final { return new Graphics::TextureDummy(d); }
 		virtual RenderState *CreateRenderState(const RenderStateDesc &d) override final { return new Graphics::Dummy::RenderState(d); }
 		virtual RenderTarget *CreateRenderTarget(const RenderTargetDesc &d) override final { return new Graphics::Dummy::RenderTarget(d); }
-		virtual VertexBuffer *CreateVertexBuffer(const VertexBufferDesc &d) override final { return new Graphics::Dummy::VertexBuffer(d); }
-		virtual IndexBuffer *CreateIndexBuffer(Uint32 size, BufferUsage bu) override final { return new Graphics::Dummy::IndexBuffer(size, bu); }
-		virtual InstanceBuffer *CreateInstanceBuffer(Uint32 size, BufferUsage bu) override final { return new Graphics::Dummy::InstanceBuffer(size, bu); }
+		virtual VertexBuffer *CreateVertexBuffer(const VertexBufferDesc &d) override final
+		{
+			m_stats.AddToStatCount(Stats::STAT_CREATE_BUFFER, 1);
+			return new Graphics::Dummy::VertexBuffer(d);
+		}
+		virtual IndexBuffer *CreateIndexBuffer(Uint32 size, BufferUsage bu) override final
+		{
+			m_stats.AddToStatCount(Stats::STAT_CREATE_BUFFER, 1);
+			return new Graphics::Dummy::IndexBuffer(size, bu);
+		}
+		virtual InstanceBuffer *CreateInstanceBuffer(Uint32 size, BufferUsage bu) override final
+		{
+			m_stats.AddToStatCount(Stats::STAT_CREATE_BUFFER, 1);
+			return new Graphics::Dummy::InstanceBuffer(size, bu);
+		}
 
 		virtual bool ReloadShaders() override final { return true; }
 
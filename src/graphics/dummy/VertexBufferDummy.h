@@ -28,6 +28,8 @@ namespace Graphics {
 
 			virtual void Unmap() override final {}
 
+			virtual void Orphan() override final {}
+
 		protected:
 			virtual Uint8 *MapInternal(BufferMapMode) override final { return m_buffer.get(); }
 
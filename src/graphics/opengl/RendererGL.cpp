@@ -481,7 +481,7 @@ namespace Graphics {
 		CheckRenderErrors(__FUNCTION__, __LINE__);
 
 		SDL_GL_SwapWindow(m_window);
-		m_stats.NextFrame();
+		NextFrameStats();
 		return true;
 	}
 
@@ -381,6 +381,16 @@ namespace Graphics {
 			glBindVertexArray(0);
 		}
 
+		void VertexBuffer::Orphan()
+		{
+			// dynamic buffers get new storage on every Unmap anyway
+			if (GetDesc().usage != BUFFER_USAGE_STATIC || !m_written)
+				return;
+			glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+			glBufferData(GL_ARRAY_BUFFER, m_desc.numVertices * m_desc.stride, 0, GL_STATIC_DRAW);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+
 		// ------------------------------------------------------------
 		IndexBuffer::IndexBuffer(Uint32 size, BufferUsage hint) :
 			Graphics::IndexBuffer(size, hint)
@@ -36,6 +36,8 @@ namespace Graphics {
 			virtual void Bind() override final;
 			virtual void Release() override final;
 
+			virtual void Orphan() override final;
+
 		protected:
 			virtual Uint8 *MapInternal(BufferMapMode) override final;
 
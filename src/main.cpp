@@ -80,11 +80,28 @@ start:
 	int pos = 2;
 	long int radius = 4;
 	long int sx = 0, sy = 0, sz = 0;
+	long int dumpThreads = 0;
 	std::string filename;
 	SystemPath startPath(0, 0, 0, 0, 0);
 
 	switch (mode) {
 	case MODE_GALAXYDUMP: {
+		// --threads=N (optional, anywhere after the mode): 1 dumps on the main thread,
+		// more uses that many workers, 0 uses the default number of workers
+		for (int i = 2; i < argc; ++i) {
+			if (starts_with(argv[i], "--threads=")) {
+				char *end = nullptr;
+				dumpThreads = std::strtol(argv[i] + 10, &end, 0);
+				if (end == nullptr || *end != 0 || dumpThreads < 0 || dumpThreads > long(MAX_THREADS)) {
+					Output("pioneer: invalid thread count: %s\n", argv[i] + 10);
+					return 1;
+				}
+				for (int j = i; j < argc - 1; ++j)
+					argv[j] = argv[j + 1];
+				--argc;
+				break;
+			}
+		}
 		if (argc < 3) {
 			Output("pioneer: galaxy dump requires a filename\n");
 			break;
@@ -174,6 +191,9 @@ start:
 			}
 		}
 
+		if (mode == MODE_GALAXYDUMP && dumpThreads > 1)
+			options["WorkerThreads"] = std::to_string(dumpThreads);
+
 		Pi::Init(options, mode == MODE_GALAXYDUMP);
 
 		if (mode == MODE_GAME)
@@ -188,7 +208,11 @@ start:
 				break;
 			}
 			RefCountedPtr<Galaxy> galaxy = GalaxyGenerator::Create();
-			galaxy->Dump(file, sx, sy, sz, radius);
+			const Uint32 startTicks = SDL_GetTicks();
+			galaxy->Dump(file, sx, sy, sz, radius, dumpThreads == 1 ? nullptr : Pi::GetAsyncJobQueue());
+			const long int side = 2 * radius + 1;
+			Output("pioneer: dumped %ld sectors in %.3f s (%s)\n", side * side * side, (SDL_GetTicks() - startTicks) / 1000.0,
+				dumpThreads == 1 ? "serial" : "parallel");
 			if (filename != "-" && fclose(file) != 0) {
 				Output("pioneer: writing to \"%s\" failed: %s\n", filename.c_str(), strerror(errno));
 			}
@@ -56,6 +56,7 @@ public:
 	virtual void OnRun() override final { RunCompiler(m_name, m_path, m_inPlace); } // RUNS IN ANOTHER THREAD!! MUST BE THREAD SAFE!
 	virtual void OnFinish() override final {}
 	virtual void OnCancel() override final {}
+	virtual const char *GetName() const override final { return "CompileJob"; }
 
 protected:
 	std::string m_name;
@@ -2,6 +2,7 @@
 // Licensed under the terms of the GPL v3. See licenses/GPL-3.txt
 
 #include "perlin.h"
+#include "CpuFeatures.h"
 #include <math.h>
 
 /* Simplex.cpp
@@ -248,23 +249,282 @@ double noise(const vector3d &p)
 	return 32.0 * (n0 + n1 + n2 + n3);
 }
 
+#ifdef CPU_HAS_SSE2
+// Batch noise. The skew, corner selection and falloff are done a register of
+// points at a time, with the same operations in the same order as noise() so
+// the results are identical; only the permutation table lookups are done a
+// point at a time.
+//
+// No FMA is used, even where the CPU has it, since contracting a multiply and
+// add changes the rounding. A compiler that contracts them in the scalar
+// version anyway will give results a few ulp apart.
+
+// Corner selection for one point, as bits of the comparison masks: 1 for
+// x0 >= y0, 2 for y0 >= z0 and 4 for x0 >= z0.
+static inline void corner_offsets(int cmp, int &i1, int &j1, int &k1, int &i2, int &j2, int &k2)
+{
+	const bool xy = (cmp & 1) != 0, yz = (cmp & 2) != 0, xz = (cmp & 4) != 0;
+	i1 = xy && xz;
+	j1 = !xy && yz;
+	k1 = !(i1 || j1);
+	i2 = xy || xz;
+	j2 = !xy || yz;
+	k2 = !yz || !xz;
+}
+
+// Looks up the gradients of the four corners of lanes points and stores them
+// into grad, laid out as [corner][axis][lane].
+static inline void corner_gradients(int lanes, const int *i, const int *j, const int *k, const int *cmp, double *grad)
+{
+	for (int l = 0; l < lanes; l++) {
+		int i1, j1, k1, i2, j2, k2;
+		corner_offsets(cmp[l], i1, j1, k1, i2, j2, k2);
+		const int ii = i[l] & 255;
+		const int jj = j[l] & 255;
+		const int kk = k[l] & 255;
+		const double *g[4] = {
+			grad3[mod12[perm[ii + perm[jj + perm[kk]]]]],
+			grad3[mod12[perm[ii + i1 + perm[jj + j1 + perm[kk + k1]]]]],
+			grad3[mod12[perm[ii + i2 + perm[jj + j2 + perm[kk + k2]]]]],
+			grad3[mod12[perm[ii + 1 + perm[jj + 1 + perm[kk + 1]]]]]
+		};
+		for (int c = 0; c < 4; c++)
+			for (int a = 0; a < 3; a++)
+				grad[(c * 3 + a) * lanes + l] = g[c][a];
+	}
+}
+
+static void noise_sse2(const vector3d *p, double *out, size_t count)
+{
+	const __m128d zero = _mm_setzero_pd();
+	const __m128d one = _mm_set1_pd(1.0);
+	const __m128d f3 = _mm_set1_pd(F3);
+	const __m128d g3 = _mm_set1_pd(G3);
+	const __m128d g3mul2 = _mm_set1_pd(G3mul2);
+	const __m128d g3mul3 = _mm_set1_pd(G3mul3);
+	const __m128d falloff = _mm_set1_pd(0.6);
+
+	size_t n = 0;
+	for (; n + 2 <= count; n += 2) {
+		const __m128d px = _mm_set_pd(p[n + 1].x, p[n].x);
+		const __m128d py = _mm_set_pd(p[n + 1].y, p[n].y);
+		const __m128d pz = _mm_set_pd(p[n + 1].z, p[n].z);
+
+		// skew, and fastfloor() by truncating x or x - 1
+		const __m128d s = _mm_mul_pd(_mm_add_pd(_mm_add_pd(px, py), pz), f3);
+		__m128d sx = _mm_add_pd(px, s), sy = _mm_add_pd(py, s), sz = _mm_add_pd(pz, s);
+		sx = _mm_or_pd(_mm_and_pd(_mm_cmpgt_pd(sx, zero), sx), _mm_andnot_pd(_mm_cmpgt_pd(sx, zero), _mm_sub_pd(sx, one)));
+		sy = _mm_or_pd(_mm_and_pd(_mm_cmpgt_pd(sy, zero), sy), _mm_andnot_pd(_mm_cmpgt_pd(sy, zero), _mm_sub_pd(sy, one)));
+		sz = _mm_or_pd(_mm_and_pd(_mm_cmpgt_pd(sz, zero), sz), _mm_andnot_pd(_mm_cmpgt_pd(sz, zero), _mm_sub_pd(sz, one)));
+		const __m128i i = _mm_cvttpd_epi32(sx), j = _mm_cvttpd_epi32(sy), k = _mm_cvttpd_epi32(sz);
+
+		const __m128d t = _mm_mul_pd(_mm_cvtepi32_pd(_mm_add_epi32(_mm_add_epi32(i, j), k)), g3);
+		const __m128d x0 = _mm_sub_pd(px, _mm_sub_pd(_mm_cvtepi32_pd(i), t));
+		const __m128d y0 = _mm_sub_pd(py, _mm_sub_pd(_mm_cvtepi32_pd(j), t));
+		const __m128d z0 = _mm_sub_pd(pz, _mm_sub_pd(_mm_cvtepi32_pd(k), t));
+
+		const __m128d xy = _mm_cmpge_pd(x0, y0), yz = _mm_cmpge_pd(y0, z0), xz = _mm_cmpge_pd(x0, z0);
+		const __m128d i1 = _mm_and_pd(_mm_and_pd(xy, xz), one);
+		const __m128d j1 = _mm_and_pd(_mm_andnot_pd(xy, yz), one);
+		const __m128d k1 = _mm_sub_pd(_mm_sub_pd(one, i1), j1);
+		const __m128d i2 = _mm_and_pd(_mm_or_pd(xy, xz), one);
+		const __m128d j2 = _mm_andnot_pd(_mm_andnot_pd(yz, xy), one);
+		const __m128d k2 = _mm_andnot_pd(_mm_and_pd(yz, xz), one);
+
+		const __m128d c[4][3] = {
+			{ x0, y0, z0 },
+			{ _mm_add_pd(_mm_sub_pd(x0, i1), g3), _mm_add_pd(_mm_sub_pd(y0, j1), g3), _mm_add_pd(_mm_sub_pd(z0, k1), g3) },
+			{ _mm_add_pd(_mm_sub_pd(x0, i2), g3mul2), _mm_add_pd(_mm_sub_pd(y0, j2), g3mul2), _mm_add_pd(_mm_sub_pd(z0, k2), g3mul2) },
+			{ _mm_add_pd(_mm_sub_pd(x0, one), g3mul3), _mm_add_pd(_mm_sub_pd(y0, one), g3mul3), _mm_add_pd(_mm_sub_pd(z0, one), g3mul3) }
+		};
+
+		int ia[4], ja[4], ka[4], cmp[2];
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(ia), i);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(ja), j);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(ka), k);
+		const int mxy = _mm_movemask_pd(xy), myz = _mm_movemask_pd(yz), mxz = _mm_movemask_pd(xz);
+		for (int l = 0; l < 2; l++)
+			cmp[l] = ((mxy >> l) & 1) | (((myz >> l) & 1) << 1) | (((mxz >> l) & 1) << 2);
+		double grad[4 * 3 * 2];
+		corner_gradients(2, ia, ja, ka, cmp, grad);
+
+		__m128d sum;
+		for (int corner = 0; corner < 4; corner++) {
+			const __m128d x = c[corner][0], y = c[corner][1], z = c[corner][2];
+			__m128d tc = _mm_sub_pd(_mm_sub_pd(_mm_sub_pd(falloff, _mm_mul_pd(x, x)), _mm_mul_pd(y, y)), _mm_mul_pd(z, z));
+			const __m128d inside = _mm_cmpnlt_pd(tc, zero);
+			const double *g = &grad[corner * 3 * 2];
+			const __m128d d = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_loadu_pd(g), x), _mm_mul_pd(_mm_loadu_pd(g + 2), y)), _mm_mul_pd(_mm_loadu_pd(g + 4), z));
+			tc = _mm_mul_pd(tc, tc);
+			const __m128d nc = _mm_and_pd(inside, _mm_mul_pd(_mm_mul_pd(tc, tc), d));
+			// not starting from zero, so a -0 result keeps its sign
+			sum = corner ? _mm_add_pd(sum, nc) : nc;
+		}
+		_mm_storeu_pd(&out[n], _mm_mul_pd(_mm_set1_pd(32.0), sum));
+	}
+	for (; n < count; n++)
+		out[n] = noise(p[n]);
+}
+
+static CPU_AVX2_TARGET void noise_avx2(const vector3d *p, double *out, size_t count)
+{
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256d f3 = _mm256_set1_pd(F3);
+	const __m256d g3 = _mm256_set1_pd(G3);
+	const __m256d g3mul2 = _mm256_set1_pd(G3mul2);
+	const __m256d g3mul3 = _mm256_set1_pd(G3mul3);
+	const __m256d falloff = _mm256_set1_pd(0.6);
+
+	size_t n = 0;
+	for (; n + 4 <= count; n += 4) {
+		const __m256d px = _mm256_set_pd(p[n + 3].x, p[n + 2].x, p[n + 1].x, p[n].x);
+		const __m256d py = _mm256_set_pd(p[n + 3].y, p[n + 2].y, p[n + 1].y, p[n].y);
+		const __m256d pz = _mm256_set_pd(p[n + 3].z, p[n + 2].z, p[n + 1].z, p[n].z);
+
+		const __m256d s = _mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(px, py), pz), f3);
+		__m256d sx = _mm256_add_pd(px, s), sy = _mm256_add_pd(py, s), sz = _mm256_add_pd(pz, s);
+		sx = _mm256_blendv_pd(_mm256_sub_pd(sx, one), sx, _mm256_cmp_pd(sx, zero, _CMP_GT_OQ));
+		sy = _mm256_blendv_pd(_mm256_sub_pd(sy, one), sy, _mm256_cmp_pd(sy, zero, _CMP_GT_OQ));
+		sz = _mm256_blendv_pd(_mm256_sub_pd(sz, one), sz, _mm256_cmp_pd(sz, zero, _CMP_GT_OQ));
+		const __m128i i = _mm256_cvttpd_epi32(sx), j = _mm256_cvttpd_epi32(sy), k = _mm256_cvttpd_epi32(sz);
+
+		const __m256d t = _mm256_mul_pd(_mm256_cvtepi32_pd(_mm_add_epi32(_mm_add_epi32(i, j), k)), g3);
+		const __m256d x0 = _mm256_sub_pd(px, _mm256_sub_pd(_mm256_cvtepi32_pd(i), t));
+		const __m256d y0 = _mm256_sub_pd(py, _mm256_sub_pd(_mm256_cvtepi32_pd(j), t));
+		const __m256d z0 = _mm256_sub_pd(pz, _mm256_sub_pd(_mm256_cvtepi32_pd(k), t));
+
+		const __m256d xy = _mm256_cmp_pd(x0, y0, _CMP_GE_OQ), yz = _mm256_cmp_pd(y0, z0, _CMP_GE_OQ), xz = _mm256_cmp_pd(x0, z0, _CMP_GE_OQ);
+		const __m256d i1 = _mm256_and_pd(_mm256_and_pd(xy, xz), one);
+		const __m256d j1 = _mm256_and_pd(_mm256_andnot_pd(xy, yz), one);
+		const __m256d k1 = _mm256_sub_pd(_mm256_sub_pd(one, i1), j1);
+		const __m256d i2 = _mm256_and_pd(_mm256_or_pd(xy, xz), one);
+		const __m256d j2 = _mm256_andnot_pd(_mm256_andnot_pd(yz, xy), one);
+		const __m256d k2 = _mm256_andnot_pd(_mm256_and_pd(yz, xz), one);
+
+		const __m256d c[4][3] = {
+			{ x0, y0, z0 },
+			{ _mm256_add_pd(_mm256_sub_pd(x0, i1), g3), _mm256_add_pd(_mm256_sub_pd(y0, j1), g3), _mm256_add_pd(_mm256_sub_pd(z0, k1), g3) },
+			{ _mm256_add_pd(_mm256_sub_pd(x0, i2), g3mul2), _mm256_add_pd(_mm256_sub_pd(y0, j2), g3mul2), _mm256_add_pd(_mm256_sub_pd(z0, k2), g3mul2) },
+			{ _mm256_add_pd(_mm256_sub_pd(x0, one), g3mul3), _mm256_add_pd(_mm256_sub_pd(y0, one), g3mul3), _mm256_add_pd(_mm256_sub_pd(z0, one), g3mul3) }
+		};
+
+		int ia[4], ja[4], ka[4], cmp[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(ia), i);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(ja), j);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(ka), k);
+		const int mxy = _mm256_movemask_pd(xy), myz = _mm256_movemask_pd(yz), mxz = _mm256_movemask_pd(xz);
+		for (int l = 0; l < 4; l++)
+			cmp[l] = ((mxy >> l) & 1) | (((myz >> l) & 1) << 1) | (((mxz >> l) & 1) << 2);
+		double grad[4 * 3 * 4];
+		corner_gradients(4, ia, ja, ka, cmp, grad);
+
+		__m256d sum;
+		for (int corner = 0; corner < 4; corner++) {
+			const __m256d x = c[corner][0], y = c[corner][1], z = c[corner][2];
+			__m256d tc = _mm256_sub_pd(_mm256_sub_pd(_mm256_sub_pd(falloff, _mm256_mul_pd(x, x)), _mm256_mul_pd(y, y)), _mm256_mul_pd(z, z));
+			const __m256d inside = _mm256_cmp_pd(tc, zero, _CMP_NLT_UQ);
+			const double *g = &grad[corner * 3 * 4];
+			const __m256d d = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(g), x), _mm256_mul_pd(_mm256_loadu_pd(g + 4), y)), _mm256_mul_pd(_mm256_loadu_pd(g + 8), z));
+			tc = _mm256_mul_pd(tc, tc);
+			const __m256d nc = _mm256_and_pd(inside, _mm256_mul_pd(_mm256_mul_pd(tc, tc), d));
+			// not starting from zero, so a -0 result keeps its sign
+			sum = corner ? _mm256_add_pd(sum, nc) : nc;
+		}
+		_mm256_storeu_pd(&out[n], _mm256_mul_pd(_mm256_set1_pd(32.0), sum));
+	}
+	for (; n < count; n++)
+		out[n] = noise(p[n]);
+}
+#endif /* CPU_HAS_SSE2 */
+
+void noise(const vector3d *p, double *out, size_t count)
+{
+#ifdef CPU_HAS_SSE2
+	static const bool avx2 = CpuHasAvx2();
+	if (avx2)
+		noise_avx2(p, out, count);
+	else
+		noise_sse2(p, out, count);
+#else
+	for (size_t n = 0; n < count; n++)
+		out[n] = noise(p[n]);
+#endif
+}
+
 #ifdef UNIT_TEST
+// Checks the batch noise against noise(), and reports how many points a
+// second each fractal manages one point at a time and in batches.
+#include "terrain/FracDef.h"
+#include "terrain/TerrainNoise.h"
+#include "BenchmarkClock.h"
+#include <chrono>
 #include <stdio.h>
-#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+typedef double (*PointFractal)(const fracdef_t &, const double, const vector3d &);
+typedef void (*BatchFractal)(const fracdef_t &, const double, const vector3d *, double *, size_t);
+
 int main()
 {
-	double x, y, z;
-	double a = 0.0;
-	x = 0.0;
-	y = 0.0;
-	z = 0.0;
-	for (int i = 0; i < 10000000; i++) {
-		a += noise(x, y, z);
-		x += 0.1;
-		y += 0.2;
-		z += 0.3;
+	using namespace TerrainNoise;
+
+	// points on a sphere, as the terrains sample them
+	std::vector<vector3d> points;
+	const int steps = 512;
+	for (int i = 0; i < steps; i++) {
+		for (int j = 0; j < steps; j++) {
+			const double lat = M_PI * (i + 0.5) / steps - M_PI * 0.5;
+			const double lon = 2.0 * M_PI * j / steps;
+			points.push_back(vector3d(cos(lat) * cos(lon), sin(lat), cos(lat) * sin(lon)));
+		}
+	}
+	const size_t count = points.size();
+
+	fracdef_t def;
+	def.amplitude = 1.0;
+	def.frequency = 20.0;
+	def.lacunarity = 2.0;
+	def.octaves = 8;
+
+	struct Fractal {
+		const char *name;
+		PointFractal point;
+		BatchFractal batch;
+	};
+	const Fractal fractals[] = {
+		{ "octave", octavenoise, octavenoise },
+		{ "river", river_octavenoise, river_octavenoise },
+		{ "ridged", ridged_octavenoise, ridged_octavenoise },
+		{ "billow", billow_octavenoise, billow_octavenoise },
+		{ "voronoiscam", voronoiscam_octavenoise, voronoiscam_octavenoise },
+		{ "dunes", dunes_octavenoise, dunes_octavenoise },
+	};
+
+	std::vector<double> expected(count), actual(count);
+	int failures = 0;
+	for (const Fractal &f : fractals) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (size_t n = 0; n < count; n++)
+			expected[n] = f.point(def, 0.5, points[n]);
+		const double pointTime = seconds_since(start);
+
+		start = std::chrono::steady_clock::now();
+		f.batch(def, 0.5, points.data(), actual.data(), count);
+		const double batchTime = seconds_since(start);
+
+		size_t mismatches = 0;
+		for (size_t n = 0; n < count; n++)
+			if (memcmp(&expected[n], &actual[n], sizeof(double)) != 0)
+				mismatches++;
+		if (mismatches)
+			failures++;
+
+		printf("%-12s %8.2f Mpts/s single, %8.2f Mpts/s batch, %zu mismatches\n", f.name,
+			count / pointTime * 1e-6, count / batchTime * 1e-6, mismatches);
 	}
-	return (int)a;
+	return failures;
 }
 
 #endif /* UNIT_TEST */
@@ -8,4 +8,9 @@
 
 double noise(const vector3d &p);
 
+// Fills out[0..count) with noise(p[n]), a few points at a time with SSE2 or
+// AVX2 where the CPU has them. Gives exactly the same values as calling
+// noise() for each point.
+void noise(const vector3d *p, double *out, size_t count);
+
 #endif /* _PERLIN_H */
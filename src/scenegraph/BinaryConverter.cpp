@@ -34,7 +34,9 @@ using namespace SceneGraph;
 // 5:	normal mapping
 // 6:	32-bit indicies
 // 6.1:	rewrote serialization, use lz4 compression instead of INFLATE/DEFLATE. Still compatible.
-const Uint32 SGM_VERSION = 6;
+// 7:	store prebuilt collision BVH trees
+// 8:	store the depth of the collision BVH trees, capped at BVHTree::MAX_DEPTH
+const Uint32 SGM_VERSION = 8;
 union SGM_STRING_VALUE {
 	char name[4];
 	Uint32 value;
@@ -262,7 +264,15 @@ Model *BinaryConverter::CreateModel(const std::string &filename, Serializer::Rea
 	m_model->m_root.Reset(root);
 
 	RefCountedPtr<CollMesh> collMesh(new CollMesh());
-	collMesh->Load(rd);
+	try {
+		collMesh->Load(rd);
+	} catch (std::runtime_error &e) {
+		// an unusable collision mesh means the model has to be reconverted
+		Warning("Error whilst loading %s\n%s\nSGM file will be ignored\n", filename.c_str(), e.what());
+		delete m_model;
+		m_model = nullptr;
+		return nullptr;
+	}
 	m_model->SetCollisionMesh(collMesh);
 	m_model->SetDrawClipRadius(rd.Float());
 
@@ -9,6 +9,12 @@
 #include "perlin.h"
 #include "../utils.h"
 #include "../galaxy/SystemBody.h"
+#include "profiler/Profiler.h"
+#include <vector>
+
+#ifdef BENCHMARK_TERRAIN
+#include "GeoPatchJobs.h"
+#endif
 
 // static instancer. selects the best height and color classes for the body
 Terrain *Terrain::InstanceTerrain(const SystemBody *body)
@@ -356,9 +362,114 @@ Terrain *Terrain::InstanceTerrain(const SystemBody *body)
 		break;
 	}
 
+#ifdef BENCHMARK_TERRAIN
+	static bool benchmarked = false;
+	if (!benchmarked && body->GetType() == SystemBody::TYPE_PLANET_TERRESTRIAL) {
+		benchmarked = true;
+		BenchmarkHeightFractals(body);
+	}
+#endif
+
 	return gi(body);
 }
 
+#ifdef BENCHMARK_TERRAIN
+void Terrain::BenchmarkHeightFractals(const SystemBody *body)
+{
+	// the mapped terrains need a body with a heightmap, so they're left out
+	const struct {
+		const char *name;
+		GeneratorInstancer instancer;
+	} fractals[] = {
+		{ "Asteroid", InstanceGenerator<TerrainHeightAsteroid, TerrainColorRock> },
+		{ "Asteroid2", InstanceGenerator<TerrainHeightAsteroid2, TerrainColorRock> },
+		{ "Asteroid3", InstanceGenerator<TerrainHeightAsteroid3, TerrainColorRock> },
+		{ "Asteroid4", InstanceGenerator<TerrainHeightAsteroid4, TerrainColorRock> },
+		{ "BarrenRock", InstanceGenerator<TerrainHeightBarrenRock, TerrainColorRock> },
+		{ "BarrenRock2", InstanceGenerator<TerrainHeightBarrenRock2, TerrainColorRock> },
+		{ "BarrenRock3", InstanceGenerator<TerrainHeightBarrenRock3, TerrainColorRock> },
+		{ "Ellipsoid", InstanceGenerator<TerrainHeightEllipsoid, TerrainColorRock> },
+		{ "Flat", InstanceGenerator<TerrainHeightFlat, TerrainColorRock> },
+		{ "HillsCraters", InstanceGenerator<TerrainHeightHillsCraters, TerrainColorRock> },
+		{ "HillsCraters2", InstanceGenerator<TerrainHeightHillsCraters2, TerrainColorRock> },
+		{ "HillsDunes", InstanceGenerator<TerrainHeightHillsDunes, TerrainColorRock> },
+		{ "HillsNormal", InstanceGenerator<TerrainHeightHillsNormal, TerrainColorRock> },
+		{ "HillsRidged", InstanceGenerator<TerrainHeightHillsRidged, TerrainColorRock> },
+		{ "HillsRivers", InstanceGenerator<TerrainHeightHillsRivers, TerrainColorRock> },
+		{ "MountainsCraters", InstanceGenerator<TerrainHeightMountainsCraters, TerrainColorRock> },
+		{ "MountainsCraters2", InstanceGenerator<TerrainHeightMountainsCraters2, TerrainColorRock> },
+		{ "MountainsNormal", InstanceGenerator<TerrainHeightMountainsNormal, TerrainColorRock> },
+		{ "MountainsRidged", InstanceGenerator<TerrainHeightMountainsRidged, TerrainColorRock> },
+		{ "MountainsRivers", InstanceGenerator<TerrainHeightMountainsRivers, TerrainColorRock> },
+		{ "MountainsRiversVolcano", InstanceGenerator<TerrainHeightMountainsRiversVolcano, TerrainColorRock> },
+		{ "MountainsVolcano", InstanceGenerator<TerrainHeightMountainsVolcano, TerrainColorRock> },
+		{ "RuggedDesert", InstanceGenerator<TerrainHeightRuggedDesert, TerrainColorRock> },
+		{ "RuggedLava", InstanceGenerator<TerrainHeightRuggedLava, TerrainColorRock> },
+		{ "WaterSolid", InstanceGenerator<TerrainHeightWaterSolid, TerrainColorRock> },
+		{ "WaterSolidCanyons", InstanceGenerator<TerrainHeightWaterSolidCanyons, TerrainColorRock> },
+	};
+
+	// a face of the cube split into patches the size the GeoPatch jobs make,
+	// with their one vertex border
+	const int edgeLen = 35;
+	const int patchesPerSide = 4;
+	const int rowLen = edgeLen * patchesPerSide;
+	std::vector<vector3d> points(rowLen * rowLen);
+	for (int y = 0; y < rowLen; y++)
+		for (int x = 0; x < rowLen; x++)
+			points[x + y * rowLen] = vector3d(2.0 * x / (rowLen - 1) - 1.0, 2.0 * y / (rowLen - 1) - 1.0, 1.0).Normalized();
+
+	// the same face again, as the patch jobs generate it with normals and colours
+	const int patchEdgeLen = edgeLen - 2;
+	std::vector<vector3d> corners((patchesPerSide + 1) * (patchesPerSide + 1));
+	for (int y = 0; y <= patchesPerSide; y++)
+		for (int x = 0; x <= patchesPerSide; x++)
+			corners[x + y * (patchesPerSide + 1)] = vector3d(2.0 * x / patchesPerSide - 1.0, 2.0 * y / patchesPerSide - 1.0, 1.0).Normalized();
+
+	std::vector<double> vertexHeights(points.size()), rowHeights(points.size());
+	for (const auto &fractal : fractals) {
+		RefCountedPtr<Terrain> terrain(fractal.instancer(body));
+
+		Profiler::Timer vertexTimer, rowTimer;
+		vertexTimer.Start();
+		for (size_t i = 0; i < points.size(); i++)
+			vertexHeights[i] = terrain->GetHeight(points[i]);
+		vertexTimer.Stop();
+
+		rowTimer.Start();
+		for (int y = 0; y < rowLen; y++)
+			terrain->GetHeights(&points[y * rowLen], &rowHeights[y * rowLen], rowLen);
+		rowTimer.Stop();
+
+		Profiler::Timer patchTimer;
+		for (int y = 0; y < patchesPerSide; y++) {
+			for (int x = 0; x < patchesPerSide; x++) {
+				const vector3d &v0 = corners[x + y * (patchesPerSide + 1)];
+				const vector3d &v1 = corners[(x + 1) + y * (patchesPerSide + 1)];
+				const vector3d &v2 = corners[(x + 1) + (y + 1) * (patchesPerSide + 1)];
+				const vector3d &v3 = corners[x + (y + 1) * (patchesPerSide + 1)];
+				SSingleSplitRequest request(v0, v1, v2, v3, (v0 + v1 + v2 + v3).Normalized(), 0, SystemPath(), GeoPatchID(0),
+					patchEdgeLen, 1.0 / (patchEdgeLen - 1), terrain.Get());
+				patchTimer.Start();
+				request.GenerateMesh();
+				patchTimer.Stop();
+				// no result takes them
+				delete[] request.heights;
+				delete[] request.normals;
+				delete[] request.colors;
+			}
+		}
+
+		Uint32 mismatches = 0;
+		for (size_t i = 0; i < points.size(); i++)
+			if (vertexHeights[i] != rowHeights[i])
+				mismatches++;
+		Output("BenchmarkHeightFractals: %s: %d patches, per vertex took %lf, per row took %lf, whole patches took %lf milliseconds, %u mismatches\n",
+			fractal.name, patchesPerSide * patchesPerSide, vertexTimer.millicycles(), rowTimer.millicycles(), patchTimer.millicycles(), mismatches);
+	}
+}
+#endif
+
 static size_t bufread_or_die(void *ptr, size_t size, size_t nmemb, ByteRange &buf)
 {
 	size_t read_count = buf.read(static_cast<char *>(ptr), size, nmemb);
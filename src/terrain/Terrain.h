@@ -13,6 +13,8 @@
 #include <memory>
 #include <string>
 
+//#define BENCHMARK_TERRAIN
+
 #ifdef _MSC_VER
 #pragma warning(disable : 4250) // workaround for MSVC 2008 multiple inheritance bug
 #endif
@@ -46,6 +48,12 @@ public:
 	virtual double GetHeight(const vector3d &p) const = 0;
 	virtual vector3d GetColor(const vector3d &p, double height, const vector3d &norm) const = 0;
 
+	// Array versions of GetHeight and GetColor, giving the same values. The
+	// patch generators call these once per row rather than once per vertex,
+	// and each fractal can evaluate its noise a batch of points at a time.
+	virtual void GetHeights(const vector3d *p, double *heights, size_t count) const = 0;
+	virtual void GetColors(const vector3d *p, const double *heights, const vector3d *norms, vector3d *colors, size_t count) const = 0;
+
 	virtual const char *GetHeightFractalName() const = 0;
 	virtual const char *GetColorFractalName() const = 0;
 
@@ -63,6 +71,12 @@ private:
 
 	typedef Terrain *(*GeneratorInstancer)(const SystemBody *);
 
+#ifdef BENCHMARK_TERRAIN
+	// times per vertex and per row height generation, and whole patch
+	// generation, for every height fractal
+	static void BenchmarkHeightFractals(const SystemBody *body);
+#endif
+
 protected:
 	Terrain(const SystemBody *body);
 
@@ -125,6 +139,12 @@ class TerrainHeightFractal : virtual public Terrain {
 public:
 	TerrainHeightFractal() = delete;
 	virtual double GetHeight(const vector3d &p) const;
+	// one point at a time unless the fractal specialises it, see below
+	virtual void GetHeights(const vector3d *p, double *heights, size_t count) const
+	{
+		for (size_t i = 0; i < count; i++)
+			heights[i] = TerrainHeightFractal::GetHeight(p[i]);
+	}
 	virtual const char *GetHeightFractalName() const;
 
 protected:
@@ -138,6 +158,11 @@ class TerrainColorFractal : virtual public Terrain {
 public:
 	TerrainColorFractal() = delete;
 	virtual vector3d GetColor(const vector3d &p, double height, const vector3d &norm) const;
+	virtual void GetColors(const vector3d *p, const double *heights, const vector3d *norms, vector3d *colors, size_t count) const
+	{
+		for (size_t i = 0; i < count; i++)
+			colors[i] = TerrainColorFractal::GetColor(p[i], heights[i], norms[i]);
+	}
 	virtual const char *GetColorFractalName() const;
 
 protected:
@@ -253,6 +278,12 @@ class TerrainColorTFGood;
 class TerrainColorTFPoor;
 class TerrainColorVolcanic;
 
+// fractals that evaluate their noise a batch of points at a time
+template <>
+void TerrainHeightFractal<TerrainHeightAsteroid>::GetHeights(const vector3d *p, double *heights, size_t count) const;
+template <>
+void TerrainHeightFractal<TerrainHeightAsteroid3>::GetHeights(const vector3d *p, double *heights, size_t count) const;
+
 #ifdef _MSC_VER
 #pragma warning(default : 4250)
 #endif
@@ -29,3 +29,21 @@ double TerrainHeightFractal<TerrainHeightAsteroid>::GetHeight(const vector3d &p)
 
 	return (n > 0.0 ? m_maxHeight * n : 0.0);
 }
+
+template <>
+void TerrainHeightFractal<TerrainHeightAsteroid>::GetHeights(const vector3d *p, double *heights, size_t count) const
+{
+	static const size_t BLOCK = 64;
+	double dunes[BLOCK];
+	for (size_t first = 0; first < count; first += BLOCK) {
+		const size_t num = std::min(BLOCK, count - first);
+		const vector3d *pb = &p[first];
+		double *hb = &heights[first];
+		octavenoise(GetFracDef(0), 0.4, pb, hb, num);
+		dunes_octavenoise(GetFracDef(1), 0.5, pb, dunes, num);
+		for (size_t i = 0; i < num; i++) {
+			const double n = hb[i] * dunes[i];
+			hb[i] = (n > 0.0 ? m_maxHeight * n : 0.0);
+		}
+	}
+}
@@ -169,6 +169,85 @@ namespace TerrainNoise {
 		return sqrt(10.0 * fabs(n));
 	}
 
+	// Batch versions of the fracdef functions above. Each fills out[0..count)
+	// with the same values as calling its single point version for p[0..count).
+
+	// Sums the octaves at each point into out, a block of points at a time so
+	// the batch noise() always has whole registers of them to work on.
+	// absolute adds the magnitude of each octave, as river_octavenoise does.
+	inline void octavenoise_sum(const int octaves, const double frequency, const double persistence, const double lacunarity, const bool absolute, const vector3d *p, double *out, size_t count)
+	{
+		static const size_t BLOCK = 64;
+		vector3d scaled[BLOCK];
+		double octave[BLOCK];
+		for (size_t first = 0; first < count; first += BLOCK) {
+			const size_t num = std::min(BLOCK, count - first);
+			double *n = &out[first];
+			for (size_t i = 0; i < num; i++)
+				n[i] = 0;
+			double amplitude = persistence;
+			double freq = frequency;
+			for (int o = 0; o < octaves; o++) {
+				for (size_t i = 0; i < num; i++)
+					scaled[i] = freq * p[first + i];
+				noise(scaled, octave, num);
+				if (absolute) {
+					for (size_t i = 0; i < num; i++)
+						n[i] += amplitude * fabs(octave[i]);
+				} else {
+					for (size_t i = 0; i < num; i++)
+						n[i] += amplitude * octave[i];
+				}
+				amplitude *= persistence;
+				freq *= lacunarity;
+			}
+		}
+	}
+
+	inline void octavenoise(const fracdef_t &def, const double persistence, const vector3d *p, double *out, size_t count)
+	{
+		octavenoise_sum(def.octaves, def.frequency, persistence, def.lacunarity, false, p, out, count);
+		for (size_t i = 0; i < count; i++)
+			out[i] = (out[i] + 1.0) * 0.5;
+	}
+
+	inline void river_octavenoise(const fracdef_t &def, const double persistence, const vector3d *p, double *out, size_t count)
+	{
+		octavenoise_sum(def.octaves, def.frequency, persistence, def.lacunarity, true, p, out, count);
+		for (size_t i = 0; i < count; i++)
+			out[i] = fabs(out[i]);
+	}
+
+	inline void ridged_octavenoise(const fracdef_t &def, const double persistence, const vector3d *p, double *out, size_t count)
+	{
+		octavenoise_sum(def.octaves, def.frequency, persistence, def.lacunarity, false, p, out, count);
+		for (size_t i = 0; i < count; i++) {
+			const double n = 1.0 - fabs(out[i]);
+			out[i] = n * n;
+		}
+	}
+
+	inline void billow_octavenoise(const fracdef_t &def, const double persistence, const vector3d *p, double *out, size_t count)
+	{
+		octavenoise_sum(def.octaves, def.frequency, persistence, def.lacunarity, false, p, out, count);
+		for (size_t i = 0; i < count; i++)
+			out[i] = (2.0 * fabs(out[i]) - 1.0) + 1.0;
+	}
+
+	inline void voronoiscam_octavenoise(const fracdef_t &def, const double persistence, const vector3d *p, double *out, size_t count)
+	{
+		octavenoise_sum(def.octaves, def.frequency, persistence, def.lacunarity, false, p, out, count);
+		for (size_t i = 0; i < count; i++)
+			out[i] = sqrt(10.0 * fabs(out[i]));
+	}
+
+	inline void dunes_octavenoise(const fracdef_t &def, const double persistence, const vector3d *p, double *out, size_t count)
+	{
+		octavenoise_sum(3, def.frequency, persistence, def.lacunarity, false, p, out, count);
+		for (size_t i = 0; i < count; i++)
+			out[i] = 1.0 - fabs(out[i]);
+	}
+
 	// not really a noise function but no better place for it
 	inline vector3d interpolate_color(const double n, const vector3d &start, const vector3d &end)
 	{